@@ -0,0 +1,123 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <curl/curl.h>
+#include <ghc/filesystem.hpp>
+
+#include "fdp/registry/api.hxx"
+
+#include "helpers/http_stub.hxx"
+
+using namespace FairDataPipeline;
+
+namespace {
+
+bench::StubResponse users_response(const bench::StubRequest &) {
+  return bench::StubResponse(
+      200, "{\"count\": 1, \"results\": [{\"url\": "
+           "\"http://127.0.0.1/api/users/1/\", \"username\": \"admin\"}]}");
+}
+
+bench::HttpStub::sptr registry_stub() {
+  static bench::HttpStub::sptr stub_ = bench::HttpStub::construct(users_response);
+  return stub_;
+}
+
+// The same registry served on a Unix domain socket
+bench::HttpStub::sptr registry_socket_stub() {
+  static bench::HttpStub::sptr stub_ = bench::HttpStub::construct(
+      users_response, (ghc::filesystem::temp_directory_path() / "fdpapi-bench-registry.sock").string());
+  return stub_;
+}
+
+size_t discard_(char *, size_t size, size_t nmemb, void *) {
+  return size * nmemb;
+}
+
+} // namespace
+
+// Reproduces the previous behaviour of API::get_request: a new easy handle,
+// and so a new connection, for every request followed by a global cleanup
+static void BM_GetRequestFreshHandle(benchmark::State &state) {
+  const std::string url_ = registry_stub()->url("api/users/?username=admin");
+  for (auto _ : state) {
+    CURL *curl_ = curl_easy_init();
+    long http_code_ = 0;
+    curl_easy_setopt(curl_, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
+    curl_easy_setopt(curl_, CURLOPT_URL, url_.c_str());
+    curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, discard_);
+    curl_easy_perform(curl_);
+    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_code_);
+    benchmark::DoNotOptimize(http_code_);
+    curl_easy_cleanup(curl_);
+    curl_global_cleanup();
+  }
+}
+BENCHMARK(BM_GetRequestFreshHandle)->UseRealTime();
+
+// API::get_request serving every request from the pooled, shared handles
+static void BM_GetRequestPooled(benchmark::State &state) {
+  API::sptr api_ = API::construct(registry_stub()->url("api/"));
+  const std::size_t connections_before_ = registry_stub()->connections();
+  for (auto _ : state) {
+    Json::Value result_ = api_->get_request(std::string("users/?username=admin"));
+    benchmark::DoNotOptimize(result_);
+  }
+  state.counters["connections"] = static_cast<double>(
+      registry_stub()->connections() - connections_before_);
+}
+BENCHMARK(BM_GetRequestPooled)->UseRealTime();
+
+// A registry round trip without the response cache, over TCP loopback or,
+// with state.range(0) set, through a Unix domain socket as with
+// local_data_registry_socket
+static void BM_GetRequestUncached(benchmark::State &state) {
+  bench::HttpStub::sptr stub_ = state.range(0) ? registry_socket_stub() : registry_stub();
+  API::sptr api_ = API::construct(stub_->url("api/"));
+  api_->set_response_cache(ResponseCache::construct(0));
+  if (state.range(0)) {
+    api_->set_transport(CurlTransport::construct(CurlPool::construct(8, stub_->unix_socket())));
+  }
+  for (auto _ : state) {
+    Json::Value result_ = api_->get_request(std::string("users/?username=admin"));
+    benchmark::DoNotOptimize(result_);
+  }
+}
+BENCHMARK(BM_GetRequestUncached)->ArgNames({"unix_socket"})->Arg(0)->Arg(1)->UseRealTime();
+
+// Independent lookups against a registry 2ms away, issued one after another
+static void BM_GetRequestSequential(benchmark::State &state) {
+  API::sptr api_ = API::construct(registry_stub()->url("api/"));
+  registry_stub()->set_latency(std::chrono::milliseconds(2));
+  for (auto _ : state) {
+    for (int i = 0; i < state.range(0); ++i) {
+      Json::Value result_ = api_->get_request(std::string("users/?username=admin"));
+      benchmark::DoNotOptimize(result_);
+    }
+  }
+  registry_stub()->set_latency(std::chrono::microseconds(0));
+}
+BENCHMARK(BM_GetRequestSequential)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// The same lookups submitted together as an API::Batch
+static void BM_GetRequestBatch(benchmark::State &state) {
+  API::sptr api_ = API::construct(registry_stub()->url("api/"));
+  registry_stub()->set_latency(std::chrono::milliseconds(2));
+  for (auto _ : state) {
+    API::Batch::sptr batch_ = api_->batch(8);
+    std::vector<std::future<Json::Value> > results_;
+    for (int i = 0; i < state.range(0); ++i) {
+      results_.push_back(batch_->get(std::string("users/?username=admin")));
+    }
+    batch_->execute();
+    for (std::size_t i = 0; i < results_.size(); ++i) {
+      benchmark::DoNotOptimize(results_[i].get());
+    }
+  }
+  registry_stub()->set_latency(std::chrono::microseconds(0));
+}
+BENCHMARK(BM_GetRequestBatch)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,608 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <ghc/filesystem.hpp>
+
+#include "fdp/fdp.hxx"
+#include "fdp/objects/config.hxx"
+#include "fdp/registry/embedded_registry.hxx"
+#include "fdp/utilities/logging.hxx"
+
+#include "helpers/mock_registry.hxx"
+#include "helpers/pipeline_files.hxx"
+
+using namespace FairDataPipeline;
+
+using bench::PipelineFiles;
+using bench::PipelineOptions;
+
+// DataPipeline::construct registers the user, author, config, script, code
+// repository and code run. Argument is the registry round trip time in ms.
+static void BM_DataPipelineConstruct(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineFiles files_(registry_->api_url());
+  registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+
+  const std::size_t requests_before_ = registry_->requests();
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    benchmark::DoNotOptimize(pipeline_);
+  }
+
+  state.counters["requests"] = benchmark::Counter(
+      static_cast<double>(registry_->requests() - requests_before_),
+      benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DataPipelineConstruct)
+    ->Arg(0)->Arg(2)->Arg(10)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// As BM_DataPipelineConstruct with a registry cache left by an earlier run,
+// only the code_run needs to be registered
+static void BM_DataPipelineConstructWarm(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.registry_cache = true;
+  PipelineFiles files_(registry_->api_url(), options_);
+  DataPipeline::construct(files_.config.string(), files_.script.string());
+  registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+
+  const std::size_t requests_before_ = registry_->requests();
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    benchmark::DoNotOptimize(pipeline_);
+  }
+
+  state.counters["requests"] = benchmark::Counter(
+      static_cast<double>(registry_->requests() - requests_before_),
+      benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DataPipelineConstructWarm)
+    ->Arg(0)->Arg(2)->Arg(10)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// A complete run writing state.range(1) data products, whose finalise
+// repeatedly looks up the same namespace, file type and storage root.
+// First argument is the registry round trip time in ms.
+static void BM_DataPipelineRun(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_writes = static_cast<int>(state.range(1));
+  PipelineFiles files_(registry_->api_url(), options_);
+  registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+
+  const std::size_t requests_before_ = registry_->requests();
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < state.range(1); ++i) {
+      std::string data_product_ = PipelineFiles::data_product(i);
+      std::ofstream output_(pipeline_->link_write(data_product_));
+      output_ << "iteration," << i << "\n";
+    }
+    pipeline_->finalise();
+  }
+
+  state.counters["requests"] = benchmark::Counter(
+      static_cast<double>(registry_->requests() - requests_before_),
+      benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DataPipelineRun)
+    ->Args({0, 8})->Args({2, 8})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// BM_DataPipelineRun/x/8 with the registry changes of finalise journaled.
+// With state.range(1) set they are left in the journal, replayed outside
+// the timing, so that finalise only hashes, syncs and renames.
+static void BM_DataPipelineRunJournaled(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_writes = 8;
+  options_.registry_journal = true;
+  options_.registry_journal_defer = state.range(1) != 0;
+  PipelineFiles files_(registry_->api_url(), options_, "fdpapi-bench-journal");
+  registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+
+  const std::size_t requests_before_ = registry_->requests();
+  double finalise_seconds_ = 0;
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_writes; ++i) {
+      std::string data_product_ = PipelineFiles::data_product(i);
+      std::ofstream output_(pipeline_->link_write(data_product_));
+      output_ << "iteration," << i << "\n";
+    }
+    const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    pipeline_->finalise();
+    finalise_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+
+    if (options_.registry_journal_defer) {
+      state.PauseTiming();
+      pipeline_->replay_registry_journal();
+      state.ResumeTiming();
+    }
+  }
+
+  state.counters["requests"] = benchmark::Counter(
+      static_cast<double>(registry_->requests() - requests_before_),
+      benchmark::Counter::kAvgIterations);
+  state.counters["finalise_ms"] = benchmark::Counter(
+      1000 * finalise_seconds_, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DataPipelineRunJournaled)
+    ->ArgNames({"latency_ms", "defer"})
+    ->Args({0, 0})->Args({0, 1})->Args({2, 0})->Args({2, 1})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// A run producing 8 outputs, each after state.range(0) ms of computation,
+// against the mock registry with 2 ms of latency. With state.range(1) set
+// each output is committed as soon as it is written, overlapping its
+// registration with the computation of the next.
+static void BM_DataPipelineRunCommit(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_writes = 8;
+  PipelineFiles files_(registry_->api_url(), options_, "fdpapi-bench-commit");
+  registry_->set_latency(std::chrono::milliseconds(2));
+
+  double finalise_seconds_ = 0;
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_writes; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(state.range(0)));
+      std::string data_product_ = PipelineFiles::data_product(i);
+      {
+        std::ofstream output_(pipeline_->link_write(data_product_));
+        output_ << "iteration," << i << "\n";
+      }
+      if (state.range(1)) {
+        pipeline_->commit(data_product_);
+      }
+    }
+    const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    pipeline_->finalise();
+    finalise_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+  state.counters["finalise_ms"] = benchmark::Counter(
+      1000 * finalise_seconds_, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DataPipelineRunCommit)
+    ->ArgNames({"compute_ms", "commit"})
+    ->Args({0, 0})->Args({0, 1})->Args({10, 0})->Args({10, 1})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// BM_DataPipelineRun/0/8 with the mock registry served on a Unix domain
+// socket, given to the run as local_data_registry_socket
+static void BM_DataPipelineRunUnixSocket(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct(
+      (ghc::filesystem::temp_directory_path() / "fdpapi-bench-mock.sock").string());
+  PipelineOptions options_;
+  options_.n_writes = static_cast<int>(state.range(0));
+  options_.registry_socket = registry_->unix_socket();
+  PipelineFiles files_(registry_->api_url(), options_, "fdpapi-bench-socket");
+
+  const std::size_t requests_before_ = registry_->requests();
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_writes; ++i) {
+      std::string data_product_ = PipelineFiles::data_product(i);
+      std::ofstream output_(pipeline_->link_write(data_product_));
+      output_ << "iteration," << i << "\n";
+    }
+    pipeline_->finalise();
+  }
+
+  state.counters["requests"] = benchmark::Counter(
+      static_cast<double>(registry_->requests() - requests_before_),
+      benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DataPipelineRunUnixSocket)
+    ->ArgNames({"writes"})
+    ->Arg(8)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// BM_DataPipelineRun registering in an embedded registry, its journal
+// growing by every run, rather than over HTTP. Compare with the mock
+// registry at no added latency, BM_DataPipelineRun/0/8.
+static void BM_DataPipelineRunEmbedded(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  PipelineOptions options_;
+  options_.n_writes = static_cast<int>(state.range(0));
+  options_.embedded_registry = true;
+  PipelineFiles files_("http://127.0.0.1:1/api/", options_, "fdpapi-bench-embedded");
+
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_writes; ++i) {
+      std::string data_product_ = PipelineFiles::data_product(i);
+      std::ofstream output_(pipeline_->link_write(data_product_));
+      output_ << "output," << i << "\n";
+    }
+    pipeline_->finalise();
+  }
+}
+BENCHMARK(BM_DataPipelineRunEmbedded)
+    ->ArgNames({"writes"})
+    ->Arg(8)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Opening an embedded registry journal holding state.range(0) registered
+// data products, as every run using it does
+static void BM_EmbeddedRegistryOpen(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  const std::string api_url_ = "http://127.0.0.1:8000/api/";
+  const ghc::filesystem::path path_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-bench-embedded-open.jsonl";
+  ghc::filesystem::remove(path_);
+  {
+    EmbeddedRegistry::sptr registry_ = EmbeddedRegistry::construct(api_url_, path_);
+    Json::Value namespace_;
+    namespace_["name"] = "testing";
+    const Json::Value j_namespace_ = registry_->insert("namespace", namespace_);
+    for (int i = 0; i < state.range(0); ++i) {
+      Json::Value location_;
+      location_["path"] = "testing/" + PipelineFiles::data_product(i) + "/output.csv";
+      location_["hash"] = std::to_string(i);
+      const Json::Value j_location_ = registry_->insert("storage_location", location_);
+
+      Json::Value object_;
+      object_["storage_location"] = j_location_["url"];
+      const Json::Value j_object_ = registry_->insert("object", object_);
+
+      Json::Value product_;
+      product_["name"] = PipelineFiles::data_product(i);
+      product_["version"] = "0.0.1";
+      product_["namespace"] = j_namespace_["url"];
+      product_["object"] = j_object_["url"];
+      registry_->insert("data_product", product_);
+    }
+  }
+
+  for (auto _ : state) {
+    EmbeddedRegistry::sptr registry_ = EmbeddedRegistry::construct(api_url_, path_);
+    benchmark::DoNotOptimize(registry_->table_size("data_product"));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(ghc::filesystem::file_size(path_)));
+  ghc::filesystem::remove(path_);
+}
+BENCHMARK(BM_EmbeddedRegistryOpen)
+    ->ArgNames({"products"})
+    ->Arg(100)->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+
+// BM_DataPipelineRun replayed from a cassette recorded against the mock
+// registry, which is stopped before the replay. With state.range(1) set the
+// requests take as long as they did when recorded.
+static void BM_DataPipelineRunReplay(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  PipelineOptions options_;
+  options_.n_writes = static_cast<int>(state.range(0));
+  const ghc::filesystem::path cassette_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-bench-cassette.jsonl";
+  {
+    bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+    PipelineFiles files_(registry_->api_url(), options_, "fdpapi-bench-replay");
+    registry_->set_latency(std::chrono::milliseconds(2));
+    setenv("FDP_REGISTRY_RECORD", cassette_.string().c_str(), 1);
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_writes; ++i) {
+      std::string data_product_ = PipelineFiles::data_product(i);
+      std::ofstream output_(pipeline_->link_write(data_product_));
+      output_ << "output," << i << "\n";
+    }
+    pipeline_->finalise();
+    unsetenv("FDP_REGISTRY_RECORD");
+  }
+
+  // The configuration still names the stopped registry
+  PipelineFiles files_("http://127.0.0.1:1/api/", options_, "fdpapi-bench-replay");
+  setenv("FDP_REGISTRY_REPLAY", cassette_.string().c_str(), 1);
+  setenv("FDP_REGISTRY_REPLAY_TIMING", state.range(1) ? "1" : "0", 1);
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_writes; ++i) {
+      std::string data_product_ = PipelineFiles::data_product(i);
+      std::ofstream output_(pipeline_->link_write(data_product_));
+      output_ << "output," << i << "\n";
+    }
+    pipeline_->finalise();
+  }
+  unsetenv("FDP_REGISTRY_REPLAY");
+  unsetenv("FDP_REGISTRY_REPLAY_TIMING");
+  ghc::filesystem::remove(cassette_);
+}
+BENCHMARK(BM_DataPipelineRunReplay)
+    ->ArgNames({"writes", "timing"})
+    ->Args({8, 0})->Args({8, 1})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// finalise alone for a run which wrote state.range(1) data products, at a
+// registry round trip time of state.range(0) ms
+static void BM_Finalise(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_writes = static_cast<int>(state.range(1));
+  PipelineFiles files_(registry_->api_url(), options_);
+
+  std::size_t requests_ = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    registry_->set_latency(std::chrono::microseconds(0));
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_writes; ++i) {
+      std::string data_product_ = PipelineFiles::data_product(i);
+      std::ofstream output_(pipeline_->link_write(data_product_));
+      output_ << "iteration," << state.iterations() << "\noutput," << i << "\n";
+    }
+    registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+    const std::size_t requests_before_ = registry_->requests();
+    state.ResumeTiming();
+
+    pipeline_->finalise();
+
+    state.PauseTiming();
+    requests_ += registry_->requests() - requests_before_;
+    state.ResumeTiming();
+  }
+
+  state.counters["requests"] = benchmark::Counter(
+      static_cast<double>(requests_), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_Finalise)
+    ->ArgNames({"latency_ms", "writes"})
+    ->Args({2, 8})->Args({2, 100})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Writing and finalising one output of state.range(0) MiB through the path
+// from link_write, which finalise reads back to hash, or through
+// link_write_stream (state.range(1) == 1), which hashes as it writes
+static void BM_WriteAndFinalise(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_writes = 1;
+  PipelineFiles files_(registry_->api_url(), options_);
+
+  std::string block_(1024 * 1024, 'x');
+  std::string data_product_ = PipelineFiles::data_product(0);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    block_[0] = static_cast<char>('a' + state.iterations() % 26);
+    state.ResumeTiming();
+
+    if (state.range(1)) {
+      OutputStream::sptr output_ = pipeline_->link_write_stream(data_product_);
+      for (int i = 0; i < state.range(0); ++i) {
+        output_->write(block_.data(), block_.size());
+      }
+      output_->close();
+    }
+    else {
+      std::ofstream output_(pipeline_->link_write(data_product_), std::ios_base::binary);
+      for (int i = 0; i < state.range(0); ++i) {
+        output_.write(block_.data(), block_.size());
+      }
+    }
+    pipeline_->finalise();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 1024 * 1024);
+}
+BENCHMARK(BM_WriteAndFinalise)
+    ->ArgNames({"MiB", "stream"})
+    ->Args({256, 0})->Args({256, 1})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Linking every write of a configuration with state.range(0) writes, each
+// twice, without the registry
+static void BM_LinkWrite(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_writes = static_cast<int>(state.range(0));
+  PipelineFiles files_(registry_->api_url(), options_);
+
+  std::vector<std::string> data_products_;
+  for (int i = 0; i < options_.n_writes; ++i) {
+    data_products_.push_back(PipelineFiles::data_product(i));
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    state.ResumeTiming();
+
+    for (int repeat = 0; repeat < 2; ++repeat) {
+      for (std::size_t i = 0; i < data_products_.size(); ++i) {
+        benchmark::DoNotOptimize(pipeline_->link_write(data_products_[i]));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * 2 * options_.n_writes);
+}
+BENCHMARK(BM_LinkWrite)
+    ->Arg(10)->Arg(1000)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Reading the inputs of a model with many fixed parameters, state.range(1)
+// reads at a round trip time of state.range(0) ms, one link_read at a time
+static void BM_LinkReadSequential(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_reads = static_cast<int>(state.range(1));
+  PipelineFiles files_(registry_->api_url(), options_);
+  files_.seed_inputs(*registry_, options_.n_reads);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    registry_->set_latency(std::chrono::microseconds(0));
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+    state.ResumeTiming();
+
+    for (int i = 0; i < options_.n_reads; ++i) {
+      std::string data_product_ = PipelineFiles::input_product(i);
+      benchmark::DoNotOptimize(pipeline_->link_read(data_product_));
+    }
+  }
+}
+BENCHMARK(BM_LinkReadSequential)
+    ->Args({2, 11})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// The same reads resolved together with link_read_many
+static void BM_LinkReadMany(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_reads = static_cast<int>(state.range(1));
+  PipelineFiles files_(registry_->api_url(), options_);
+  files_.seed_inputs(*registry_, options_.n_reads);
+
+  std::vector<std::string> data_products_;
+  for (int i = 0; i < options_.n_reads; ++i) {
+    data_products_.push_back(PipelineFiles::input_product(i));
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    registry_->set_latency(std::chrono::microseconds(0));
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+    state.ResumeTiming();
+
+    benchmark::DoNotOptimize(pipeline_->link_read_many(data_products_));
+  }
+}
+BENCHMARK(BM_LinkReadMany)
+    ->Args({2, 11})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Construction with prefetch_reads followed by every link_read, compared
+// with construction followed by sequential link_read calls
+static void BM_ConstructAndRead(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_reads = static_cast<int>(state.range(1));
+  options_.prefetch_reads = state.range(2) != 0;
+  PipelineFiles files_(registry_->api_url(), options_);
+  files_.seed_inputs(*registry_, options_.n_reads);
+  registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+
+  for (auto _ : state) {
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    for (int i = 0; i < options_.n_reads; ++i) {
+      std::string data_product_ = PipelineFiles::input_product(i);
+      benchmark::DoNotOptimize(pipeline_->link_read(data_product_));
+    }
+  }
+}
+BENCHMARK(BM_ConstructAndRead)
+    ->ArgNames({"latency_ms", "reads", "prefetch"})
+    ->Args({2, 11, 0})->Args({2, 11, 1})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// A simulation whose state.range(0) threads each link their share of 64
+// writes and 64 reads at a round trip time of 2 ms, the reads one at a time
+static void BM_LinkConcurrent(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  const int n_threads_ = static_cast<int>(state.range(0));
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_writes = 64;
+  options_.n_reads = 64;
+  PipelineFiles files_(registry_->api_url(), options_);
+  files_.seed_inputs(*registry_, options_.n_reads);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    registry_->set_latency(std::chrono::microseconds(0));
+    DataPipeline::sptr pipeline_ = DataPipeline::construct(
+        files_.config.string(), files_.script.string());
+    registry_->set_latency(std::chrono::milliseconds(2));
+    state.ResumeTiming();
+
+    std::vector<std::thread> threads_;
+    for (int t = 0; t < n_threads_; ++t) {
+      threads_.push_back(std::thread([&, t]() {
+        for (int i = t; i < options_.n_reads; i += n_threads_) {
+          std::string read_ = PipelineFiles::input_product(i);
+          benchmark::DoNotOptimize(pipeline_->link_read(read_));
+          std::string write_ = PipelineFiles::data_product(i);
+          benchmark::DoNotOptimize(pipeline_->link_write(write_));
+        }
+      }));
+    }
+    for (std::size_t t = 0; t < threads_.size(); ++t) {
+      threads_[t].join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * (options_.n_writes + options_.n_reads));
+}
+BENCHMARK(BM_LinkConcurrent)
+    ->ArgNames({"threads"})
+    ->Arg(1)->Arg(4)->Arg(16)->Arg(64)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Reading a configuration file, argument is the number of writes and of reads
+static void BM_ParseYaml(benchmark::State &state) {
+  PipelineOptions options_;
+  options_.n_writes = static_cast<int>(state.range(0));
+  options_.n_reads = static_cast<int>(state.range(0));
+  PipelineFiles files_("http://127.0.0.1:8000/api/", options_);
+
+  for (auto _ : state) {
+    YAML::Node config_ = Config::parse_yaml(files_.config);
+    benchmark::DoNotOptimize(config_);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(
+      state.iterations() * ghc::filesystem::file_size(files_.config)));
+}
+BENCHMARK(BM_ParseYaml)->Arg(10)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,48 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <ghc/filesystem.hpp>
+
+#include "fdp/objects/config.hxx"
+#include "fdp/registry/data_io.hxx"
+#include "fdp/utilities/logging.hxx"
+
+#include "helpers/mock_registry.hxx"
+#include "helpers/pipeline_files.hxx"
+
+using namespace FairDataPipeline;
+
+using bench::PipelineFiles;
+
+// Writing a point estimate to the data store as a TOML file
+static void BM_CreateEstimate(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineFiles files_(registry_->api_url(), bench::PipelineOptions(), "fdpapi-bench-data-io");
+  Config::sptr config_ = Config::construct(files_.config, files_.script, "", RESTAPI::LOCAL);
+  const ghc::filesystem::path data_product_ = "bench/estimate";
+  const Versioning::version version_("0.1.0");
+
+  double value_ = 0.5;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(create_estimate(value_, data_product_, version_, config_.get()));
+  }
+}
+BENCHMARK(BM_CreateEstimate)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+static void BM_ReadPointEstimate(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineFiles files_(registry_->api_url(), bench::PipelineOptions(), "fdpapi-bench-data-io");
+  Config::sptr config_ = Config::construct(files_.config, files_.script, "", RESTAPI::LOCAL);
+  double value_ = 0.5;
+  const ghc::filesystem::path estimate_ = create_estimate(
+      value_, "bench/estimate", Versioning::version("0.1.0"), config_.get());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(read_point_estimate_from_toml(estimate_));
+  }
+}
+BENCHMARK(BM_ReadPointEstimate)->Unit(benchmark::kMicrosecond);
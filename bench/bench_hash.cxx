@@ -0,0 +1,207 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <benchmark/benchmark.h>
+#include <ghc/filesystem.hpp>
+
+#include "digestpp.hpp"
+
+#include "fdp/objects/metadata.hxx"
+#include "fdp/utilities/batch_hasher.hxx"
+#include "fdp/utilities/file_hash_cache.hxx"
+#include "fdp/utilities/sha1.hxx"
+
+using namespace FairDataPipeline;
+
+namespace {
+
+// A file of the given size in MiB in a scratch directory, removed afterwards
+struct HashFile {
+  explicit HashFile(long mebibytes, int index = 0) {
+    path = ghc::filesystem::temp_directory_path() /
+           ("fdpapi-bench-hash-" + std::to_string(mebibytes) + "-" + std::to_string(index) + ".dat");
+
+    std::vector<char> block_(1024 * 1024);
+    for (std::size_t i = 0; i < block_.size(); ++i) {
+      block_[i] = static_cast<char>(i * 2654435761u >> 24);
+    }
+    std::ofstream file_(path.string(), std::ios_base::binary);
+    for (long i = 0; i < mebibytes; ++i) {
+      block_[0] = static_cast<char>(i);
+      file_.write(&block_[0], block_.size());
+    }
+    file_.close();
+
+    // As an input left by an earlier run
+    ghc::filesystem::last_write_time(
+        path, ghc::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+  }
+
+  ~HashFile() { ghc::filesystem::remove(path); }
+
+  ghc::filesystem::path path;
+};
+
+// File sizes from 1 MiB up to FDPAPI_BENCH_HASH_MAX_MIB (default 1 GiB, set
+// it to 10240 for the 10 GiB case)
+void file_sizes(benchmark::internal::Benchmark *benchmark) {
+  const char *max_ = std::getenv("FDPAPI_BENCH_HASH_MAX_MIB");
+  const long max_mib_ = max_ ? std::atol(max_) : 1024;
+  const long sizes_[] = {1, 16, 256, 1024, 10240};
+  for (std::size_t i = 0; i < sizeof(sizes_) / sizeof(sizes_[0]); ++i) {
+    if (sizes_[i] <= max_mib_) {
+      benchmark->Arg(sizes_[i]);
+    }
+  }
+}
+
+// Drops a file from the page cache, where the system allows it
+void evict(const ghc::filesystem::path &path) {
+#ifndef _WIN32
+  const int fd_ = ::open(path.string().c_str(), O_RDONLY);
+  if (fd_ >= 0) {
+    ::fdatasync(fd_);
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd_);
+  }
+#endif
+}
+
+} // namespace
+
+// The SHA1 compression function over 64 MiB in memory, argument is the
+// Sha1::Engine
+static void BM_Sha1Engine(benchmark::State &state) {
+  const Sha1::Engine engine_ = static_cast<Sha1::Engine>(state.range(0));
+  if (!Sha1::is_supported(engine_)) {
+    state.SkipWithError("engine not supported by this CPU");
+    return;
+  }
+  state.SetLabel(Sha1::engine_name(engine_));
+
+  const std::string data_(64 * 1024 * 1024, 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Sha1(engine_).update(data_).hexdigest());
+  }
+  state.SetBytesProcessed(state.iterations() * data_.size());
+}
+BENCHMARK(BM_Sha1Engine)
+    ->Arg(static_cast<int>(Sha1::Engine::SCALAR))
+    ->Arg(static_cast<int>(Sha1::Engine::SHA_NI))
+    ->Unit(benchmark::kMillisecond);
+
+// digestpp over the same data, the implementation used before Sha1
+static void BM_Sha1Digestpp(benchmark::State &state) {
+  const std::string data_(64 * 1024 * 1024, 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(digestpp::sha1().absorb(data_).hexdigest());
+  }
+  state.SetBytesProcessed(state.iterations() * data_.size());
+}
+BENCHMARK(BM_Sha1Digestpp)->Unit(benchmark::kMillisecond);
+
+// calculate_hash_from_file on a file of state.range(0) MiB in the page cache
+static void BM_HashFile(benchmark::State &state) {
+  HashFile file_(state.range(0));
+  state.SetLabel(Sha1::engine_name(Sha1::best_engine()));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculate_hash_from_file(file_.path));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 1024 * 1024);
+}
+BENCHMARK(BM_HashFile)->Apply(file_sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// The previous calculate_hash_from_file, digestpp reading an std::ifstream
+static void BM_HashFileStream(benchmark::State &state) {
+  HashFile file_(state.range(0));
+
+  for (auto _ : state) {
+    std::ifstream stream_(file_.path.string(), std::ios_base::in | std::ios_base::binary);
+    benchmark::DoNotOptimize(digestpp::sha1().absorb(stream_).hexdigest());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 1024 * 1024);
+}
+BENCHMARK(BM_HashFileStream)->Apply(file_sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// calculate_hash_from_file of an unchanged file with a warm FileHashCache,
+// as for the config and script of a repeated run
+static void BM_HashFileCached(benchmark::State &state) {
+  HashFile file_(state.range(0));
+  const ghc::filesystem::path directory_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-bench-hash-cache";
+  FileHashCache::sptr cache_ = FileHashCache::construct(directory_);
+  calculate_hash_from_file(file_.path, cache_);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculate_hash_from_file(file_.path, cache_));
+  }
+  state.counters["hits"] = benchmark::Counter(
+      static_cast<double>(cache_->get_stats().hits), benchmark::Counter::kAvgIterations);
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 1024 * 1024);
+
+  ghc::filesystem::remove_all(directory_);
+}
+BENCHMARK(BM_HashFileCached)->Apply(file_sizes)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// 32 files of 8 MiB hashed one after another (first argument -1) or as a
+// batch with the BatchHasher::Backend given by the first argument. With a
+// second argument of 1 the files are dropped from the page cache before
+// each iteration so that they are read from storage.
+static void BM_HashFiles(benchmark::State &state) {
+  std::vector<std::unique_ptr<HashFile>> files_;
+  std::vector<ghc::filesystem::path> paths_;
+  for (int i = 0; i < 32; ++i) {
+    files_.push_back(std::unique_ptr<HashFile>(new HashFile(8, i)));
+    paths_.push_back(files_.back()->path);
+  }
+
+  std::unique_ptr<BatchHasher> hasher_;
+  if (state.range(0) < 0) {
+    state.SetLabel("sequential");
+  }
+  else {
+    const BatchHasher::Backend backend_ = static_cast<BatchHasher::Backend>(state.range(0));
+    if (!BatchHasher::is_supported(backend_)) {
+      state.SkipWithError("backend not supported on this system");
+      return;
+    }
+    state.SetLabel(BatchHasher::backend_name(backend_));
+    hasher_.reset(new BatchHasher(backend_));
+  }
+
+  for (auto _ : state) {
+    if (state.range(1)) {
+      state.PauseTiming();
+      for (std::size_t i = 0; i < paths_.size(); ++i) {
+        evict(paths_[i]);
+      }
+      state.ResumeTiming();
+    }
+
+    if (hasher_) {
+      benchmark::DoNotOptimize(hasher_->hash(paths_));
+    }
+    else {
+      for (std::size_t i = 0; i < paths_.size(); ++i) {
+        benchmark::DoNotOptimize(calculate_hash_from_file(paths_[i]));
+      }
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * paths_.size() * 8 * 1024 * 1024);
+}
+BENCHMARK(BM_HashFiles)
+    ->ArgsProduct({{-1, static_cast<int>(BatchHasher::Backend::THREADS),
+                    static_cast<int>(BatchHasher::Backend::IO_URING)},
+                   {0, 1}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,117 @@
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "fdp/fdp.hxx"
+#include "fdp/utilities/logging.hxx"
+
+#include "helpers/mock_registry.hxx"
+#include "helpers/pipeline_files.hxx"
+
+using namespace FairDataPipeline;
+
+using bench::PipelineFiles;
+using bench::PipelineOptions;
+
+namespace {
+
+// Wall time and registry requests of each phase of a run, summed over runs
+class PhaseTimer {
+public:
+  explicit PhaseTimer(const bench::MockRegistry &registry) : registry_(registry) {}
+
+  void start() {
+    start_ = std::chrono::steady_clock::now();
+    requests_before_ = registry_.requests();
+  }
+
+  void stop(const std::string &phase) {
+    seconds_[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    requests_[phase] += static_cast<double>(registry_.requests() - requests_before_);
+  }
+
+  // Averages per run as counters named <phase>_ms and <phase>_requests
+  void report(benchmark::State &state) const {
+    for (std::map<std::string, double>::const_iterator it = seconds_.begin(); it != seconds_.end(); ++it) {
+      state.counters[it->first + "_ms"] =
+          benchmark::Counter(it->second * 1e3, benchmark::Counter::kAvgIterations);
+      state.counters[it->first + "_requests"] =
+          benchmark::Counter(requests_.at(it->first), benchmark::Counter::kAvgIterations);
+    }
+  }
+
+private:
+  const bench::MockRegistry &registry_;
+  std::chrono::steady_clock::time_point start_;
+  std::size_t requests_before_;
+  std::map<std::string, double> seconds_;
+  std::map<std::string, double> requests_;
+};
+
+} // namespace
+
+// A complete run of a configuration with `reads` inputs and `writes`
+// outputs against a registry with a round trip time of latency_ms plus up to
+// jitter_ms, failing error_pct percent of requests with 503. Each phase is
+// reported as <phase>_ms and <phase>_requests per run, runs which throw are
+// counted as failed_runs.
+static void BM_Load(benchmark::State &state) {
+  logger::get_logger()->set_level(logging::LOG_LEVEL::OFF);
+
+  bench::MockRegistry::sptr registry_ = bench::MockRegistry::construct();
+  PipelineOptions options_;
+  options_.n_reads = static_cast<int>(state.range(3));
+  options_.n_writes = static_cast<int>(state.range(4));
+  PipelineFiles files_(registry_->api_url(), options_, "fdpapi-bench-load");
+  files_.seed_inputs(*registry_, options_.n_reads);
+
+  registry_->set_latency(std::chrono::milliseconds(state.range(0)));
+  registry_->set_jitter(std::chrono::milliseconds(state.range(1)));
+  registry_->set_error_rate(state.range(2) / 100.0);
+
+  PhaseTimer timer_(*registry_);
+  double failed_runs_ = 0;
+  for (auto _ : state) {
+    try {
+      timer_.start();
+      DataPipeline::sptr pipeline_ = DataPipeline::construct(
+          files_.config.string(), files_.script.string());
+      timer_.stop("construct");
+
+      timer_.start();
+      for (int i = 0; i < options_.n_reads; ++i) {
+        std::string data_product_ = PipelineFiles::input_product(i);
+        benchmark::DoNotOptimize(pipeline_->link_read(data_product_));
+      }
+      timer_.stop("link_read");
+
+      timer_.start();
+      for (int i = 0; i < options_.n_writes; ++i) {
+        std::string data_product_ = PipelineFiles::data_product(i);
+        std::ofstream output_(pipeline_->link_write(data_product_));
+        output_ << "iteration," << state.iterations() << "\noutput," << i << "\n";
+      }
+      timer_.stop("link_write");
+
+      timer_.start();
+      pipeline_->finalise();
+      timer_.stop("finalise");
+    }
+    catch (const std::exception &) {
+      ++failed_runs_;
+    }
+  }
+
+  timer_.report(state);
+  state.counters["failed_runs"] = benchmark::Counter(failed_runs_);
+  state.counters["errors"] = benchmark::Counter(static_cast<double>(registry_->errors()));
+}
+BENCHMARK(BM_Load)
+    ->ArgNames({"latency_ms", "jitter_ms", "error_pct", "reads", "writes"})
+    ->Args({2, 0, 0, 1, 1})->Args({2, 0, 0, 10, 10})->Args({2, 0, 0, 100, 100})
+    ->Args({2, 0, 0, 100, 0})->Args({2, 0, 0, 0, 100})
+    ->Args({2, 2, 0, 10, 10})->Args({2, 2, 1, 10, 10})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,140 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <ghc/filesystem.hpp>
+#include <json/json.h>
+
+#include "fdp/utilities/binary_log.hxx"
+#include "fdp/utilities/logging.hxx"
+
+using namespace FairDataPipeline;
+
+namespace {
+
+// A registry POST body of a few kB, as logged by API::make_post_request_
+Json::Value post_data() {
+  Json::Value data_;
+  for (int i = 0; i < 32; ++i) {
+    Json::Value entry_;
+    entry_["path"] = "SEIRS_model/parameters/" + std::to_string(i) + ".toml";
+    entry_["hash"] = "a9993e364706816aba3e25717850c26c9cd0d89d";
+    entry_["storage_root"] = "http://127.0.0.1:8000/api/storage_root/1/";
+    entry_["public"] = true;
+    data_["locations"].append(entry_);
+  }
+  return data_;
+}
+
+// Sets the level of the global logger's sink for the duration of a benchmark
+struct GlobalSinkLevel {
+  explicit GlobalSinkLevel(logging::LOG_LEVEL lvl)
+      : previous(logger::get_logger()->sink()->log_level()) {
+    logger::get_logger()->sink()->log_level(lvl);
+  }
+  ~GlobalSinkLevel() { logger::get_logger()->sink()->log_level(previous); }
+
+  logging::LOG_LEVEL previous;
+};
+
+} // namespace
+
+// A disabled debug message through the stream interface, the arguments are
+// evaluated but not formatted
+static void BM_LogDisabledStream(benchmark::State &state) {
+  GlobalSinkLevel level_(logging::OFF);
+  const std::string body_ = post_data().toStyledString();
+  for (auto _ : state) {
+    logger::get_logger()->debug() << "API:Post: Post Data\n" << body_ << " " << 42;
+  }
+}
+BENCHMARK(BM_LogDisabledStream);
+
+// The same message through FDP_LOG, which evaluates nothing
+static void BM_LogDisabledMacro(benchmark::State &state) {
+  GlobalSinkLevel level_(logging::OFF);
+  const std::string body_ = post_data().toStyledString();
+  for (auto _ : state) {
+    FDP_LOG(DEBUG) << "API:Post: Post Data\n" << body_ << " " << 42;
+  }
+}
+BENCHMARK(BM_LogDisabledMacro);
+
+// Serialising the JSON inside the message, only FDP_LOG avoids the cost
+static void BM_LogDisabledJsonStream(benchmark::State &state) {
+  GlobalSinkLevel level_(logging::OFF);
+  const Json::Value data_ = post_data();
+  for (auto _ : state) {
+    logger::get_logger()->debug() << "API:Post: Post Data\n" << data_.toStyledString();
+  }
+}
+BENCHMARK(BM_LogDisabledJsonStream);
+
+static void BM_LogDisabledJsonMacro(benchmark::State &state) {
+  GlobalSinkLevel level_(logging::OFF);
+  const Json::Value data_ = post_data();
+  for (auto _ : state) {
+    FDP_LOG(DEBUG) << "API:Post: Post Data\n" << data_.toStyledString();
+  }
+}
+BENCHMARK(BM_LogDisabledJsonMacro);
+
+// An enabled message written to a string stream, for scale
+static void BM_LogEnabled(benchmark::State &state) {
+  std::ostringstream out_;
+  logging::Logger::sptr logger_ =
+      logging::Logger::create(logging::DEBUG, logging::OStreamSink::create(logging::DEBUG, out_));
+  const std::string body_ = post_data().toStyledString();
+  for (auto _ : state) {
+    logger_->debug() << "API:Post: Post Data\n" << body_ << " " << 42;
+    out_.str(std::string());
+  }
+}
+BENCHMARK(BM_LogEnabled);
+
+// Enabled INFO messages from state.threads() threads to a file written
+// with a system call per message, as std::cout is on a terminal. The
+// argument selects the sink: 0 writes on the logging thread, 1 through an
+// AsyncSink, 2 records the message in binary to memory mapped files.
+static void BM_LogSink(benchmark::State &state) {
+  static std::ofstream *file_;
+  static logging::Logger::sptr logger_;
+  const ghc::filesystem::path path_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-bench-log.txt";
+
+  if (state.thread_index() == 0) {
+    file_ = new std::ofstream(path_.string());
+    *file_ << std::unitbuf;
+    logging::Sink::sptr sink_ = logging::OStreamSink::create(logging::INFO, *file_);
+    if (state.range(0) == 1) {
+      sink_ = logging::AsyncSink::create(logging::INFO, sink_);
+    } else if (state.range(0) == 2) {
+      sink_ = logging::BinarySink::create(logging::INFO, path_.string() + "-binary");
+    }
+    logger_ = logging::Logger::create(logging::INFO, sink_, "BENCH");
+  }
+
+  for (auto _ : state) {
+    logger_->info() << "Writing SEIRS_model/parameters to local registry " << 42;
+  }
+
+  if (state.thread_index() == 0) {
+    logger_->flush();
+    logger_.reset();
+    delete file_;
+    ghc::filesystem::remove(path_);
+    const std::string binary_ = path_.filename().string() + "-binary.";
+    std::vector<ghc::filesystem::path> binary_files_;
+    for (ghc::filesystem::directory_iterator it_(path_.parent_path()), end_; it_ != end_; ++it_) {
+      if (it_->path().filename().string().compare(0, binary_.size(), binary_) == 0) {
+        binary_files_.push_back(it_->path());
+      }
+    }
+    for (std::size_t i = 0; i < binary_files_.size(); ++i) {
+      ghc::filesystem::remove(binary_files_[i]);
+    }
+  }
+}
+BENCHMARK(BM_LogSink)->Arg(0)->Arg(1)->Arg(2)->ThreadRange(1, 4)->UseRealTime();
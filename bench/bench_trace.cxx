@@ -0,0 +1,37 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "fdp/utilities/trace.hxx"
+
+using namespace FairDataPipeline;
+
+// A span with an argument, the argument 0 with tracing disabled and 1 with
+// it enabled. The recorded spans are discarded, nothing is written.
+static void BM_TraceSpan(benchmark::State &state) {
+  const bool was_enabled_ = trace::enabled();
+  if (state.range(0)) {
+    if (!was_enabled_) {
+      trace::start(std::string());
+    }
+  } else {
+    trace::stop();
+  }
+
+  const std::string path_ = "SEIRS_model/parameters/output.csv";
+  std::size_t n_ = 0;
+  for (auto _ : state) {
+    trace::Span span_("bench", "span");
+    span_.arg("path", path_);
+    // Keeps the per thread buffer from growing without bound
+    if (++n_ % 65536 == 0) {
+      trace::clear();
+    }
+  }
+
+  trace::clear();
+  if (!was_enabled_) {
+    trace::stop();
+  }
+}
+BENCHMARK(BM_TraceSpan)->Arg(0)->Arg(1);
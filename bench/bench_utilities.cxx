@@ -0,0 +1,127 @@
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <json/json.h>
+
+#include "fdp/registry/api.hxx"
+#include "fdp/utilities/json.hxx"
+#include "fdp/utilities/semver.hxx"
+
+using namespace FairDataPipeline;
+
+namespace {
+
+const std::string api_url_ = "http://127.0.0.1:8000/api/";
+
+// A registry entry as returned by a POST, with references to other tables
+Json::Value registry_entry(int i) {
+  Json::Value entry_;
+  entry_["url"] = api_url_ + "data_product/" + std::to_string(i) + "/";
+  entry_["name"] = "model/output " + std::to_string(i);
+  entry_["version"] = "0.1." + std::to_string(i);
+  entry_["namespace"] = api_url_ + "namespace/1/";
+  entry_["object"] = api_url_ + "object/" + std::to_string(i) + "/";
+  entry_["inputs"].append(api_url_ + "object_component/" + std::to_string(i) + "/");
+  entry_["inputs"].append(api_url_ + "object_component/" + std::to_string(i + 1) + "/");
+  return entry_;
+}
+
+// A listing of a registry table, argument is the number of results
+Json::Value registry_listing(int n) {
+  Json::Value listing_;
+  listing_["count"] = n;
+  listing_["next"] = Json::Value::null;
+  listing_["previous"] = Json::Value::null;
+  listing_["results"] = Json::Value(Json::arrayValue);
+  for (int i = 0; i < n; ++i) {
+    listing_["results"].append(registry_entry(i));
+  }
+  return listing_;
+}
+
+} // namespace
+
+// Query string of a GET looking up an entry, stripping the API root from the
+// references to other tables
+static void BM_JsonToQueryString(benchmark::State &state) {
+  API::sptr api_ = API::construct(api_url_);
+  Json::Value entry_ = registry_entry(1);
+  entry_.removeMember("url");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(api_->json_to_query_string(entry_));
+  }
+}
+BENCHMARK(BM_JsonToQueryString);
+
+static void BM_EscapeSpace(benchmark::State &state) {
+  API::sptr api_ = API::construct(api_url_);
+  std::string query_ = "?name=model/output with several spaces in it&version=0.1.0&";
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(api_->escape_space(query_));
+  }
+}
+BENCHMARK(BM_EscapeSpace);
+
+static void BM_UrlEncode(benchmark::State &state) {
+  const std::string url_ = api_url_ + "data_product/?name=model/output with spaces&version=0.1.0";
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(url_encode(url_));
+  }
+}
+BENCHMARK(BM_UrlEncode);
+
+// Serialising a POST body, argument is the number of entries
+static void BM_JsonToString(benchmark::State &state) {
+  Json::Value listing_ = registry_listing(static_cast<int>(state.range(0)));
+
+  std::size_t bytes_ = 0;
+  for (auto _ : state) {
+    const std::string text_ = json_to_string(listing_);
+    bytes_ += text_.size();
+    benchmark::DoNotOptimize(text_);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes_));
+}
+BENCHMARK(BM_JsonToString)->Arg(1)->Arg(100);
+
+// Parsing a registry response as the API does, argument is the number of results
+static void BM_ParseResponse(benchmark::State &state) {
+  Json::Value listing_ = registry_listing(static_cast<int>(state.range(0)));
+  const std::string text_ = json_to_string(listing_);
+  Json::CharReaderBuilder builder_;
+
+  for (auto _ : state) {
+    std::unique_ptr<Json::CharReader> reader_(builder_.newCharReader());
+    Json::Value root_;
+    std::string errors_;
+    reader_->parse(text_.data(), text_.data() + text_.size(), &root_, &errors_);
+    benchmark::DoNotOptimize(root_);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text_.size()));
+}
+BENCHMARK(BM_ParseResponse)->Arg(1)->Arg(100);
+
+static void BM_VersionParse(benchmark::State &state) {
+  const std::string version_ = "1.12.3-rc.4+build.567";
+
+  for (auto _ : state) {
+    Versioning::version parsed_(version_);
+    benchmark::DoNotOptimize(parsed_);
+  }
+}
+BENCHMARK(BM_VersionParse);
+
+static void BM_VersionCompare(benchmark::State &state) {
+  const Versioning::version a_("1.12.3-rc.4");
+  const Versioning::version b_("1.12.3");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a_ < b_);
+    benchmark::DoNotOptimize(a_ == b_);
+  }
+}
+BENCHMARK(BM_VersionCompare);
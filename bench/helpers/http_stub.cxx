@@ -0,0 +1,299 @@
+#include "helpers/http_stub.hxx"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace FairDataPipeline {
+namespace bench {
+
+static std::string to_lower_( std::string s )
+{
+    std::transform( s.begin(), s.end(), s.begin(), ::tolower );
+    return s;
+}
+
+static std::string reason_( int status )
+{
+    switch( status )
+    {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+    }
+    return "Unknown";
+}
+
+static bool send_all_( int fd, const std::string& data )
+{
+    std::size_t sent = 0;
+    while( sent < data.size() )
+    {
+        ssize_t n = ::send( fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL );
+        if( n <= 0 )
+            return false;
+        sent += static_cast< std::size_t >( n );
+    }
+    return true;
+}
+
+HttpStub::sptr HttpStub::construct( handler_type handler, const std::string& unix_socket )
+{
+    return HttpStub::sptr( new HttpStub( handler, unix_socket ) );
+}
+
+HttpStub::HttpStub( handler_type handler, const std::string& unix_socket )
+    : handler_( handler ), unix_socket_( unix_socket ), listen_fd_( -1 ), port_( 0 ),
+      running_( true ), connections_( 0 ), requests_( 0 ), errors_( 0 ), latency_us_( 0 ),
+      jitter_us_( 0 ), error_rate_( 0 ), error_status_( 503 ), random_( 5489u )
+{
+    if( !unix_socket_.empty() )
+    {
+        sockaddr_un addr;
+        std::memset( &addr, 0, sizeof( addr ) );
+        addr.sun_family = AF_UNIX;
+        if( unix_socket_.size() >= sizeof( addr.sun_path ) )
+            throw std::runtime_error( "HttpStub: socket path too long" );
+        std::strcpy( addr.sun_path, unix_socket_.c_str() );
+
+        listen_fd_ = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+        if( listen_fd_ < 0 )
+            throw std::runtime_error( "HttpStub: failed to create socket" );
+
+        ::unlink( unix_socket_.c_str() );
+        if( ::bind( listen_fd_, reinterpret_cast< sockaddr* >( &addr ), sizeof( addr ) ) != 0
+            || ::listen( listen_fd_, 128 ) != 0 )
+        {
+            ::close( listen_fd_ );
+            throw std::runtime_error( "HttpStub: failed to listen on " + unix_socket_ );
+        }
+
+        acceptor_ = std::thread( &HttpStub::accept_loop_, this );
+        return;
+    }
+
+    listen_fd_ = ::socket( AF_INET, SOCK_STREAM, 0 );
+    if( listen_fd_ < 0 )
+        throw std::runtime_error( "HttpStub: failed to create socket" );
+
+    int one = 1;
+    ::setsockopt( listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+
+    sockaddr_in addr;
+    std::memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    addr.sin_port = 0;
+
+    if( ::bind( listen_fd_, reinterpret_cast< sockaddr* >( &addr ), sizeof( addr ) ) != 0
+        || ::listen( listen_fd_, 128 ) != 0 )
+    {
+        ::close( listen_fd_ );
+        throw std::runtime_error( "HttpStub: failed to listen on 127.0.0.1" );
+    }
+
+    socklen_t len = sizeof( addr );
+    ::getsockname( listen_fd_, reinterpret_cast< sockaddr* >( &addr ), &len );
+    port_ = ntohs( addr.sin_port );
+
+    acceptor_ = std::thread( &HttpStub::accept_loop_, this );
+}
+
+HttpStub::~HttpStub()
+{
+    stop();
+}
+
+void HttpStub::stop()
+{
+    if( !running_.exchange( false ) )
+        return;
+
+    ::shutdown( listen_fd_, SHUT_RDWR );
+    ::close( listen_fd_ );
+    acceptor_.join();
+    if( !unix_socket_.empty() )
+        ::unlink( unix_socket_.c_str() );
+
+    std::unique_lock< std::mutex > lock( clients_mutex_ );
+    for( std::size_t i = 0; i < client_fds_.size(); ++i )
+        ::shutdown( client_fds_[i], SHUT_RDWR );
+    clients_done_.wait( lock, [this](){ return client_fds_.empty(); } );
+}
+
+std::string HttpStub::url( const std::string& path ) const
+{
+    if( !unix_socket_.empty() )
+        return "http://localhost/" + path;
+    return "http://127.0.0.1:" + std::to_string( port_ ) + "/" + path;
+}
+
+void HttpStub::accept_loop_()
+{
+    while( running_ )
+    {
+        int fd = ::accept( listen_fd_, NULL, NULL );
+        if( fd < 0 )
+        {
+            if( !running_ )
+                break;
+            continue;
+        }
+
+        if( unix_socket_.empty() )
+        {
+            int one = 1;
+            ::setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+        }
+        ++connections_;
+
+        std::lock_guard< std::mutex > lock( clients_mutex_ );
+        client_fds_.push_back( fd );
+        // Connection threads are detached so that benchmarks opening a new
+        // connection per request do not accumulate finished threads, stop()
+        // instead waits for client_fds_ to drain
+        std::thread( &HttpStub::serve_, this, fd ).detach();
+    }
+}
+
+// Read one request from the connection, returning false once the client has
+// gone away
+static bool read_request_( int fd, std::string& buffer, StubRequest& request )
+{
+    char chunk[ 16384 ];
+
+    // Read until the end of the header block
+    std::size_t header_end;
+    while( ( header_end = buffer.find( "\r\n\r\n" ) ) == std::string::npos )
+    {
+        ssize_t n = ::recv( fd, chunk, sizeof( chunk ), 0 );
+        if( n <= 0 )
+            return false;
+        buffer.append( chunk, static_cast< std::size_t >( n ) );
+    }
+
+    std::istringstream head( buffer.substr( 0, header_end ) );
+    std::string line;
+    std::getline( head, line );
+    std::istringstream request_line( line );
+    request_line >> request.method >> request.target;
+
+    while( std::getline( head, line ) )
+    {
+        if( !line.empty() && line[ line.size() - 1 ] == '\r' )
+            line.erase( line.size() - 1 );
+        std::size_t colon = line.find( ':' );
+        if( colon == std::string::npos )
+            continue;
+        std::size_t value_start = line.find_first_not_of( ' ', colon + 1 );
+        request.headers[ to_lower_( line.substr( 0, colon ) ) ] =
+            value_start == std::string::npos ? "" : line.substr( value_start );
+    }
+    buffer.erase( 0, header_end + 4 );
+
+    if( to_lower_( request.headers[ "expect" ] ) == "100-continue" )
+    {
+        if( !send_all_( fd, "HTTP/1.1 100 Continue\r\n\r\n" ) )
+            return false;
+    }
+
+    std::size_t content_length = static_cast< std::size_t >(
+        std::strtoul( request.headers[ "content-length" ].c_str(), NULL, 10 ) );
+    while( buffer.size() < content_length )
+    {
+        ssize_t n = ::recv( fd, chunk, sizeof( chunk ), 0 );
+        if( n <= 0 )
+            return false;
+        buffer.append( chunk, static_cast< std::size_t >( n ) );
+    }
+    request.body = buffer.substr( 0, content_length );
+    buffer.erase( 0, content_length );
+
+    return true;
+}
+
+void HttpStub::set_error_rate( double rate, int status )
+{
+    error_status_ = status;
+    error_rate_ = rate;
+}
+
+void HttpStub::set_seed( unsigned seed )
+{
+    std::lock_guard< std::mutex > lock( random_mutex_ );
+    random_.seed( seed );
+}
+
+// Adds the jitter to the delay, returning whether to inject an error
+bool HttpStub::draw_( long long& delay_us )
+{
+    const long long jitter_us = jitter_us_;
+    const double error_rate = error_rate_;
+    if( jitter_us <= 0 && error_rate <= 0 )
+        return false;
+
+    std::lock_guard< std::mutex > lock( random_mutex_ );
+    if( jitter_us > 0 )
+        delay_us += std::uniform_int_distribution< long long >( 0, jitter_us )( random_ );
+    return error_rate > 0 && std::uniform_real_distribution< double >( 0, 1 )( random_ ) < error_rate;
+}
+
+void HttpStub::serve_( int fd )
+{
+    std::string buffer;
+    bool keep_alive = true;
+
+    while( running_ && keep_alive )
+    {
+        StubRequest request;
+        if( !read_request_( fd, buffer, request ) )
+            break;
+
+        keep_alive = to_lower_( request.headers[ "connection" ] ) != "close";
+
+        long long delay_us = latency_us_;
+        const bool fail = draw_( delay_us );
+        if( delay_us > 0 )
+            std::this_thread::sleep_for( std::chrono::microseconds( delay_us ) );
+
+        StubResponse response = fail ? StubResponse( error_status_, "{\"detail\":\"Injected error.\"}" )
+                                     : handler_( request );
+        ++requests_;
+        if( fail )
+            ++errors_;
+
+        std::ostringstream out;
+        out << "HTTP/1.1 " << response.status << " " << reason_( response.status ) << "\r\n"
+            << "Content-Type: application/json\r\n"
+            << "Content-Length: " << response.body.size() << "\r\n"
+            << ( keep_alive ? "" : "Connection: close\r\n" )
+            << "\r\n"
+            << response.body;
+
+        if( !send_all_( fd, out.str() ) )
+            break;
+    }
+
+    std::lock_guard< std::mutex > lock( clients_mutex_ );
+    client_fds_.erase( std::remove( client_fds_.begin(), client_fds_.end(), fd ),
+                       client_fds_.end() );
+    ::close( fd );
+    clients_done_.notify_all();
+}
+
+} // namespace bench
+} // namespace FairDataPipeline
@@ -0,0 +1,178 @@
+/*! **************************************************************************
+ * @file bench/helpers/http_stub.hxx
+ * @brief A minimal localhost HTTP/1.1 server used as a registry stand-in
+ *
+ * The server accepts keep-alive connections on 127.0.0.1, parses just enough
+ * of each request to hand the method, target and body to a handler and
+ * writes the handler's JSON response back. It exists so that benchmarks can
+ * exercise the API networking code without a running registry.
+ ****************************************************************************/
+#ifndef __FDP_BENCH_HTTP_STUB_HXX__
+#define __FDP_BENCH_HTTP_STUB_HXX__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace FairDataPipeline {
+namespace bench {
+
+/**
+ * @brief a request as received by the HttpStub
+ */
+struct StubRequest {
+  std::string method;
+  std::string target;
+  std::string body;
+  std::map< std::string, std::string > headers; /*!< keys are lower case */
+};
+
+/**
+ * @brief a response to be sent by the HttpStub
+ */
+struct StubResponse {
+  StubResponse( int status_code = 200, const std::string& content = "{}" )
+      : status( status_code ), body( content ) {}
+
+  int status;
+  std::string body;
+};
+
+/*! **************************************************************************
+ * @class HttpStub
+ * @brief localhost HTTP server answering every request through a handler
+ *
+ * Each accepted connection is served on its own thread so keep-alive
+ * clients and concurrent clients both behave as they would against the
+ * registry.
+ ****************************************************************************/
+class HttpStub {
+public:
+  typedef std::shared_ptr< HttpStub > sptr;
+  typedef std::function< StubResponse( const StubRequest& ) > handler_type;
+
+  /**
+   * @brief start a server on an ephemeral port of 127.0.0.1, or on a Unix
+   * domain socket
+   *
+   * @param handler function producing the response for each request
+   * @param unix_socket path of the socket, replacing any file there, which
+   * is removed when the server stops; empty to serve over TCP
+   * @return HttpStub::sptr
+   */
+  static sptr construct( handler_type handler, const std::string& unix_socket = "" );
+
+  ~HttpStub();
+
+  /**
+   * @brief stop accepting connections and join all server threads
+   */
+  void stop();
+
+  int port() const { return port_; }
+
+  /**
+   * @brief path of the Unix domain socket served, empty for TCP
+   */
+  const std::string& unix_socket() const { return unix_socket_; }
+
+  /**
+   * @brief root URL of the server with the given path appended
+   *
+   * @param path e.g. "api/"
+   * @return std::string e.g. "http://127.0.0.1:41234/api/", or
+   * "http://localhost/api/" on a Unix domain socket
+   */
+  std::string url( const std::string& path = "" ) const;
+
+  /**
+   * @brief add a fixed delay before every response, emulating the round trip
+   * time to a remote registry
+   *
+   * @param latency delay applied to each request
+   */
+  void set_latency( std::chrono::microseconds latency ) { latency_us_ = latency.count(); }
+
+  /**
+   * @brief add a random delay of up to jitter on top of the latency
+   *
+   * Delays and injected errors are drawn from a generator with a fixed seed
+   * so that a run can be repeated.
+   *
+   * @param jitter upper bound of the uniformly distributed extra delay
+   */
+  void set_jitter( std::chrono::microseconds jitter ) { jitter_us_ = jitter.count(); }
+
+  /**
+   * @brief answer a fraction of requests with an error instead of passing
+   * them to the handler
+   *
+   * @param rate probability of an error, between 0 and 1
+   * @param status HTTP status of the injected errors
+   */
+  void set_error_rate( double rate, int status = 503 );
+
+  /**
+   * @brief seed the generator of delays and errors
+   */
+  void set_seed( unsigned seed );
+
+  /**
+   * @brief number of connections accepted since construction
+   */
+  std::size_t connections() const { return connections_; }
+
+  /**
+   * @brief number of HTTP requests answered since construction
+   */
+  std::size_t requests() const { return requests_; }
+
+  /**
+   * @brief number of requests answered with an injected error
+   */
+  std::size_t errors() const { return errors_; }
+
+private:
+  HttpStub( handler_type handler, const std::string& unix_socket );
+  HttpStub( const HttpStub& ) = delete;
+  HttpStub& operator=( const HttpStub& ) = delete;
+
+  void accept_loop_();
+  void serve_( int fd );
+  bool draw_( long long& delay_us );
+
+  handler_type handler_;
+  std::string unix_socket_;
+  int listen_fd_;
+  int port_;
+  std::atomic< bool > running_;
+  std::atomic< std::size_t > connections_;
+  std::atomic< std::size_t > requests_;
+  std::atomic< std::size_t > errors_;
+  std::atomic< long long > latency_us_;
+  std::atomic< long long > jitter_us_;
+  std::atomic< double > error_rate_;
+  std::atomic< int > error_status_;
+
+  std::mutex random_mutex_;
+  std::mt19937 random_;
+
+  std::thread acceptor_;
+  std::mutex clients_mutex_;
+  std::condition_variable clients_done_;
+  std::vector< int > client_fds_;
+};
+
+} // namespace bench
+} // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,84 @@
+#include "helpers/mock_registry.hxx"
+
+#include <functional>
+
+namespace FairDataPipeline {
+namespace bench {
+
+MockRegistry::sptr MockRegistry::construct( const std::string& unix_socket )
+{
+    return MockRegistry::sptr( new MockRegistry( unix_socket ) );
+}
+
+MockRegistry::MockRegistry( const std::string& unix_socket )
+{
+    stub_ = HttpStub::construct(
+        std::bind( &MockRegistry::handle_, this, std::placeholders::_1 ), unix_socket );
+    registry_ = EmbeddedRegistry::construct( api_url() );
+}
+
+MockRegistry::~MockRegistry()
+{
+    stub_->stop();
+}
+
+std::string MockRegistry::api_url() const
+{
+    return stub_->url( "api/" );
+}
+
+void MockRegistry::set_latency( std::chrono::microseconds latency )
+{
+    stub_->set_latency( latency );
+}
+
+void MockRegistry::set_jitter( std::chrono::microseconds jitter )
+{
+    stub_->set_jitter( jitter );
+}
+
+void MockRegistry::set_error_rate( double rate )
+{
+    stub_->set_error_rate( rate );
+}
+
+std::size_t MockRegistry::errors() const
+{
+    return stub_->errors();
+}
+
+std::size_t MockRegistry::requests() const
+{
+    return stub_->requests();
+}
+
+std::size_t MockRegistry::table_size( const std::string& table ) const
+{
+    return registry_->table_size( table );
+}
+
+Json::Value MockRegistry::insert( const std::string& table, const Json::Value& entry )
+{
+    return registry_->insert( table, entry );
+}
+
+StubResponse MockRegistry::handle_( const StubRequest& request )
+{
+    HttpRequest request_;
+    if( request.method == "POST" )
+        request_.method = HttpRequest::POST;
+    else if( request.method == "PATCH" )
+        request_.method = HttpRequest::PATCH;
+    else if( request.method != "GET" )
+        return StubResponse( 405, "{\"detail\":\"Method not allowed.\"}" );
+
+    // The target is "/api/<table>/...", relative to the root of the stub
+    request_.url = stub_->url( request.target.substr( request.target.empty() ? 0 : 1 ) );
+    request_.body = request.body;
+
+    const HttpResponse response_ = registry_->handle( request_ );
+    return StubResponse( static_cast< int >( response_.http_code ), response_.body );
+}
+
+} // namespace bench
+} // namespace FairDataPipeline
@@ -0,0 +1,132 @@
+/*! **************************************************************************
+ * @file bench/helpers/mock_registry.hxx
+ * @brief An in-memory stand-in for the FAIR data registry REST API
+ *
+ * The MockRegistry serves an in-memory EmbeddedRegistry on top of an
+ * HttpStub, so that requests take the same path through curl as with a
+ * registry. It allows whole DataPipeline runs to be benchmarked offline with
+ * a configurable round trip time, jitter and rate of errors.
+ ****************************************************************************/
+#ifndef __FDP_BENCH_MOCK_REGISTRY_HXX__
+#define __FDP_BENCH_MOCK_REGISTRY_HXX__
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <json/json.h>
+
+#include "fdp/registry/embedded_registry.hxx"
+
+#include "helpers/http_stub.hxx"
+
+namespace FairDataPipeline {
+namespace bench {
+
+/*! **************************************************************************
+ * @class MockRegistry
+ * @brief in-memory registry tables served over HTTP on 127.0.0.1
+ *
+ * The registry is seeded with the admin user and its author, as created by
+ * "fair init".
+ ****************************************************************************/
+class MockRegistry {
+public:
+  typedef std::shared_ptr< MockRegistry > sptr;
+
+  /**
+   * @brief start a registry
+   *
+   * @param unix_socket path of a Unix domain socket to serve on, or empty to
+   * serve on an ephemeral port of 127.0.0.1
+   * @return MockRegistry::sptr
+   */
+  static sptr construct( const std::string& unix_socket = "" );
+
+  /**
+   * @brief stop the server before the tables are released
+   */
+  ~MockRegistry();
+
+  /**
+   * @brief root of the REST API
+   *
+   * @return std::string e.g. "http://127.0.0.1:41234/api/"
+   */
+  std::string api_url() const;
+
+  /**
+   * @brief path of the Unix domain socket served, empty for TCP
+   */
+  const std::string& unix_socket() const { return stub_->unix_socket(); }
+
+  /**
+   * @brief add a fixed delay before every response
+   *
+   * @param latency emulated round trip time
+   */
+  void set_latency( std::chrono::microseconds latency );
+
+  /**
+   * @brief add a random delay of up to jitter to every response
+   *
+   * @param jitter upper bound of the uniformly distributed extra delay
+   */
+  void set_jitter( std::chrono::microseconds jitter );
+
+  /**
+   * @brief answer a fraction of requests with 503 Service Unavailable, as a
+   * registry under load or being restarted would
+   *
+   * @param rate probability of an error, between 0 and 1
+   */
+  void set_error_rate( double rate );
+
+  /**
+   * @brief number of requests answered with an injected error
+   */
+  std::size_t errors() const;
+
+  /**
+   * @brief number of HTTP requests answered since construction
+   */
+  std::size_t requests() const;
+
+  /**
+   * @brief number of entries currently held in a table
+   *
+   * @param table e.g. "object"
+   * @return std::size_t
+   */
+  std::size_t table_size( const std::string& table ) const;
+
+  /**
+   * @brief add an entry directly, as if it had been POSTed
+   *
+   * @param table registry table
+   * @param entry fields of the entry
+   * @return Json::Value the stored entry including its url
+   */
+  Json::Value insert( const std::string& table, const Json::Value& entry );
+
+  /**
+   * @brief the tables served
+   */
+  EmbeddedRegistry::sptr registry() const { return registry_; }
+
+private:
+  explicit MockRegistry( const std::string& unix_socket );
+  MockRegistry( const MockRegistry& ) = delete;
+  MockRegistry& operator=( const MockRegistry& ) = delete;
+
+  StubResponse handle_( const StubRequest& request );
+
+  HttpStub::sptr stub_;
+  EmbeddedRegistry::sptr registry_;
+};
+
+} // namespace bench
+} // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,112 @@
+#include "helpers/pipeline_files.hxx"
+
+#include <fstream>
+
+namespace FairDataPipeline {
+namespace bench {
+
+PipelineFiles::PipelineFiles( const std::string& api_url, const PipelineOptions& options,
+                              const std::string& name )
+{
+    root = ghc::filesystem::temp_directory_path() / name;
+    ghc::filesystem::create_directories( root / "data_store" );
+
+    config = root / "config.yaml";
+    std::ofstream config_( config.string() );
+    config_ << "run_metadata:\n"
+            << "  description: Benchmark run\n"
+            << "  local_data_registry_url: " << api_url << "\n"
+            << "  remote_data_registry_url: https://data.scrc.uk/api/\n"
+            << "  default_input_namespace: testing\n"
+            << "  default_output_namespace: testing\n"
+            << "  write_data_store: " << ( root / "data_store" ).string() << "/\n"
+            << "  local_repo: ./\n"
+            << "  public: true\n"
+            << "  latest_commit: 52008720d240693150e96021ea34ac6fffe05870\n"
+            << "  remote_repo: https://github.com/FAIRDataPipeline/cppDataPipeline\n";
+    if( options.registry_cache )
+        config_ << "  registry_cache_dir: " << ( root / "registry_cache" ).string() << "\n";
+    if( options.prefetch_reads )
+        config_ << "  prefetch_reads: true\n";
+    if( !options.registry_socket.empty() )
+        config_ << "  local_data_registry_socket: " << options.registry_socket << "\n";
+    if( options.embedded_registry )
+        config_ << "  embedded_registry_file: " << ( root / "registry.jsonl" ).string() << "\n";
+    if( options.registry_journal )
+        config_ << "  registry_journal: true\n";
+    if( options.registry_journal_defer )
+        config_ << "  registry_journal_defer: true\n";
+
+    if( options.n_writes > 0 )
+        config_ << "write:\n";
+    for( int i = 0; i < options.n_writes; ++i )
+    {
+        config_ << "- data_product: " << data_product( i ) << "\n"
+                << "  description: Benchmark output\n"
+                << "  file_type: csv\n";
+    }
+
+    if( options.n_reads > 0 )
+        config_ << "read:\n";
+    for( int i = 0; i < options.n_reads; ++i )
+    {
+        config_ << "- data_product: " << input_product( i ) << "\n"
+                << "  use:\n"
+                << "    version: 0.0.1\n";
+    }
+
+    script = root / "script.sh";
+    std::ofstream script_( script.string() );
+    script_ << "#!/bin/bash\necho \"benchmark\"\n";
+}
+
+PipelineFiles::~PipelineFiles()
+{
+    ghc::filesystem::remove_all( root );
+}
+
+void PipelineFiles::seed_inputs( MockRegistry& registry, int n ) const
+{
+    Json::Value namespace_;
+    namespace_["name"] = "testing";
+    const Json::Value j_namespace_ = registry.insert( "namespace", namespace_ );
+
+    Json::Value storage_root_;
+    storage_root_["root"] = "file://" + ( root / "data_store" ).string() + "/";
+    storage_root_["local"] = true;
+    const Json::Value j_storage_root_ = registry.insert( "storage_root", storage_root_ );
+
+    for( int i = 0; i < n; ++i )
+    {
+        Json::Value location_;
+        location_["path"] = "testing/" + input_product( i ) + "/input.csv";
+        location_["hash"] = std::to_string( i );
+        location_["public"] = true;
+        location_["storage_root"] = j_storage_root_["url"];
+        const Json::Value j_location_ = registry.insert( "storage_location", location_ );
+
+        Json::Value object_;
+        object_["storage_location"] = j_location_["url"];
+        const Json::Value j_object_ = registry.insert( "object", object_ );
+
+        Json::Value product_;
+        product_["name"] = input_product( i );
+        product_["version"] = "0.0.1";
+        product_["namespace"] = j_namespace_["url"];
+        product_["object"] = j_object_["url"];
+        registry.insert( "data_product", product_ );
+    }
+}
+
+std::string PipelineFiles::data_product( int i )
+{
+    return "bench/output_" + std::to_string( i );
+}
+
+std::string PipelineFiles::input_product( int i )
+{
+    return "bench/input_" + std::to_string( i );
+}
+
+} // namespace bench
+} // namespace FairDataPipeline
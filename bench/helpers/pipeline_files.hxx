@@ -0,0 +1,92 @@
+/*! **************************************************************************
+ * @file bench/helpers/pipeline_files.hxx
+ * @brief Synthetic configurations for benchmarking whole pipeline runs
+ *
+ * PipelineFiles writes a configuration with any number of reads and writes,
+ * and a submission script, pointing at a MockRegistry so that DataPipeline
+ * runs of any size can be benchmarked offline.
+ ****************************************************************************/
+#ifndef __FDP_BENCH_PIPELINE_FILES_HXX__
+#define __FDP_BENCH_PIPELINE_FILES_HXX__
+
+#include <string>
+
+#include <ghc/filesystem.hpp>
+
+#include "helpers/mock_registry.hxx"
+
+namespace FairDataPipeline {
+namespace bench {
+
+/**
+ * @brief contents of a synthetic configuration
+ */
+struct PipelineOptions {
+  PipelineOptions()
+      : n_writes( 0 ), n_reads( 0 ), registry_cache( false ), prefetch_reads( false ),
+        embedded_registry( false ), registry_journal( false ), registry_journal_defer( false ) {}
+
+  int n_writes;
+  int n_reads;
+  bool registry_cache;
+  bool prefetch_reads;
+  bool embedded_registry; /*!< register in a journal in the scratch directory */
+  std::string registry_socket; /*!< Unix domain socket of the registry */
+  bool registry_journal; /*!< journal the registry changes of finalise */
+  bool registry_journal_defer; /*!< leave the journal to be replayed later */
+};
+
+/*! **************************************************************************
+ * @class PipelineFiles
+ * @brief a configuration and submission script in a scratch directory
+ *
+ * The directory, including the data store written by the runs, is removed
+ * on destruction.
+ ****************************************************************************/
+class PipelineFiles {
+public:
+  /**
+   * @brief write the configuration and script
+   *
+   * @param api_url root of the registry, e.g. MockRegistry::api_url()
+   * @param options numbers of reads and writes and run_metadata options
+   * @param name of the scratch directory, distinguishing concurrent users
+   */
+  explicit PipelineFiles( const std::string& api_url,
+                          const PipelineOptions& options = PipelineOptions(),
+                          const std::string& name = "fdpapi-bench-config" );
+
+  ~PipelineFiles();
+
+  /**
+   * @brief register n input products, all sharing one storage root, as an
+   * earlier run would have done
+   *
+   * @param registry
+   * @param n number of products named by input_product()
+   */
+  void seed_inputs( MockRegistry& registry, int n ) const;
+
+  /**
+   * @brief name of the ith data product written by the configuration
+   */
+  static std::string data_product( int i );
+
+  /**
+   * @brief name of the ith data product read by the configuration
+   */
+  static std::string input_product( int i );
+
+  ghc::filesystem::path root;
+  ghc::filesystem::path config;
+  ghc::filesystem::path script;
+
+private:
+  PipelineFiles( const PipelineFiles& ) = delete;
+  PipelineFiles& operator=( const PipelineFiles& ) = delete;
+};
+
+} // namespace bench
+} // namespace FairDataPipeline
+
+#endif
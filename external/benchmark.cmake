@@ -0,0 +1,25 @@
+# Try and find Google Benchmark
+FIND_PACKAGE( benchmark QUIET )
+MESSAGE( STATUS "[Google Benchmark]" )
+
+# If Google Benchmark is not Found, Install it
+IF(NOT benchmark_FOUND)
+
+    SET( BENCHMARK_URL "https://github.com/google/benchmark/archive/refs/tags/v1.6.1.zip" )
+
+    MESSAGE( STATUS "\tGoogle Benchmark Will be installed." )
+    MESSAGE( STATUS "\tURL: ${BENCHMARK_URL}" )
+
+    SET( BENCHMARK_ENABLE_TESTING OFF CACHE INTERNAL "Don't build benchmark tests" )
+    SET( BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE INTERNAL "Don't build benchmark gtests" )
+    SET( BENCHMARK_ENABLE_INSTALL OFF CACHE INTERNAL "Don't install benchmark" )
+
+    include(FetchContent)
+    FetchContent_Declare(
+        benchmark
+        URL ${BENCHMARK_URL}
+    )
+    FetchContent_MakeAvailable(benchmark)
+ELSE()
+    MESSAGE( STATUS "\tVersion: ${benchmark_VERSION}" )
+ENDIF()
@@ -1,5 +1,7 @@
 # Try and find CURL
-FIND_PACKAGE( CURL QUIET )
+# curl_multi_poll and curl_multi_wakeup need 7.68, older system curls
+# fall back to the fetched release
+FIND_PACKAGE( CURL 7.68 QUIET )
 MESSAGE( STATUS "[Curl]" )
 
 # If CURL is not Found, Install it
@@ -13,8 +13,14 @@ public:
 
 class rest_apiquery_error : public std::runtime_error {
 public:
-  rest_apiquery_error(const std::string& message)
-      : std::runtime_error(message) {}
+  rest_apiquery_error(const std::string& message, long http_code = 0)
+      : std::runtime_error(message), http_code_(http_code) {}
+
+  /** status of the failed response, 0 if the registry could not be reached */
+  long http_code() const { return http_code_; }
+
+private:
+  long http_code_;
 };
 
 class json_parse_error : public std::runtime_error {
@@ -1,14 +1,22 @@
 #ifndef __FDP__
 #define __FDP__
 
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "fdp/objects/output_stream.hxx"
+#include "fdp/utilities/metrics.hxx"
 
 namespace FairDataPipeline {
 /**
  * @brief DataPipeline Class:
  * A PIMPL Class for interacting the the FAIR Data Pipeline
  * 
+ * The link and commit calls may be made from several threads of a
+ * simulation at once, finalise once they have all returned.
+ * 
  */
     class DataPipeline {
 
@@ -46,6 +54,15 @@ namespace FairDataPipeline {
    */
 	    std::string link_read(std::string &data_product);
 
+  /**
+   * @brief Return paths to several data products, resolving them from
+   * the registry concurrently whilst recording their meta data
+   * 
+   * @param data_products 
+   * @return std::vector<std::string> paths in the order of data_products
+   */
+	    std::vector<std::string> link_read_many(const std::vector<std::string> &data_products);
+
   /**
    * @brief Return a path to be used for a given data product
    * whilst recording it's meta data
@@ -55,6 +72,29 @@ namespace FairDataPipeline {
    */
 	    std::string link_write(std::string &data_product);
 
+  /**
+   * @brief Return a stream writing the given data product, whose
+   * contents are hashed as they are written so that finalise does not
+   * read the file again. The stream must be closed (or destroyed)
+   * before finalise is called
+   * 
+   * @param data_product 
+   * @return OutputStream::sptr 
+   */
+	    OutputStream::sptr link_write_stream(std::string &data_product);
+
+  /**
+   * @brief Mark an output as complete: it is hashed, moved to its content
+   * addressed path and registered by a background thread while the model
+   * continues, so that finalise only waits for committed outputs and
+   * updates the code run. The output (or its stream, which must be
+   * closed) must not be written after it is committed. Outputs which are
+   * never committed are registered by finalise as before
+   * 
+   * @param data_product 
+   */
+	    void commit(std::string &data_product);
+
   /**
    * @brief Finalise the pipeline
    * Record all data products and meta data to the registry
@@ -63,6 +103,28 @@ namespace FairDataPipeline {
    */
             void finalise();
 
+  /**
+   * @brief Apply the registry changes journaled by earlier runs which
+   * could not reach the registry, or deferred them with
+   * "registry_journal_defer: true", resuming each from its first change
+   * not yet applied. Does nothing unless the registry journal is enabled
+   * by FDP_REGISTRY_JOURNAL_DIR or the registry_journal(_dir)
+   * run_metadata entries
+   * 
+   * @return std::size_t the number of journals applied
+   */
+            std::size_t replay_registry_journal();
+
+  /**
+   * @brief Get the metrics of this run: registry requests, transferred
+   * bytes, cache hits, hashing and the files moved by finalise. They are
+   * also written in the Prometheus text format by finalise when
+   * FDP_METRICS_FILE or the metrics_file run_metadata entry is set
+   * 
+   * @return Metrics::sptr 
+   */
+            Metrics::sptr get_metrics() const;
+
         private:
             explicit DataPipeline(
                     const std::string &config_file_path,
@@ -12,8 +12,18 @@
 #ifndef __FDP_CONFIG_HXX__
 #define __FDP_CONFIG_HXX__
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <ghc/filesystem.hpp>
 #include <yaml-cpp/yaml.h>
@@ -21,11 +31,21 @@
 #include "fdp/registry/api.hxx"
 #include "fdp/objects/api_object.hxx"
 #include "fdp/objects/io_object.hxx"
+#include "fdp/registry/registry_journal.hxx"
+#include "fdp/utilities/file_hash_cache.hxx"
+#include "fdp/utilities/metrics.hxx"
 
 namespace FairDataPipeline {
     /**
      * @brief class for interacting with confifurations
      * 
+     * link_read, link_read_many, link_write, link_write_stream, commit and
+     * prefetch_reads may be called from several threads at once, the work of
+     * linking one data product does not hold up others. finalise must only
+     * be called once every other call has returned. The YAML accessors
+     * (meta_data_, get_config_data and the config_ accessors) are not
+     * thread safe.
+     * 
      */
     class Config {
         public:
@@ -41,6 +61,11 @@ namespace FairDataPipeline {
             std::string api_url_;
             std::string token_;
             API::sptr api_;
+            FileHashCache::sptr hash_cache_;
+            Metrics::sptr metrics_;
+            ghc::filesystem::path metrics_file_;
+            ghc::filesystem::path registry_journal_dir_;
+            bool registry_journal_defer_ = false;
 
             ApiObject::sptr user_;
             ApiObject::sptr author_;
@@ -66,6 +91,7 @@ namespace FairDataPipeline {
 
             map_type outputs_;
             map_type inputs_;
+            map_type prefetched_reads_;
 
             RESTAPI rest_api_location_ = RESTAPI::LOCAL;
 
@@ -74,6 +100,124 @@ namespace FairDataPipeline {
             
             void initialise(RESTAPI api_location);
             void validate_config(ghc::filesystem::path yaml_path, RESTAPI api_location);
+
+            /**
+             * @brief A read from the config with its "use" defaults applied
+             * 
+             */
+            struct ReadSpec {
+                ReadSpec() : default_version(false), linked(NULL),
+                    mutex(std::make_shared<std::mutex>()) {}
+
+                std::string data_product;
+                std::string use_data_product;
+                std::string use_version;
+                std::string use_namespace;
+                bool default_version;
+                const IOObject* linked; /*!< entry in reads_ once linked */
+                std::shared_ptr<std::mutex> mutex; /*!< held while linking, linked is set under it and links_mutex_ */
+            };
+
+            /**
+             * @brief A write from the config with its "use" defaults applied,
+             * missing fields are reported when the write is linked
+             * 
+             */
+            struct WriteSpec {
+                WriteSpec() : is_public(true), has_description(false),
+                    has_file_type(false), default_version(false), linked(NULL),
+                    mutex(std::make_shared<std::mutex>()) {}
+
+                std::string data_product;
+                std::string use_data_product;
+                std::string use_version;
+                std::string use_namespace;
+                std::string description;
+                std::string file_type;
+                bool is_public;
+                bool has_description;
+                bool has_file_type;
+                bool default_version;
+                const IOObject* linked; /*!< entry in writes_ once linked */
+                std::shared_ptr<std::mutex> mutex; /*!< held while linking, linked is set under it and links_mutex_ */
+            };
+
+            /*! reads and writes keyed on data_product, built by validate_config
+             *  and not changed afterwards so that they may be looked up from
+             *  any thread */
+            std::unordered_map< std::string, ReadSpec > read_specs_;
+            std::unordered_map< std::string, WriteSpec > write_specs_;
+            bool reads_specified_ = false;
+            bool writes_specified_ = false;
+
+            /*! values of the run_metadata used after construction, as a
+             *  YAML::Node may not be read from several threads */
+            ghc::filesystem::path data_store_path_;
+            std::string default_input_namespace_;
+            std::string default_output_namespace_;
+
+            /*! guards the structure of writes_, reads_ and prefetched_reads_,
+             *  each entry is guarded by the mutex of its spec */
+            mutable std::mutex links_mutex_;
+
+            void index_config_();
+            ReadSpec& read_spec_(const std::string &data_product);
+            WriteSpec& write_spec_(const std::string &data_product);
+            IOObject& link_write_(WriteSpec &spec);
+            IOObject resolve_read_(const ReadSpec &spec) const;
+            void resolve_reads_(const std::vector<ReadSpec> &specs, map_type &resolved, bool skip_failures);
+
+            typedef std::function< std::shared_ptr<std::mutex>(const std::string&) > lock_type;
+
+            void register_write_(IOObject &write, const std::string &hash,
+                                 const ApiObject::sptr &file_type,
+                                 const ApiObject::sptr &namespace_obj,
+                                 const lock_type &lock_for);
+            /**
+             * @brief A write handed to the registrar by commit()
+             * 
+             */
+            struct CommittedWrite {
+                CommittedWrite() : write(NULL), hashed(false), registered(false) {}
+
+                IOObject* write;
+                std::string hash;
+                bool hashed;
+                bool registered; /*!< moved and registered, awaiting the code run */
+                std::exception_ptr error;
+            };
+
+            /*! writes keyed on data_product, serviced in order by registrars_ */
+            std::map< std::string, CommittedWrite > committed_;
+            std::deque< CommittedWrite* > registrar_queue_;
+            std::mutex registrar_mutex_;
+            std::condition_variable registrar_cv_;
+            std::vector< std::thread > registrars_;
+            std::size_t registrars_busy_ = 0;
+            bool registrar_stopping_ = false;
+            /*! registry objects shared between committed writes, each
+             *  guarded by the mutex of its key */
+            std::map< std::string, ApiObject::sptr > registrar_objects_;
+            std::map< std::string, std::shared_ptr<std::mutex> > registrar_locks_;
+
+            void run_registrar_();
+            void register_committed_(CommittedWrite &committed, const lock_type &lock_for);
+            void drain_registrar_();
+            void stop_registrar_();
+            std::vector<IOObject*> closed_writes_();
+            void finalise_journaled_();
+            void report_finalise_(std::chrono::steady_clock::time_point start);
+            Json::Value apply_journal_(RegistryJournal &journal);
+            Json::Value apply_register_write_(RegistryJournal &journal, std::size_t entry,
+                                              const ApiObject::sptr &file_type,
+                                              const ApiObject::sptr &namespace_obj,
+                                              const lock_type &lock_for);
+            void init_metrics_(const std::string &write_data_store);
+            ghc::filesystem::path embedded_registry_path_() const;
+            std::string embedded_registry_source_() const;
+            std::string hash_file_(const ghc::filesystem::path &path);
+            void count_hashed_(const std::vector<ghc::filesystem::path> &paths,
+                               const std::string &kind, double seconds);
             /**
              * @brief Construct a new Config object
              * 
@@ -228,6 +372,26 @@ namespace FairDataPipeline {
              */
             ghc::filesystem::path link_write( const std::string &data_product);
 
+            /**
+             * @brief Provide a stream writing a given data product whilst
+             * recording metadata, the contents are hashed as they are written
+             * 
+             * @param data_product 
+             * @return OutputStream::sptr 
+             */
+            OutputStream::sptr link_write_stream( const std::string &data_product);
+
+            /**
+             * @brief Mark a linked output as complete so that it is hashed,
+             * moved and registered by a background thread while the model
+             * continues, rather than by finalise. The output must not be
+             * written after it is committed; finalise waits for every
+             * committed output and reports the first which failed
+             * 
+             * @param data_product 
+             */
+            void commit( const std::string &data_product);
+
             /**
              * @brief Return the filepath to a given data product
              * 
@@ -235,6 +399,22 @@ namespace FairDataPipeline {
              * @return ghc::filesystem::path 
              */
             ghc::filesystem::path link_read(const std::string& data_product);
+            /**
+             * @brief Return the filepaths to several data products, resolving
+             * them from the registry concurrently
+             * 
+             * @param data_products 
+             * @return std::vector<ghc::filesystem::path> paths in the order of data_products
+             */
+            std::vector<ghc::filesystem::path> link_read_many(const std::vector<std::string>& data_products);
+            /**
+             * @brief Resolve every data product in the config reads
+             * concurrently so that later calls to link_read do not need to
+             * contact the registry. Called at construction when the
+             * run_metadata contains "prefetch_reads: true"
+             * 
+             */
+            void prefetch_reads();
 
             /**
              * @brief Finalise the pipeline
@@ -244,6 +424,25 @@ namespace FairDataPipeline {
              */
             void finalise();
 
+            /**
+             * @brief Apply the registry journals left in the journal
+             * directory by runs whose registry update was deferred or
+             * interrupted, resuming each from its first change not yet
+             * applied. Journals being written or applied by another
+             * process are skipped
+             * 
+             * @return std::size_t the number of journals applied
+             */
+            std::size_t replay_registry_journal();
+
+            /**
+             * @brief Get the directory of the registry journals, empty
+             * unless finalise journals its registry changes
+             * 
+             * @return ghc::filesystem::path 
+             */
+            ghc::filesystem::path get_registry_journal_dir() const {return registry_journal_dir_;}
+
             /**
              * @brief Read a given yaml file into a Yaml Node
              * 
@@ -266,6 +465,13 @@ namespace FairDataPipeline {
              */
              API::sptr get_api() const {return api_;}
 
+            /**
+             * @brief Get the metrics of this run, shared with its API
+             * 
+             * @return Metrics::sptr 
+             */
+             Metrics::sptr get_metrics() const {return metrics_;}
+
             /**
              * @brief Get the rest api location (local / remote)
              * 
@@ -7,6 +7,7 @@
 
 #include "fdp/utilities/logging.hxx"
 #include "fdp/objects/api_object.hxx"
+#include "fdp/objects/output_stream.hxx"
 
 namespace FairDataPipeline {
     /**
@@ -27,6 +28,7 @@ namespace FairDataPipeline {
 
             ApiObject::sptr component_obj_;
             ApiObject::sptr data_product_obj_;
+            std::shared_ptr<const OutputStream::Digest> stream_digest_;
 
         public:
             /**
@@ -182,6 +184,21 @@ namespace FairDataPipeline {
              * @param data_product_obj 
              */
             void set_data_product_object(ApiObject &data_product_obj){data_product_obj_ = std::make_shared<ApiObject>(data_product_obj);}
+
+            /**
+             * @brief Get the digest of the stream the data product was
+             * written through, null if it was written through its path
+             * 
+             * @return std::shared_ptr<const OutputStream::Digest> 
+             */
+            std::shared_ptr<const OutputStream::Digest> get_stream_digest() const {return stream_digest_;}
+
+            /**
+             * @brief Set the digest of the stream the data product is written through
+             * 
+             * @param stream_digest 
+             */
+            void set_stream_digest(std::shared_ptr<const OutputStream::Digest> stream_digest){stream_digest_ = stream_digest;}
     };
 };
 
@@ -18,7 +18,9 @@
 #include <sstream>
 #include <random>
 #include <chrono>
+#include <memory>
 #include <regex>
+#include <vector>
 
 #include "digestpp.hpp"
 
@@ -30,12 +32,29 @@
 #endif
 
 namespace FairDataPipeline {
+class FileHashCache;
+
 /*! **************************************************************************
  * @brief calculates a hash from a given input file via SHA1
  *
+ * @param hash_cache optional cache of earlier hashes, an unchanged file is
+ * then not read again
  * @return the hash obtained from the file contents
  ****************************************************************************/
-std::string calculate_hash_from_file(const ghc::filesystem::path &);
+std::string calculate_hash_from_file(const ghc::filesystem::path &,
+    const std::shared_ptr<FileHashCache> &hash_cache = std::shared_ptr<FileHashCache>());
+
+/*! **************************************************************************
+ * @brief calculates the hashes of many files via SHA1, keeping the reads of
+ * several files in flight at once
+ *
+ * @param paths files to hash
+ * @param hash_cache optional cache of earlier hashes, unchanged files are
+ * then not read again
+ * @return the hashes in the order of paths
+ ****************************************************************************/
+std::vector<std::string> hash_files(const std::vector<ghc::filesystem::path> &paths,
+    const std::shared_ptr<FileHashCache> &hash_cache = std::shared_ptr<FileHashCache>());
 
 /*! **************************************************************************
  * @brief calculates a hash from a given string via SHA1
@@ -94,6 +113,17 @@ bool file_exists( const std::string &Filename );
  */
 std::string read_token(const ghc::filesystem::path &token_path);
 
+/**
+ * @brief write a file such that other processes only ever see it complete,
+ * the contents go to a uniquely named temporary file which is flushed to
+ * disk and then renamed into place
+ * 
+ * @param path file to write, replaced if it exists
+ * @param contents 
+ * @return true if the file was written
+ */
+bool write_file_atomically(const ghc::filesystem::path &path, const std::string &contents);
+
 }; // namespace FairDataPipeline
 
 #endif
\ No newline at end of file
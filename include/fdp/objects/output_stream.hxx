@@ -0,0 +1,102 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/objects/output_stream.hxx
+ * @brief File containing a buffered output file which hashes its contents
+ * as they are written
+ *
+ * Outputs written through a path from link_write are read back in full by
+ * finalise to obtain their hash. An OutputStream computes the SHA1 of the
+ * data as it passes through so the file is only ever written, never re-read.
+ ****************************************************************************/
+#ifndef __FDP_OUTPUT_STREAM_HXX__
+#define __FDP_OUTPUT_STREAM_HXX__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include <ghc/filesystem.hpp>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class OutputStream
+ * @brief an std::ostream writing to a file through its own buffer, hashing
+ * each block of data as it is flushed
+ *
+ * The hash is complete once the stream has been closed, either explicitly
+ * or on destruction. Large writes bypass the buffer and go straight to the
+ * file. The file must not be modified by other means after it is closed
+ * as the recorded hash would no longer match its contents.
+ ****************************************************************************/
+class OutputStream : public std::ostream {
+public:
+  typedef std::shared_ptr< OutputStream > sptr;
+
+  /**
+   * @brief hash of a stream's contents, shared with the IOObject of the
+   * output so that it outlives the stream
+   */
+  struct Digest {
+    Digest() : closed( false ), size( 0 ) {}
+
+    mutable std::mutex mutex;
+    bool closed;       /*!< the stream has been closed and hash is complete */
+    std::string hash;  /*!< SHA1 of the contents as a hex string */
+    std::uint64_t size; /*!< number of bytes written */
+  };
+
+  /**
+   * @brief open a file for writing, truncating it if it exists
+   *
+   * @param path file to write
+   * @param buffer_size bytes held before they are hashed and written
+   * @return OutputStream::sptr
+   */
+  static sptr construct( const ghc::filesystem::path& path,
+                         std::size_t buffer_size = 256 * 1024 );
+
+  ~OutputStream();
+
+  /**
+   * @brief flush any buffered data, close the file and complete the hash
+   */
+  void close();
+
+  /**
+   * @brief whether the stream is still open for writing
+   *
+   * @return true if close() has not been called
+   */
+  bool is_open() const;
+
+  /**
+   * @brief path of the file being written
+   *
+   * @return ghc::filesystem::path
+   */
+  ghc::filesystem::path get_path() const { return path_; }
+
+  /**
+   * @brief the digest recording the hash once the stream is closed
+   *
+   * @return std::shared_ptr< const Digest >
+   */
+  std::shared_ptr< const Digest > get_digest() const { return digest_; }
+
+private:
+  class Buffer;
+
+  OutputStream( const ghc::filesystem::path& path, std::size_t buffer_size );
+  OutputStream( const OutputStream& ) = delete;
+  OutputStream& operator=( const OutputStream& ) = delete;
+
+  ghc::filesystem::path path_;
+  std::unique_ptr< Buffer > buffer_;
+  std::shared_ptr< Digest > digest_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -11,8 +11,12 @@
 #ifndef __FDP_API_HXX__
 #define __FDP_API_HXX__
 
+#include <atomic>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <curl/curl.h>
 #include <ghc/filesystem.hpp>
@@ -20,18 +24,25 @@
 
 #include "fdp/exceptions.hxx"
 #include "fdp/objects/api_object.hxx"
+#include "fdp/registry/curl_multi.hxx"
+#include "fdp/registry/curl_pool.hxx"
+#include "fdp/registry/disk_cache.hxx"
+#include "fdp/registry/response_cache.hxx"
+#include "fdp/registry/transport.hxx"
 #include "fdp/utilities/json.hxx"
+#include "fdp/utilities/metrics.hxx"
 
 namespace FairDataPipeline {
 /*! **************************************************************************
  * @enum RESTAPI
- * @brief selection of either local or remote pipeline running
+ * @brief selection of the registry a pipeline runs against
  * @author K. Zarebski (UKAEA) & R. Field
  *
  ****************************************************************************/
 enum class RESTAPI {
-  REMOTE, /*!< Run from remote registry */
-  LOCAL   /*!< Run from local registry */
+  REMOTE,  /*!< Run from remote registry */
+  LOCAL,   /*!< Run from local registry */
+  EMBEDDED /*!< Run from an in-process registry, see embedded_registry.hxx */
 };
 
 #if 0
@@ -55,12 +66,97 @@ size_t write_func_(void *ptr, size_t size, size_t nmemb, std::string *data);
  * @author K. Zarebski (UKAEA) & R. Field
  *
  * The API class has know specific knowledge about the RestAPI but rather
- * provides the interface for sending/receiving data as JSON strings
+ * provides the interface for sending/receiving data as JSON strings. All
+ * requests made by an instance are carried by its Transport, by default
+ * from a shared CurlPool so that consecutive requests reuse the same
+ * connection to the registry.
+ *
+ * Besides the blocking methods, requests can be issued asynchronously with
+ * get_async()/post_async()/patch_async(), which are serviced by a background
+ * thread, or grouped into a Batch which runs them concurrently on the calling
+ * thread. Both return futures holding the same value the blocking call would
+ * have returned, or the exception it would have thrown.
+ *
+ * Successful GET responses are kept in a ResponseCache according to its
+ * table policy, so repeated lookups of immutable registry entries are only
+ * fetched once. Writes to a table invalidate its cached query results.
+ * When a DiskCache is attached, blocking GETs to immutable tables, and POSTs
+ * to those of them which are unique on their fields (users, storage roots
+ * and locations, file types and namespaces), are also persisted there and
+ * reused by later processes.
  *****************************************************************************/
-class API {
+class API : public std::enable_shared_from_this< API > {
 public:
     typedef std::shared_ptr< API > sptr;
 
+  /*! *************************************************************************
+   * @class Batch
+   * @brief a group of requests executed concurrently through one CURLM loop
+   *
+   * Requests are queued by get()/post()/patch() and only sent when execute()
+   * is called, after which all of the returned futures are ready. At most
+   * max_in_flight requests are transferring at once.
+   ***************************************************************************/
+  class Batch {
+  public:
+    typedef std::shared_ptr< Batch > sptr;
+
+    /**
+     * @brief queue a GET request, see API::get_request
+     */
+    std::future<Json::Value> get(const std::string &addr_path,
+                                 long expected_response = 200,
+                                 std::string token = "");
+
+    /**
+     * @brief queue a GET request built from a JSON query, see
+     * API::get_by_json_query
+     */
+    std::future<Json::Value> get_by_json_query(const std::string &addr_path,
+                                               Json::Value &query_data,
+                                               long expected_response = 200,
+                                               std::string token = "");
+
+    /**
+     * @brief queue a POST request, see API::post
+     */
+    std::future<Json::Value> post(const std::string addr_path,
+                                  Json::Value &post_data,
+                                  const std::string &token,
+                                  long expected_response = 201);
+
+    /**
+     * @brief queue a PATCH request, see API::patch
+     */
+    std::future<Json::Value> patch(const std::string addr_path,
+                                   Json::Value &post_data,
+                                   const std::string &token,
+                                   long expected_response = 200);
+
+    /**
+     * @brief send all queued requests, returning once every one of them has
+     * completed
+     */
+    void execute();
+
+    /**
+     * @brief number of requests queued since the last execute()
+     *
+     * @return std::size_t
+     */
+    std::size_t size() const { return size_; }
+
+  private:
+    friend class API;
+    Batch(API::sptr api, std::size_t max_in_flight);
+    Batch(const Batch &) = delete;
+    Batch &operator=(const Batch &) = delete;
+
+    API::sptr api_;
+    RequestLoop::sptr multi_;
+    std::size_t size_;
+  };
+
   /*! *************************************************************************
    * @brief construct an API object using the given URL as the root
    * @author K. Zarebski (UKAEA)
@@ -69,6 +165,12 @@ public:
    ***************************************************************************/
     static sptr construct( const std::string& url_root );
 
+  /**
+   * @brief Destroy the API, stopping the background request thread,
+   * outstanding asynchronous requests fail with rest_apiquery_error
+   */
+    ~API();
+
 
   /**
    * @brief sends the given 'packet' of information to the RestAPI
@@ -99,6 +201,52 @@ public:
 
   Json::Value post_storage_root(Json::Value &post_data, const std::string &token);
 
+  /**
+   * @brief asynchronous form of get_request
+   *
+   * @return std::future<Json::Value> ready once the request has completed
+   */
+  std::future<Json::Value> get_async(const std::string &addr_path,
+                                     long expected_response = 200,
+                                     std::string token = "");
+
+  /**
+   * @brief asynchronous form of post, an existing entry (409) is fetched
+   * without blocking other requests
+   *
+   * @return std::future<Json::Value> ready once the request has completed
+   */
+  std::future<Json::Value> post_async(const std::string addr_path,
+                                      Json::Value &post_data,
+                                      const std::string &token,
+                                      long expected_response = 201);
+
+  /**
+   * @brief asynchronous form of patch
+   *
+   * @return std::future<Json::Value> ready once the request has completed
+   */
+  std::future<Json::Value> patch_async(const std::string addr_path,
+                                       Json::Value &post_data,
+                                       const std::string &token,
+                                       long expected_response = 200);
+
+  /**
+   * @brief create an empty batch of requests bound to this API
+   *
+   * @param max_in_flight maximum number of concurrent requests
+   * @return Batch::sptr
+   */
+  Batch::sptr batch(std::size_t max_in_flight = 8);
+
+  /**
+   * @brief Set the maximum number of concurrent requests made by the
+   * asynchronous methods, must be called before their first use
+   *
+   * @param max_in_flight 
+   */
+  void set_max_in_flight(std::size_t max_in_flight) { max_in_flight_ = max_in_flight; }
+
   Json::Value get_by_json_query(const std::string &addr_path,
                                   Json::Value &query_data,
                                   long expected_response = 200,
@@ -160,15 +308,130 @@ public:
    */
   static std::string remove_leading_forward_slash(std::string str);
 
+  /**
+   * @brief Get the pool of CURL handles used for requests by this instance
+   * 
+   * @return CurlPool::sptr 
+   */
+  CurlPool::sptr get_curl_pool() const { return curl_pool_; }
+
+  /**
+   * @brief Get the transport carrying the requests of this instance, a
+   * CurlTransport using get_curl_pool() unless replaced
+   * 
+   * @return Transport::sptr 
+   */
+  Transport::sptr get_transport() const { return transport_; }
+
+  /**
+   * @brief Replace the transport, e.g. to record or replay the requests,
+   * must be called before requests are made
+   * 
+   * @param transport 
+   */
+  void set_transport(Transport::sptr transport) { transport_ = transport; }
+
+  /**
+   * @brief Get the cache of GET responses used by this instance, e.g. to
+   * inspect its hit/miss counters or change the per table policy
+   * 
+   * @return ResponseCache::sptr 
+   */
+  ResponseCache::sptr get_response_cache() const { return response_cache_; }
+
+  /**
+   * @brief Replace the cache of GET responses, a cache constructed with a
+   * capacity of 0 disables caching
+   * 
+   * @param cache 
+   */
+  void set_response_cache(ResponseCache::sptr cache) { response_cache_ = cache; }
+
+  /**
+   * @brief Get the persistent cache used by this instance
+   * 
+   * @return DiskCache::sptr null if none is attached
+   */
+  DiskCache::sptr get_disk_cache() const { return disk_cache_; }
+
+  /**
+   * @brief Attach a persistent cache, must be called before requests are
+   * made
+   * 
+   * @param cache cache to use, null to detach
+   */
+  void set_disk_cache(DiskCache::sptr cache) { disk_cache_ = cache; }
+
+  /**
+   * @brief Get the metrics updated by this instance: requests, bytes and
+   * durations per table, 409 fallbacks and cache hits
+   * 
+   * @return Metrics::sptr 
+   */
+  Metrics::sptr get_metrics() const { return metrics_; }
+
+  /**
+   * @brief Record metrics into a shared registry, must be called before
+   * requests are made
+   * 
+   * @param metrics 
+   */
+  void set_metrics(Metrics::sptr metrics);
+
 private:
-  API( const std::string& url_root)
-      : url_root_(API::append_with_forward_slash(url_root)) {}
+  typedef std::shared_ptr< std::promise<Json::Value> > promise_sptr;
+
+  API( const std::string& url_root);
+  API( const API& ) = delete;
+  API& operator=( const API& ) = delete;
 
   std::string url_root_;
-  CURL *setup_json_session_(std::string &addr_path, std::string *response,
-                            long &http_code, std::string token = "");
-  CURL *setup_download_session_(const ghc::filesystem::path &addr_path,
-                                FILE *file);  
+  CurlPool::sptr curl_pool_;
+  ResponseCache::sptr response_cache_;
+  DiskCache::sptr disk_cache_;
+  Metrics::sptr metrics_;
+  Transport::sptr transport_;
+
+  std::size_t max_in_flight_;
+  std::once_flag dispatcher_once_;
+  RequestLoop::sptr dispatcher_multi_;
+  std::atomic<bool> dispatcher_running_;
+  std::thread dispatcher_thread_;
+
+  RequestLoop::sptr dispatcher_();
+
+  HttpRequest make_get_request_(const std::string &addr_path,
+                                const std::string &token) const;
+  HttpRequest make_post_request_(const std::string &addr_path,
+                                 Json::Value &post_data,
+                                 const std::string &token, bool PATCH) const;
+  HttpResponse perform_(const HttpRequest &request, const std::string &table);
+  static void record_request_(Metrics &metrics, const std::string &table,
+                              const HttpRequest &request,
+                              const HttpResponse &response);
+
+  static Json::Value parse_json_response_(const std::string &context,
+                                          const HttpResponse &response);
+  static Json::Value handle_get_response_(const HttpRequest &request,
+                                          const HttpResponse &response,
+                                          long expected_response);
+  bool persistent_(const std::string &table) const;
+  static void invalidate_cache_(ResponseCache &cache, const std::string &addr_path,
+                                long http_code, bool PATCH);
+  static bool entry_exists_(const std::string &addr_path,
+                            const HttpRequest &request,
+                            const HttpResponse &response,
+                            long expected_response);
+
+  void submit_get_(RequestLoop &multi, const std::string &addr_path,
+                   long expected_response, const std::string &token,
+                   promise_sptr promise);
+  void submit_post_(RequestLoop &multi, const std::string &addr_path,
+                    Json::Value &post_data, const std::string &token,
+                    long expected_response, bool PATCH, promise_sptr promise);
+
+  void setup_download_session_(const ghc::filesystem::path &addr_path,
+                               FILE *file);  
                       
   Json::Value post_patch_request(const std::string addr_path, Json::Value &post_data,
                       const std::string &token, long expected_response, bool PATCH = false);
@@ -0,0 +1,161 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/cassette.hxx
+ * @brief File containing transports recording registry traffic to a file
+ * and replaying it
+ *
+ * A cassette holds the requests and responses of one or more runs, one JSON
+ * object per line, without API tokens. Replaying it serves a DataPipeline
+ * run without a registry, optionally taking as long as the recorded
+ * requests did, so that runs and benchmarks can be repeated offline.
+ * Recording is enabled by setting FDP_REGISTRY_RECORD to the file to
+ * write, replay by setting FDP_REGISTRY_REPLAY to a recorded file.
+ ****************************************************************************/
+#ifndef __FDP_CASSETTE_HXX__
+#define __FDP_CASSETTE_HXX__
+
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ghc/filesystem.hpp>
+
+#include "fdp/registry/transport.hxx"
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class RecordingTransport
+ * @brief passes requests to another transport, appending each request and
+ * its response to a cassette
+ *
+ * Entries are written as their responses arrive, so the cassette of a run
+ * which fails part way is still usable.
+ ****************************************************************************/
+class RecordingTransport : public Transport,
+                           public std::enable_shared_from_this< RecordingTransport > {
+public:
+  typedef std::shared_ptr< RecordingTransport > sptr;
+
+  /**
+   * @brief start a new cassette
+   *
+   * @param transport the transport performing the requests
+   * @param path file receiving the cassette, replaced if it exists
+   * @param url_root root of the registry, stored so that the cassette can be
+   * replayed under another root
+   * @throws write_error if the file cannot be created
+   * @return RecordingTransport::sptr
+   */
+  static sptr construct( Transport::sptr transport, const ghc::filesystem::path& path,
+                         const std::string& url_root );
+
+  HttpResponse perform( const HttpRequest& request );
+  RequestLoop::sptr loop( std::size_t max_in_flight );
+
+  /**
+   * @brief number of requests recorded
+   */
+  std::size_t size() const;
+
+private:
+  class Loop;
+
+  RecordingTransport( Transport::sptr transport, const ghc::filesystem::path& path,
+                      const std::string& url_root );
+  RecordingTransport( const RecordingTransport& ) = delete;
+  RecordingTransport& operator=( const RecordingTransport& ) = delete;
+
+  void record_( const HttpRequest& request, const HttpResponse& response );
+
+  Transport::sptr transport_;
+  ghc::filesystem::path path_;
+
+  mutable std::mutex mutex_;
+  std::ofstream out_;
+  std::size_t size_;
+};
+
+/*! **************************************************************************
+ * @class ReplayTransport
+ * @brief serves requests from a cassette
+ *
+ * A request is answered by the next unused recording of the same method,
+ * URL and body, or failing that of the same method and URL, as bodies such
+ * as that registering a code run hold the time of the run. Once every
+ * matching recording has been used the last one is repeated. A request
+ * which was never recorded fails as if the registry could not be reached.
+ ****************************************************************************/
+class ReplayTransport : public Transport,
+                        public std::enable_shared_from_this< ReplayTransport > {
+public:
+  typedef std::shared_ptr< ReplayTransport > sptr;
+
+  /**
+   * @brief load a cassette
+   *
+   * @param path cassette written by a RecordingTransport
+   * @param url_root root of the registry the requests are sent to, which
+   * replaces the recorded root in URLs and bodies
+   * @param timing whether each request takes as long as it did when it was
+   * recorded, otherwise responses are immediate
+   * @throws json_parse_error if the file is not a cassette
+   * @return ReplayTransport::sptr
+   */
+  static sptr construct( const ghc::filesystem::path& path, const std::string& url_root,
+                         bool timing = false );
+
+  HttpResponse perform( const HttpRequest& request );
+  RequestLoop::sptr loop( std::size_t max_in_flight );
+
+  /**
+   * @brief number of recordings in the cassette
+   */
+  std::size_t size() const { return entries_.size(); }
+
+  /**
+   * @brief number of requests which had no recording
+   */
+  std::size_t misses() const;
+
+  bool timing() const { return timing_; }
+
+private:
+  class Loop;
+
+  struct Entry {
+    Entry() : used( false ) {}
+
+    HttpResponse response;
+    bool used;
+  };
+
+  // Recordings of one request in order, next is the first which may be unused
+  struct Matches {
+    Matches() : next( 0 ) {}
+
+    std::vector< std::size_t > entries;
+    std::size_t next;
+  };
+
+  ReplayTransport( const ghc::filesystem::path& path, const std::string& url_root, bool timing );
+  ReplayTransport( const ReplayTransport& ) = delete;
+  ReplayTransport& operator=( const ReplayTransport& ) = delete;
+
+  HttpResponse lookup_( const HttpRequest& request );
+  bool take_( std::map< std::string, Matches >& index, const std::string& key, HttpResponse& response );
+
+  bool timing_;
+  std::vector< Entry > entries_;
+
+  mutable std::mutex mutex_;
+  std::map< std::string, Matches > exact_;
+  std::map< std::string, Matches > by_url_;
+  std::size_t misses_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
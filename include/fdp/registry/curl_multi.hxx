@@ -0,0 +1,145 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/curl_multi.hxx
+ * @brief File containing the libcurl transport and multi loop
+ *
+ * The CurlMulti class drives many registry requests at once through a single
+ * CURLM handle, using easy handles taken from a CurlPool, so that independent
+ * requests overlap their network latency instead of being serialised.
+ * CurlTransport sends requests through them and is the default Transport.
+ ****************************************************************************/
+#ifndef __FDP_CURL_MULTI_HXX__
+#define __FDP_CURL_MULTI_HXX__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "fdp/registry/curl_pool.hxx"
+#include "fdp/registry/transport.hxx"
+
+namespace FairDataPipeline {
+/**
+ * @brief fill in the outcome of a completed transfer
+ *
+ * @param curl handle which performed the request
+ * @param result result of the transfer
+ * @param response receives the result, HTTP code and transfer time
+ */
+void complete_transfer( CURL* curl, CURLcode result, HttpResponse* response );
+
+/**
+ * @brief apply the options for a request to an easy handle
+ *
+ * @param curl handle obtained from a CurlPool
+ * @param request the request to perform
+ * @param response response whose body will receive the transferred data
+ * @return curl_slist* header list which must be freed once the transfer
+ * has completed
+ */
+curl_slist* setup_transfer( CURL* curl, const HttpRequest& request,
+                            HttpResponse* response );
+
+/**
+ * @brief record a completed transfer and its DNS, connect, TLS, wait and
+ * receive phases, from curl's timings, in the trace
+ *
+ * @param curl handle which performed the request
+ * @param request the request
+ * @param response its response
+ * @param start_ns trace::now_ns() when the request was made
+ * @param async_id trace track of the transfer, 0 for the calling thread,
+ * time before curl started a transfer on a track is shown as queued
+ */
+void trace_transfer( CURL* curl, const HttpRequest& request, const HttpResponse& response,
+                     std::uint64_t start_ns, std::uint64_t async_id );
+
+/*! **************************************************************************
+ * @class CurlMulti
+ * @brief runs queued HttpRequests concurrently through one CURLM handle
+ *
+ * At most max_in_flight requests are transferring at any one time.
+ ****************************************************************************/
+class CurlMulti : public RequestLoop {
+public:
+  typedef std::shared_ptr< CurlMulti > sptr;
+
+  /**
+   * @brief construct a new multi loop
+   *
+   * @param pool pool providing the easy handles
+   * @param max_in_flight maximum number of concurrent transfers
+   * @return CurlMulti::sptr
+   */
+  static sptr construct( CurlPool::sptr pool, std::size_t max_in_flight = 8 );
+
+  /**
+   * @brief Destroy the multi loop, requests which have not completed are
+   * finished with a CURLE_ABORTED_BY_CALLBACK result
+   */
+  ~CurlMulti();
+
+  void add( const HttpRequest& request, callback_type on_done );
+  void run();
+  bool perform_once( int timeout_ms );
+  void wait( int timeout_ms );
+  void wakeup();
+  std::size_t max_in_flight() const { return max_in_flight_; }
+
+private:
+  struct Transfer;
+
+  CurlMulti( CurlPool::sptr pool, std::size_t max_in_flight );
+  CurlMulti( const CurlMulti& ) = delete;
+  CurlMulti& operator=( const CurlMulti& ) = delete;
+
+  void start_pending_();
+  void finish_( Transfer* transfer, CURLcode result );
+  bool has_work_();
+
+  CurlPool::sptr pool_;
+  CURLM* multi_;
+  std::size_t max_in_flight_;
+  std::size_t in_flight_;
+  std::vector< Transfer* > active_;
+
+  std::mutex pending_mutex_;
+  std::deque< Transfer* > pending_;
+};
+
+/*! **************************************************************************
+ * @class CurlTransport
+ * @brief sends requests with libcurl, using handles from a CurlPool
+ ****************************************************************************/
+class CurlTransport : public Transport {
+public:
+  typedef std::shared_ptr< CurlTransport > sptr;
+
+  /**
+   * @brief construct a transport sharing the connections of a pool
+   *
+   * @param pool
+   * @return CurlTransport::sptr
+   */
+  static sptr construct( CurlPool::sptr pool );
+
+  HttpResponse perform( const HttpRequest& request );
+  RequestLoop::sptr loop( std::size_t max_in_flight );
+
+  CurlPool::sptr get_curl_pool() const { return pool_; }
+
+private:
+  explicit CurlTransport( CurlPool::sptr pool ) : pool_( pool ) {}
+
+  CurlPool::sptr pool_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,127 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/curl_pool.hxx
+ * @brief File containing a pool of reusable libcurl handles
+ *
+ * The pool keeps finished CURL easy handles alive between requests and
+ * attaches them all to a single CURLSH share so that the DNS cache, the
+ * connection cache and TLS sessions are reused for every request an API
+ * instance makes to the registry. A pool may instead connect through a Unix
+ * domain socket, as to a local registry served on one.
+ ****************************************************************************/
+#ifndef __FDP_CURL_POOL_HXX__
+#define __FDP_CURL_POOL_HXX__
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class CurlPool
+ * @brief a thread safe pool of CURL easy handles sharing one connection cache
+ *
+ * Handles returned by acquire() have had the options common to all registry
+ * requests applied (TLS version, keep-alive, share) and should be given back
+ * with release() once the transfer has completed, where they are reset and
+ * parked for the next request. The CurlPool::Handle class does this
+ * automatically.
+ ****************************************************************************/
+class CurlPool {
+public:
+  typedef std::shared_ptr< CurlPool > sptr;
+
+  /**
+   * @brief RAII wrapper which acquires a handle from a pool and returns it
+   * on destruction
+   */
+  class Handle {
+  public:
+    explicit Handle( CurlPool::sptr pool )
+        : pool_( pool ), curl_( pool->acquire() ) {}
+    ~Handle() { pool_->release( curl_ ); }
+
+    CURL* get() const { return curl_; }
+
+  private:
+    Handle( const Handle& ) = delete;
+    Handle& operator=( const Handle& ) = delete;
+
+    CurlPool::sptr pool_;
+    CURL* curl_;
+  };
+
+  /**
+   * @brief construct a new pool
+   *
+   * @param max_idle maximum number of finished handles kept for reuse,
+   * handles released beyond this are cleaned up
+   * @param unix_socket path of a Unix domain socket every request connects
+   * through whatever the host of its URL, or empty to connect over TCP
+   * @throws std::runtime_error if libcurl does not support Unix sockets
+   * @return CurlPool::sptr
+   */
+  static sptr construct( std::size_t max_idle = 8, const std::string& unix_socket = "" );
+
+  ~CurlPool();
+
+  /**
+   * @brief take a handle from the pool, creating one if none are idle
+   *
+   * @return CURL* handle with the common session options applied
+   */
+  CURL* acquire();
+
+  /**
+   * @brief return a handle to the pool once its transfer has finished
+   *
+   * @param curl handle previously obtained from acquire()
+   */
+  void release( CURL* curl );
+
+  /**
+   * @brief number of handles currently parked in the pool
+   *
+   * @return std::size_t
+   */
+  std::size_t idle_count() const;
+
+  /**
+   * @brief number of easy handles created by the pool since construction
+   *
+   * @return std::size_t
+   */
+  std::size_t created_count() const;
+
+  /**
+   * @brief Unix domain socket connected through, empty for TCP
+   */
+  const std::string& unix_socket() const { return unix_socket_; }
+
+private:
+  CurlPool( std::size_t max_idle, const std::string& unix_socket );
+  CurlPool( const CurlPool& ) = delete;
+  CurlPool& operator=( const CurlPool& ) = delete;
+
+  void apply_defaults_( CURL* curl );
+
+  static void lock_share_( CURL* curl, curl_lock_data data,
+                           curl_lock_access access, void* userptr );
+  static void unlock_share_( CURL* curl, curl_lock_data data, void* userptr );
+
+  CURLSH* share_;
+  std::mutex share_locks_[ CURL_LOCK_DATA_LAST ];
+
+  mutable std::mutex idle_mutex_;
+  std::vector< CURL* > idle_;
+  std::size_t max_idle_;
+  std::size_t created_;
+  std::string unix_socket_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,107 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/disk_cache.hxx
+ * @brief File containing a persistent cache of immutable registry responses
+ *
+ * The same model is often run many times against the same registry, each run
+ * resolving the same user, author, storage roots, file types and input data
+ * products. The DiskCache persists these responses between processes so that
+ * a repeated run can start without asking the registry again.
+ ****************************************************************************/
+#ifndef __FDP_DISK_CACHE_HXX__
+#define __FDP_DISK_CACHE_HXX__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <ghc/filesystem.hpp>
+#include <json/value.h>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class DiskCache
+ * @brief a directory of JSON responses keyed on the request, shared by every
+ * process using the same registry
+ *
+ * Each entry is a separate file named by the SHA1 of its key (keys may
+ * contain the API token which is therefore never written to disk). Entries
+ * are written to a uniquely named temporary file which is then renamed into
+ * place, so readers in other processes only ever see complete entries and
+ * no locking is required. Only responses which can never change may be
+ * stored as entries are never revalidated.
+ ****************************************************************************/
+class DiskCache {
+public:
+  typedef std::shared_ptr< DiskCache > sptr;
+
+  /**
+   * @brief counters describing how effective the cache has been
+   */
+  struct Stats {
+    Stats() : hits( 0 ), misses( 0 ), writes( 0 ) {}
+
+    std::size_t hits;   /*!< entries read from disk */
+    std::size_t misses; /*!< lookups which found no entry */
+    std::size_t writes; /*!< entries written */
+  };
+
+  /**
+   * @brief open (creating if needed) the cache for a registry
+   *
+   * @param directory root directory of the cache
+   * @param registry_url URL of the registry, each registry has its own
+   * sub-directory as entries refer to registry ids
+   * @return DiskCache::sptr
+   */
+  static sptr construct( const ghc::filesystem::path& directory,
+                         const std::string& registry_url );
+
+  /**
+   * @brief read an entry
+   *
+   * @param key request key
+   * @param value receives the stored response
+   * @return true if the entry exists
+   */
+  bool load( const std::string& key, Json::Value& value );
+
+  /**
+   * @brief atomically write an entry, replacing any existing one
+   *
+   * @param key request key
+   * @param value response to store
+   */
+  void save( const std::string& key, const Json::Value& value );
+
+  /**
+   * @brief remove every entry for this registry, e.g. after the registry
+   * has been reset
+   */
+  void clear();
+
+  Stats get_stats() const;
+
+  /**
+   * @brief directory holding the entries for this registry
+   *
+   * @return ghc::filesystem::path
+   */
+  ghc::filesystem::path get_directory() const { return directory_; }
+
+private:
+  DiskCache( const ghc::filesystem::path& directory, const std::string& registry_url );
+  DiskCache( const DiskCache& ) = delete;
+  DiskCache& operator=( const DiskCache& ) = delete;
+
+  ghc::filesystem::path entry_path_( const std::string& key ) const;
+
+  ghc::filesystem::path directory_;
+  std::atomic< std::size_t > hits_;
+  std::atomic< std::size_t > misses_;
+  std::atomic< std::size_t > writes_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,164 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/embedded_registry.hxx
+ * @brief File containing an in-process registry answering API requests
+ * without HTTP
+ *
+ * The EmbeddedRegistry holds the registry tables used by Config in memory,
+ * with the registry's semantics for the requests the API sends: listings
+ * filtered by query string, retrieval by id, POST with the uniqueness
+ * constraints of the registry (409 on a duplicate) and PATCH. Tables may be
+ * kept in an append-only journal, shared by every process of a batch job,
+ * so that provenance can be registered at disk speed and synchronised with
+ * a registry later. It is selected by running with RESTAPI::EMBEDDED.
+ ****************************************************************************/
+#ifndef __FDP_EMBEDDED_REGISTRY_HXX__
+#define __FDP_EMBEDDED_REGISTRY_HXX__
+
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ghc/filesystem.hpp>
+#include <json/json.h>
+
+#include "fdp/registry/transport.hxx"
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class EmbeddedRegistry
+ * @brief registry tables answering HttpRequests in process
+ *
+ * A new registry is seeded with the admin user and its author, as created
+ * by "fair init". Every field is indexed by the values a query may give
+ * for it, so lookups do not slow down as tables grow. Every change is appended to the journal, if any, as the
+ * resulting entry. Before a change the entries appended by other processes
+ * are read under an exclusive lock of the journal so that ids stay
+ * consistent between processes. Locking between processes is not
+ * available on Windows.
+ ****************************************************************************/
+class EmbeddedRegistry {
+public:
+  typedef std::shared_ptr< EmbeddedRegistry > sptr;
+
+  /**
+   * @brief open a registry
+   *
+   * @param url_root root of the REST API under which entries are addressed,
+   * e.g. "http://127.0.0.1:8000/api/"
+   * @param path journal holding the tables, created if it does not exist,
+   * or empty to hold the tables in memory only
+   * @throws write_error if the journal cannot be opened
+   * @throws json_parse_error if the journal is not valid
+   * @return EmbeddedRegistry::sptr
+   */
+  static sptr construct( const std::string& url_root,
+                         const ghc::filesystem::path& path = ghc::filesystem::path() );
+
+  ~EmbeddedRegistry();
+
+  /**
+   * @brief answer a request as the registry would
+   *
+   * @param request request addressed below url_root()
+   * @return HttpResponse with a JSON body, 404 for an unknown address
+   */
+  HttpResponse handle( const HttpRequest& request );
+
+  /**
+   * @brief add an entry directly, as if it had been POSTed
+   *
+   * @param table registry table
+   * @param entry fields of the entry
+   * @return Json::Value the stored entry including its url
+   */
+  Json::Value insert( const std::string& table, const Json::Value& entry );
+
+  /**
+   * @brief number of entries currently held in a table
+   *
+   * @param table e.g. "object"
+   * @return std::size_t
+   */
+  std::size_t table_size( const std::string& table ) const;
+
+  const std::string& url_root() const { return url_root_; }
+  const ghc::filesystem::path& path() const { return path_; }
+
+private:
+  typedef std::vector< std::pair< std::string, std::string > > filter_type;
+
+  struct Table {
+    Table() : indexed( 0 ) {}
+
+    std::vector< Json::Value > rows; /*!< entry with id i is at i - 1 */
+    /** positions of the rows matching "<field>\n<value>" in ascending order */
+    std::map< std::string, std::vector< std::size_t > > index;
+    std::size_t indexed; /*!< rows before this are in the index */
+  };
+
+  EmbeddedRegistry( const std::string& url_root, const ghc::filesystem::path& path );
+  EmbeddedRegistry( const EmbeddedRegistry& ) = delete;
+  EmbeddedRegistry& operator=( const EmbeddedRegistry& ) = delete;
+
+  HttpResponse get_( const std::string& table, int id, const std::string& query );
+  HttpResponse post_( const std::string& table, const Json::Value& body );
+  HttpResponse patch_( const std::string& table, int id, const Json::Value& body );
+
+  Json::Value insert_( const std::string& table, const Json::Value& entry );
+  bool store_( const std::string& table, const Json::Value& row, bool defer_index = false );
+  static void index_row_( Table& table, std::size_t position, bool add );
+  const Json::Value* find_( const std::string& table, int id ) const;
+  std::vector< std::size_t > select_( const std::string& table, const filter_type& filters ) const;
+  void seed_();
+
+  // Journal access, mutex_ is held
+  void read_journal_();
+  void write_journal_( const std::string& table, const Json::Value& row );
+  void flush_journal_();
+  bool journal_grown_() const;
+
+  std::string url_root_;
+  ghc::filesystem::path path_;
+
+  mutable std::mutex mutex_;
+  std::map< std::string, Table > tables_;
+  std::FILE* journal_;
+  long journal_offset_;
+  std::string journal_root_;
+};
+
+/*! **************************************************************************
+ * @class EmbeddedTransport
+ * @brief carries requests to an EmbeddedRegistry on the calling thread
+ *
+ * Requests added to a loop are answered when the loop is next driven.
+ ****************************************************************************/
+class EmbeddedTransport : public Transport,
+                          public std::enable_shared_from_this< EmbeddedTransport > {
+public:
+  typedef std::shared_ptr< EmbeddedTransport > sptr;
+
+  static sptr construct( EmbeddedRegistry::sptr registry );
+
+  HttpResponse perform( const HttpRequest& request );
+  RequestLoop::sptr loop( std::size_t max_in_flight );
+
+  EmbeddedRegistry::sptr registry() const { return registry_; }
+
+private:
+  class Loop;
+
+  explicit EmbeddedTransport( EmbeddedRegistry::sptr registry );
+  EmbeddedTransport( const EmbeddedTransport& ) = delete;
+  EmbeddedTransport& operator=( const EmbeddedTransport& ) = delete;
+
+  EmbeddedRegistry::sptr registry_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,136 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/registry_journal.hxx
+ * @brief File containing a write-ahead journal of the registry changes made
+ * by finalise
+ *
+ * With a journal, finalise records the entries it intends to register, and
+ * the code run update, in a file next to the data store before moving any
+ * output. The registry is then updated from the journal, either straight
+ * away or by a later run, and each change is marked as applied in the
+ * journal as it completes. An update interrupted by a failing registry or
+ * by the end of the process is resumed from the first change not yet
+ * applied rather than by running the job again.
+ ****************************************************************************/
+#ifndef __FDP_REGISTRY_JOURNAL_HXX__
+#define __FDP_REGISTRY_JOURNAL_HXX__
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ghc/filesystem.hpp>
+#include <json/json.h>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class RegistryJournal
+ * @brief an append-only file of intended registry changes and of the
+ * progress made applying them
+ *
+ * The file holds one JSON object per line: a header, the entries, a commit
+ * line once every entry has been written and a progress line for each step
+ * applied. Entries are synced to disk together by commit(), progress is
+ * only flushed as applying a change twice has the same effect. Progress on
+ * different entries may be recorded from several threads. A journal is
+ * locked for as long as it is open so that two processes never apply it at
+ * the same time. Locking between processes is not available on Windows.
+ ****************************************************************************/
+class RegistryJournal {
+public:
+  typedef std::shared_ptr< RegistryJournal > sptr;
+
+  /**
+   * @brief start a new journal
+   *
+   * @param path file receiving the journal, which must not exist
+   * @throws write_error if the file cannot be created
+   * @return RegistryJournal::sptr
+   */
+  static sptr create( const ghc::filesystem::path& path );
+
+  /**
+   * @brief open an existing journal to apply it
+   *
+   * @param path journal written by a RegistryJournal
+   * @throws json_parse_error if the file is not a journal
+   * @return RegistryJournal::sptr, empty if another process has it open
+   */
+  static sptr open( const ghc::filesystem::path& path );
+
+  /**
+   * @brief the pending journals in a directory, oldest first
+   *
+   * @param directory
+   * @return std::vector<ghc::filesystem::path>
+   */
+  static std::vector< ghc::filesystem::path > list( const ghc::filesystem::path& directory );
+
+  ~RegistryJournal();
+
+  /**
+   * @brief append an entry, written to disk by the next commit()
+   *
+   * @param entry change to apply, with an "op" naming it
+   * @return std::size_t the position of the entry
+   */
+  std::size_t append( const Json::Value& entry );
+
+  /**
+   * @brief mark every entry as written and sync the journal to disk
+   *
+   * @throws write_error if the journal cannot be written
+   */
+  void commit();
+
+  /**
+   * @brief record progress in applying an entry
+   *
+   * @param entry position of the entry
+   * @param result values for later steps of the entry, merged with those
+   * already recorded
+   * @param done whether the entry has been applied
+   * @throws write_error if the journal cannot be written
+   */
+  void record( std::size_t entry, const Json::Value& result, bool done );
+
+  /**
+   * @brief close and delete the journal once it has been applied
+   */
+  void remove();
+
+  /**
+   * @brief close the journal and set it aside as <path>.rejected, for a
+   * journal the registry will not accept, so that it is no longer replayed
+   */
+  void reject();
+
+  const ghc::filesystem::path& path() const { return path_; }
+  bool committed() const { return committed_; }
+  std::size_t size() const { return entries_.size(); }
+  const Json::Value& entry( std::size_t i ) const { return entries_[i]; }
+  const Json::Value& result( std::size_t i ) const { return results_[i]; }
+  bool done( std::size_t i ) const { return done_[i] != 0; }
+
+private:
+  RegistryJournal( const ghc::filesystem::path& path, std::FILE* file );
+  RegistryJournal( const RegistryJournal& ) = delete;
+  RegistryJournal& operator=( const RegistryJournal& ) = delete;
+
+  void read_();
+  void write_( const Json::Value& line );
+
+  ghc::filesystem::path path_;
+  std::mutex mutex_;
+  std::FILE* file_;
+  bool committed_;
+  std::vector< Json::Value > entries_;
+  std::vector< Json::Value > results_;
+  std::vector< char > done_; /*!< not vector<bool>, entries are marked from several threads */
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,199 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/response_cache.hxx
+ * @brief File containing a bounded cache of registry GET responses
+ *
+ * Much of what the pipeline reads from the registry (namespaces, storage
+ * roots, file types, authors...) never changes once created. The
+ * ResponseCache keeps recent responses in memory so that repeated lookups
+ * of the same entry during a run do not each cost a round trip.
+ ****************************************************************************/
+#ifndef __FDP_RESPONSE_CACHE_HXX__
+#define __FDP_RESPONSE_CACHE_HXX__
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <json/value.h>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class ResponseCache
+ * @brief a thread safe least recently used cache of JSON responses with a
+ * per table expiry policy and single-flight fetching
+ *
+ * Entries are keyed on the normalised request and the token it was made
+ * with. Each registry table has a time to live: zero means responses from
+ * that table are never cached, ResponseCache::immutable() means they never
+ * expire. Empty query results are not cached so that an entry created later
+ * in the run is found.
+ *
+ * Concurrent get() calls for the same key are coalesced so that only one of
+ * them goes to the registry, the others wait for and share its result.
+ ****************************************************************************/
+class ResponseCache {
+public:
+  typedef std::shared_ptr< ResponseCache > sptr;
+  typedef std::function< Json::Value() > fetch_type;
+  typedef std::chrono::milliseconds ttl_type;
+
+  /**
+   * @brief counters describing how effective the cache has been
+   */
+  struct Stats {
+    Stats() : hits( 0 ), misses( 0 ), coalesced( 0 ), evictions( 0 ) {}
+
+    std::size_t hits;      /*!< requests answered from the cache */
+    std::size_t misses;    /*!< cacheable requests sent to the registry */
+    std::size_t coalesced; /*!< requests which waited on an identical one in flight */
+    std::size_t evictions; /*!< entries dropped to stay within capacity */
+  };
+
+  /**
+   * @brief construct a new cache with the default table policy, tables
+   * whose entries are never modified by the pipeline are immutable and all
+   * others are not cached
+   *
+   * @param capacity maximum number of responses held, 0 disables the cache
+   * @return ResponseCache::sptr
+   */
+  static sptr construct( std::size_t capacity = 1024 );
+
+  /**
+   * @brief time to live marking a table's responses as never expiring
+   */
+  static ttl_type immutable() { return ttl_type::max(); }
+
+  /**
+   * @brief Set how long responses from a table remain valid
+   *
+   * @param table registry table e.g. "namespace"
+   * @param ttl time to live, 0 to disable caching of the table
+   */
+  void set_ttl( const std::string& table, ttl_type ttl );
+
+  /**
+   * @brief Get how long responses from a table remain valid
+   *
+   * @param table registry table
+   * @return ttl_type
+   */
+  ttl_type get_ttl( const std::string& table ) const;
+
+  /**
+   * @brief return the cached response for key, otherwise obtain it with
+   * fetch, sharing the result with any concurrent callers for the same key
+   *
+   * @param key normalised request key, see make_key()
+   * @param table registry table the request is made to
+   * @param fetch function performing the request, exceptions it throws are
+   * rethrown to every waiting caller and nothing is cached
+   * @return Json::Value
+   */
+  Json::Value get( const std::string& key, const std::string& table, fetch_type fetch );
+
+  /**
+   * @brief look up a response without fetching it, counting a hit or miss
+   * for cacheable tables
+   *
+   * @param key normalised request key
+   * @param table registry table
+   * @param value receives the cached response if found
+   * @return true if the response was cached
+   */
+  bool lookup( const std::string& key, const std::string& table, Json::Value& value );
+
+  /**
+   * @brief store a response obtained outside of get()
+   *
+   * @param key normalised request key
+   * @param table registry table
+   * @param value the response
+   */
+  void store( const std::string& key, const std::string& table, const Json::Value& value );
+
+  /**
+   * @brief drop every cached response from a table, used when the table has
+   * been written to
+   *
+   * @param table registry table
+   */
+  void invalidate( const std::string& table );
+
+  /**
+   * @brief drop the cached query results from a table but keep entries
+   * fetched by id, used when an entry has been added to the table
+   *
+   * @param table registry table
+   */
+  void invalidate_queries( const std::string& table );
+
+  /**
+   * @brief drop every cached response
+   */
+  void clear();
+
+  Stats get_stats() const;
+  std::size_t size() const;
+  std::size_t capacity() const { return capacity_; }
+
+  /**
+   * @brief build the cache key for a request, the query parameters are
+   * sorted and separators normalised so equivalent requests share an entry
+   *
+   * @param addr_path request path relative to the API root, e.g.
+   * "namespace/?name=PSU&"
+   * @param token registry API token
+   * @return std::string
+   */
+  static std::string make_key( const std::string& addr_path, const std::string& token );
+
+  /**
+   * @brief the registry table a request path refers to
+   *
+   * @param addr_path request path relative to the API root
+   * @return std::string e.g. "namespace"
+   */
+  static std::string table_of( const std::string& addr_path );
+
+private:
+  typedef std::chrono::steady_clock clock_type;
+
+  struct Entry {
+    std::string key;
+    std::string table;
+    Json::Value value;
+    clock_type::time_point expires;
+    bool never_expires;
+  };
+  typedef std::list< Entry > list_type;
+
+  explicit ResponseCache( std::size_t capacity );
+  ResponseCache( const ResponseCache& ) = delete;
+  ResponseCache& operator=( const ResponseCache& ) = delete;
+
+  bool cacheable_( const std::string& table ) const;
+  void erase_if_( const std::string& table, bool queries_only );
+  bool find_( const std::string& key, Json::Value& value );
+  void store_( const std::string& key, const std::string& table, const Json::Value& value );
+
+  const std::size_t capacity_;
+
+  mutable std::mutex mutex_;
+  std::map< std::string, ttl_type > ttl_;
+  list_type entries_; /*!< most recently used first */
+  std::unordered_map< std::string, list_type::iterator > index_;
+  std::unordered_map< std::string, std::shared_future< Json::Value > > in_flight_;
+  Stats stats_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
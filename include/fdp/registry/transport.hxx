@@ -0,0 +1,136 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/registry/transport.hxx
+ * @brief File containing the interface through which the API sends requests
+ *
+ * The API builds HttpRequests and interprets HttpResponses, a Transport
+ * carries them to the registry. CurlTransport, the default, sends them with
+ * libcurl while RecordingTransport and ReplayTransport (cassette.hxx) save
+ * and serve them from a file so that runs can be repeated offline.
+ ****************************************************************************/
+#ifndef __FDP_TRANSPORT_HXX__
+#define __FDP_TRANSPORT_HXX__
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <curl/curl.h>
+
+namespace FairDataPipeline {
+/**
+ * @brief description of a single HTTP request to the registry
+ */
+struct HttpRequest {
+  enum Method { GET, POST, PATCH };
+
+  HttpRequest() : method( GET ) {}
+
+  Method method;
+  std::string url;
+  std::string body;  /*!< JSON payload for POST and PATCH */
+  std::string token; /*!< registry API token, may be empty */
+};
+
+/**
+ * @brief the outcome of an HttpRequest
+ */
+struct HttpResponse {
+  HttpResponse() : result( CURLE_OK ), http_code( 0 ), total_time( 0 ) {}
+
+  CURLcode result;  /*!< transfer result, http_code is 0 unless CURLE_OK */
+  long http_code;
+  std::string body;
+  double total_time; /*!< seconds spent on the transfer */
+};
+
+/**
+ * @brief name of a request method, e.g. "GET"
+ */
+const char* method_name( HttpRequest::Method method );
+
+/*! **************************************************************************
+ * @class RequestLoop
+ * @brief runs queued HttpRequests concurrently
+ *
+ * Requests may be added from any thread. Completion callbacks are invoked
+ * on the thread driving the loop (run() or perform_once()) and may
+ * themselves add further requests.
+ ****************************************************************************/
+class RequestLoop {
+public:
+  typedef std::shared_ptr< RequestLoop > sptr;
+  typedef std::function< void( HttpResponse& ) > callback_type;
+
+  virtual ~RequestLoop() {}
+
+  /**
+   * @brief queue a request
+   *
+   * @param request the request to perform
+   * @param on_done callback receiving the response once complete
+   */
+  virtual void add( const HttpRequest& request, callback_type on_done ) = 0;
+
+  /**
+   * @brief drive the loop until every queued request has completed
+   */
+  virtual void run() = 0;
+
+  /**
+   * @brief start queued requests, progress those in flight and wait up to
+   * timeout_ms for activity or a wakeup()
+   *
+   * @param timeout_ms maximum time to wait
+   * @return true if requests remain queued or in flight
+   */
+  virtual bool perform_once( int timeout_ms ) = 0;
+
+  /**
+   * @brief block for up to timeout_ms or until add() or wakeup() is called,
+   * used by a thread servicing the loop while it has nothing to do
+   *
+   * @param timeout_ms maximum time to wait
+   */
+  virtual void wait( int timeout_ms ) = 0;
+
+  /**
+   * @brief interrupt a perform_once() or wait() waiting for activity
+   */
+  virtual void wakeup() = 0;
+
+  virtual std::size_t max_in_flight() const = 0;
+};
+
+/*! **************************************************************************
+ * @class Transport
+ * @brief carries registry requests, one at a time or through a RequestLoop
+ *
+ * Implementations must be safe to use from several threads.
+ ****************************************************************************/
+class Transport {
+public:
+  typedef std::shared_ptr< Transport > sptr;
+
+  virtual ~Transport() {}
+
+  /**
+   * @brief perform a request on the calling thread
+   *
+   * @param request
+   * @return HttpResponse
+   */
+  virtual HttpResponse perform( const HttpRequest& request ) = 0;
+
+  /**
+   * @brief create a loop running requests concurrently
+   *
+   * @param max_in_flight maximum number of concurrent requests
+   * @return RequestLoop::sptr
+   */
+  virtual RequestLoop::sptr loop( std::size_t max_in_flight ) = 0;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,118 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/utilities/batch_hasher.hxx
+ * @brief File containing a hasher for many files at once
+ *
+ * finalise hashes every output of a run. Hashing them one after another
+ * leaves the storage idle while each block is hashed and runs at the
+ * latency of a single stream. The BatchHasher keeps the reads of several
+ * files in flight at once, through io_uring on Linux and otherwise on a
+ * pool of threads.
+ ****************************************************************************/
+#ifndef __FDP_BATCH_HASHER_HXX__
+#define __FDP_BATCH_HASHER_HXX__
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <ghc/filesystem.hpp>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class BatchHasher
+ * @brief SHA1 of a list of files with the reads of several files in flight
+ *
+ * Files are shared between workers, one per CPU. With the IO_URING backend
+ * each worker reads up to max_files_in_flight files through its own ring,
+ * hashing the blocks of whichever file completes first. With the THREADS
+ * backend each worker hashes one file at a time and at least
+ * max_files_in_flight workers are used.
+ ****************************************************************************/
+class BatchHasher {
+public:
+  /**
+   * @brief how files are read
+   */
+  enum class Backend {
+    THREADS, /*!< blocking reads on a pool of threads */
+    IO_URING /*!< asynchronous reads through Linux io_uring */
+  };
+
+  /**
+   * @brief called with the index of a file in the list and either its hash
+   * or the error raised hashing it, possibly from several threads at once
+   */
+  typedef std::function< void( std::size_t, const std::string&, std::exception_ptr ) > callback_type;
+
+  /**
+   * @brief the fastest backend available, IO_URING where the kernel allows it
+   *
+   * @return Backend
+   */
+  static Backend best_backend();
+
+  /**
+   * @brief whether a backend can be used on this system
+   *
+   * @param backend
+   * @return true if supported
+   */
+  static bool is_supported( Backend backend );
+
+  /**
+   * @brief name of a backend for log output
+   *
+   * @param backend
+   * @return std::string e.g. "io_uring"
+   */
+  static std::string backend_name( Backend backend );
+
+  /**
+   * @brief Construct a new Batch Hasher
+   *
+   * @param backend how files are read, which must be supported
+   * @param max_files_in_flight files read at once by each io_uring worker,
+   * and the least number of workers with the thread pool
+   * @param block_size bytes per read
+   */
+  explicit BatchHasher( Backend backend = best_backend(), std::size_t max_files_in_flight = 4,
+                        std::size_t block_size = 512 * 1024 );
+
+  /**
+   * @brief hash every file, reporting each as soon as it is done
+   *
+   * @param paths files to hash
+   * @param on_hash receives each hash or error
+   * @param cancelled stops reporting further files once set
+   */
+  void hash( const std::vector< ghc::filesystem::path >& paths, const callback_type& on_hash,
+             const std::atomic< bool >* cancelled = nullptr ) const;
+
+  /**
+   * @brief hash every file
+   *
+   * @param paths files to hash
+   * @return std::vector<std::string> hashes in the order of paths
+   * @throws the error of the first file which could not be hashed
+   */
+  std::vector< std::string > hash( const std::vector< ghc::filesystem::path >& paths ) const;
+
+  Backend get_backend() const { return backend_; }
+
+private:
+  void hash_threads_( const std::vector< ghc::filesystem::path >& paths, const callback_type& on_hash,
+                      const std::atomic< bool >* cancelled, std::atomic< std::size_t >& next ) const;
+  void hash_io_uring_( const std::vector< ghc::filesystem::path >& paths, const callback_type& on_hash,
+                       const std::atomic< bool >* cancelled, std::atomic< std::size_t >& next ) const;
+
+  Backend backend_;
+  std::size_t max_files_in_flight_;
+  std::size_t block_size_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,166 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/utilities/binary_log.hxx
+ * @brief File containing a binary log sink and the reader decoding it
+ *
+ * Text logging formats a timestamp header and the full message for every
+ * line. The BinarySink instead writes each message as its raw timestamp,
+ * level, interned logger and format ids and the values of its arguments
+ * into memory mapped files, leaving the formatting to the decoder. The
+ * fdplog tool renders these files as text or JSON.
+ ****************************************************************************/
+#ifndef __FDP_BINARY_LOG_HXX__
+#define __FDP_BINARY_LOG_HXX__
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ghc/filesystem.hpp>
+
+#include "fdp/utilities/logging.hxx"
+
+namespace FairDataPipeline {
+namespace logging {
+
+/*! **************************************************************************
+ * @class BinarySink
+ * @brief structured sink writing compact binary records to a series of
+ * memory mapped files of a fixed size
+ *
+ * Files are named <prefix>.<sequence>.fdplog, a new one is started when a
+ * record does not fit and only the newest max_files are kept. Formats and
+ * logger names are written once per file, before their first use, so each
+ * file can be decoded on its own. A file cut short by a crash ends at its
+ * last complete record.
+ ****************************************************************************/
+class BinarySink : public Sink {
+public:
+  typedef std::shared_ptr< BinarySink > sptr;
+
+  /**
+   * @brief start writing a binary log
+   *
+   * @param lvl lowest level written
+   * @param prefix path of the files without the .<sequence>.fdplog suffix,
+   * existing files with this prefix are removed
+   * @param max_file_size size of each file in bytes
+   * @param max_files number of files kept
+   * @return sptr
+   */
+  static sptr create( enum LOG_LEVEL lvl, const ghc::filesystem::path& prefix,
+                      std::size_t max_file_size = 64 * 1024 * 1024, std::size_t max_files = 8 );
+
+  ~BinarySink();
+
+  bool structured() const { return true; }
+  int log_record( Logger* logger, const LogRecord& record );
+
+  /**
+   * @brief log preformatted text, recorded as a single string argument
+   */
+  int log( enum LOG_LEVEL msg_lvl, const std::string& s );
+
+  /**
+   * @brief ask the system to write the mapped pages to disk
+   */
+  void flush();
+
+  /**
+   * @brief the files currently kept, oldest first
+   */
+  std::vector< ghc::filesystem::path > get_files() const;
+
+private:
+  BinarySink( enum LOG_LEVEL lvl, const ghc::filesystem::path& prefix, std::size_t max_file_size,
+              std::size_t max_files );
+  BinarySink( const BinarySink& ) = delete;
+  BinarySink& operator=( const BinarySink& ) = delete;
+
+  ghc::filesystem::path file_path_( std::size_t sequence ) const;
+  void open_file_();
+  void close_file_();
+  void write_( const void* data, std::size_t size );
+  void write_string_( const std::string& s );
+  std::uint32_t intern_( std::map< std::string, std::uint32_t >& ids, std::vector< bool >& defined,
+                         const std::string& text );
+  int write_record_( const std::string& logger_name, const LogRecord& record );
+
+  ghc::filesystem::path prefix_;
+  std::size_t max_file_size_;
+  std::size_t max_files_;
+
+  mutable std::mutex mutex_;
+  std::size_t sequence_;
+  std::size_t first_sequence_;
+  std::size_t offset_;
+#ifdef _WIN32
+  std::ofstream file_;
+#else
+  int fd_;
+  char* map_;
+#endif
+
+  // Interned strings, and which of them the current file defines
+  std::map< std::string, std::uint32_t > format_ids_;
+  std::map< std::string, std::uint32_t > logger_ids_;
+  std::vector< bool > formats_defined_;
+  std::vector< bool > loggers_defined_;
+};
+
+/*! **************************************************************************
+ * @class BinaryLogReader
+ * @brief reads the messages of a file written by a BinarySink
+ ****************************************************************************/
+class BinaryLogReader {
+public:
+  /**
+   * @brief a decoded message
+   */
+  struct Entry {
+    std::uint64_t time_ns;   /*!< nanoseconds since the epoch */
+    enum LOG_LEVEL msg_lvl;
+    std::string logger;
+    LogRecord record;
+
+    /**
+     * @brief the message as a text log line
+     */
+    std::string to_text() const;
+
+    /**
+     * @brief the message as a single line JSON object
+     */
+    std::string to_json() const;
+  };
+
+  /**
+   * @brief open a file
+   *
+   * @param path a .fdplog file
+   * @throws std::runtime_error if it is not a binary log
+   */
+  explicit BinaryLogReader( const ghc::filesystem::path& path );
+
+  /**
+   * @brief read the next message
+   *
+   * @param entry receives the message
+   * @return false at the end of the file
+   */
+  bool next( Entry& entry );
+
+private:
+  std::vector< char > data_;
+  std::size_t offset_;
+  std::map< std::uint32_t, std::string > formats_;
+  std::map< std::uint32_t, std::string > loggers_;
+};
+
+} // namespace logging
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,123 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/utilities/file_hash_cache.hxx
+ * @brief File containing a persistent cache of file hashes
+ *
+ * The config file and submission script are hashed by every run even when
+ * they have not changed since the last one. The FileHashCache remembers the
+ * hash of a file along with its identity on disk so that an unchanged file
+ * costs a stat rather than a full read.
+ ****************************************************************************/
+#ifndef __FDP_FILE_HASH_CACHE_HXX__
+#define __FDP_FILE_HASH_CACHE_HXX__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ghc/filesystem.hpp>
+
+#include "fdp/utilities/batch_hasher.hxx"
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class FileHashCache
+ * @brief a directory of SHA1 hashes keyed on the device, inode, size,
+ * modification and status change times of the file they were computed from
+ *
+ * Any write to a file changes its modification time, and replacing it
+ * changes its inode, so a changed file is never matched to an old hash.
+ * Files modified within the last few seconds are not cached as a further
+ * write within the timestamp resolution of the filesystem would go
+ * unnoticed. Entries are written atomically so the cache may be shared by
+ * concurrent processes. On Windows the key is the absolute path, size and
+ * modification time.
+ ****************************************************************************/
+class FileHashCache {
+public:
+  typedef std::shared_ptr< FileHashCache > sptr;
+
+  /**
+   * @brief counters describing how effective the cache has been
+   */
+  struct Stats {
+    Stats() : hits( 0 ), misses( 0 ), writes( 0 ), skipped( 0 ) {}
+
+    std::size_t hits;    /*!< hashes read from the cache */
+    std::size_t misses;  /*!< files which had to be hashed */
+    std::size_t writes;  /*!< entries written */
+    std::size_t skipped; /*!< hashes not stored as the file was recently modified */
+  };
+
+  /**
+   * @brief open (creating if needed) a cache
+   *
+   * @param directory directory holding the entries
+   * @return FileHashCache::sptr
+   */
+  static sptr construct( const ghc::filesystem::path& directory );
+
+  /**
+   * @brief the SHA1 of a file, read from the cache if the file is unchanged
+   * and otherwise computed and stored
+   *
+   * @param path file to hash
+   * @return std::string
+   */
+  std::string hash_file( const ghc::filesystem::path& path );
+
+  /**
+   * @brief hash many files, reading only those not found in the cache
+   * through a BatchHasher
+   *
+   * @param paths files to hash
+   * @param hasher used for the files which are not cached
+   * @param on_hash receives each hash or error, cached ones first
+   * @param cancelled stops reporting further files once set
+   */
+  void hash_files( const std::vector< ghc::filesystem::path >& paths, const BatchHasher& hasher,
+                   const BatchHasher::callback_type& on_hash,
+                   const std::atomic< bool >* cancelled = nullptr );
+
+  /**
+   * @brief remove every entry
+   */
+  void clear();
+
+  Stats get_stats() const;
+
+  ghc::filesystem::path get_directory() const { return directory_; }
+
+private:
+  /**
+   * @brief identity of a file on disk
+   */
+  struct Identity {
+    Identity() : age_ns( 0 ), identified( false ) {}
+
+    std::string key;           /*!< device, inode, size and times */
+    long long age_ns;          /*!< time since the last modification */
+    bool identified;           /*!< false if the file could not be found */
+  };
+
+  explicit FileHashCache( const ghc::filesystem::path& directory );
+  FileHashCache( const FileHashCache& ) = delete;
+  FileHashCache& operator=( const FileHashCache& ) = delete;
+
+  static bool identify_( const ghc::filesystem::path& path, Identity& identity );
+  ghc::filesystem::path entry_path_( const std::string& key ) const;
+  bool load_( const std::string& key, std::string& hash ) const;
+  bool lookup_( const ghc::filesystem::path& path, Identity& identity, std::string& hash );
+  void store_( const ghc::filesystem::path& path, const Identity& before, const std::string& hash );
+
+  ghc::filesystem::path directory_;
+  std::atomic< std::size_t > hits_;
+  std::atomic< std::size_t > misses_;
+  std::atomic< std::size_t > writes_;
+  std::atomic< std::size_t > skipped_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -10,12 +10,38 @@
  ****************************************************************************/
 #ifndef __FDP_LOGGING_HXX__
 #define __FDP_LOGGING_HXX__
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <memory>
+#include <mutex>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+/**
+ * @brief messages below this level are compiled out of FDP_LOG statements,
+ * set through the FDPAPI_LOG_MIN_LEVEL CMake option
+ */
+#ifndef FDP_LOG_MIN_LEVEL
+#define FDP_LOG_MIN_LEVEL 0
+#endif
+
+/**
+ * @brief log a message at a level (TRACE, DEBUG, INFO, WARN, ERROR or
+ * CRITICAL) of the global logger, the message is only evaluated if the
+ * level is enabled, e.g. FDP_LOG( DEBUG ) << "Post Data: " << data;
+ */
+#define FDP_LOG( lvl )                                                                 \
+    if( !::FairDataPipeline::logger::should_log( ::FairDataPipeline::logging::lvl ) ) \
+    {                                                                                  \
+    }                                                                                  \
+    else                                                                               \
+        ::FairDataPipeline::logger::get_logger()->builder( ::FairDataPipeline::logging::lvl )
+
 namespace FairDataPipeline {
     namespace logging {
 
@@ -36,9 +62,114 @@ namespace FairDataPipeline {
         {
             typedef std::shared_ptr< ISink > sptr;
             virtual int log( enum LOG_LEVEL msg_lvl, const std::string& msg ) = 0;
+
+            /**
+             * @brief write out anything buffered
+             */
+            virtual void flush(){}
+
             virtual ~ISink(){};
         };
 
+        /**
+         * @brief a value logged as part of a structured message
+         */
+        struct LogArg
+        {
+            enum Type
+            {
+                INT = 0,
+                UINT = 1,
+                DOUBLE = 2,
+                STRING = 3
+            };
+
+            LogArg() : type( STRING ), i( 0 ), u( 0 ), d( 0 ) {}
+
+            Type type;
+            long long i;
+            unsigned long long u;
+            double d;
+            std::string s;
+        };
+
+        /**
+         * @brief a message kept as a format, made of the string literals
+         * written to it with a {} for each other value, and those values
+         */
+        struct LogRecord
+        {
+            enum LOG_LEVEL msg_lvl;
+            std::string format;
+            std::vector< LogArg > args;
+
+            void append_format( const char* s );
+            void append_int( long long value );
+            void append_uint( unsigned long long value );
+            void append_double( double value );
+            void append_string( const std::string& value );
+
+            /**
+             * @brief the message as text, as it would have been streamed
+             */
+            std::string render() const;
+        };
+
+        /**
+         * @brief adds a value streamed into a message to its LogRecord,
+         * string literals become part of the format and the rest arguments
+         */
+        template< typename T, typename Enable = void >
+            struct LogArgAppender
+            {
+                static void append( LogRecord& record, const T& value )
+                {
+                    std::ostringstream oss;
+                    oss << value;
+                    record.append_string( oss.str() );
+                }
+            };
+
+        template< std::size_t N >
+            struct LogArgAppender< char[N] >
+            {
+                static void append( LogRecord& record, const char ( &value )[N] )
+                {
+                    record.append_format( value );
+                }
+            };
+
+        template<>
+            struct LogArgAppender< std::string >
+            {
+                static void append( LogRecord& record, const std::string& value )
+                {
+                    record.append_string( value );
+                }
+            };
+
+        template< typename T >
+            struct LogArgAppender< T, typename std::enable_if< std::is_integral< T >::value &&
+                                                               std::is_signed< T >::value &&
+                                                               !std::is_same< T, char >::value >::type >
+            {
+                static void append( LogRecord& record, const T& value ) { record.append_int( value ); }
+            };
+
+        template< typename T >
+            struct LogArgAppender< T, typename std::enable_if< std::is_integral< T >::value &&
+                                                               !std::is_signed< T >::value &&
+                                                               !std::is_same< T, char >::value >::type >
+            {
+                static void append( LogRecord& record, const T& value ) { record.append_uint( value ); }
+            };
+
+        template< typename T >
+            struct LogArgAppender< T, typename std::enable_if< std::is_floating_point< T >::value >::type >
+            {
+                static void append( LogRecord& record, const T& value ) { record.append_double( value ); }
+            };
+
         class Logger;
 
         class SinkFormatter;
@@ -61,19 +192,33 @@ namespace FairDataPipeline {
                 enum LOG_LEVEL log_level();
                 void log_level( enum LOG_LEVEL log_lvl );
 
-                bool should_log( enum LOG_LEVEL msg_lvl );
+                bool should_log( enum LOG_LEVEL msg_lvl ) const
+                {
+                    return msg_lvl >= _log_lvl.load( std::memory_order_relaxed );
+                }
 
                 void set_formatter( ISinkFormatter::sptr fmtr ){_fmtr = fmtr;}
                 
                 int execute( Logger* logger, enum LOG_LEVEL msg_lvl, const std::string& s );
 
+                /**
+                 * @brief whether messages should reach this sink as LogRecords
+                 * rather than text
+                 */
+                virtual bool structured() const { return false; }
+
+                /**
+                 * @brief log a structured message, by default as its text
+                 */
+                virtual int log_record( Logger* logger, const LogRecord& record );
+
             protected:
                 Sink( enum LOG_LEVEL log_lvl );
 
             private:
 
 
-                enum LOG_LEVEL _log_lvl;
+                std::atomic< LOG_LEVEL > _log_lvl;
                 ISinkFormatter::sptr _fmtr;
         };
 
@@ -86,12 +231,14 @@ namespace FairDataPipeline {
                 static sptr create( enum LOG_LEVEL lvl, std::ostream& os );
 
                 int log( enum LOG_LEVEL msg_lvl, const std::string& s);
+                void flush();
 
             private:
 
                 OStreamSink(enum LOG_LEVEL log_lvl, std::ostream& os);
 
                 std::ostream& _os;
+                std::mutex _mutex;
         };
 
         class CompositeSink : public Sink
@@ -104,6 +251,7 @@ namespace FairDataPipeline {
 
 
                 int log( enum LOG_LEVEL msg_lvl, const std::string& s);
+                void flush();
                 void add_sink( Sink::sptr sink ){ _sinks.push_back( sink ); }
 
             private:
@@ -113,6 +261,105 @@ namespace FairDataPipeline {
         };
 
 
+        /*! **************************************************************************
+         * @class AsyncSink
+         * @brief sink queueing formatted messages in a bounded lock free ring
+         * which a background thread writes to another sink in batches
+         *
+         * Logging threads only format and enqueue their messages, several may
+         * do so at once. When the ring is full the overflow policy decides
+         * whether they wait for space or the message is dropped.
+         ****************************************************************************/
+        class AsyncSink : public Sink
+        {
+            public:
+                typedef std::shared_ptr< AsyncSink > sptr;
+
+                /**
+                 * @brief what happens to a message when the ring is full
+                 */
+                enum class Overflow
+                {
+                    BLOCK, /*!< wait for the writer to make space */
+                    DROP,  /*!< discard the message */
+                    COUNT  /*!< discard the message, writing how many were
+                                discarded once there is space again */
+                };
+
+                /**
+                 * @brief start a sink and its writer thread
+                 *
+                 * @param lvl lowest level queued
+                 * @param sink written to by the background thread
+                 * @param capacity messages held, rounded up to a power of two
+                 * @param overflow policy when the ring is full
+                 * @return sptr
+                 */
+                static sptr create( enum LOG_LEVEL lvl, Sink::sptr sink, std::size_t capacity = 8192,
+                                    Overflow overflow = Overflow::BLOCK );
+
+                /**
+                 * @brief write out every queued message before returning
+                 */
+                ~AsyncSink();
+
+                int log( enum LOG_LEVEL msg_lvl, const std::string& s );
+
+                /**
+                 * @brief wait until every message queued so far has been
+                 * written to the wrapped sink, and flush it
+                 */
+                void flush();
+
+                /**
+                 * @brief number of messages discarded as the ring was full
+                 */
+                std::size_t dropped() const { return _dropped.load(); }
+
+            private:
+                /**
+                 * @brief a slot of the ring, its sequence number says whether
+                 * it is free to write or ready to read for a position
+                 */
+                struct Cell
+                {
+                    std::atomic< std::size_t > sequence;
+                    enum LOG_LEVEL msg_lvl;
+                    std::string msg;
+                };
+
+                AsyncSink( enum LOG_LEVEL lvl, Sink::sptr sink, std::size_t capacity, Overflow overflow );
+                AsyncSink( const AsyncSink& ) = delete;
+                AsyncSink& operator=( const AsyncSink& ) = delete;
+
+                bool try_push_( enum LOG_LEVEL msg_lvl, const std::string& s );
+                std::size_t drain_();
+                void run_();
+                void wake_();
+
+                Sink::sptr _sink;
+                Overflow _overflow;
+
+                std::vector< Cell > _cells;
+                std::size_t _mask;
+                std::atomic< std::size_t > _enqueue_pos;
+                std::size_t _dequeue_pos;
+
+                std::atomic< std::size_t > _dropped;
+                std::size_t _dropped_reported;
+                std::atomic< std::size_t > _written;
+                std::size_t _flush_target;
+                std::size_t _flushed;
+
+                std::mutex _mutex;
+                std::condition_variable _wake;
+                std::condition_variable _drained;
+                std::atomic< bool > _sleeping;
+                bool _stopping;
+                std::thread _thread;
+        };
+
+
         class SinkFormatter : public ISinkFormatter
         {
             public:
@@ -140,30 +387,72 @@ namespace FairDataPipeline {
                         friend class Logger;
                         typedef std::shared_ptr< MsgBuilder > sptr;
 
+                        MsgBuilder( MsgBuilder&& rhs );
                         ~MsgBuilder();
 
+                        /**
+                         * @brief append to the message, does nothing (and
+                         * so formats nothing) if the level is disabled
+                         */
                         template< typename T >
                             MsgBuilder& operator<<( const T& s)
                             {
-                                if( _logger->sink()->should_log( _msg_lvl ) )
+                                if( _oss )
+                                {
+                                    *_oss << s;
+                                }
+                                else if( _record )
                                 {
-                                    _oss << s;
+                                    LogArgAppender< T >::append( *_record, s );
                                 }
                                 return *this;
                             }
 
+                        bool enabled() const { return _oss || _record; }
+
                     private:
                         MsgBuilder( enum LOG_LEVEL msg_lvl, Logger* logger );
-                        MsgBuilder( const MsgBuilder& rhs );
+                        MsgBuilder( const MsgBuilder& rhs ) = delete;
 
                         Logger* _logger;
                         enum LOG_LEVEL _msg_lvl;
 
-                        std::ostringstream _oss;
+                        // Only created if the level is enabled, the record
+                        // if the sink is structured
+                        std::unique_ptr< std::ostringstream > _oss;
+                        std::unique_ptr< LogRecord > _record;
                 };
 
                 static sptr create( enum LOG_LEVEL lvl, Sink::sptr sink, std::string name="" );
 
+                /**
+                 * @brief whether messages at a level reach the sink
+                 */
+                bool should_log( enum LOG_LEVEL msg_lvl ) const
+                {
+                    return static_cast< int >( msg_lvl ) >= FDP_LOG_MIN_LEVEL && _sink && _sink->should_log( msg_lvl );
+                }
+
+                /**
+                 * @brief start a message at a level
+                 */
+                MsgBuilder builder( enum LOG_LEVEL msg_lvl );
+
+                /**
+                 * @brief log the concatenation of the arguments, which are
+                 * only formatted if the level is enabled
+                 */
+                template< typename... Args >
+                    void log( enum LOG_LEVEL msg_lvl, const Args&... args )
+                    {
+                        if( should_log( msg_lvl ) )
+                        {
+                            MsgBuilder msg( msg_lvl, this );
+                            int expand[] = { 0, ( msg << args, 0 )... };
+                            (void)expand;
+                        }
+                    }
+
                 MsgBuilder info();
                 MsgBuilder debug();
                 MsgBuilder trace();
@@ -174,15 +463,20 @@ namespace FairDataPipeline {
                 Sink::sptr sink(){ return _sink; }
                 const std::string& name() const { return _name;}
 
-                void set_level( enum LOG_LEVEL lvl){ _log_lvl = lvl;}
-                enum LOG_LEVEL get_level() const { return _log_lvl;}
+                /**
+                 * @brief write out any messages buffered by the sink
+                 */
+                void flush(){ if( _sink ) _sink->flush(); }
+
+                void set_level( enum LOG_LEVEL lvl){ _log_lvl.store( lvl, std::memory_order_relaxed );}
+                enum LOG_LEVEL get_level() const { return _log_lvl.load( std::memory_order_relaxed );}
 
             protected:
                 Logger( enum LOG_LEVEL lvl, Sink::sptr sink, std::string name ) ;
 
             private:
 
-                enum LOG_LEVEL _log_lvl;
+                std::atomic< LOG_LEVEL > _log_lvl; /*!< set while other threads log */
                 Sink::sptr _sink;
                 std::string _name;
         };
@@ -194,7 +488,19 @@ namespace FairDataPipeline {
             typedef std::shared_ptr< logging::Logger > logger_sptr;
 
             static logger_sptr get_logger();
+
+            /**
+             * @brief whether messages at a level reach the global logger's
+             * sink, levels below FDP_LOG_MIN_LEVEL are never logged
+             */
+            static bool should_log( enum logging::LOG_LEVEL lvl )
+            {
+                return static_cast< int >( lvl ) >= FDP_LOG_MIN_LEVEL && instance_().should_log( lvl );
+            }
+
         private:
+            static logging::Logger& instance_();
+
             static logger_sptr _instance;
     };
 
@@ -0,0 +1,203 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/utilities/metrics.hxx
+ * @brief File containing counters, gauges and latency histograms of a run
+ *
+ * Traces show a single run in detail, Metrics keep the aggregate numbers of
+ * one: registry requests per table, bytes transferred, cache hits, hashing
+ * and the files moved by finalise. They can be read through
+ * DataPipeline::get_metrics() and written in the Prometheus text format.
+ ****************************************************************************/
+#ifndef __FDP_METRICS_HXX__
+#define __FDP_METRICS_HXX__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class Metrics
+ * @brief a thread safe registry of named metrics
+ *
+ * A metric is identified by its name and labels, the first use of a name
+ * fixes its type. The returned references stay valid for the life of the
+ * registry so that frequently updated metrics can be looked up once.
+ ****************************************************************************/
+class Metrics {
+public:
+  typedef std::shared_ptr< Metrics > sptr;
+  typedef std::map< std::string, std::string > labels_type;
+  typedef std::function< void( Metrics& ) > collector_type;
+
+  /**
+   * @brief a value which only increases
+   */
+  class Counter {
+  public:
+    Counter() : value_( 0 ) {}
+
+    void increment( std::uint64_t n = 1 ) { value_.fetch_add( n, std::memory_order_relaxed ); }
+
+    /**
+     * @brief set the total of something counted elsewhere, by a collector
+     */
+    void set( std::uint64_t value ) { value_.store( value, std::memory_order_relaxed ); }
+
+    std::uint64_t value() const { return value_.load( std::memory_order_relaxed ); }
+
+  private:
+    std::atomic< std::uint64_t > value_;
+  };
+
+  /**
+   * @brief a value which may go up and down
+   */
+  class Gauge {
+  public:
+    Gauge() : value_( 0 ) {}
+
+    void set( double value ) { value_.store( value, std::memory_order_relaxed ); }
+    void add( double delta );
+    double value() const { return value_.load( std::memory_order_relaxed ); }
+
+  private:
+    std::atomic< double > value_;
+  };
+
+  /**
+   * @brief distribution of durations in log spaced buckets
+   *
+   * Durations are kept in nanoseconds in buckets 1/16 of a power of two
+   * wide, as an HDR histogram does, so quantiles are within about 6% of the
+   * recorded values whatever their magnitude.
+   */
+  class Histogram {
+  public:
+    Histogram();
+
+    /**
+     * @brief record a duration
+     *
+     * @param seconds
+     */
+    void record( double seconds );
+    void record_ns( std::uint64_t ns );
+
+    std::uint64_t count() const { return count_.load( std::memory_order_relaxed ); }
+
+    /**
+     * @brief total of the recorded durations in seconds
+     */
+    double sum() const;
+
+    /**
+     * @brief estimate of a quantile in seconds
+     *
+     * @param q between 0 and 1, e.g. 0.99
+     * @return double 0 if nothing was recorded
+     */
+    double quantile( double q ) const;
+
+    /**
+     * @brief number of durations up to a bound
+     *
+     * @param seconds
+     * @return std::uint64_t durations whose bucket lies at or below seconds
+     */
+    std::uint64_t count_below( double seconds ) const;
+
+  private:
+    static const unsigned sub_bucket_bits_ = 4;
+    static const unsigned n_buckets_ = ( 64 - sub_bucket_bits_ + 1 ) << sub_bucket_bits_;
+
+    static unsigned bucket_of_( std::uint64_t ns );
+    static double bucket_middle_ns_( unsigned bucket );
+
+    std::atomic< std::uint64_t > buckets_[n_buckets_];
+    std::atomic< std::uint64_t > count_;
+    std::atomic< std::uint64_t > sum_ns_;
+  };
+
+  static sptr construct();
+
+  /**
+   * @brief the counter of a name and labels, created at zero
+   *
+   * @throws std::invalid_argument if the name is used by another type
+   */
+  Counter& counter( const std::string& name, const labels_type& labels = labels_type() );
+
+  /**
+   * @brief the gauge of a name and labels, created at zero
+   *
+   * @throws std::invalid_argument if the name is used by another type
+   */
+  Gauge& gauge( const std::string& name, const labels_type& labels = labels_type() );
+
+  /**
+   * @brief the histogram of a name and labels, created empty
+   *
+   * @throws std::invalid_argument if the name is used by another type
+   */
+  Histogram& histogram( const std::string& name, const labels_type& labels = labels_type() );
+
+  /**
+   * @brief set the help text of a metric name
+   */
+  void describe( const std::string& name, const std::string& help );
+
+  /**
+   * @brief add a function run before the metrics are read, which copies
+   * in values kept elsewhere
+   */
+  void add_collector( collector_type collector );
+
+  /**
+   * @brief run the collectors
+   */
+  void collect();
+
+  /**
+   * @brief the metrics in the Prometheus text exposition format, after
+   * running the collectors
+   *
+   * Histograms are written with fixed bucket bounds from 100us to 60s so
+   * that runs can be aggregated.
+   *
+   * @return std::string
+   */
+  std::string to_prometheus();
+
+private:
+  Metrics() {}
+  Metrics( const Metrics& ) = delete;
+  Metrics& operator=( const Metrics& ) = delete;
+
+  enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+  struct Family {
+    Type type;
+    std::string help;
+    std::map< labels_type, std::unique_ptr< Counter > > counters;
+    std::map< labels_type, std::unique_ptr< Gauge > > gauges;
+    std::map< labels_type, std::unique_ptr< Histogram > > histograms;
+  };
+
+  Family& family_( const std::string& name, Type type );
+
+  std::mutex mutex_;
+  std::map< std::string, Family > families_;
+  std::map< std::string, std::string > help_;
+
+  std::mutex collectors_mutex_;
+  std::vector< collector_type > collectors_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
@@ -0,0 +1,108 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/utilities/sha1.hxx
+ * @brief File containing the SHA1 implementation used to hash files
+ *
+ * Every output of a run, along with its config and submission script, is
+ * hashed. Sha1 uses the SHA extensions of x86 processors when the CPU it is
+ * running on has them, falling back to a portable implementation otherwise,
+ * and reads files through memory maps rather than streams.
+ ****************************************************************************/
+#ifndef __FDP_SHA1_HXX__
+#define __FDP_SHA1_HXX__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <ghc/filesystem.hpp>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class Sha1
+ * @brief incremental SHA1 with a compression function chosen at runtime
+ ****************************************************************************/
+class Sha1 {
+public:
+  /**
+   * @brief implementations of the SHA1 compression function
+   */
+  enum class Engine {
+    SCALAR, /*!< portable C++ */
+    SHA_NI  /*!< x86 SHA extensions */
+  };
+
+  /**
+   * @brief the fastest engine supported by this CPU
+   *
+   * @return Engine
+   */
+  static Engine best_engine();
+
+  /**
+   * @brief whether an engine can be used on this CPU
+   *
+   * @param engine
+   * @return true if supported
+   */
+  static bool is_supported( Engine engine );
+
+  /**
+   * @brief name of an engine for log output
+   *
+   * @param engine
+   * @return std::string e.g. "sha-ni"
+   */
+  static std::string engine_name( Engine engine );
+
+  /**
+   * @brief start a new hash
+   *
+   * @param engine compression function to use, which must be supported
+   */
+  explicit Sha1( Engine engine = best_engine() );
+
+  /**
+   * @brief add data to the hash
+   *
+   * @param data
+   * @param size number of bytes
+   * @return Sha1&
+   */
+  Sha1& update( const void* data, std::size_t size );
+
+  Sha1& update( const std::string& data ) { return update( data.data(), data.size() ); }
+
+  /**
+   * @brief add the contents of a file to the hash, mapping it into memory
+   * where possible and otherwise reading it in large blocks
+   *
+   * @param path file to read
+   * @return Sha1&
+   */
+  Sha1& update_file( const ghc::filesystem::path& path );
+
+  /**
+   * @brief the hash of everything added so far as a lower case hex string,
+   * more data may still be added afterwards
+   *
+   * @return std::string
+   */
+  std::string hexdigest() const;
+
+  Engine get_engine() const { return engine_; }
+
+private:
+  typedef void ( *compress_type )( std::uint32_t* state, const unsigned char* blocks,
+                                   std::size_t n_blocks );
+
+  Engine engine_;
+  compress_type compress_;
+  std::uint32_t state_[5];
+  unsigned char block_[64];
+  std::size_t block_size_;
+  std::uint64_t length_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
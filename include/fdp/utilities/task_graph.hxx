@@ -0,0 +1,79 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/utilities/task_graph.hxx
+ * @brief File containing a small dependency graph executor
+ *
+ * The TaskGraph runs a set of tasks concurrently while respecting the data
+ * dependencies declared between them. It is used to overlap independent
+ * registry requests which would otherwise be issued one after another.
+ ****************************************************************************/
+#ifndef __FDP_TASK_GRAPH_HXX__
+#define __FDP_TASK_GRAPH_HXX__
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FairDataPipeline {
+/*! **************************************************************************
+ * @class TaskGraph
+ * @brief executes tasks on worker threads as soon as their dependencies are
+ * complete
+ *
+ * Tasks may only depend on tasks added before them so the graph is always
+ * acyclic. If a task throws, no further tasks are started and the first
+ * exception is rethrown from run() once running tasks have finished.
+ ****************************************************************************/
+class TaskGraph {
+public:
+  typedef std::shared_ptr< TaskGraph > sptr;
+  typedef std::function< void() > task_type;
+  typedef std::size_t task_id;
+
+  static sptr construct();
+
+  /**
+   * @brief add a task to the graph
+   *
+   * @param name name used in log output
+   * @param task the work to perform
+   * @param dependencies ids of tasks which must complete first
+   * @return task_id id used to declare dependencies on this task
+   */
+  task_id add( const std::string& name, task_type task,
+               const std::vector< task_id >& dependencies = std::vector< task_id >() );
+
+  /**
+   * @brief run every task, returning when all have completed
+   *
+   * @param max_parallel maximum number of tasks run at once, 0 runs every
+   * ready task at once
+   */
+  void run( std::size_t max_parallel = 0 );
+
+  /**
+   * @brief number of tasks in the graph
+   *
+   * @return std::size_t
+   */
+  std::size_t size() const { return nodes_.size(); }
+
+private:
+  struct Node {
+    std::string name;
+    task_type task;
+    std::vector< task_id > dependents;
+    std::size_t n_dependencies;
+  };
+
+  TaskGraph() {}
+  TaskGraph( const TaskGraph& ) = delete;
+  TaskGraph& operator=( const TaskGraph& ) = delete;
+
+  std::vector< Node > nodes_;
+};
+
+}; // namespace FairDataPipeline
+
+#endif
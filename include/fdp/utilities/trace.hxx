@@ -0,0 +1,163 @@
+/*! **************************************************************************
+ * @file FairDataPipeline/utilities/trace.hxx
+ * @brief File containing timeline tracing of the library's work
+ *
+ * A trace::Span records how long a scope took on which thread. Spans are
+ * kept in per thread buffers and written out as Chrome Trace Event JSON,
+ * which chrome://tracing and https://ui.perfetto.dev display as a timeline.
+ * Tracing is enabled by setting FDP_TRACE_FILE to the file to write, the
+ * trace is written by DataPipeline::finalise and at exit. While disabled a
+ * span costs a single relaxed load.
+ ****************************************************************************/
+#ifndef __FDP_TRACE_HXX__
+#define __FDP_TRACE_HXX__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace FairDataPipeline {
+namespace trace {
+
+extern std::atomic< bool > enabled_;
+
+/**
+ * @brief whether spans are being recorded
+ */
+inline bool enabled() { return enabled_.load( std::memory_order_relaxed ); }
+
+/**
+ * @brief start recording spans, to be written to path
+ *
+ * @param path file receiving the trace, replacing that of FDP_TRACE_FILE
+ */
+void start( const std::string& path );
+
+/**
+ * @brief stop recording spans, those recorded are kept
+ */
+void stop();
+
+/**
+ * @brief write every span recorded so far to the trace file, if there is one
+ */
+void write();
+
+/**
+ * @brief discard the spans recorded so far
+ */
+void clear();
+
+/**
+ * @brief name the calling thread in the trace, if tracing is enabled
+ *
+ * @param name a string literal
+ */
+void set_thread_name( const char* name );
+
+/**
+ * @brief monotonic time in nanoseconds, as used for span timestamps
+ */
+std::uint64_t now_ns();
+
+/**
+ * @brief record a span which has already ended, on the calling thread
+ *
+ * Spans on a thread must nest. Work overlapping on one thread, such as the
+ * transfers of a curl multi loop, is given an async_id instead and shown
+ * on a track of its own, spans with the same id nest within it.
+ *
+ * @param category a string literal grouping spans, e.g. "api"
+ * @param name a string literal
+ * @param start_ns start from now_ns()
+ * @param duration_ns
+ * @param args members of a JSON object, e.g. "\"url\":\"...\"", or empty
+ * @param async_id from new_async_id(), or 0 for a span of the thread
+ */
+void record( const char* category, const char* name, std::uint64_t start_ns, std::uint64_t duration_ns,
+             const std::string& args = std::string(), std::uint64_t async_id = 0 );
+
+/**
+ * @brief record a span with a name built at run time
+ */
+void record( const char* category, const std::string& name, std::uint64_t start_ns, std::uint64_t duration_ns,
+             const std::string& args = std::string(), std::uint64_t async_id = 0 );
+
+/**
+ * @brief a unique id for a track of overlapping work
+ */
+std::uint64_t new_async_id();
+
+/*! **************************************************************************
+ * @class Span
+ * @brief records the time from its construction to its destruction
+ *
+ * Details are attached with arg(), which does nothing while tracing is
+ * disabled so that only already computed values should be passed to it.
+ ****************************************************************************/
+class Span {
+public:
+  /**
+   * @brief start a span
+   *
+   * @param category a string literal grouping spans, e.g. "api"
+   * @param name a string literal
+   */
+  Span( const char* category, const char* name )
+      : category_( category ), name_( name ), start_ns_( enabled() ? now_ns() : 0 ) {}
+
+  ~Span()
+  {
+    if( !start_ns_ )
+      return;
+    if( label_.empty() )
+      record( category_, name_, start_ns_, now_ns() - start_ns_, args_ );
+    else
+      record( category_, label_, start_ns_, now_ns() - start_ns_, args_ );
+  }
+
+  /**
+   * @brief whether this span is being recorded
+   */
+  bool active() const { return start_ns_ != 0; }
+
+  /**
+   * @brief the time this span started, 0 when it is not recorded
+   */
+  std::uint64_t start_ns() const { return start_ns_; }
+
+  /**
+   * @brief show the span under a name built at run time
+   */
+  void label( const std::string& name );
+
+  void arg( const char* key, const std::string& value );
+  void arg( const char* key, long long value );
+  void arg( const char* key, double value );
+
+private:
+  Span( const Span& ) = delete;
+  Span& operator=( const Span& ) = delete;
+
+  const char* category_;
+  const char* name_;
+  std::uint64_t start_ns_;
+  std::string label_;
+  std::string args_;
+};
+
+/**
+ * @brief append a member to the members of a JSON object
+ *
+ * @param args members so far, as passed to record()
+ * @param key
+ * @param value
+ */
+void append_arg( std::string& args, const char* key, const std::string& value );
+void append_arg( std::string& args, const char* key, long long value );
+void append_arg( std::string& args, const char* key, double value );
+
+} // namespace trace
+}; // namespace FairDataPipeline
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "fdp/objects/config.hxx"
 #include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/trace.hxx"
 
 namespace FairDataPipeline {
     /*! **************************************************************************
@@ -69,6 +70,15 @@ namespace FairDataPipeline {
    */
   ghc::filesystem::path link_read(std::string &data_product);
 
+  /**
+   * @brief Return paths to several data products, resolving them
+   * concurrently whilst recording their meta data
+   * 
+   * @param data_products 
+   * @return std::vector<std::string> 
+   */
+  std::vector<std::string> link_read_many(const std::vector<std::string> &data_products);
+
   /**
    * @brief Return a path to be used for a given data product
    * whilst recording it's meta data
@@ -79,6 +89,22 @@ namespace FairDataPipeline {
 
   ghc::filesystem::path link_write(std::string &data_product);
 
+  /**
+   * @brief Return a stream for a given data product which hashes its
+   * contents as they are written
+   * 
+   * @param data_product 
+   * @return OutputStream::sptr
+   */
+  OutputStream::sptr link_write_stream(std::string &data_product);
+
+  /**
+   * @brief Hand a complete output to the background registrar
+   * 
+   * @param data_product 
+   */
+  void commit(std::string &data_product);
+
   /**
    * @brief Finalise the pipeline
    * Record all data products and meta data to the registry
@@ -87,6 +113,13 @@ namespace FairDataPipeline {
    */
   void finalise();
 
+  /**
+   * @brief Apply the pending registry journals
+   * 
+   * @return std::size_t the number of journals applied
+   */
+  std::size_t replay_registry_journal();
+
   /**
    * @brief Get the code run uuid
    * 
@@ -94,6 +127,13 @@ namespace FairDataPipeline {
    */
   std::string get_code_run_uuid() const;
 
+  /**
+   * @brief Get the metrics of the run
+   * 
+   * @return Metrics::sptr 
+   */
+  Metrics::sptr get_metrics() const { return config_->get_metrics(); }
+
 };
 DataPipeline::impl::sptr DataPipeline::impl::construct(const ghc::filesystem::path &config_file_path,
                     const ghc::filesystem::path &script_file_path,
@@ -113,6 +153,8 @@ DataPipeline::impl::impl(const ghc::filesystem::path &config_file_path,
                     const std::string& token,
                     RESTAPI api_location)
 {
+    trace::Span span_("pipeline", "DataPipeline::construct");
+    span_.arg("config", config_file_path.string());
     this->config_  = Config::construct(config_file_path, script_file_path, token, api_location);
 
     const std::string api_root_ = config_->get_api_url();
@@ -126,13 +168,47 @@ DataPipeline::impl::impl(const ghc::filesystem::path &config_file_path,
 }
 
 ghc::filesystem::path FairDataPipeline::DataPipeline::impl::link_read(std::string &data_product){
+    trace::Span span_("pipeline", "DataPipeline::link_read");
+    span_.arg("data_product", data_product);
     return config_->link_read(data_product);
 }
+std::vector<std::string> FairDataPipeline::DataPipeline::impl::link_read_many(const std::vector<std::string> &data_products){
+    trace::Span span_("pipeline", "DataPipeline::link_read_many");
+    span_.arg("data_products", static_cast<long long>(data_products.size()));
+    const std::vector<ghc::filesystem::path> paths_ = config_->link_read_many(data_products);
+    std::vector<std::string> rtn_;
+    for (std::size_t i = 0; i < paths_.size(); ++i) {
+        rtn_.push_back(paths_[i].string());
+    }
+    return rtn_;
+}
 ghc::filesystem::path FairDataPipeline::DataPipeline::impl::link_write(std::string &data_product){
+    trace::Span span_("pipeline", "DataPipeline::link_write");
+    span_.arg("data_product", data_product);
     return config_->link_write(data_product);
 }
+OutputStream::sptr FairDataPipeline::DataPipeline::impl::link_write_stream(std::string &data_product){
+    trace::Span span_("pipeline", "DataPipeline::link_write_stream");
+    span_.arg("data_product", data_product);
+    return config_->link_write_stream(data_product);
+}
+void FairDataPipeline::DataPipeline::impl::commit(std::string &data_product){
+    trace::Span span_("pipeline", "DataPipeline::commit");
+    span_.arg("data_product", data_product);
+    config_->commit(data_product);
+}
 void FairDataPipeline::DataPipeline::impl::finalise(){
-    config_->finalise();
+    {
+        trace::Span span_("pipeline", "DataPipeline::finalise");
+        config_->finalise();
+    }
+    // The trace so far is written out, it is written again at exit
+    trace::write();
+}
+
+std::size_t FairDataPipeline::DataPipeline::impl::replay_registry_journal(){
+    trace::Span span_("pipeline", "DataPipeline::replay_registry_journal");
+    return config_->replay_registry_journal();
 }
 
 std::string FairDataPipeline::DataPipeline::impl::get_code_run_uuid() const { 
@@ -159,7 +235,7 @@ DataPipeline::DataPipeline(
         std::string token )
 : pimpl_( DataPipeline::impl::construct(ghc::filesystem::path(config_file_path), ghc::filesystem::path(script_file_path), token )) 
 {
-    logger::get_logger()->debug() << "DataPipeline: Initialising session '" 
+    FDP_LOG(DEBUG) << "DataPipeline: Initialising session '" 
         << pimpl_->get_code_run_uuid() << "'";
 }
 
@@ -167,14 +243,34 @@ std::string FairDataPipeline::DataPipeline::link_read(std::string &data_product)
     return pimpl_->link_read(data_product);
 }
 
+std::vector<std::string> FairDataPipeline::DataPipeline::link_read_many(const std::vector<std::string> &data_products){
+    return pimpl_->link_read_many(data_products);
+}
+
 std::string FairDataPipeline::DataPipeline::link_write(std::string &data_product){
     return pimpl_->link_write(data_product);
 }
 
+OutputStream::sptr FairDataPipeline::DataPipeline::link_write_stream(std::string &data_product){
+    return pimpl_->link_write_stream(data_product);
+}
+
+void FairDataPipeline::DataPipeline::commit(std::string &data_product){
+    pimpl_->commit(data_product);
+}
+
 void FairDataPipeline::DataPipeline::finalise(){
     pimpl_->finalise();
 }
 
+std::size_t FairDataPipeline::DataPipeline::replay_registry_journal(){
+    return pimpl_->replay_registry_journal();
+}
+
+Metrics::sptr FairDataPipeline::DataPipeline::get_metrics() const {
+    return pimpl_->get_metrics();
+}
+
 
 
 
@@ -1,8 +1,32 @@
 #include "fdp/objects/config.hxx"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+
 #include "fdp/objects/metadata.hxx"
+#include "fdp/registry/cassette.hxx"
+#include "fdp/registry/embedded_registry.hxx"
+#include "fdp/registry/registry_journal.hxx"
+#include "fdp/utilities/batch_hasher.hxx"
+#include "fdp/utilities/task_graph.hxx"
+#include "fdp/utilities/trace.hxx"
 namespace FairDataPipeline {
 
+// Upper bound on the registry requests a Config issues at once
+static const std::size_t max_concurrent_requests_ = 16;
+static const std::size_t max_registrars_ = 4;
+
+// Root under which an embedded registry without a configured URL is addressed
+static const char* default_embedded_registry_url_ = "http://127.0.0.1:8000/api/";
+
     Config::sptr Config::construct(const ghc::filesystem::path &config_file_path,
                     const ghc::filesystem::path &script_file_path,
                     const std::string &token,
@@ -25,15 +49,25 @@ FairDataPipeline::Config::Config(const ghc::filesystem::path &config_file_path,
     : token_(token), config_file_path_(config_file_path), script_file_path_(script_file_path),
     rest_api_location_(api_location) {
   validate_config(config_file_path, api_location);
-  initialise(api_location);
+  initialise(rest_api_location_);
+
+  if(meta_data_()["prefetch_reads"] && meta_data_()["prefetch_reads"].as<bool>()){
+    prefetch_reads();
+  }
 
     }
 
 Config::~Config() {
+  // Committed outputs not yet registered are abandoned along with the run
+  {
+    std::lock_guard<std::mutex> lock_(registrar_mutex_);
+    registrar_queue_.clear();
+  }
+  stop_registrar_();
 }
 
 YAML::Node FairDataPipeline::Config::parse_yaml(ghc::filesystem::path yaml_path) {
-  logger::get_logger()->debug() 
+  FDP_LOG(DEBUG) 
       << "[Config]: Reading configuration file '" << yaml_path.string().c_str() << "'";
   return YAML::LoadFile(yaml_path.string().c_str());
 }
@@ -65,10 +99,12 @@ bool FairDataPipeline::Config::config_has_reads() const{
 }
 
 bool FairDataPipeline::Config::has_writes() const{
+  std::lock_guard<std::mutex> lock_(links_mutex_);
   return ! writes_.empty();
 }
 
 bool FairDataPipeline::Config::has_reads() const{
+  std::lock_guard<std::mutex> lock_(links_mutex_);
   return ! reads_.empty();
 }
 
@@ -81,16 +117,15 @@ bool FairDataPipeline::Config::has_outputs() const{
 }
 
 ghc::filesystem::path FairDataPipeline::Config::get_data_store() const {
-  return ghc::filesystem::path(
-      FairDataPipeline::Config::meta_data_()["write_data_store"].as<std::string>());
+  return data_store_path_;
 }
 
 std::string FairDataPipeline::Config::get_default_input_namespace() const {
-  return meta_data_()["default_input_namespace"].as<std::string>();
+  return default_input_namespace_;
 }
 
 std::string FairDataPipeline::Config::get_default_output_namespace() const {
-  return meta_data_()["default_output_namespace"].as<std::string>();
+  return default_output_namespace_;
 }
 
 void FairDataPipeline::Config::validate_config(ghc::filesystem::path yaml_path,
@@ -103,6 +138,17 @@ void FairDataPipeline::Config::validate_config(ghc::filesystem::path yaml_path,
     throw config_parsing_error("No run metadata provided");
   }
 
+  // A local run may instead register its provenance in an embedded registry,
+  // said loudly as nothing then reaches the local registry
+  if (api_location == RESTAPI::LOCAL && !embedded_registry_path_().empty()) {
+    logger::get_logger()->warn()
+        << "Config: Registering this run in the embedded registry "
+        << embedded_registry_path_().string() << " instead of the local registry, "
+        << "selected by " << embedded_registry_source_()
+        << ", use RESTAPI::EMBEDDED to select it explicitly";
+    api_location = rest_api_location_ = RESTAPI::EMBEDDED;
+  }
+
   if (api_location == RESTAPI::LOCAL &&
       !meta_data_()["local_data_registry_url"]) {
     logger::get_logger()->error()
@@ -122,7 +168,8 @@ void FairDataPipeline::Config::validate_config(ghc::filesystem::path yaml_path,
   }
 
   else if (!(api_location == RESTAPI::LOCAL ||
-             api_location == RESTAPI::REMOTE)) {
+             api_location == RESTAPI::REMOTE ||
+             api_location == RESTAPI::EMBEDDED)) {
     logger::get_logger()->error() << "Unrecognised API location";
     throw config_parsing_error("Failed to resolve registry location");
   }
@@ -143,6 +190,9 @@ void FairDataPipeline::Config::validate_config(ghc::filesystem::path yaml_path,
         << "Failed to Read: [\"default_output_namespace\"] from " << yaml_path.string();
     throw config_parsing_error("Failed to Read: [\"default_output_namespace\"] from " + yaml_path.string());
   }
+  data_store_path_ = ghc::filesystem::path(meta_data_()["write_data_store"].as<std::string>());
+  default_input_namespace_ = meta_data_()["default_input_namespace"].as<std::string>();
+  default_output_namespace_ = meta_data_()["default_output_namespace"].as<std::string>();
 
   if (!meta_data_()["latest_commit"]) {
     logger::get_logger()->error() 
@@ -185,13 +235,86 @@ void FairDataPipeline::Config::validate_config(ghc::filesystem::path yaml_path,
     
   }
 
+  index_config_();
+}
+
+// The value of entry["use"][key] or fallback if it is absent
+static std::string use_value_(const YAML::Node &entry, const char *key,
+                              const std::string &fallback) {
+  const YAML::Node use_ = entry["use"];
+  if (use_ && use_[key]) {
+    return use_[key].as<std::string>();
+  }
+  return fallback;
+}
+
+void FairDataPipeline::Config::index_config_() {
+  // Later entries for the same data product replace earlier ones
+  read_specs_.clear();
+  reads_specified_ = config_has_reads() && config_reads_().IsSequence();
+  if (reads_specified_) {
+    const std::string default_namespace_ = get_default_input_namespace();
+    for (YAML::const_iterator it = config_reads_().begin(); it != config_reads_().end(); ++it) {
+      const YAML::Node read_ = *it;
+      if (!read_["data_product"]) {
+        continue;
+      }
+
+      ReadSpec spec_;
+      spec_.data_product = read_["data_product"].as<std::string>();
+      spec_.use_data_product = use_value_(read_, "data_product", spec_.data_product);
+      spec_.default_version = !(read_["use"] && read_["use"]["version"]);
+      spec_.use_version = use_value_(read_, "version", "0.0.1");
+      spec_.use_namespace = use_value_(read_, "namespace", default_namespace_);
+      read_specs_[spec_.data_product] = spec_;
+    }
+  }
+
+  write_specs_.clear();
+  writes_specified_ = config_has_writes() && config_writes_().IsSequence();
+  if (writes_specified_) {
+    const std::string default_namespace_ = get_default_output_namespace();
+    const bool is_public_ = meta_data_()["public"].as<bool>();
+    for (YAML::const_iterator it = config_writes_().begin(); it != config_writes_().end(); ++it) {
+      const YAML::Node write_ = *it;
+      if (!write_["data_product"]) {
+        continue;
+      }
+
+      WriteSpec spec_;
+      spec_.data_product = write_["data_product"].as<std::string>();
+      spec_.use_data_product = use_value_(write_, "data_product", spec_.data_product);
+      spec_.default_version = !(write_["use"] && write_["use"]["version"]);
+      spec_.use_version = use_value_(write_, "version", "0.0.1");
+      spec_.use_namespace = use_value_(write_, "namespace", default_namespace_);
+      spec_.has_description = static_cast<bool>(write_["description"]);
+      if (spec_.has_description) {
+        spec_.description = write_["description"].as<std::string>();
+      }
+      spec_.has_file_type = static_cast<bool>(write_["file_type"]);
+      if (spec_.has_file_type) {
+        spec_.file_type = write_["file_type"].as<std::string>();
+      }
+      spec_.is_public = is_public_;
+      write_specs_[spec_.data_product] = spec_;
+    }
+  }
+
+  FDP_LOG(DEBUG) 
+      << "Config: Indexed " << read_specs_.size() << " reads and "
+      << write_specs_.size() << " writes";
 }
 
 void FairDataPipeline::Config::initialise(RESTAPI api_location) {
+  trace::Span span_("config", "Config::initialise");
+  const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
   // Set API URL
   if (api_location == RESTAPI::REMOTE) {
     api_url_ = API::append_with_forward_slash(
         meta_data_()["remote_data_registry_url"].as<std::string>());
+  } else if (api_location == RESTAPI::EMBEDDED &&
+             !meta_data_()["local_data_registry_url"]) {
+    api_url_ = default_embedded_registry_url_;
   } else {
     api_url_ = API::append_with_forward_slash(
         meta_data_()["local_data_registry_url"].as<std::string>());
@@ -203,168 +326,419 @@ void FairDataPipeline::Config::initialise(RESTAPI api_location) {
   // Create and API object as a shared pointer
   api_ = API::construct(api_url_);
 
-  // Get the admin user from registry
-  Json::Value user_json_;
-  user_json_["username"] = "admin";
-
-  Json::Value j = api_->get_by_json_query("users", user_json_, 200, token_);
-  this->user_ = ApiObject::from_json( j [0]);
-
-  if (user_->is_empty()) {
-    logger::get_logger()->error() << "User: Admin Not Found";
-    throw std::runtime_error("User: Admin Not Found");
+  // Everything needed from the YAML configuration is read up front as
+  // YAML::Node is not safe to access from the registration tasks
+  const std::string write_data_store_ = meta_data_()["write_data_store"].as<std::string>();
+
+  // Optionally reach a local registry through a Unix domain socket, serve
+  // the registry in process or from a recording, or record its traffic
+  Transport::sptr transport_ = api_->get_transport();
+  if (api_location == RESTAPI::LOCAL && meta_data_()["local_data_registry_socket"]) {
+    const std::string socket_ = meta_data_()["local_data_registry_socket"].as<std::string>();
+    logger::get_logger()->info() << "Connecting to " << api_url_ << " through " << socket_;
+    transport_ = CurlTransport::construct(CurlPool::construct(8, socket_));
   }
+  if (api_location == RESTAPI::EMBEDDED) {
+    transport_ = EmbeddedTransport::construct(
+        EmbeddedRegistry::construct(api_url_, embedded_registry_path_()));
+  }
+  const char* replay_env_ = std::getenv("FDP_REGISTRY_REPLAY");
+  if (replay_env_ && *replay_env_) {
+    const char* timing_env_ = std::getenv("FDP_REGISTRY_REPLAY_TIMING");
+    transport_ = ReplayTransport::construct(replay_env_, api_url_,
+                                            timing_env_ && *timing_env_ && std::string(timing_env_) != "0");
+  }
+  const char* record_env_ = std::getenv("FDP_REGISTRY_RECORD");
+  if (record_env_ && *record_env_) {
+    transport_ = RecordingTransport::construct(transport_, record_env_, api_url_);
+  }
+  api_->set_transport(transport_);
 
-  //Get the author by querying the user_author table
-  Json::Value user_author_json_;
-  user_author_json_["user"] = user_->get_id();
-  Json::Value user_author_ = api_->get_by_json_query("user_author", user_author_json_, 200, token_)[0];
-
-  Json::Value j_author = api_->get_by_id("author", ApiObject::get_id_from_string(user_author_["author"].asString()), 200, token_);
+  // Optionally persist immutable registry entries between runs
+  ghc::filesystem::path registry_cache_dir_;
+  const char* registry_cache_env_ = std::getenv("FDP_REGISTRY_CACHE_DIR");
+  if (registry_cache_env_ && *registry_cache_env_) {
+    registry_cache_dir_ = registry_cache_env_;
+  }
+  else if (meta_data_()["registry_cache_dir"]) {
+    registry_cache_dir_ = meta_data_()["registry_cache_dir"].as<std::string>();
+  }
+  else if (meta_data_()["registry_cache"] && meta_data_()["registry_cache"].as<bool>()) {
+    registry_cache_dir_ = ghc::filesystem::path(remove_local_from_root(write_data_store_)) / ".registry_cache";
+  }
+  if (!registry_cache_dir_.empty()) {
+    api_->set_disk_cache(DiskCache::construct(registry_cache_dir_, api_url_));
+  }
 
-  this->author_ = ApiObject::from_json( j_author );
+  // Optionally remember the hashes of unchanged files between runs
+  ghc::filesystem::path hash_cache_dir_;
+  const char* hash_cache_env_ = std::getenv("FDP_HASH_CACHE_DIR");
+  if (hash_cache_env_ && *hash_cache_env_) {
+    hash_cache_dir_ = hash_cache_env_;
+  }
+  else if (meta_data_()["hash_cache_dir"]) {
+    hash_cache_dir_ = meta_data_()["hash_cache_dir"].as<std::string>();
+  }
+  else if (meta_data_()["hash_cache"] && meta_data_()["hash_cache"].as<bool>()) {
+    hash_cache_dir_ = ghc::filesystem::path(remove_local_from_root(write_data_store_)) / ".hash_cache";
+  }
+  if (!hash_cache_dir_.empty()) {
+    hash_cache_ = FileHashCache::construct(hash_cache_dir_);
+  }
 
-  if (author_->is_empty()) {
-    logger::get_logger()->error()
-        <<  "Author for User Admin not found please ensure you have run fair init";
-    throw std::runtime_error(
-        "Author Not Found: Please ensure you have run fair init");
+  // Optionally journal the registry changes of finalise so that they can be
+  // applied, or resumed, without the outputs being produced again
+  const char* registry_journal_env_ = std::getenv("FDP_REGISTRY_JOURNAL_DIR");
+  if (registry_journal_env_ && *registry_journal_env_) {
+    registry_journal_dir_ = registry_journal_env_;
+  }
+  else if (meta_data_()["registry_journal_dir"]) {
+    registry_journal_dir_ = meta_data_()["registry_journal_dir"].as<std::string>();
+  }
+  else if (meta_data_()["registry_journal"] && meta_data_()["registry_journal"].as<bool>()) {
+    registry_journal_dir_ = ghc::filesystem::path(remove_local_from_root(write_data_store_)) / ".registry_journal";
   }
+  registry_journal_defer_ = !registry_journal_dir_.empty() &&
+      meta_data_()["registry_journal_defer"] && meta_data_()["registry_journal_defer"].as<bool>();
 
-  // Create Config Storage Root
-  Json::Value config_storage_root_value_;
-  config_storage_root_value_["root"] = meta_data_()["write_data_store"].as<std::string>();
-  config_storage_root_value_["local"] = api_location == RESTAPI::LOCAL; 
+  init_metrics_(write_data_store_);
 
-  Json::Value j_storage_root = api_->post_storage_root(config_storage_root_value_, token_);
-  this->config_storage_root_  = ApiObject::from_json( j_storage_root );
+  const std::string remote_repo_ = meta_data_()["remote_repo"].as<std::string>();
+  const std::string latest_commit_ = meta_data_()["latest_commit"].as<std::string>();
+  const std::string description_ = meta_data_()["description"].as<std::string>();
 
   // Remove the Write Data Store from config file path
-  Json::Value config_storage_location_value_;
-  if(config_file_path_.string().find(meta_data_()["write_data_store"].as<std::string>()) !=std::string::npos){
-    config_storage_location_value_["path"] = config_file_path_.string().replace(
-    config_file_path_.string().find(meta_data_()["write_data_store"].as<std::string>()),
-    sizeof(meta_data_()["write_data_store"].as<std::string>()) - 1, "");
+  std::string config_storage_path_;
+  if(config_file_path_.string().find(write_data_store_) !=std::string::npos){
+    config_storage_path_ = config_file_path_.string().replace(
+    config_file_path_.string().find(write_data_store_),
+    sizeof(write_data_store_) - 1, "");
   }
   else {
-    config_storage_location_value_["path"] = config_file_path_.string();
+    config_storage_path_ = config_file_path_.string();
   }
-  config_storage_location_value_["path"] = remove_backslash_from_path(config_storage_location_value_["path"].asString());
-  config_storage_location_value_["path"] = API::remove_leading_forward_slash(config_storage_location_value_["path"].asString());
-  config_storage_location_value_["public"] = true;  
-  config_storage_location_value_["hash"] = calculate_hash_from_file(config_file_path_);
-  config_storage_location_value_["storage_root"] = config_storage_root_->get_uri();
-
-
-  Json::Value j_storage_location = api_->post("storage_location", config_storage_location_value_, token_);
-  this->config_storage_location_ = ApiObject::from_json( j_storage_location );
-
-  Json::Value config_value_;
-  config_value_["description"] = "Working config.yaml in datastore";
-  config_value_["storage_location"] = config_storage_location_->get_uri();
-  Json::Value author_id_ = author_->get_uri();
-  config_value_["authors"].append(author_id_);
-
-  Json::Value  config_file_type_value;
-  config_file_type_value["name"] = "yaml";
-  config_file_type_value["extension"] = "yaml";
-  Json::Value config_file_type_url_ = api_->post("file_type", config_file_type_value, token_)["url"];
-
-  config_value_["file_type"] = config_file_type_url_;
-
-  logger::get_logger()->info() 
-      << "Writing config file " 
-      <<  config_file_path_.string()
-      << " to registry", config_file_path_.string();
-
-  Json::Value j_config_obj = api_->post("object", config_value_, token_);
- 
-  this->config_obj_ = ApiObject::from_json( j_config_obj );
+  config_storage_path_ = API::remove_leading_forward_slash(remove_backslash_from_path(config_storage_path_));
 
-    Json::Value script_storage_location_value_;
-
-  if(script_file_path_.string().find(meta_data_()["write_data_store"].as<std::string>()) !=std::string::npos){
-    script_storage_location_value_["path"] = script_file_path_.string().replace(
-    script_file_path_.string().find(meta_data_()["write_data_store"].as<std::string>()),
-    sizeof(meta_data_()["write_data_store"].as<std::string>()) - 1, "");
+  std::string script_storage_path_;
+  if(script_file_path_.string().find(write_data_store_) !=std::string::npos){
+    script_storage_path_ = script_file_path_.string().replace(
+    script_file_path_.string().find(write_data_store_),
+    sizeof(write_data_store_) - 1, "");
   }
   else {
-    script_storage_location_value_["path"] = script_file_path_.string();
+    script_storage_path_ = script_file_path_.string();
   }
-  script_storage_location_value_["path"] = remove_backslash_from_path(script_storage_location_value_["path"].asString());
-  script_storage_location_value_["path"] = API::remove_leading_forward_slash(script_storage_location_value_["path"].asString());
-  script_storage_location_value_["hash"] = calculate_hash_from_file(script_file_path_);
-  script_storage_location_value_["public"] = true;
-  script_storage_location_value_["storage_root"] = config_storage_root_->get_uri();
-
-  Json::Value j_script_storage_location = api_->post("storage_location", script_storage_location_value_, token_);
-
-  this->script_storage_location_ = ApiObject::from_json( j_script_storage_location );
+  script_storage_path_ = API::remove_leading_forward_slash(remove_backslash_from_path(script_storage_path_));
+
+  // The registrations below form a dependency graph, each task only waits
+  // for the objects it refers to so independent requests overlap and the
+  // run is bounded by the longest chain (user -> author -> object -> code_run)
+  std::string config_hash_;
+  std::string script_hash_;
+  std::string config_file_type_url_;
+  std::string script_file_type_url_;
+
+  std::function<void()> register_run_ = [&]() {
+    TaskGraph::sptr graph_ = TaskGraph::construct();
+
+    // Get the admin user from registry
+    TaskGraph::task_id user_task_ = graph_->add("user", [&]() {
+      Json::Value user_json_;
+      user_json_["username"] = "admin";
+
+      Json::Value j = api_->get_by_json_query("users", user_json_, 200, token_);
+      this->user_ = ApiObject::from_json( j [0]);
+
+      if (user_->is_empty()) {
+        logger::get_logger()->error() << "User: Admin Not Found";
+        throw std::runtime_error("User: Admin Not Found");
+      }
+    });
 
-  // @todo What happens if a unix executable without and extension is given
-  Json::Value script_file_type_value_;
-  script_file_type_value_["name"] = "C++ Submission Script" + script_file_path_.extension().string();
-  script_file_type_value_["extension"] = script_file_path_.extension().string();
-  Json::Value script_file_type_url_ = api_->post("file_type", script_file_type_value_, token_)["url"];
+    //Get the author by querying the user_author table
+    TaskGraph::task_id author_task_ = graph_->add("author", [&]() {
+      Json::Value user_author_json_;
+      user_author_json_["user"] = user_->get_id();
+      Json::Value user_author_ = api_->get_by_json_query("user_author", user_author_json_, 200, token_)[0];
 
-  Json::Value script_value_;
-  script_value_["description"] = "Working script location in datastore";
-  script_value_["authors"].append(author_id_);
-  script_value_["filetype"] = script_file_type_url_.asString();
-  script_value_["storage_location"] = script_storage_location_->get_uri();
+      Json::Value j_author = api_->get_by_id("author", ApiObject::get_id_from_string(user_author_["author"].asString()), 200, token_);
 
-  logger::get_logger()->info() 
-      << "Writing script file " 
-      << script_file_path_.string() 
-      << " to registry";
+      this->author_ = ApiObject::from_json( j_author );
 
-  Json::Value j_script_obj = api_->post("object", script_value_, token_);
-  this->script_obj_ = ApiObject::from_json( j_script_obj );
-
-  Json::Value repo_storage_root_value_;
-  repo_storage_root_value_["root"] = "https://github.com/";
-  repo_storage_root_value_["local"] = false;
+      if (author_->is_empty()) {
+        logger::get_logger()->error()
+            <<  "Author for User Admin not found please ensure you have run fair init";
+        throw std::runtime_error(
+            "Author Not Found: Please ensure you have run fair init");
+      }
+    }, {user_task_});
+
+    // Create Config Storage Root
+    TaskGraph::task_id config_root_task_ = graph_->add("config_storage_root", [&]() {
+      Json::Value config_storage_root_value_;
+      config_storage_root_value_["root"] = write_data_store_;
+      config_storage_root_value_["local"] = api_location != RESTAPI::REMOTE;
+
+      Json::Value j_storage_root = api_->post_storage_root(config_storage_root_value_, token_);
+      this->config_storage_root_  = ApiObject::from_json( j_storage_root );
+    });
+
+    TaskGraph::task_id config_hash_task_ = graph_->add("config_hash", [&]() {
+      config_hash_ = hash_file_(config_file_path_);
+    });
+
+    TaskGraph::task_id script_hash_task_ = graph_->add("script_hash", [&]() {
+      script_hash_ = hash_file_(script_file_path_);
+    });
+
+    TaskGraph::task_id config_location_task_ = graph_->add("config_storage_location", [&]() {
+      Json::Value config_storage_location_value_;
+      config_storage_location_value_["path"] = config_storage_path_;
+      config_storage_location_value_["public"] = true;  
+      config_storage_location_value_["hash"] = config_hash_;
+      config_storage_location_value_["storage_root"] = config_storage_root_->get_uri();
+
+      Json::Value j_storage_location = api_->post("storage_location", config_storage_location_value_, token_);
+      this->config_storage_location_ = ApiObject::from_json( j_storage_location );
+    }, {config_root_task_, config_hash_task_});
+
+    TaskGraph::task_id config_file_type_task_ = graph_->add("config_file_type", [&]() {
+      Json::Value  config_file_type_value;
+      config_file_type_value["name"] = "yaml";
+      config_file_type_value["extension"] = "yaml";
+      config_file_type_url_ = api_->post("file_type", config_file_type_value, token_)["url"].asString();
+    });
+
+    TaskGraph::task_id config_obj_task_ = graph_->add("config_object", [&]() {
+      Json::Value config_value_;
+      config_value_["description"] = "Working config.yaml in datastore";
+      config_value_["storage_location"] = config_storage_location_->get_uri();
+      Json::Value author_id_ = author_->get_uri();
+      config_value_["authors"].append(author_id_);
+      config_value_["file_type"] = config_file_type_url_;
 
-  Json::Value j_code_repo_root = api_->post("storage_root", repo_storage_root_value_, token_);
-  this->code_repo_storage_root_ = ApiObject::from_json( j_code_repo_root );
+      logger::get_logger()->info() 
+          << "Writing config file " 
+          <<  config_file_path_.string()
+          << " to registry";
+
+      Json::Value j_config_obj = api_->post("object", config_value_, token_);
+      this->config_obj_ = ApiObject::from_json( j_config_obj );
+    }, {author_task_, config_location_task_, config_file_type_task_});
+
+    TaskGraph::task_id script_location_task_ = graph_->add("script_storage_location", [&]() {
+      Json::Value script_storage_location_value_;
+      script_storage_location_value_["path"] = script_storage_path_;
+      script_storage_location_value_["hash"] = script_hash_;
+      script_storage_location_value_["public"] = true;
+      script_storage_location_value_["storage_root"] = config_storage_root_->get_uri();
+
+      Json::Value j_script_storage_location = api_->post("storage_location", script_storage_location_value_, token_);
+      this->script_storage_location_ = ApiObject::from_json( j_script_storage_location );
+    }, {config_root_task_, script_hash_task_});
+
+    // @todo What happens if a unix executable without and extension is given
+    TaskGraph::task_id script_file_type_task_ = graph_->add("script_file_type", [&]() {
+      Json::Value script_file_type_value_;
+      script_file_type_value_["name"] = "C++ Submission Script" + script_file_path_.extension().string();
+      script_file_type_value_["extension"] = script_file_path_.extension().string();
+      script_file_type_url_ = api_->post("file_type", script_file_type_value_, token_)["url"].asString();
+    });
+
+    TaskGraph::task_id script_obj_task_ = graph_->add("script_object", [&]() {
+      Json::Value script_value_;
+      script_value_["description"] = "Working script location in datastore";
+      Json::Value author_id_ = author_->get_uri();
+      script_value_["authors"].append(author_id_);
+      script_value_["filetype"] = script_file_type_url_;
+      script_value_["storage_location"] = script_storage_location_->get_uri();
 
-  std::string repo_storage_path_ = std::regex_replace(meta_data_()["remote_repo"].as<std::string>(), std::regex(repo_storage_root_value_["root"].asString()), "");
+      logger::get_logger()->info() 
+          << "Writing script file " 
+          << script_file_path_.string() 
+          << " to registry";
+
+      Json::Value j_script_obj = api_->post("object", script_value_, token_);
+      this->script_obj_ = ApiObject::from_json( j_script_obj );
+    }, {author_task_, script_location_task_, script_file_type_task_});
+
+    const std::string repo_storage_root_ = "https://github.com/";
+
+    TaskGraph::task_id repo_root_task_ = graph_->add("code_repo_storage_root", [&]() {
+      Json::Value repo_storage_root_value_;
+      repo_storage_root_value_["root"] = repo_storage_root_;
+      repo_storage_root_value_["local"] = false;
+
+      Json::Value j_code_repo_root = api_->post("storage_root", repo_storage_root_value_, token_);
+      this->code_repo_storage_root_ = ApiObject::from_json( j_code_repo_root );
+    });
+
+    TaskGraph::task_id repo_location_task_ = graph_->add("code_repo_storage_location", [&]() {
+      std::string repo_storage_path_ = std::regex_replace(remote_repo_, std::regex(repo_storage_root_), "");
+
+      Json::Value repo_storage_location_value_;
+      repo_storage_location_value_["hash"] = latest_commit_;
+      repo_storage_location_value_["public"] = true;
+      repo_storage_location_value_["storage_root"] = code_repo_storage_root_->get_uri();
+      repo_storage_location_value_["path"] = repo_storage_path_;
+
+      Json::Value j_code_repo_location = api_->post("storage_location", repo_storage_location_value_, token_);
+      this->code_repo_storage_location_ = ApiObject::from_json( j_code_repo_location );
+    }, {repo_root_task_});
+
+    TaskGraph::task_id repo_obj_task_ = graph_->add("code_repo_object", [&]() {
+      Json::Value code_repo_obj_value_;
+      code_repo_obj_value_["description"] = "Processing Script Location";
+      code_repo_obj_value_["storage_location"] = code_repo_storage_location_->get_uri();
+      Json::Value author_id_ = author_->get_uri();
+      code_repo_obj_value_["authors"].append(author_id_);
+
+      Json::Value j_code_repo_obj = api_->post("object", code_repo_obj_value_, token_);
+      this->code_repo_obj_ = ApiObject::from_json( j_code_repo_obj );
+    }, {author_task_, repo_location_task_});
+
+    graph_->add("code_run", [&]() {
+      Json::Value code_run_value_;
+      code_run_value_["run_date"] = current_time_stamp();
+      code_run_value_["description"] = description_;
+      code_run_value_["code_repo"] = code_repo_obj_->get_uri();
+      code_run_value_["model_config"] = config_obj_->get_uri();
+      code_run_value_["submission_script"] = script_obj_->get_uri();
+      code_run_value_["input_urls"] = Json::arrayValue;
+      code_run_value_["output_urls"] = Json::arrayValue;
+
+      logger::get_logger()->info() << "Writing new code run to registry";
+
+      Json::Value j_code_run = api_->post("code_run", code_run_value_, token_);
+      this->code_run_ = ApiObject::from_json( j_code_run );
+    }, {config_obj_task_, script_obj_task_, repo_obj_task_});
+
+    graph_->run();
+  };
+
+  DiskCache::sptr disk_cache_ = api_->get_disk_cache();
+  try {
+    register_run_();
+  }
+  catch (const std::exception& e) {
+    // Entries persisted by earlier runs may refer to objects which no longer
+    // exist, e.g. after the registry has been reset, so retry from scratch
+    if (!disk_cache_ || disk_cache_->get_stats().hits == 0) {
+      throw;
+    }
+    logger::get_logger()->warn() 
+        << "Registration using the registry cache failed (" << e.what()
+        << "), clearing the cache and retrying";
+    disk_cache_->clear();
+    api_->get_response_cache()->clear();
+    register_run_();
+  }
 
-  Json::Value repo_storage_location_value_;
-  repo_storage_location_value_["hash"] = meta_data_()["latest_commit"].as<std::string>();
-  repo_storage_location_value_["public"] = true;
-  repo_storage_location_value_["storage_root"] = code_repo_storage_root_->get_uri();
-  repo_storage_location_value_["path"] = repo_storage_path_;
+  logger::get_logger()->info() 
+      << "Code run " 
+      <<  code_run_->get_value_as_string("uuid") 
+      << " successfully generated";
 
-  Json::Value j_code_repo_location = api_->post("storage_location", repo_storage_location_value_, token_);
-  this->code_repo_storage_location_ = ApiObject::from_json( j_code_repo_location );
+  metrics_->gauge("fdp_initialise_duration_seconds").set(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+}
 
-  Json::Value code_repo_obj_value_;
-  code_repo_obj_value_["description"] = "Processing Script Location";
-  code_repo_obj_value_["storage_location"] = code_repo_storage_location_->get_uri();
-  code_repo_obj_value_["authors"].append(author_id_);
+ghc::filesystem::path Config::embedded_registry_path_() const {
+  const char* embedded_env_ = std::getenv("FDP_EMBEDDED_REGISTRY");
+  if (embedded_env_ && *embedded_env_) {
+    return embedded_env_;
+  }
+  if (meta_data_()["embedded_registry_file"]) {
+    return meta_data_()["embedded_registry_file"].as<std::string>();
+  }
+  if (meta_data_()["embedded_registry"] && meta_data_()["embedded_registry"].as<bool>() &&
+      meta_data_()["write_data_store"]) {
+    return ghc::filesystem::path(remove_local_from_root(
+        meta_data_()["write_data_store"].as<std::string>())) / ".registry" / "registry.jsonl";
+  }
+  return ghc::filesystem::path();
+}
 
-  Json::Value j_code_repo_obj = api_->post("object", code_repo_obj_value_, token_);
-  this->code_repo_obj_ = ApiObject::from_json( j_code_repo_obj );
+std::string Config::embedded_registry_source_() const {
+  const char* embedded_env_ = std::getenv("FDP_EMBEDDED_REGISTRY");
+  if (embedded_env_ && *embedded_env_) {
+    return "FDP_EMBEDDED_REGISTRY";
+  }
+  if (meta_data_()["embedded_registry_file"]) {
+    return "run_metadata:embedded_registry_file";
+  }
+  return "run_metadata:embedded_registry";
+}
 
-  Json::Value code_run_value_;
-  code_run_value_["run_date"] = current_time_stamp();
-  code_run_value_["description"] = meta_data_()["description"].as<std::string>();
-  code_run_value_["code_repo"] = code_repo_obj_->get_uri();
-  code_run_value_["model_config"] = config_obj_->get_uri();
-  code_run_value_["submission_script"] = script_obj_->get_uri();
-  code_run_value_["input_urls"] = Json::arrayValue;
-  code_run_value_["output_urls"] = Json::arrayValue;
+void Config::init_metrics_(const std::string &write_data_store) {
+  metrics_ = Metrics::construct();
+  api_->set_metrics(metrics_);
+
+  metrics_->describe("fdp_initialise_duration_seconds", "Time taken to read the configuration and register the code run");
+  metrics_->describe("fdp_finalise_duration_seconds", "Time taken by finalise");
+  metrics_->describe("fdp_hash_files_total", "Files hashed, including those found in the hash cache");
+  metrics_->describe("fdp_hash_bytes_total", "Bytes of the files hashed");
+  metrics_->describe("fdp_hash_duration_seconds", "Time to hash a file, or a batch of outputs in finalise");
+  metrics_->describe("fdp_hash_cache_total", "Lookups and writes of the file hash cache by result");
+  metrics_->describe("fdp_finalise_files_renamed_total", "Outputs moved to their content addressed path by finalise");
+  metrics_->describe("fdp_finalise_files_removed_total", "Outputs removed by finalise as the registry already held their contents");
+  metrics_->describe("fdp_registry_journal_entries_total", "Registry changes written to the registry journal and applied from it");
+
+  // The hash cache counts for itself, its totals are copied in when read
+  FileHashCache::sptr hash_cache_ = this->hash_cache_;
+  metrics_->add_collector([hash_cache_](Metrics &metrics) {
+    if (!hash_cache_) {
+      return;
+    }
+    const FileHashCache::Stats hash_stats_ = hash_cache_->get_stats();
+    Metrics::labels_type labels_;
+    labels_["result"] = "hit";
+    metrics.counter("fdp_hash_cache_total", labels_).set(hash_stats_.hits);
+    labels_["result"] = "miss";
+    metrics.counter("fdp_hash_cache_total", labels_).set(hash_stats_.misses);
+    labels_["result"] = "write";
+    metrics.counter("fdp_hash_cache_total", labels_).set(hash_stats_.writes);
+    labels_["result"] = "skipped";
+    metrics.counter("fdp_hash_cache_total", labels_).set(hash_stats_.skipped);
+  });
+
+  // Optionally write the metrics in the Prometheus text format at finalise
+  const char* metrics_file_env_ = std::getenv("FDP_METRICS_FILE");
+  if (metrics_file_env_ && *metrics_file_env_) {
+    metrics_file_ = metrics_file_env_;
+  }
+  else if (meta_data_()["metrics_file"]) {
+    metrics_file_ = meta_data_()["metrics_file"].as<std::string>();
+  }
+  else if (meta_data_()["metrics"] && meta_data_()["metrics"].as<bool>()) {
+    metrics_file_ = ghc::filesystem::path(remove_local_from_root(write_data_store)) / "metrics.prom";
+  }
+}
 
-  logger::get_logger()->info() << "Writing new code run to registry";
+std::string Config::hash_file_(const ghc::filesystem::path &path) {
+  const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+  const std::string hash_ = calculate_hash_from_file(path, hash_cache_);
+  count_hashed_(std::vector<ghc::filesystem::path>(1, path), "file",
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+  return hash_;
+}
 
-  Json::Value j_code_run = api_->post("code_run", code_run_value_, token_);
-  this->code_run_ = ApiObject::from_json( j_code_run );
+void Config::count_hashed_(const std::vector<ghc::filesystem::path> &paths,
+                           const std::string &kind, double seconds) {
+  std::uintmax_t bytes_ = 0;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    std::error_code ec_;
+    const std::uintmax_t size_ = ghc::filesystem::file_size(paths[i], ec_);
+    if (!ec_) {
+      bytes_ += size_;
+    }
+  }
+  metrics_->counter("fdp_hash_files_total").increment(paths.size());
+  metrics_->counter("fdp_hash_bytes_total").increment(bytes_);
 
-  logger::get_logger()->info() 
-      << "Code run " 
-      <<  code_run_->get_value_as_string("uuid") 
-      << " successfully generated";
+  Metrics::labels_type labels_;
+  labels_["kind"] = kind;
+  metrics_->histogram("fdp_hash_duration_seconds", labels_).record(seconds);
 }
 
 std::string Config::get_config_directory() const{
@@ -376,36 +750,15 @@ std::string Config::get_code_run_uuid() const{
 };
 
 
-ghc::filesystem::path Config::link_write( const std::string& data_product){
-  if (!config_has_writes()){
+Config::WriteSpec& FairDataPipeline::Config::write_spec_( const std::string &data_product){
+  if (!writes_specified_){
     logger::get_logger()->error()
         << "Config Error: Write has not been specified in the given config file";
     throw config_parsing_error("Config Error: Write has not been specified in the given config file");
   }
 
-  //logger::get_logger()->info() << "Node Type: " 
-  //<< config_writes_().Type());
-  
-  YAML::Node currentWrite;
-
-  if(config_writes_().IsSequence()){
-    for (YAML::const_iterator it = config_writes_().begin(); it != config_writes_().end(); ++it) {
-      if(it->as<YAML::Node>()["data_product"]){
-        if(it->as<YAML::Node>()["data_product"].as<std::string>() == data_product)
-        {
-          currentWrite = it->as<YAML::Node>();
-        }
-      }
-
-    }
-  }
-  else{
-    logger::get_logger()->error()
-        << "Config Error: Write has not been specified in the given config file";
-    throw config_parsing_error("Config Error: Write has not been specified in the given config file");
-  }
-
-  if(!currentWrite)
+  std::unordered_map<std::string, WriteSpec>::iterator it = write_specs_.find(data_product);
+  if (it == write_specs_.end())
   {
       logger::get_logger()->error()
           << "Config Error: Cannot Find "
@@ -415,7 +768,25 @@ ghc::filesystem::path Config::link_write( const std::string& data_product){
     throw config_parsing_error("Config Error: cannot find " + data_product + "in writes");
   }
 
-  if(!currentWrite["description"])
+  return it->second;
+}
+
+ghc::filesystem::path Config::link_write( const std::string& data_product){
+  WriteSpec& spec_ = write_spec_(data_product);
+  std::lock_guard<std::mutex> lock_(*spec_.mutex);
+  return link_write_(spec_).get_path();
+}
+
+IOObject& Config::link_write_( WriteSpec &spec_){
+  const std::string& data_product = spec_.data_product;
+
+  // A data product is only written to one file per run
+  if (spec_.linked) {
+    std::lock_guard<std::mutex> lock_(links_mutex_);
+    return writes_.find(data_product)->second;
+  }
+
+  if(!spec_.has_description)
   {
     logger::get_logger()->error() 
         << "Config Error: Cannot Find description of "
@@ -424,7 +795,7 @@ ghc::filesystem::path Config::link_write( const std::string& data_product){
     throw config_parsing_error("Config Error: cannot find description of " + data_product + "in writes");
   }
 
-  if(!currentWrite["file_type"])
+  if(!spec_.has_file_type)
   {
     logger::get_logger()->error()
         << "Config Error: Cannot Find file_type of " 
@@ -433,68 +804,237 @@ ghc::filesystem::path Config::link_write( const std::string& data_product){
     throw config_parsing_error("Config Error: cannot find file_type of " + data_product + "in writes");
   }
 
-  if(!currentWrite["use"]["version"]){
+  if(spec_.default_version){
     logger::get_logger()->info() 
         << "Use: Version not found in "
         << data_product 
         << ", using version 0.0.1 by default";
-    currentWrite["use"]["version"] = "0.0.1";
-  }
-
-  if(!currentWrite["use"]["data_product"]){
-    currentWrite["use"]["data_product"] = currentWrite["data_product"].as<std::string>();
-  }
-
-    if(!currentWrite["use"]["namespace"]){
-    currentWrite["use"]["namespace"] = meta_data_()["default_output_namespace"].as<std::string>();
   }
 
-  std::string filename_("dat-" + generate_random_hash() + "." + currentWrite["file_type"].as<std::string>());
-  ghc::filesystem::path path_ = ghc::filesystem::path(meta_data_()["write_data_store"].as<std::string>()) / currentWrite["use"]["namespace"].as<std::string>() / currentWrite["use"]["data_product"].as<std::string>() / filename_;
+  std::string filename_("dat-" + generate_random_hash() + "." + spec_.file_type);
+  ghc::filesystem::path path_ = get_data_store() / spec_.use_namespace / spec_.use_data_product / filename_;
 
   logger::get_logger()->info() << "Link Path: " << path_.string();
 
   // Create Directory
   ghc::filesystem::create_directories(path_.parent_path().string());
 
-  writes_[data_product] = IOObject(data_product, 
-    currentWrite["data_product"].as<std::string>(),
-    currentWrite["use"]["version"].as<std::string>(),
-    currentWrite["use"]["namespace"].as<std::string>(),
+  const IOObject object_(data_product, 
+    spec_.data_product,
+    spec_.use_version,
+    spec_.use_namespace,
     path_,
-    currentWrite["description"].as<std::string>(),
-    meta_data_()["public"].as<bool>()
+    spec_.description,
+    spec_.is_public
     );
-  return path_;
+  // Entries of a std::map stay where they are as others are added
+  std::lock_guard<std::mutex> lock_(links_mutex_);
+  IOObject& write_ = writes_[data_product];
+  write_ = object_;
+  spec_.linked = &write_;
+  return write_;
+}
 
+OutputStream::sptr Config::link_write_stream( const std::string& data_product){
+  WriteSpec& spec_ = write_spec_(data_product);
+  std::lock_guard<std::mutex> lock_(*spec_.mutex);
+  IOObject& write_ = link_write_(spec_);
+
+  OutputStream::sptr stream_ = OutputStream::construct(write_.get_path());
+  write_.set_stream_digest(stream_->get_digest());
+  return stream_;
 }
 
-ghc::filesystem::path FairDataPipeline::Config::link_read( const std::string &data_product){
-  YAML::Node currentRead;
+void Config::commit( const std::string& data_product){
+  const WriteSpec& spec_ = write_spec_(data_product);
+  std::lock_guard<std::mutex> spec_lock_(*spec_.mutex);
+  if (!spec_.linked) {
+    logger::get_logger()->error() 
+        << "Config Error: Cannot commit " << data_product << " which has not been linked";
+    throw config_parsing_error("Config Error: cannot commit " + data_product + " which has not been linked");
+  }
 
-  auto it = inputs_.find("data_product");
-  if (it != inputs_.end()) {
-      return it->second.get_path();
+  IOObject* write_ptr_;
+  {
+    std::lock_guard<std::mutex> lock_(links_mutex_);
+    write_ptr_ = &writes_.find(data_product)->second;
+  }
+  IOObject& write_ = *write_ptr_;
+  if(! file_exists(write_.get_path().string())){
+    logger::get_logger()->error() 
+        << "File Error: Cannot Find file for write" << write_.get_use_data_product();
+    throw std::runtime_error("File Error Cannot Find file for write: " + write_.get_use_data_product());
   }
 
-  if(config_reads_().IsSequence()){
-    for (YAML::const_iterator it = config_reads_().begin(); it != config_reads_().end(); ++it) {
-      if(it->as<YAML::Node>()["data_product"]){
-        if(it->as<YAML::Node>()["data_product"].as<std::string>() == data_product)
-        {
-          currentRead = it->as<YAML::Node>();
-        }
+  std::shared_ptr<const OutputStream::Digest> digest_ = write_.get_stream_digest();
+  if (digest_) {
+    std::lock_guard<std::mutex> lock_(digest_->mutex);
+    if (!digest_->closed) {
+      logger::get_logger()->error() 
+          << "File Error: Output stream for " << data_product << " has not been closed";
+      throw std::runtime_error("File Error: Output stream for " + data_product + " has not been closed");
+    }
+  }
+
+  std::lock_guard<std::mutex> lock_(registrar_mutex_);
+  if (committed_.find(data_product) != committed_.end()) {
+    return;
+  }
+  CommittedWrite& committed_write_ = committed_[data_product];
+  committed_write_.write = &write_;
+  registrar_queue_.push_back(&committed_write_);
+
+  // Registrars are started as commits outpace them, registering up to
+  // max_registrars_ outputs at once
+  if (registrar_queue_.size() > registrars_.size() - registrars_busy_ &&
+      registrars_.size() < max_registrars_) {
+    registrar_stopping_ = false;
+    registrars_.push_back(std::thread(&Config::run_registrar_, this));
+  }
+  registrar_cv_.notify_one();
+  FDP_LOG(DEBUG) << "Config: Committed " << data_product;
+}
+
+void Config::run_registrar_(){
+  trace::set_thread_name("registrar");
+
+  lock_type lock_for_ = [this](const std::string &key) {
+    std::lock_guard<std::mutex> lock_(registrar_mutex_);
+    std::shared_ptr<std::mutex> &mutex_ = registrar_locks_[key];
+    if (!mutex_) {
+      mutex_ = std::make_shared<std::mutex>();
+    }
+    return mutex_;
+  };
+
+  std::unique_lock<std::mutex> lock_(registrar_mutex_);
+  for (;;) {
+    registrar_cv_.wait(lock_, [this]() { return registrar_stopping_ || !registrar_queue_.empty(); });
+    if (registrar_queue_.empty()) {
+      return;
+    }
+    CommittedWrite* committed_write_ = registrar_queue_.front();
+    registrar_queue_.pop_front();
+    ++registrars_busy_;
+    lock_.unlock();
+
+    try {
+      register_committed_(*committed_write_, lock_for_);
+    }
+    catch (...) {
+      committed_write_->error = std::current_exception();
+    }
+
+    lock_.lock();
+    --registrars_busy_;
+    registrar_cv_.notify_all();
+  }
+}
+
+void Config::register_committed_(CommittedWrite &committed, const lock_type &lock_for){
+  IOObject& currentWrite = *committed.write;
+  trace::Span span_("pipeline", "Config::register_committed_");
+  span_.arg("data_product", currentWrite.get_data_product());
+
+  std::shared_ptr<const OutputStream::Digest> digest_ = currentWrite.get_stream_digest();
+  if (digest_) {
+    std::lock_guard<std::mutex> lock_(digest_->mutex);
+    committed.hash = digest_->hash;
+  }
+  else {
+    committed.hash = hash_file_(currentWrite.get_path());
+  }
+  committed.hashed = true;
+
+  // A journaled run registers every output from its journal at finalise
+  if (!registry_journal_dir_.empty()) {
+    return;
+  }
+
+  // File types and namespaces are looked up once for every output
+  const std::string extension = currentWrite.get_path().extension().string();
+  const std::string file_type_key_ = "file_type\n" + extension;
+  ApiObject::sptr filetypeObj;
+  {
+    std::lock_guard<std::mutex> lock_(*lock_for(file_type_key_));
+    ApiObject::sptr* cached_;
+    {
+      std::lock_guard<std::mutex> objects_lock_(registrar_mutex_);
+      cached_ = &registrar_objects_[file_type_key_];
+    }
+    if (!*cached_) {
+      Json::Value filetypeData;
+      filetypeData["name"] = extension;
+      filetypeData["extension"] = extension;
+      *cached_ = ApiObject::from_json(api_->post("file_type", filetypeData, token_));
+    }
+    filetypeObj = *cached_;
+  }
+
+  const std::string use_namespace = currentWrite.get_use_namespace();
+  const std::string namespace_key_ = "namespace\n" + use_namespace;
+  ApiObject::sptr namespaceObj;
+  {
+    std::lock_guard<std::mutex> lock_(*lock_for(namespace_key_));
+    ApiObject::sptr* cached_;
+    {
+      std::lock_guard<std::mutex> objects_lock_(registrar_mutex_);
+      cached_ = &registrar_objects_[namespace_key_];
+    }
+    if (!*cached_) {
+      Json::Value namespaceData;
+      namespaceData["name"] = use_namespace;
+      *cached_ = ApiObject::from_json( api_->get_by_json_query("namespace", namespaceData)[0]);
+      if ((*cached_)->is_empty()){
+        *cached_ = ApiObject::from_json(api_->post("namespace", namespaceData, token_));
       }
+    }
+    namespaceObj = *cached_;
+  }
 
+  register_write_(currentWrite, committed.hash, filetypeObj, namespaceObj, lock_for);
+  committed.registered = true;
+}
+
+void Config::drain_registrar_(){
+  {
+    std::unique_lock<std::mutex> lock_(registrar_mutex_);
+    registrar_cv_.wait(lock_, [this]() { return registrar_queue_.empty() && registrars_busy_ == 0; });
+  }
+  stop_registrar_();
+
+  // Every committed output is reported as finalise would have
+  std::map< std::string, CommittedWrite >::const_iterator it;
+  for (it = committed_.begin(); it != committed_.end(); ++it) {
+    if (it->second.error) {
+      logger::get_logger()->error() 
+          << "Config: Failed to register committed output " << it->first;
+      std::rethrow_exception(it->second.error);
     }
   }
-  else{
+}
+
+void Config::stop_registrar_(){
+  {
+    std::lock_guard<std::mutex> lock_(registrar_mutex_);
+    registrar_stopping_ = true;
+    registrar_cv_.notify_all();
+  }
+  for (std::size_t i = 0; i < registrars_.size(); ++i) {
+    registrars_[i].join();
+  }
+  registrars_.clear();
+}
+
+Config::ReadSpec& FairDataPipeline::Config::read_spec_( const std::string &data_product){
+  if(!reads_specified_){
     logger::get_logger()->error() 
         << "Config Error: Write has not been specified in the given config file";
     throw config_parsing_error("Config Error: Write has not been specified in the given config file");
   }
 
-  if(!currentRead)
+  std::unordered_map<std::string, ReadSpec>::iterator it = read_specs_.find(data_product);
+  if(it == read_specs_.end())
   {
     logger::get_logger()->error() 
         << "Config Error: Cannot Find " 
@@ -503,24 +1043,12 @@ ghc::filesystem::path FairDataPipeline::Config::link_read( const std::string &da
     throw config_parsing_error("Config Error: cannot find " + data_product + "in reads");
   }
 
-  if(!currentRead["use"]["version"]){
-    logger::get_logger()->info() 
-        << "Use: Version not found in "
-        << data_product
-        << ", using version 0.0.1 by default";
-    currentRead["use"]["version"] = "0.0.1";
-  }
-
-  if(!currentRead["use"]["data_product"]){
-    currentRead["use"]["data_product"] = currentRead["data_product"].as<std::string>();
-  }
-
-  if(!currentRead["use"]["namespace"]){
-    currentRead["use"]["namespace"] = meta_data_()["default_input_namespace"].as<std::string>();
-  }
+  return it->second;
+}
 
+IOObject FairDataPipeline::Config::resolve_read_( const ReadSpec &spec) const{
   Json::Value namespaceData;
-  namespaceData["name"] = currentRead["use"]["namespace"].as<std::string>();
+  namespaceData["name"] = spec.use_namespace;
 
   Json::Value j_namespace = api_->get_by_json_query("namespace", namespaceData)[0];
   ApiObject::sptr namespaceObj = ApiObject::from_json( j_namespace );
@@ -528,14 +1056,14 @@ ghc::filesystem::path FairDataPipeline::Config::link_read( const std::string &da
   if (namespaceObj->is_empty()){
     logger::get_logger()->error()
         << "Namespace Error: could not find namespace " 
-        <<  currentRead["use"]["namespace"].as<std::string>() 
+        <<  spec.use_namespace 
         << " in registry";
-    throw std::runtime_error("Namespace Error: could not find namespace " + currentRead["use"]["namespace"].as<std::string>() + " in Registry");
+    throw std::runtime_error("Namespace Error: could not find namespace " + spec.use_namespace + " in Registry");
   }
 
   Json::Value dataProductData;
-  dataProductData["name"] = currentRead["use"]["data_product"].as<std::string>();
-  dataProductData["version"] = currentRead["use"]["version"].as<std::string>();
+  dataProductData["name"] = spec.use_data_product;
+  dataProductData["version"] = spec.use_version;
   dataProductData["namespace"] = namespaceObj->get_id();
   
   Json::Value j_data_prod_obj = api_->get_by_json_query("data_product", dataProductData)[0];
@@ -544,9 +1072,9 @@ ghc::filesystem::path FairDataPipeline::Config::link_read( const std::string &da
   if (dataProductObj->is_empty()){
     logger::get_logger()->error() 
         << "data_product Error: could not find data_product "
-        <<  currentRead["use"]["data_product"].as<std::string>() 
+        <<  spec.use_data_product 
         << " in registry";
-    throw std::runtime_error("Namespace Error: could not find data_product " + currentRead["use"]["data_product"].as<std::string>() + " in Registry");
+    throw std::runtime_error("Namespace Error: could not find data_product " + spec.use_data_product + " in Registry");
   }
 
   Json::Value _j_ = api_->get_by_id("object", ApiObject::get_id_from_string(dataProductObj->get_value_as_string("object")));
@@ -600,135 +1128,423 @@ ghc::filesystem::path FairDataPipeline::Config::link_read( const std::string &da
   ghc::filesystem::path path_ = ghc::filesystem::path(remove_local_from_root(storageRootObj->get_value_as_string("root"))) / 
     API::remove_leading_forward_slash(storageLocationObj->get_value_as_string("path"));
 
-  reads_[data_product] = IOObject(data_product, 
-    currentRead["data_product"].as<std::string>(),
-    currentRead["use"]["version"].as<std::string>(),
-    currentRead["use"]["namespace"].as<std::string>(),
+  return IOObject(spec.data_product, 
+    spec.data_product,
+    spec.use_version,
+    spec.use_namespace,
     path_,
     *componentObj,
     *dataProductObj
     );
+}
 
-  return path_;
+void FairDataPipeline::Config::resolve_reads_( const std::vector<ReadSpec> &specs,
+                                               map_type &resolved, bool skip_failures){
+  // Each data product is resolved by its own chain of requests, shared
+  // lookups such as namespaces and storage roots are only fetched once as
+  // concurrent identical requests are coalesced by the API response cache
+  std::mutex resolved_mutex_;
+  TaskGraph::sptr graph_ = TaskGraph::construct();
+
+  for (std::size_t i = 0; i < specs.size(); ++i) {
+    const ReadSpec& spec_ = specs[i];
+    graph_->add("read " + spec_.data_product, [&, spec_]() {
+      try {
+        IOObject read_ = resolve_read_(spec_);
+        std::lock_guard<std::mutex> lock(resolved_mutex_);
+        resolved[spec_.data_product] = read_;
+      }
+      catch (const std::exception &e) {
+        if (!skip_failures) {
+          throw;
+        }
+        logger::get_logger()->warn() 
+            << "Failed to prefetch " << spec_.data_product << ": " << e.what();
+      }
+    });
+  }
+
+  graph_->run(max_concurrent_requests_);
 }
 
-void FairDataPipeline::Config::finalise(){
+void FairDataPipeline::Config::prefetch_reads(){
+  std::vector<ReadSpec> specs_;
+  {
+    std::lock_guard<std::mutex> lock_(links_mutex_);
+    std::unordered_map<std::string, ReadSpec>::const_iterator it;
+    for (it = read_specs_.begin(); it != read_specs_.end(); ++it) {
+      if (!it->second.linked &&
+          prefetched_reads_.find(it->first) == prefetched_reads_.end()) {
+        specs_.push_back(it->second);
+      }
+    }
+  }
 
-  if(has_writes()){
-      Config::map_type::iterator it;
-    for (it = writes_.begin(); it != writes_.end(); it++){
-      IOObject& currentWrite = it->second;
+  FDP_LOG(DEBUG) << "Prefetching " << specs_.size() << " reads";
+  map_type resolved_;
+  resolve_reads_(specs_, resolved_, true);
 
-      if(! file_exists(currentWrite.get_path().string())){
-        logger::get_logger()->error() 
-            << "File Error: Cannot Find file for write" << currentWrite.get_use_data_product();
+  std::lock_guard<std::mutex> lock_(links_mutex_);
+  prefetched_reads_.insert(resolved_.begin(), resolved_.end());
+}
 
-        throw std::runtime_error("File Error Cannot Find file for write: " + currentWrite.get_use_data_product());
-      }
+ghc::filesystem::path FairDataPipeline::Config::link_read( const std::string &data_product){
+  ReadSpec& spec_ = read_spec_(data_product);
+  // Other data products are linked while this one is resolved
+  std::lock_guard<std::mutex> spec_lock_(*spec_.mutex);
+  if (spec_.linked) {
+    return spec_.linked->get_path();
+  }
+
+  if(spec_.default_version){
+    logger::get_logger()->info() 
+        << "Use: Version not found in "
+        << data_product
+        << ", using version 0.0.1 by default";
+  }
+
+  // Only record the read once it has been resolved
+  IOObject resolved_;
+  bool prefetched_;
+  {
+    std::lock_guard<std::mutex> lock_(links_mutex_);
+    map_type::const_iterator it = prefetched_reads_.find(data_product);
+    prefetched_ = it != prefetched_reads_.end();
+    if (prefetched_) {
+      resolved_ = it->second;
+    }
+  }
+  if (!prefetched_) {
+    resolved_ = resolve_read_(spec_);
+  }
 
-      Json::Value storageData;
-      storageData["hash"] = calculate_hash_from_file(currentWrite.get_path());
-      storageData["storage_root"] = config_storage_root_->get_id();
-      storageData["public"] = currentWrite.is_public();
+  std::lock_guard<std::mutex> lock_(links_mutex_);
+  IOObject& read_ = reads_[data_product];
+  read_ = resolved_;
+  spec_.linked = &read_;
 
+  return read_.get_path();
+}
 
-      ApiObject::sptr storageLocationObj = ApiObject::from_json(api_->get_by_json_query("storage_location", storageData)[0]);
-      ApiObject::sptr StorageRootObj;
+std::vector<ghc::filesystem::path> FairDataPipeline::Config::link_read_many( const std::vector<std::string> &data_products){
+  std::vector<ReadSpec> specs_;
+  for (std::size_t i = 0; i < data_products.size(); ++i) {
+    const ReadSpec& spec_ = read_spec_(data_products[i]);
+    std::lock_guard<std::mutex> lock_(links_mutex_);
+    if (!spec_.linked &&
+        prefetched_reads_.find(data_products[i]) == prefetched_reads_.end()) {
+      specs_.push_back(spec_);
+    }
+  }
 
-      ghc::filesystem::path newPath;
-      std::string extension = currentWrite.get_path().extension().string();
+  map_type resolved_;
+  resolve_reads_(specs_, resolved_, false);
+  {
+    std::lock_guard<std::mutex> lock_(links_mutex_);
+    prefetched_reads_.insert(resolved_.begin(), resolved_.end());
+  }
 
-      if (!storageLocationObj->is_empty()){
-        remove(currentWrite.get_path());
+  std::vector<ghc::filesystem::path> paths_;
+  for (std::size_t i = 0; i < data_products.size(); ++i) {
+    paths_.push_back(link_read(data_products[i]));
+  }
+  return paths_;
+}
 
-        StorageRootObj = ApiObject::from_json(api_->get_by_id("storage_root", ApiObject::get_id_from_string(storageLocationObj->get_value_as_string("storage_root"))));
+void FairDataPipeline::Config::register_write_( IOObject &currentWrite,
+    const std::string &hash, const ApiObject::sptr &filetypeObj,
+    const ApiObject::sptr &namespaceObj, const lock_type &lock_for){
+
+  Json::Value storageData;
+  storageData["hash"] = hash;
+  storageData["storage_root"] = config_storage_root_->get_id();
+  storageData["public"] = currentWrite.is_public();
+
+  ApiObject::sptr storageLocationObj;
+  {
+    // Writes with the same contents share a storage location
+    std::lock_guard<std::mutex> lock_(*lock_for("storage_location\n" + hash));
 
-        newPath = ghc::filesystem::path(remove_local_from_root(StorageRootObj->get_value_as_string("root"))) / storageLocationObj->get_value_as_string("path");
+    storageLocationObj = ApiObject::from_json(api_->get_by_json_query("storage_location", storageData)[0]);
+    ApiObject::sptr StorageRootObj;
 
+    ghc::filesystem::path newPath;
+    std::string extension = currentWrite.get_path().extension().string();
+
+    if (!storageLocationObj->is_empty()){
+      {
+        trace::Span remove_span_("io", "remove");
+        remove_span_.arg("path", currentWrite.get_path().string());
+        remove(currentWrite.get_path());
       }
-      else {
-        ghc::filesystem::path tmpFilename = currentWrite.get_path().filename();
-        ghc::filesystem::path newFileName = ghc::filesystem::path(storageData["hash"].asString() + extension);
+      metrics_->counter("fdp_finalise_files_removed_total").increment();
+
+      StorageRootObj = ApiObject::from_json(api_->get_by_id("storage_root", ApiObject::get_id_from_string(storageLocationObj->get_value_as_string("storage_root"))));
+
+      newPath = ghc::filesystem::path(remove_local_from_root(StorageRootObj->get_value_as_string("root"))) / storageLocationObj->get_value_as_string("path");
+
+    }
+    else {
+      ghc::filesystem::path tmpFilename = currentWrite.get_path().filename();
+      ghc::filesystem::path newFileName = ghc::filesystem::path(storageData["hash"].asString() + extension);
 
-        newPath = ghc::filesystem::path(remove_local_from_root(get_data_store().string())) / currentWrite.get_use_namespace() / currentWrite.get_use_data_product() / newFileName;
+      newPath = ghc::filesystem::path(remove_local_from_root(get_data_store().string())) / currentWrite.get_use_namespace() / currentWrite.get_use_data_product() / newFileName;
 
+      {
+        trace::Span rename_span_("io", "rename");
+        rename_span_.arg("from", currentWrite.get_path().string());
+        rename_span_.arg("to", newPath.string());
         ghc::filesystem::rename(currentWrite.get_path().string(), newPath.string());
+      }
+      metrics_->counter("fdp_finalise_files_renamed_total").increment();
+
+      ghc::filesystem::path str_path =  ghc::filesystem::path(currentWrite.get_use_namespace()) / currentWrite.get_use_data_product() / newFileName;
+
+      storageData["path"] = str_path.string();
+      storageData["path"] = remove_backslash_from_path(storageData["path"].asString());
+      storageData["path"] = API::remove_leading_forward_slash(storageData["path"].asString());
+      storageData["storage_root"] = config_storage_root_->get_uri();
 
-        ghc::filesystem::path str_path =  ghc::filesystem::path(currentWrite.get_use_namespace()) / currentWrite.get_use_data_product() / newFileName;
+      storageLocationObj = ApiObject::from_json(api_->post("storage_location", storageData, token_));
 
-        storageData["path"] = str_path.string();
-        storageData["path"] = remove_backslash_from_path(storageData["path"].asString());
-        storageData["path"] = API::remove_leading_forward_slash(storageData["path"].asString());
-        storageData["storage_root"] = config_storage_root_->get_uri();
+    }
+  }
 
-        storageLocationObj = ApiObject::from_json(api_->post("storage_location", storageData, token_));
+  Json::Value dataproductData;
+  dataproductData["name"] = currentWrite.get_use_data_product();
+  dataproductData["version"] = currentWrite.get_use_version();
+  dataproductData["namespace"] = namespaceObj->get_uri();
 
+  ApiObject::sptr dataProductObj;
+  ApiObject::sptr obj;
+  std::string componentUrl;
+  {
+    std::lock_guard<std::mutex> lock_(*lock_for("data_product\n" + namespaceObj->get_uri() + "\n" +
+        currentWrite.get_use_data_product() + "\n" + currentWrite.get_use_version()));
+
+    Json::Value j_dataProd = api_->get_by_json_query("data_product", dataproductData)[0];
+
+    dataProductObj = ApiObject::from_json( j_dataProd );
+
+    if(!dataProductObj->is_empty()){
+        Json::Value _j_ = api_->get_by_id("object", ApiObject::get_id_from_string(dataProductObj->get_value_as_string("object")));
+      obj = ApiObject::from_json( _j_ );
+      componentUrl = obj->get_first_component();
+    }
+    else{
+      Json::Value objData;
+      objData["description"] = currentWrite.get_data_product_description();
+      objData["storage_location"] = storageLocationObj->get_uri();
+      Json::Value author_id_ = author_->get_uri();
+      objData["authors"].append(author_id_);
+      objData["file_type"] = filetypeObj->get_uri();
+      
+      Json::Value j_tmp_obj = api_->post("object", objData, token_);
+      obj = ApiObject::from_json( j_tmp_obj );
+
+      if (currentWrite.get_use_component() != "None"){
+        //@todo allow use_component
+        componentUrl = obj->get_first_component();
+      }
+      else{        
+        componentUrl = obj->get_first_component();
       }
 
-      Json::Value filetypeData;
-      filetypeData["name"] = extension;
-      filetypeData["extension"] = extension;
-      ApiObject::sptr filetypeObj = ApiObject::from_json(api_->post("file_type", filetypeData, token_));
+      dataproductData["object"] = obj->get_uri();
 
-      Json::Value namespaceData;
-      namespaceData["name"] = currentWrite.get_use_namespace();
+      
+      Json::Value j_tmp = api_->post("data_product", dataproductData, token_);
+      dataProductObj = ApiObject::from_json( j_tmp);
+
+    }
+  }
+
+  Json::Value j_componen_obj = api_->get_by_id("object_component", ApiObject::get_id_from_string(componentUrl));
+  ApiObject::sptr  componentObj = ApiObject::from_json( j_componen_obj );
+
+  currentWrite.set_component_object( *componentObj);
+  currentWrite.set_data_product_object( *dataProductObj );
+}
+
+std::vector<FairDataPipeline::IOObject*> FairDataPipeline::Config::closed_writes_(){
+  std::vector<IOObject*> writes_list_;
+  Config::map_type::iterator it;
+  for (it = writes_.begin(); it != writes_.end(); it++){
+    IOObject& currentWrite = it->second;
+
+    // Registered by the registrar
+    std::map< std::string, CommittedWrite >::const_iterator committed_it_ = committed_.find(it->first);
+    if (committed_it_ != committed_.end() && committed_it_->second.registered) {
+      outputs_[currentWrite.get_data_product()] = currentWrite;
+      continue;
+    }
 
-      ApiObject::sptr  namespaceObj = ApiObject::from_json( api_->get_by_json_query("namespace", namespaceData)[0]);
-      if (namespaceObj->is_empty()){
-        namespaceObj = ApiObject::from_json(api_->post("namespace", namespaceData, token_));
+    if(! file_exists(currentWrite.get_path().string())){
+      logger::get_logger()->error() 
+          << "File Error: Cannot Find file for write" << currentWrite.get_use_data_product();
+
+      throw std::runtime_error("File Error Cannot Find file for write: " + currentWrite.get_use_data_product());
+    }
+
+    std::shared_ptr<const OutputStream::Digest> digest_ = currentWrite.get_stream_digest();
+    if (digest_) {
+      std::lock_guard<std::mutex> lock_(digest_->mutex);
+      if (!digest_->closed) {
+        logger::get_logger()->error() 
+            << "File Error: Output stream for " << currentWrite.get_data_product() << " has not been closed";
+        throw std::runtime_error("File Error: Output stream for " + currentWrite.get_data_product() + " has not been closed");
       }
+    }
+    writes_list_.push_back(&currentWrite);
+  }
+  return writes_list_;
+}
 
-      Json::Value dataproductData;
-      dataproductData["name"] = currentWrite.get_use_data_product();
-      dataproductData["version"] = currentWrite.get_use_version();
-      dataproductData["namespace"] = namespaceObj->get_uri();
+void FairDataPipeline::Config::finalise(){
+  const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
 
-      Json::Value j_dataProd = api_->get_by_json_query("data_product", dataproductData)[0];
+  drain_registrar_();
 
-      ApiObject::sptr dataProductObj = ApiObject::from_json( j_dataProd );
-      ApiObject::sptr obj;
-      std::string componentUrl;
+  if (!registry_journal_dir_.empty()) {
+    finalise_journaled_();
+    report_finalise_(start_);
+    return;
+  }
 
-      if(!dataProductObj->is_empty()){
-          Json::Value _j_ = api_->get_by_id("object", ApiObject::get_id_from_string(dataProductObj->get_value_as_string("object")));
-        obj = ApiObject::from_json( _j_ );
-        componentUrl = obj->get_first_component();
+  if(has_writes()){
+    const std::vector<IOObject*> writes_list_ = closed_writes_();
+
+    // Each registration waits on the hash of its own output
+    const std::size_t n_writes_ = writes_list_.size();
+    std::vector< std::promise<std::string> > hash_promises_(n_writes_);
+    std::vector< std::shared_future<std::string> > hashes_;
+    for (std::size_t i = 0; i < n_writes_; ++i) {
+      hashes_.push_back(hash_promises_[i].get_future().share());
+    }
+
+    // Outputs written through an OutputStream were hashed as they were written
+    std::vector<std::size_t> unhashed_;
+    for (std::size_t i = 0; i < n_writes_; ++i) {
+      std::shared_ptr<const OutputStream::Digest> digest_ = writes_list_[i]->get_stream_digest();
+      if (!digest_) {
+        unhashed_.push_back(i);
+        continue;
       }
-      else{
-        Json::Value objData;
-        objData["description"] = currentWrite.get_data_product_description();
-        objData["storage_location"] = storageLocationObj->get_uri();
-        Json::Value author_id_ = author_->get_uri();
-        objData["authors"].append(author_id_);
-        objData["file_type"] = filetypeObj->get_uri();
-        
-        Json::Value j_tmp_obj = api_->post("object", objData, token_);
-        obj = ApiObject::from_json( j_tmp_obj );
 
-        if (currentWrite.get_use_component() != "None"){
-          //@todo allow use_component
-          componentUrl = obj->get_first_component();
-        }
-        else{        
-          componentUrl = obj->get_first_component();
-        }
+      std::lock_guard<std::mutex> lock_(digest_->mutex);
+      hash_promises_[i].set_value(digest_->hash);
+    }
 
-        dataproductData["object"] = obj->get_uri();
+    // The remaining outputs are hashed as a batch with the reads of several
+    // files in flight
+    std::vector<ghc::filesystem::path> unhashed_paths_;
+    for (std::size_t j = 0; j < unhashed_.size(); ++j) {
+      unhashed_paths_.push_back(writes_list_[unhashed_[j]]->get_path());
+    }
 
-        
-        Json::Value j_tmp = api_->post("data_product", dataproductData, token_);
-        dataProductObj = ApiObject::from_json( j_tmp);
+    std::atomic<bool> hashing_cancelled_(false);
+    BatchHasher::callback_type on_hash_ = [&](std::size_t j, const std::string &hash, std::exception_ptr error) {
+      if (error) {
+        hash_promises_[unhashed_[j]].set_exception(error);
+      }
+      else {
+        hash_promises_[unhashed_[j]].set_value(hash);
+      }
+    };
+    std::thread hash_thread_([&]() {
+      trace::set_thread_name("hash");
+      const std::chrono::steady_clock::time_point hash_start_ = std::chrono::steady_clock::now();
+      const BatchHasher hasher_;
+      if (hash_cache_) {
+        hash_cache_->hash_files(unhashed_paths_, hasher_, on_hash_, &hashing_cancelled_);
+      }
+      else {
+        hasher_.hash(unhashed_paths_, on_hash_, &hashing_cancelled_);
+      }
+      if (!unhashed_paths_.empty()) {
+        count_hashed_(unhashed_paths_, "batch",
+                      std::chrono::duration<double>(std::chrono::steady_clock::now() - hash_start_).count());
+      }
+    });
+
+    // Registry objects shared between outputs are created once
+    std::mutex locks_mutex_;
+    std::map< std::string, std::shared_ptr<std::mutex> > locks_;
+    lock_type lock_for_ = [&](const std::string &key) {
+      std::lock_guard<std::mutex> lock_(locks_mutex_);
+      std::shared_ptr<std::mutex> &mutex_ = locks_[key];
+      if (!mutex_) {
+        mutex_ = std::make_shared<std::mutex>();
+      }
+      return mutex_;
+    };
+
+    TaskGraph::sptr graph_ = TaskGraph::construct();
+    std::map< std::string, std::pair<TaskGraph::task_id, ApiObject::sptr> > file_types_;
+    std::map< std::string, std::pair<TaskGraph::task_id, ApiObject::sptr> > namespaces_;
+
+    for (std::size_t i = 0; i < n_writes_; ++i) {
+      IOObject& currentWrite = *writes_list_[i];
+
+      const std::string extension = currentWrite.get_path().extension().string();
+      if (file_types_.find(extension) == file_types_.end()) {
+        std::pair<TaskGraph::task_id, ApiObject::sptr>* file_type_ = &file_types_[extension];
+        file_type_->first = graph_->add("file_type " + extension, [this, file_type_, extension]() {
+          Json::Value filetypeData;
+          filetypeData["name"] = extension;
+          filetypeData["extension"] = extension;
+          file_type_->second = ApiObject::from_json(api_->post("file_type", filetypeData, token_));
+        });
+      }
 
+      const std::string use_namespace = currentWrite.get_use_namespace();
+      if (namespaces_.find(use_namespace) == namespaces_.end()) {
+        std::pair<TaskGraph::task_id, ApiObject::sptr>* namespace_ = &namespaces_[use_namespace];
+        namespace_->first = graph_->add("namespace " + use_namespace, [this, namespace_, use_namespace]() {
+          Json::Value namespaceData;
+          namespaceData["name"] = use_namespace;
+
+          ApiObject::sptr namespaceObj = ApiObject::from_json( api_->get_by_json_query("namespace", namespaceData)[0]);
+          if (namespaceObj->is_empty()){
+            namespaceObj = ApiObject::from_json(api_->post("namespace", namespaceData, token_));
+          }
+          namespace_->second = namespaceObj;
+        });
       }
 
-      Json::Value j_componen_obj = api_->get_by_id("object_component", ApiObject::get_id_from_string(componentUrl));
-      ApiObject::sptr  componentObj = ApiObject::from_json( j_componen_obj );
+      const std::pair<TaskGraph::task_id, ApiObject::sptr>* file_type_ = &file_types_[extension];
+      const std::pair<TaskGraph::task_id, ApiObject::sptr>* namespace_ = &namespaces_[use_namespace];
+      std::vector<TaskGraph::task_id> dependencies_;
+      dependencies_.push_back(file_type_->first);
+      dependencies_.push_back(namespace_->first);
+
+      IOObject* write_ = &currentWrite;
+      graph_->add("write " + currentWrite.get_data_product(), [&, write_, file_type_, namespace_, i]() {
+        register_write_(*write_, hashes_[i].get(), file_type_->second,
+                        namespace_->second, lock_for_);
+      }, dependencies_);
+    }
 
-      currentWrite.set_component_object( *componentObj);
-      currentWrite.set_data_product_object( *dataProductObj );
+    FDP_LOG(DEBUG) 
+        << "Finalise: Registering " << n_writes_ << " writes with "
+        << file_types_.size() << " file types and " << namespaces_.size() << " namespaces";
 
-      outputs_[currentWrite.get_data_product()] = currentWrite;      
+    std::exception_ptr error_;
+    try {
+      graph_->run(max_concurrent_requests_);
+    }
+    catch (...) {
+      error_ = std::current_exception();
+    }
+
+    hashing_cancelled_ = true;
+    hash_thread_.join();
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
 
+    for (std::size_t i = 0; i < n_writes_; ++i) {
+      outputs_[writes_list_[i]->get_data_product()] = *writes_list_[i];
     }
   }
 
@@ -775,6 +1591,431 @@ void FairDataPipeline::Config::finalise(){
   Json::Value j_code_run = api_->patch(code_run_endpoint, patch_data, token_);
   this-> code_run_ = ApiObject::from_json( j_code_run );
 
+  report_finalise_(start_);
+}
+
+void FairDataPipeline::Config::report_finalise_(std::chrono::steady_clock::time_point start_){
+  const ResponseCache::Stats cache_stats_ = api_->get_response_cache()->get_stats();
+  FDP_LOG(DEBUG) 
+      << "API: Response cache saved " << cache_stats_.hits + cache_stats_.coalesced
+      << " requests (" << cache_stats_.hits << " hits, "
+      << cache_stats_.coalesced << " coalesced, "
+      << cache_stats_.misses << " misses)";
+
+  if (api_->get_disk_cache()) {
+    const DiskCache::Stats disk_stats_ = api_->get_disk_cache()->get_stats();
+    FDP_LOG(DEBUG) 
+        << "API: Registry cache " << disk_stats_.hits << " hits, "
+        << disk_stats_.misses << " misses, " << disk_stats_.writes << " writes";
+  }
+
+  if (hash_cache_) {
+    const FileHashCache::Stats hash_stats_ = hash_cache_->get_stats();
+    FDP_LOG(DEBUG) 
+        << "Config: Hash cache " << hash_stats_.hits << " hits, "
+        << hash_stats_.misses << " misses, " << hash_stats_.writes << " writes, "
+        << hash_stats_.skipped << " recently modified";
+  }
+
+  metrics_->gauge("fdp_finalise_duration_seconds").set(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+  if (!metrics_file_.empty()) {
+    if (write_file_atomically(metrics_file_, metrics_->to_prometheus())) {
+      FDP_LOG(DEBUG) << "Config: Wrote metrics to " << metrics_file_.string();
+    }
+    else {
+      logger::get_logger()->warn() << "Config: Failed to write metrics to " << metrics_file_.string();
+    }
+  }
+
+  // Messages queued by an asynchronous sink are written before returning
+  logger::get_logger()->flush();
+}
+
+
+void FairDataPipeline::Config::finalise_journaled_(){
+  const std::vector<IOObject*> writes_list_ = closed_writes_();
+  const std::size_t n_writes_ = writes_list_.size();
+
+  // Every output is hashed before the journal is written
+  std::vector<std::string> hashes_(n_writes_);
+  std::vector<std::size_t> unhashed_;
+  std::vector<ghc::filesystem::path> unhashed_paths_;
+  for (std::size_t i = 0; i < n_writes_; ++i) {
+    std::shared_ptr<const OutputStream::Digest> digest_ = writes_list_[i]->get_stream_digest();
+    std::map< std::string, CommittedWrite >::const_iterator committed_it_ = committed_.find(writes_list_[i]->get_data_product());
+    if (committed_it_ != committed_.end() && committed_it_->second.hashed) {
+      hashes_[i] = committed_it_->second.hash;
+    }
+    else if (digest_) {
+      std::lock_guard<std::mutex> lock_(digest_->mutex);
+      hashes_[i] = digest_->hash;
+    }
+    else {
+      unhashed_.push_back(i);
+      unhashed_paths_.push_back(writes_list_[i]->get_path());
+    }
+  }
+
+  if (!unhashed_paths_.empty()) {
+    const std::chrono::steady_clock::time_point hash_start_ = std::chrono::steady_clock::now();
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+    BatchHasher::callback_type on_hash_ = [&](std::size_t j, const std::string &hash, std::exception_ptr error) {
+      if (error) {
+        std::lock_guard<std::mutex> lock_(error_mutex_);
+        if (!error_) {
+          error_ = error;
+        }
+      }
+      else {
+        hashes_[unhashed_[j]] = hash;
+      }
+    };
+    const BatchHasher hasher_;
+    if (hash_cache_) {
+      hash_cache_->hash_files(unhashed_paths_, hasher_, on_hash_);
+    }
+    else {
+      hasher_.hash(unhashed_paths_, on_hash_);
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    count_hashed_(unhashed_paths_, "batch",
+                  std::chrono::duration<double>(std::chrono::steady_clock::now() - hash_start_).count());
+  }
+
+  const std::string data_store_ = remove_local_from_root(get_data_store().string());
+  RegistryJournal::sptr journal_ = RegistryJournal::create(registry_journal_dir_ / (get_code_run_uuid() + ".wal"));
+
+  Json::Value code_run_entry_;
+  code_run_entry_["op"] = "code_run";
+  code_run_entry_["code_run"] = code_run_->get_uri();
+  code_run_entry_["outputs"] = Json::Value(Json::arrayValue);
+  code_run_entry_["inputs"] = Json::Value(Json::arrayValue);
+
+  std::vector< std::pair<std::string, std::string> > moves_;
+  for (std::size_t i = 0; i < n_writes_; ++i) {
+    IOObject& currentWrite = *writes_list_[i];
+    const std::string extension = currentWrite.get_path().extension().string();
+    const ghc::filesystem::path str_path = ghc::filesystem::path(currentWrite.get_use_namespace()) /
+        currentWrite.get_use_data_product() / (hashes_[i] + extension);
+
+    Json::Value entry_;
+    entry_["op"] = "register_write";
+    entry_["name"] = currentWrite.get_use_data_product();
+    entry_["version"] = currentWrite.get_use_version();
+    entry_["namespace"] = currentWrite.get_use_namespace();
+    entry_["description"] = currentWrite.get_data_product_description();
+    entry_["public"] = currentWrite.is_public();
+    entry_["hash"] = hashes_[i];
+    entry_["extension"] = extension;
+    entry_["path"] = API::remove_leading_forward_slash(remove_backslash_from_path(str_path.string()));
+    entry_["from"] = currentWrite.get_path().string();
+    entry_["to"] = (ghc::filesystem::path(data_store_) / str_path).string();
+    entry_["storage_root"] = config_storage_root_->get_uri();
+    entry_["author"] = author_->get_uri();
+
+    code_run_entry_["outputs"].append(static_cast<Json::UInt64>(journal_->append(entry_)));
+    moves_.push_back(std::make_pair(entry_["from"].asString(), entry_["to"].asString()));
+  }
+
+  map_type::iterator it;
+  for (it = reads_.begin(); it != reads_.end(); it++){
+    code_run_entry_["inputs"].append(it->second.get_component_object()->get_uri());
+  }
+  journal_->append(code_run_entry_);
+
+  // Outputs are only moved once the journal describing them is on disk
+  journal_->commit();
+  Metrics::labels_type labels_;
+  labels_["state"] = "written";
+  metrics_->counter("fdp_registry_journal_entries_total", labels_).increment(journal_->size());
+
+  for (std::size_t i = 0; i < moves_.size(); ++i) {
+    {
+      trace::Span rename_span_("io", "rename");
+      rename_span_.arg("from", moves_[i].first);
+      rename_span_.arg("to", moves_[i].second);
+      ghc::filesystem::rename(moves_[i].first, moves_[i].second);
+    }
+    metrics_->counter("fdp_finalise_files_renamed_total").increment();
+  }
+
+  for (std::size_t i = 0; i < n_writes_; ++i) {
+    outputs_[writes_list_[i]->get_data_product()] = *writes_list_[i];
+  }
+  for (it = reads_.begin(); it != reads_.end(); it++){
+    inputs_[it->second.get_data_product()] = it->second;
+  }
+
+  logger::get_logger()->info() 
+      << "Config: Journaled " << journal_->size() << " registry changes to " << journal_->path().string();
+
+  if (registry_journal_defer_) {
+    return;
+  }
+
+  // A registry which cannot be reached, or fails with a server error, leaves
+  // the journals for a later run, a request it rejects is not retried
+  try {
+    const Json::Value j_code_run = apply_journal_(*journal_);
+    journal_->remove();
+    journal_.reset();
+    this->code_run_ = ApiObject::from_json( j_code_run );
+
+    // Journals left by earlier runs are applied while the registry is up
+    replay_registry_journal();
+  }
+  catch (const rest_apiquery_error &e) {
+    if (e.http_code() != 0 && e.http_code() < 500) {
+      if (journal_) {
+        journal_->reject();
+        logger::get_logger()->error() 
+            << "Config: Registry rejected journal, moved to " << journal_->path().string();
+      }
+      throw;
+    }
+    logger::get_logger()->warn() 
+        << "Config: Registry update failed, journals in " << registry_journal_dir_.string()
+        << " will be applied by a later run: " << e.what();
+  }
+}
+
+std::size_t FairDataPipeline::Config::replay_registry_journal(){
+  if (registry_journal_dir_.empty()) {
+    return 0;
+  }
+
+  std::size_t applied_ = 0;
+  const std::vector<ghc::filesystem::path> paths_ = RegistryJournal::list(registry_journal_dir_);
+  for (std::size_t i = 0; i < paths_.size(); ++i) {
+    RegistryJournal::sptr journal_ = RegistryJournal::open(paths_[i]);
+    if (!journal_) {
+      FDP_LOG(DEBUG) << "Config: Skipping " << paths_[i].string() << " which is open in another process";
+      continue;
+    }
+    // Outputs are only moved once their journal is committed, so one which
+    // is not was left by a run which registered nothing
+    if (!journal_->committed()) {
+      logger::get_logger()->warn() 
+          << "Config: Removing incomplete registry journal " << paths_[i].string();
+      journal_->remove();
+      continue;
+    }
+
+    // A journal the registry rejects would fail every later run, it is set
+    // aside instead
+    try {
+      apply_journal_(*journal_);
+    }
+    catch (const rest_apiquery_error &e) {
+      if (e.http_code() == 0 || e.http_code() >= 500) {
+        throw;
+      }
+      journal_->reject();
+      logger::get_logger()->error() 
+          << "Config: Registry rejected journal " << paths_[i].string()
+          << ", moved to " << journal_->path().string() << ": " << e.what();
+      continue;
+    }
+    journal_->remove();
+    logger::get_logger()->info() << "Config: Applied registry journal " << paths_[i].string();
+    ++applied_;
+  }
+  return applied_;
+}
+
+Json::Value FairDataPipeline::Config::apply_journal_(RegistryJournal &journal){
+  trace::Span span_("pipeline", "Config::apply_journal_");
+  span_.arg("path", journal.path().string());
+
+  // Registry objects shared between outputs are created once
+  std::mutex locks_mutex_;
+  std::map< std::string, std::shared_ptr<std::mutex> > locks_;
+  lock_type lock_for_ = [&](const std::string &key) {
+    std::lock_guard<std::mutex> lock_(locks_mutex_);
+    std::shared_ptr<std::mutex> &mutex_ = locks_[key];
+    if (!mutex_) {
+      mutex_ = std::make_shared<std::mutex>();
+    }
+    return mutex_;
+  };
+
+  std::atomic<std::size_t> applied_(0);
+  Json::Value j_code_run;
+  TaskGraph::sptr graph_ = TaskGraph::construct();
+  std::map< std::string, std::pair<TaskGraph::task_id, ApiObject::sptr> > file_types_;
+  std::map< std::string, std::pair<TaskGraph::task_id, ApiObject::sptr> > namespaces_;
+  std::vector<TaskGraph::task_id> writes_;
+  for (std::size_t i = 0; i < journal.size(); ++i) {
+    const Json::Value &entry_ = journal.entry(i);
+    const std::string op_ = entry_["op"].asString();
+    if (journal.done(i)) {
+      continue;
+    }
+    if (op_ == "register_write") {
+      const std::string extension = entry_["extension"].asString();
+      if (file_types_.find(extension) == file_types_.end()) {
+        std::pair<TaskGraph::task_id, ApiObject::sptr>* file_type_ = &file_types_[extension];
+        file_type_->first = graph_->add("file_type " + extension, [this, file_type_, extension]() {
+          Json::Value filetypeData;
+          filetypeData["name"] = extension;
+          filetypeData["extension"] = extension;
+          file_type_->second = ApiObject::from_json(api_->post("file_type", filetypeData, token_));
+        });
+      }
+
+      const std::string use_namespace = entry_["namespace"].asString();
+      if (namespaces_.find(use_namespace) == namespaces_.end()) {
+        std::pair<TaskGraph::task_id, ApiObject::sptr>* namespace_ = &namespaces_[use_namespace];
+        namespace_->first = graph_->add("namespace " + use_namespace, [this, namespace_, use_namespace]() {
+          Json::Value namespaceData;
+          namespaceData["name"] = use_namespace;
+
+          ApiObject::sptr namespaceObj = ApiObject::from_json( api_->get_by_json_query("namespace", namespaceData)[0]);
+          if (namespaceObj->is_empty()){
+            namespaceObj = ApiObject::from_json(api_->post("namespace", namespaceData, token_));
+          }
+          namespace_->second = namespaceObj;
+        });
+      }
+
+      const std::pair<TaskGraph::task_id, ApiObject::sptr>* file_type_ = &file_types_[extension];
+      const std::pair<TaskGraph::task_id, ApiObject::sptr>* namespace_ = &namespaces_[use_namespace];
+      std::vector<TaskGraph::task_id> dependencies_;
+      dependencies_.push_back(file_type_->first);
+      dependencies_.push_back(namespace_->first);
+
+      writes_.push_back(graph_->add("journal write " + entry_["name"].asString(), [&, i, file_type_, namespace_]() {
+        apply_register_write_(journal, i, file_type_->second, namespace_->second, lock_for_);
+        ++applied_;
+      }, dependencies_));
+    }
+    else if (op_ == "code_run") {
+      // The code run is updated once every output it refers to is registered
+      graph_->add("journal code_run", [&, i]() {
+        const Json::Value &code_run_entry_ = journal.entry(i);
+        Json::Value patch_data;
+        for (Json::Value::ArrayIndex j = 0; j < code_run_entry_["outputs"].size(); ++j) {
+          patch_data["outputs"].append(journal.result(code_run_entry_["outputs"][j].asUInt())["component"]);
+        }
+        for (Json::Value::ArrayIndex j = 0; j < code_run_entry_["inputs"].size(); ++j) {
+          patch_data["inputs"].append(code_run_entry_["inputs"][j]);
+        }
+
+        const std::string code_run_endpoint = "code_run/" +
+            std::to_string(ApiObject::get_id_from_string(code_run_entry_["code_run"].asString()));
+        j_code_run = api_->patch(code_run_endpoint, patch_data, token_);
+        journal.record(i, Json::Value(Json::objectValue), true);
+        ++applied_;
+      }, writes_);
+    }
+    else {
+      throw json_parse_error("Config: Unknown registry journal entry '" + op_ + "' in " + journal.path().string());
+    }
+  }
+
+  graph_->run(max_concurrent_requests_);
+
+  Metrics::labels_type labels_;
+  labels_["state"] = "applied";
+  metrics_->counter("fdp_registry_journal_entries_total", labels_).increment(applied_);
+  return j_code_run;
+}
+
+Json::Value FairDataPipeline::Config::apply_register_write_(RegistryJournal &journal,
+    std::size_t entry, const ApiObject::sptr &filetypeObj,
+    const ApiObject::sptr &namespaceObj, const lock_type &lock_for){
+  const Json::Value &entry_ = journal.entry(entry);
+  const ghc::filesystem::path from_ = entry_["from"].asString();
+  const ghc::filesystem::path to_ = entry_["to"].asString();
+
+  // The process which wrote the journal may have stopped before moving the
+  // output, or another output of the run may have the same contents
+  if (file_exists(from_.string())) {
+    if (file_exists(to_.string())) {
+      remove(from_);
+    }
+    else {
+      ghc::filesystem::rename(from_, to_);
+      metrics_->counter("fdp_finalise_files_renamed_total").increment();
+    }
+  }
+
+  Json::Value storageData;
+  storageData["hash"] = entry_["hash"];
+  storageData["storage_root"] = ApiObject::get_id_from_string(entry_["storage_root"].asString());
+  storageData["public"] = entry_["public"];
+
+  ApiObject::sptr storageLocationObj;
+  {
+    std::lock_guard<std::mutex> lock_(*lock_for("storage_location\n" + entry_["hash"].asString()));
+
+    storageLocationObj = ApiObject::from_json(api_->get_by_json_query("storage_location", storageData)[0]);
+    if (!storageLocationObj->is_empty()){
+      ApiObject::sptr StorageRootObj = ApiObject::from_json(api_->get_by_id("storage_root", ApiObject::get_id_from_string(storageLocationObj->get_value_as_string("storage_root"))));
+      const ghc::filesystem::path existing_ = ghc::filesystem::path(remove_local_from_root(StorageRootObj->get_value_as_string("root"))) / storageLocationObj->get_value_as_string("path");
+
+      // Registered from this output by an earlier attempt, or from a file
+      // with the same contents
+      if (existing_ != to_ && file_exists(to_.string())) {
+        remove(to_);
+        metrics_->counter("fdp_finalise_files_removed_total").increment();
+      }
+    }
+    else {
+      storageData["path"] = entry_["path"];
+      storageData["storage_root"] = entry_["storage_root"];
+      storageLocationObj = ApiObject::from_json(api_->post("storage_location", storageData, token_));
+    }
+  }
+
+  Json::Value dataproductData;
+  dataproductData["name"] = entry_["name"];
+  dataproductData["version"] = entry_["version"];
+  dataproductData["namespace"] = namespaceObj->get_uri();
+
+  Json::Value result_;
+  {
+    std::lock_guard<std::mutex> lock_(*lock_for("data_product\n" + namespaceObj->get_uri() + "\n" +
+        entry_["name"].asString() + "\n" + entry_["version"].asString()));
+
+    ApiObject::sptr dataProductObj = ApiObject::from_json(api_->get_by_json_query("data_product", dataproductData)[0]);
+    if (dataProductObj->is_empty()){
+      // An object created by an interrupted attempt is used rather than
+      // creating another
+      ApiObject::sptr obj;
+      if (journal.result(entry).isMember("object")) {
+        obj = ApiObject::from_json(api_->get_by_id("object", ApiObject::get_id_from_string(journal.result(entry)["object"].asString())));
+      }
+      else {
+        Json::Value objData;
+        objData["description"] = entry_["description"];
+        objData["storage_location"] = storageLocationObj->get_uri();
+        objData["authors"].append(entry_["author"]);
+        objData["file_type"] = filetypeObj->get_uri();
+        obj = ApiObject::from_json(api_->post("object", objData, token_));
+
+        Json::Value progress_;
+        progress_["object"] = obj->get_uri();
+        journal.record(entry, progress_, false);
+      }
+
+      dataproductData["object"] = obj->get_uri();
+      dataProductObj = ApiObject::from_json(api_->post("data_product", dataproductData, token_));
+      result_["component"] = obj->get_first_component();
+    }
+    else {
+      const ApiObject::sptr obj = ApiObject::from_json(api_->get_by_id("object", ApiObject::get_id_from_string(dataProductObj->get_value_as_string("object"))));
+      result_["component"] = obj->get_first_component();
+    }
+    result_["data_product"] = dataProductObj->get_uri();
+  }
+
+  journal.record(entry, result_, true);
+  return result_;
 }
 
 }; // namespace FairDataPipeline
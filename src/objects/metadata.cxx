@@ -1,22 +1,56 @@
 #include "fdp/objects/metadata.hxx"
 
+#include <cstdio>
+
+#include "fdp/utilities/batch_hasher.hxx"
+#include "fdp/utilities/file_hash_cache.hxx"
+#include "fdp/utilities/sha1.hxx"
+#include "fdp/utilities/trace.hxx"
+
 namespace FairDataPipeline {
-std::string calculate_hash_from_file(const ghc::filesystem::path &file_path) {
+std::string calculate_hash_from_file(const ghc::filesystem::path &file_path,
+                                     const std::shared_ptr<FileHashCache> &hash_cache) {
   if (!ghc::filesystem::exists(file_path)) {
     throw std::invalid_argument("File '" + file_path.string() + "' not found");
   }
 
-  std::ifstream file_(file_path.string(), std::ios_base::in | std::ios_base::binary);
+  trace::Span span_("hash", "calculate_hash_from_file");
+  span_.arg("path", file_path.string());
+  if (hash_cache) {
+    return hash_cache->hash_file(file_path);
+  }
+  return Sha1().update_file(file_path).hexdigest();
+}
 
-  const std::string hash_ = digestpp::sha1().absorb(file_).hexdigest();
+std::vector<std::string> hash_files(const std::vector<ghc::filesystem::path> &paths,
+                                    const std::shared_ptr<FileHashCache> &hash_cache) {
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    if (!ghc::filesystem::exists(paths[i])) {
+      throw std::invalid_argument("File '" + paths[i].string() + "' not found");
+    }
+  }
 
-  file_.close();
+  if (!hash_cache) {
+    return BatchHasher().hash(paths);
+  }
 
-  return hash_;
+  std::vector<std::string> hashes_(paths.size());
+  std::vector<std::exception_ptr> errors_(paths.size());
+  hash_cache->hash_files(paths, BatchHasher(),
+      [&](std::size_t i, const std::string &hash, std::exception_ptr error) {
+        hashes_[i] = hash;
+        errors_[i] = error;
+      });
+  for (std::size_t i = 0; i < errors_.size(); ++i) {
+    if (errors_[i]) {
+      std::rethrow_exception(errors_[i]);
+    }
+  }
+  return hashes_;
 }
 
 std::string calculate_hash_from_string(const std::string &input) {
-  return digestpp::sha1().absorb(input).hexdigest();
+  return Sha1().update(input).hexdigest();
 }
 
 std::string generate_random_hash() {
@@ -85,4 +119,35 @@ std::string read_token(const ghc::filesystem::path &token_path){
   return key_str_;
 }
 
+bool write_file_atomically(const ghc::filesystem::path &path, const std::string &contents){
+  const ghc::filesystem::path temporary_ = path.string() + ".tmp-" + generate_random_hash();
+
+  FILE* file_ = std::fopen(temporary_.string().c_str(), "wb");
+  if (NULL == file_) {
+    return false;
+  }
+
+  bool written_ = std::fwrite(contents.data(), 1, contents.size(), file_) == contents.size() &&
+                  std::fflush(file_) == 0;
+
+  // The contents must be on disk before they become visible under the name
+#ifdef _WIN32
+  written_ = written_ && _commit(_fileno(file_)) == 0;
+#else
+  written_ = written_ && fsync(fileno(file_)) == 0;
+#endif
+  written_ = (std::fclose(file_) == 0) && written_;
+
+  std::error_code ec;
+  if (written_) {
+    ghc::filesystem::rename(temporary_, path, ec);
+  }
+
+  if (!written_ || ec) {
+    ghc::filesystem::remove(temporary_, ec);
+    return false;
+  }
+  return true;
+}
+
 }; // namespace FairDataPipeline
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "fdp/objects/output_stream.hxx"
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/sha1.hxx"
+
+namespace FairDataPipeline {
+
+/*! **************************************************************************
+ * @class OutputStream::Buffer
+ * @brief stream buffer hashing and writing its put area whenever it is
+ * flushed, the C file is unbuffered as this class does the buffering
+ ****************************************************************************/
+class OutputStream::Buffer : public std::streambuf {
+public:
+  Buffer( const ghc::filesystem::path& path, std::size_t buffer_size )
+      : file_( std::fopen( path.string().c_str(), "wb" ) ),
+        buffer_( buffer_size > 1 ? buffer_size : 2 ), size_( 0 ), failed_( false )
+  {
+    if( NULL == file_ )
+      throw std::runtime_error( "File Error: Cannot open " + path.string() + " for writing" );
+    std::setvbuf( file_, NULL, _IONBF, 0 );
+
+    // The last character is kept free for overflow()
+    setp( &buffer_[0], &buffer_[0] + buffer_.size() - 1 );
+  }
+
+  ~Buffer()
+  {
+    if( file_ )
+      std::fclose( file_ );
+  }
+
+  bool is_open() const { return file_ != NULL; }
+
+  /**
+   * @brief flush and close the file
+   *
+   * @param hash receives the SHA1 of everything written
+   * @param size receives the number of bytes written
+   * @return true if every byte reached the file
+   */
+  bool close( std::string& hash, std::uint64_t& size )
+  {
+    if( !file_ )
+      return false;
+
+    flush_();
+    failed_ = ( std::fclose( file_ ) != 0 ) || failed_;
+    file_ = NULL;
+
+    hash = sha1_.hexdigest();
+    size = size_;
+    return !failed_;
+  }
+
+protected:
+  int_type overflow( int_type c ) override
+  {
+    if( !traits_type::eq_int_type( c, traits_type::eof() ) )
+    {
+      *pptr() = traits_type::to_char_type( c );
+      pbump( 1 );
+    }
+    return flush_() ? traits_type::not_eof( c ) : traits_type::eof();
+  }
+
+  std::streamsize xsputn( const char* s, std::streamsize n ) override
+  {
+    // Writes which would not fit in the buffer go straight to the file
+    if( n < epptr() - pptr() )
+      return std::streambuf::xsputn( s, n );
+
+    if( !flush_() || !write_( s, static_cast< std::size_t >( n ) ) )
+      return 0;
+    return n;
+  }
+
+  int sync() override { return flush_() ? 0 : -1; }
+
+private:
+  bool flush_()
+  {
+    const std::size_t n = static_cast< std::size_t >( pptr() - pbase() );
+    setp( &buffer_[0], &buffer_[0] + buffer_.size() - 1 );
+    return n == 0 || write_( &buffer_[0], n );
+  }
+
+  bool write_( const char* data, std::size_t n )
+  {
+    if( !file_ || failed_ )
+      return false;
+
+    sha1_.update( data, n );
+    size_ += n;
+    if( std::fwrite( data, 1, n, file_ ) != n )
+      failed_ = true;
+    return !failed_;
+  }
+
+  std::FILE* file_;
+  std::vector< char > buffer_;
+  Sha1 sha1_;
+  std::uint64_t size_;
+  bool failed_;
+};
+
+OutputStream::sptr OutputStream::construct( const ghc::filesystem::path& path,
+                                            std::size_t buffer_size )
+{
+  return OutputStream::sptr( new OutputStream( path, buffer_size ) );
+}
+
+OutputStream::OutputStream( const ghc::filesystem::path& path, std::size_t buffer_size )
+    : std::ostream( NULL ), path_( path ), buffer_( new Buffer( path, buffer_size ) ),
+      digest_( std::make_shared< Digest >() )
+{
+  rdbuf( buffer_.get() );
+}
+
+OutputStream::~OutputStream()
+{
+  try
+  {
+    close();
+  }
+  catch( const std::exception& e )
+  {
+    logger::get_logger()->error() << e.what();
+  }
+}
+
+void OutputStream::close()
+{
+  if( !buffer_->is_open() )
+    return;
+
+  std::string hash_;
+  std::uint64_t size_ = 0;
+  const bool written_ = buffer_->close( hash_, size_ ) && !bad();
+
+  if( !written_ )
+  {
+    setstate( std::ios_base::badbit );
+    throw std::runtime_error( "File Error: Failed to write " + path_.string() );
+  }
+
+  std::lock_guard< std::mutex > lock( digest_->mutex );
+  digest_->hash = hash_;
+  digest_->size = size_;
+  digest_->closed = true;
+
+  FDP_LOG( DEBUG )
+      << "OutputStream: Wrote " << size_ << " bytes to " << path_.string();
+}
+
+bool OutputStream::is_open() const
+{
+  return buffer_->is_open();
+}
+
+}; // namespace FairDataPipeline
@@ -2,13 +2,9 @@
 
 #include <regex>
 
-namespace FairDataPipeline {
-static size_t write_str_(char *ptr, size_t size, size_t nmemb, void* userdata ) {
-    std::string* data = static_cast< std::string* >( userdata );
-    data->append((char *)ptr, size * nmemb);
-    return size * nmemb;
-}
+#include "fdp/utilities/trace.hxx"
 
+namespace FairDataPipeline {
 static size_t write_file_(char*ptr, size_t size, size_t nmemb, void* userdata ) {
     FILE* stream = static_cast< FILE* >( userdata );
     size_t written_n_ = fwrite(ptr, size, nmemb, stream);
@@ -17,82 +13,122 @@ static size_t write_file_(char*ptr, size_t size, size_t nmemb, void* userdata )
 
 API::sptr API::construct( const std::string& url_root )
 {
-    return API::sptr( new API( url_root ) );
+    API::sptr api = API::sptr( new API( url_root ) );
+    api->set_metrics( Metrics::construct() );
+    return api;
 }
 
-std::string url_encode( const std::string& url) {
-  CURL *curl_ = curl_easy_init();
-  curl_easy_setopt(curl_, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
-  return curl_easy_escape(curl_, url.c_str(), 0);
-}
-
-CURL *API::setup_json_session_(std::string &addr_path, std::string *response,
-                               long &http_code, std::string token) {
-  CURL *curl_ = curl_easy_init();
-  curl_easy_setopt(curl_, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
-
-
-  if (!token.empty()) {
-    logger::get_logger()->debug() 
-        << "Adding token: " 
-        << token
-        << " to headers";
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(
-        headers, (std::string("Authorization: token ") + token).c_str());
-    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
-  }
+void API::set_metrics(Metrics::sptr metrics) {
+  metrics_ = metrics;
+  metrics_->describe("fdp_registry_requests_total", "Registry requests by method, table and HTTP code, 0 if there was no response");
+  metrics_->describe("fdp_registry_request_duration_seconds", "Time curl spent on each registry request");
+  metrics_->describe("fdp_registry_sent_bytes_total", "Bytes of request bodies sent to the registry");
+  metrics_->describe("fdp_registry_received_bytes_total", "Bytes of response bodies received from the registry");
+  metrics_->describe("fdp_registry_entry_exists_total", "POSTs answered with 409 and resolved by looking up the existing entry");
+  metrics_->describe("fdp_registry_response_cache_total", "Lookups of the in memory response cache by result");
+  metrics_->describe("fdp_registry_disk_cache_total", "Lookups and writes of the persistent registry cache by result");
+
+  // The caches count for themselves, their totals are copied in when read
+  std::weak_ptr<API> api_ = shared_from_this();
+  metrics_->add_collector([api_](Metrics &metrics) {
+    API::sptr api = api_.lock();
+    if (!api || api->get_metrics().get() != &metrics) {
+      return;
+    }
+    const ResponseCache::Stats cache_stats_ = api->get_response_cache()->get_stats();
+    Metrics::labels_type labels_;
+    labels_["result"] = "hit";
+    metrics.counter("fdp_registry_response_cache_total", labels_).set(cache_stats_.hits);
+    labels_["result"] = "coalesced";
+    metrics.counter("fdp_registry_response_cache_total", labels_).set(cache_stats_.coalesced);
+    labels_["result"] = "miss";
+    metrics.counter("fdp_registry_response_cache_total", labels_).set(cache_stats_.misses);
+
+    if (api->get_disk_cache()) {
+      const DiskCache::Stats disk_stats_ = api->get_disk_cache()->get_stats();
+      labels_["result"] = "hit";
+      metrics.counter("fdp_registry_disk_cache_total", labels_).set(disk_stats_.hits);
+      labels_["result"] = "miss";
+      metrics.counter("fdp_registry_disk_cache_total", labels_).set(disk_stats_.misses);
+      labels_["result"] = "write";
+      metrics.counter("fdp_registry_disk_cache_total", labels_).set(disk_stats_.writes);
+    }
+  });
+}
 
-  logger::get_logger()->debug() 
-      << "API:JSONSession: Attempting to access: " << addr_path;
-  curl_easy_setopt(curl_, CURLOPT_URL, addr_path.c_str());
-  curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 1);
-  curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_str_);
-  curl_easy_setopt(curl_, CURLOPT_WRITEDATA, response);
-  CURLcode res = curl_easy_perform(curl_);
-  if (res == CURLE_OK) {
-    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_code);
-  } else {
-    http_code = 0;
-  }
-  curl_easy_cleanup(curl_);
-  curl_global_cleanup();
+void API::record_request_(Metrics &metrics, const std::string &table,
+                          const HttpRequest &request,
+                          const HttpResponse &response) {
+  Metrics::labels_type labels_;
+  labels_["method"] = method_name(request.method);
+  labels_["table"] = table;
+  metrics.histogram("fdp_registry_request_duration_seconds", labels_).record(response.total_time);
+  labels_["code"] = std::to_string(response.http_code);
+  metrics.counter("fdp_registry_requests_total", labels_).increment();
+  metrics.counter("fdp_registry_sent_bytes_total").increment(request.body.size());
+  metrics.counter("fdp_registry_received_bytes_total").increment(response.body.size());
+}
+
+API::API( const std::string& url_root )
+    : url_root_( API::append_with_forward_slash( url_root ) ),
+      curl_pool_( CurlPool::construct() ),
+      response_cache_( ResponseCache::construct() ),
+      transport_( CurlTransport::construct( curl_pool_ ) ),
+      max_in_flight_( 8 ), dispatcher_running_( false ) {}
 
-  return curl_;
+std::string url_encode( const std::string& url) {
+  // Percent encode everything except the RFC 3986 unreserved characters,
+  // matching curl_easy_escape without needing a CURL handle per call
+  static const char hex_[] = "0123456789ABCDEF";
+  std::string encoded_;
+  encoded_.reserve(url.size() * 3);
+  for (std::string::const_iterator it = url.begin(); it != url.end(); ++it) {
+    const unsigned char c_ = static_cast<unsigned char>(*it);
+    if ((c_ >= 'A' && c_ <= 'Z') || (c_ >= 'a' && c_ <= 'z') ||
+        (c_ >= '0' && c_ <= '9') || c_ == '-' || c_ == '.' || c_ == '_' ||
+        c_ == '~') {
+      encoded_ += static_cast<char>(c_);
+    } else {
+      encoded_ += '%';
+      encoded_ += hex_[c_ >> 4];
+      encoded_ += hex_[c_ & 0x0F];
+    }
+  }
+  return encoded_;
 }
 
 void API::download_file(const ghc::filesystem::path &url,
                         ghc::filesystem::path out_path) {
-  CURL *curl_ = curl_easy_init();
   FILE *file_ = fopen(out_path.string().c_str(), "wb");
 
-  logger::get_logger()->debug() 
+  FDP_LOG(DEBUG) 
       << "API: Downloading file '"
       << url.string()
       << "' -> '" << out_path.string() << "'", url.string();
-  curl_easy_setopt(curl_, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);                 
-  curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
-  curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_file_);
-  curl_easy_setopt(curl_, CURLOPT_WRITEDATA, file_);
-  curl_easy_perform(curl_);
+  setup_download_session_(url, file_);
   fclose(file_);
 }
 
-CURL *API::setup_download_session_(const ghc::filesystem::path &addr_path,
+void API::setup_download_session_(const ghc::filesystem::path &addr_path,
                                    FILE *file) {
-  CURL *curl_ = curl_easy_init();
+  CurlPool::Handle handle_(curl_pool_);
+  CURL *curl_ = handle_.get();
 
-  logger::get_logger()->debug() 
+  FDP_LOG(DEBUG) 
       << "API:DownloadSession: Attempting to access: " << addr_path.string();
 
   curl_easy_setopt(curl_, CURLOPT_URL, addr_path.string().c_str());
-  curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 1);
   curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_file_);
   curl_easy_setopt(curl_, CURLOPT_WRITEDATA, file);
-  curl_easy_perform(curl_);
-  curl_easy_cleanup(curl_);
-  curl_global_cleanup();
-  return curl_;
+
+  const std::uint64_t trace_start_ = trace::enabled() ? trace::now_ns() : 0;
+  HttpResponse response_;
+  complete_transfer(curl_, curl_easy_perform(curl_), &response_);
+  if (trace_start_) {
+    HttpRequest request_;
+    request_.url = addr_path.string();
+    trace_transfer(curl_, request_, response_, trace_start_, 0);
+  }
 }
 
 Json::Value API::get_request(const ghc::filesystem::path &addr_path,
@@ -101,51 +137,160 @@ Json::Value API::get_request(const ghc::filesystem::path &addr_path,
   return get_request(addr_path_, expected_response);
 }
 
-Json::Value API::get_request(const std::string &addr_path, long expected_response, std::string token) {
-  Json::Value root_;
-  Json::CharReaderBuilder json_charbuilder_;
-
-  long http_code;
+HttpRequest API::make_get_request_(const std::string &addr_path,
+                                   const std::string &token) const {
+  HttpRequest request_;
+  request_.method = HttpRequest::GET;
+  request_.url = url_root_ + addr_path;
+  request_.token = token;
+  return request_;
+}
 
-  std::string search_str_ = url_root_ + addr_path;
+HttpRequest API::make_post_request_(const std::string &addr_path,
+                                    Json::Value &post_data,
+                                    const std::string &token, bool PATCH) const {
+  HttpRequest request_;
+  request_.method = PATCH ? HttpRequest::PATCH : HttpRequest::POST;
+  request_.url = url_root_ + API::append_with_forward_slash(addr_path);
+  request_.body = json_to_string(post_data);
+  request_.token = token;
+  FDP_LOG(DEBUG) << "API:Post: Post Data\n" << request_.body;
+  return request_;
+}
 
-  std::string response_str_;
+HttpResponse API::perform_(const HttpRequest &request, const std::string &table) {
+  const HttpResponse response_ = transport_->perform(request);
+  record_request_(*metrics_, table, request, response_);
+  return response_;
+}
 
-  auto *session_ = setup_json_session_(search_str_, &response_str_, http_code, token);
+Json::Value API::parse_json_response_(const std::string &context,
+                                      const HttpResponse &response) {
+  Json::Value root_;
+  Json::CharReaderBuilder json_charbuilder_;
 
   const std::unique_ptr<Json::CharReader> json_reader_(
       json_charbuilder_.newCharReader());
-  const auto response_str_len_ = response_str_.length();
+  const auto response_str_len_ = response.body.length();
   JSONCPP_STRING err;
 
-  if (http_code == 0) {
+  if (!json_reader_->parse(response.body.c_str(),
+                           response.body.c_str() + response_str_len_, &root_,
+                           &err)) {
+    logger::get_logger()->error() 
+        << context << ": Response string '"
+        << response.body
+        << "' is not JSON parsable. Return Code was "
+        << response.http_code;
+    throw rest_apiquery_error(
+        "Failed to retrieve information from JSON response string", response.http_code);
+  }
+
+  return (root_.isMember("results")) ? root_["results"] : root_;
+}
+
+Json::Value API::handle_get_response_(const HttpRequest &request,
+                                      const HttpResponse &response,
+                                      long expected_response) {
+  if (response.http_code == 0) {
     logger::get_logger()->error() 
         << "API:Request: Request to '"
-        << search_str_
+        << request.url
         << "' returned no response";
     throw rest_apiquery_error("No response was given");
   }
 
-  else if (http_code != expected_response) {
-    throw rest_apiquery_error("Request '" + search_str_ +
+  else if (response.http_code != expected_response) {
+    throw rest_apiquery_error("Request '" + request.url +
                               "' returned exit code " +
-                              std::to_string(http_code) + " but expected " +
-                              std::to_string(expected_response));
+                              std::to_string(response.http_code) + " but expected " +
+                              std::to_string(expected_response), response.http_code);
   }
 
-  if (!json_reader_->parse(response_str_.c_str(),
-                           response_str_.c_str() + response_str_len_, &root_,
-                           &err)) {
+  return parse_json_response_("API:Query", response);
+}
+
+bool API::entry_exists_(const std::string &addr_path,
+                        const HttpRequest &request,
+                        const HttpResponse &response,
+                        long expected_response) {
+  if (response.result != CURLE_OK) {
     logger::get_logger()->error() 
-        << "API:Query: Response string '"
-        << response_str_
-        << "' is not JSON parsable. Return Code was "
-        << http_code;
+        << "API:Post: Post to '"
+        << request.url
+        << "' returned no response";
+    throw rest_apiquery_error("No response was given");
+  }
+
+  if (response.http_code == 404) {
+    throw rest_apiquery_error("'" + addr_path + "' does not exist", response.http_code);
+  }
+
+  else if (response.http_code == 409) {
+    logger::get_logger()->info() 
+        << "API:Post Entry Exists attempting to return entry";
+    return true;
+  }
+
+  else if (response.http_code != expected_response) {
     throw rest_apiquery_error(
-        "Failed to retrieve information from JSON response string");
+        "API:Post: '" + request.url + "' returned exit code " +
+        std::to_string(response.http_code) + " but expected " +
+        std::to_string(expected_response) + " Responce: " + response.body, response.http_code);
   }
 
-  return (root_.isMember("results")) ? root_["results"] : root_;
+  return false;
+}
+
+Json::Value API::get_request(const std::string &addr_path, long expected_response, std::string token) {
+  const HttpRequest request_ = make_get_request_(addr_path, token);
+  const std::string table_ = ResponseCache::table_of(addr_path);
+  if (expected_response != 200) {
+    return handle_get_response_(request_, perform_(request_, table_), expected_response);
+  }
+
+  const std::string key_ = ResponseCache::make_key(addr_path, token);
+  return response_cache_->get(key_, table_, [&]() {
+    Json::Value value_;
+    if (persistent_(table_) && disk_cache_->load(key_, value_)) {
+      return value_;
+    }
+    value_ = handle_get_response_(request_, perform_(request_, table_), expected_response);
+    if (persistent_(table_) && !(value_.isArray() && value_.empty())) {
+      disk_cache_->save(key_, value_);
+    }
+    return value_;
+  });
+}
+
+bool API::persistent_(const std::string &table) const {
+  return disk_cache_ && response_cache_->get_ttl(table) == ResponseCache::immutable();
+}
+
+// Tables where POSTing the same fields again yields the existing entry, in
+// the others, such as object and data_product, every POST adds a new entry
+static bool unique_on_fields_(const std::string &table) {
+  static const char* const tables_[] = {
+      "users", "storage_root", "storage_location", "file_type", "namespace"};
+  for (std::size_t i = 0; i < sizeof(tables_) / sizeof(tables_[0]); ++i) {
+    if (table == tables_[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void API::invalidate_cache_(ResponseCache &cache, const std::string &addr_path,
+                            long http_code, bool PATCH) {
+  // A 409 means nothing was written
+  if (http_code == 409) {
+    return;
+  }
+  if (PATCH) {
+    cache.invalidate(ResponseCache::table_of(addr_path));
+  } else {
+    cache.invalidate_queries(ResponseCache::table_of(addr_path));
+  }
 }
 
 Json::Value API::get_by_json_query(const std::string &addr_path,
@@ -227,95 +372,209 @@ Json::Value API::patch(std::string addr_path, Json::Value &post_data,
 Json::Value API::post_patch_request(std::string addr_path, Json::Value &post_data,
                          const std::string &token, long expected_response,
                          bool PATCH) {
-  const std::string url_path_ =
-      url_root_ + API::append_with_forward_slash(addr_path);
-  const std::string data_ = json_to_string(post_data);
-  logger::get_logger()->debug() << "API:Post: Post Data\n" << data_;
-  long return_code_;
-  std::string response_;
-  CURL *curl_ = curl_easy_init();
-
-  struct curl_slist *headers = NULL;
-  headers = curl_slist_append(headers, "Content-Type: application/json");
-
-  if (!token.empty()) {
-    logger::get_logger()->debug()
-        << "Adding token: "
-        << token
-        << " to headers";
-    headers = curl_slist_append(
-        headers, (std::string("Authorization: token ") + token).c_str());
-  }
-  curl_easy_setopt(curl_, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
-  curl_easy_setopt(curl_, CURLOPT_URL, url_path_.c_str());
-  curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
-  if (PATCH) {
-    curl_easy_setopt(curl_, CURLOPT_CUSTOMREQUEST, "PATCH");
+  const HttpRequest request_ = make_post_request_(addr_path, post_data, token, PATCH);
+
+  // Registering the same entry of a table which is unique on its fields
+  // always yields the same entry, so a previous process's result can be
+  // reused without contacting the registry
+  const std::string table_ = ResponseCache::table_of(addr_path);
+  const std::string key_ = "POST\n" + ResponseCache::make_key(addr_path, token) + "\n" + request_.body;
+  const bool persistent_post_ = !PATCH && persistent_(table_) && unique_on_fields_(table_);
+  Json::Value value_;
+  if (persistent_post_ && disk_cache_->load(key_, value_)) {
+    return value_;
   }
 
-  curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, data_.c_str());
-  curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_str_);
-  curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response_);
+  const HttpResponse response_ = perform_(request_, table_);
+  invalidate_cache_(*response_cache_, addr_path, response_.http_code, PATCH);
 
-  CURLcode res = curl_easy_perform(curl_);
-  long http_code;
-
-  if (res == CURLE_OK) {
-    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_code);
+  if (entry_exists_(addr_path, request_, response_, expected_response)) {
+    Metrics::labels_type labels_;
+    labels_["table"] = table_;
+    metrics_->counter("fdp_registry_entry_exists_total", labels_).increment();
+    value_ = get_request(API::append_with_forward_slash(addr_path) +
+                   json_to_query_string(post_data))[0];
   } else {
-    curl_easy_cleanup(curl_);
-    curl_global_cleanup();
-    logger::get_logger()->error() 
-        << "API:Post: Post to '"
-        <<url_path_
-        << "' returned no response";
-    throw rest_apiquery_error("No response was given");
+    value_ = parse_json_response_("API:Post", response_);
   }
 
-  curl_easy_cleanup(curl_);
-  curl_global_cleanup();
-
-  if (http_code == 404) {
-    throw rest_apiquery_error("'" + addr_path + "' does not exist");
+  if (persistent_post_ && !value_.isNull()) {
+    disk_cache_->save(key_, value_);
   }
+  return value_;
+}
 
-  else if (http_code == 409) {
-    logger::get_logger()->info() 
-        << "API:Post Entry Exists attempting to return entry";
-    return get_request(API::append_with_forward_slash(addr_path) +
-                   json_to_query_string(post_data))[0];
+void API::submit_get_(RequestLoop &multi, const std::string &addr_path,
+                      long expected_response, const std::string &token,
+                      promise_sptr promise) {
+  const HttpRequest request_ = make_get_request_(addr_path, token);
+  const std::string key_ = ResponseCache::make_key(addr_path, token);
+  const std::string table_ = ResponseCache::table_of(addr_path);
+  ResponseCache::sptr cache_ = response_cache_;
+  Metrics::sptr metrics_ = this->metrics_;
+
+  Json::Value cached_;
+  if (expected_response == 200 && cache_->lookup(key_, table_, cached_)) {
+    promise->set_value(cached_);
+    return;
   }
 
-  else if (http_code != expected_response) {
-    throw rest_apiquery_error(
-        "API:Post: '" + url_path_ + "' returned exit code " +
-        std::to_string(http_code) + " but expected " +
-        std::to_string(expected_response) + " Responce: " + response_);
-  }
+  multi.add(request_, [=](HttpResponse &response) {
+    API::record_request_(*metrics_, table_, request_, response);
+    try {
+      const Json::Value value_ = API::handle_get_response_(request_, response, expected_response);
+      if (expected_response == 200) {
+        cache_->store(key_, table_, value_);
+      }
+      promise->set_value(value_);
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+}
 
-  Json::Value root_;
-  Json::CharReaderBuilder json_charbuilder_;
+void API::submit_post_(RequestLoop &multi, const std::string &addr_path,
+                       Json::Value &post_data, const std::string &token,
+                       long expected_response, bool PATCH,
+                       promise_sptr promise) {
+  const HttpRequest request_ = make_post_request_(addr_path, post_data, token, PATCH);
+  // Query used to return the existing entry when the registry reports 409,
+  // issued on the same loop so the fallback does not block it
+  const std::string existing_ = API::append_with_forward_slash(addr_path) +
+                                json_to_query_string(post_data);
+  const HttpRequest existing_request_ = make_get_request_(existing_, "");
+  RequestLoop *multi_ = &multi;
+  ResponseCache::sptr cache_ = response_cache_;
+  Metrics::sptr metrics_ = this->metrics_;
+  const std::string table_ = ResponseCache::table_of(addr_path);
+  const std::string existing_table_ = ResponseCache::table_of(existing_);
+
+  multi.add(request_, [=](HttpResponse &response) {
+    API::record_request_(*metrics_, table_, request_, response);
+    try {
+      API::invalidate_cache_(*cache_, addr_path, response.http_code, PATCH);
+      if (API::entry_exists_(addr_path, request_, response, expected_response)) {
+        Metrics::labels_type labels_;
+        labels_["table"] = table_;
+        metrics_->counter("fdp_registry_entry_exists_total", labels_).increment();
+        multi_->add(existing_request_, [existing_request_, existing_table_, metrics_, promise](HttpResponse &existing) {
+          API::record_request_(*metrics_, existing_table_, existing_request_, existing);
+          try {
+            promise->set_value(API::handle_get_response_(existing_request_, existing, 200)[0]);
+          } catch (...) {
+            promise->set_exception(std::current_exception());
+          }
+        });
+        return;
+      }
+      promise->set_value(API::parse_json_response_("API:Post", response));
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+}
 
-  const auto response_str_len_ = response_.length();
-  const std::unique_ptr<Json::CharReader> json_reader_(
-      json_charbuilder_.newCharReader());
-  JSONCPP_STRING err;
+RequestLoop::sptr API::dispatcher_() {
+  std::call_once(dispatcher_once_, [this]() {
+    dispatcher_multi_ = transport_->loop(max_in_flight_);
+    dispatcher_running_ = true;
+    dispatcher_thread_ = std::thread([this]() {
+      trace::set_thread_name("registry dispatcher");
+      while (dispatcher_running_) {
+        if (!dispatcher_multi_->perform_once(1000)) {
+          dispatcher_multi_->wait(1000);
+        }
+      }
+    });
+  });
+  return dispatcher_multi_;
+}
 
-  if (!json_reader_->parse(response_.c_str(),
-                           response_.c_str() + response_str_len_, &root_,
-                           &err)) {
-    logger::get_logger()->error() 
-        << "API:Post: Response string '"
-        << response_
-        << "' is not JSON parsable. Return Code was "
-        << return_code_;
-    throw rest_apiquery_error(
-        "Failed to retrieve information from JSON response string");
-  }
+std::future<Json::Value> API::get_async(const std::string &addr_path,
+                                        long expected_response,
+                                        std::string token) {
+  promise_sptr promise_ = std::make_shared<std::promise<Json::Value> >();
+  submit_get_(*dispatcher_(), addr_path, expected_response, token, promise_);
+  return promise_->get_future();
+}
+
+std::future<Json::Value> API::post_async(const std::string addr_path,
+                                         Json::Value &post_data,
+                                         const std::string &token,
+                                         long expected_response) {
+  promise_sptr promise_ = std::make_shared<std::promise<Json::Value> >();
+  submit_post_(*dispatcher_(), addr_path, post_data, token, expected_response, false, promise_);
+  return promise_->get_future();
+}
+
+std::future<Json::Value> API::patch_async(const std::string addr_path,
+                                          Json::Value &post_data,
+                                          const std::string &token,
+                                          long expected_response) {
+  promise_sptr promise_ = std::make_shared<std::promise<Json::Value> >();
+  submit_post_(*dispatcher_(), addr_path, post_data, token, expected_response, true, promise_);
+  return promise_->get_future();
+}
+
+API::Batch::sptr API::batch(std::size_t max_in_flight) {
+  return API::Batch::sptr(new API::Batch(shared_from_this(), max_in_flight));
+}
+
+API::Batch::Batch(API::sptr api, std::size_t max_in_flight)
+    : api_(api), multi_(api->transport_->loop(max_in_flight)),
+      size_(0) {}
+
+std::future<Json::Value> API::Batch::get(const std::string &addr_path,
+                                         long expected_response,
+                                         std::string token) {
+  promise_sptr promise_ = std::make_shared<std::promise<Json::Value> >();
+  api_->submit_get_(*multi_, addr_path, expected_response, token, promise_);
+  ++size_;
+  return promise_->get_future();
+}
 
-  Json::Value results_ = (root_.isMember("results")) ? root_["results"] : root_;
+std::future<Json::Value> API::Batch::get_by_json_query(const std::string &addr_path,
+                                                       Json::Value &query_data,
+                                                       long expected_response,
+                                                       std::string token) {
+  return get(append_with_forward_slash(addr_path) + api_->json_to_query_string(query_data),
+             expected_response, token);
+}
 
-  return results_;
+std::future<Json::Value> API::Batch::post(const std::string addr_path,
+                                          Json::Value &post_data,
+                                          const std::string &token,
+                                          long expected_response) {
+  promise_sptr promise_ = std::make_shared<std::promise<Json::Value> >();
+  api_->submit_post_(*multi_, addr_path, post_data, token, expected_response, false, promise_);
+  ++size_;
+  return promise_->get_future();
+}
+
+std::future<Json::Value> API::Batch::patch(const std::string addr_path,
+                                           Json::Value &post_data,
+                                           const std::string &token,
+                                           long expected_response) {
+  promise_sptr promise_ = std::make_shared<std::promise<Json::Value> >();
+  api_->submit_post_(*multi_, addr_path, post_data, token, expected_response, true, promise_);
+  ++size_;
+  return promise_->get_future();
+}
+
+void API::Batch::execute() {
+  FDP_LOG(DEBUG) 
+      << "API:Batch: Executing " << size_ << " requests with at most "
+      << multi_->max_in_flight() << " in flight";
+  multi_->run();
+  size_ = 0;
+}
+
+API::~API() {
+  if (dispatcher_thread_.joinable()) {
+    dispatcher_running_ = false;
+    dispatcher_multi_->wakeup();
+    dispatcher_thread_.join();
+  }
 }
 
 std::string API::append_with_forward_slash(std::string str) {
@@ -0,0 +1,433 @@
+#include "fdp/registry/cassette.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <sstream>
+#include <thread>
+
+#include <json/json.h>
+
+#include "fdp/exceptions.hxx"
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/trace.hxx"
+
+namespace FairDataPipeline {
+
+static const int cassette_version_ = 1;
+
+static std::string replace_all_( std::string s, const std::string& from, const std::string& to )
+{
+    if( from.empty() || from == to )
+        return s;
+    for( std::size_t pos = s.find( from ); pos != std::string::npos; pos = s.find( from, pos + to.size() ) )
+        s.replace( pos, from.size(), to );
+    return s;
+}
+
+static std::string to_line_( const Json::Value& value )
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    builder["precision"] = 6;
+    return Json::writeString( builder, value ) + "\n";
+}
+
+// Recordings are matched on the request without its token
+static std::string url_key_( HttpRequest::Method method, const std::string& url )
+{
+    return std::string( method_name( method ) ) + " " + url;
+}
+
+static std::string exact_key_( HttpRequest::Method method, const std::string& url, const std::string& body )
+{
+    return url_key_( method, url ) + "\n" + body;
+}
+
+static void trace_replay_( const HttpRequest& request, const HttpResponse& response, std::uint64_t start_ns,
+                           std::uint64_t async_id )
+{
+    std::string args;
+    trace::append_arg( args, "url", request.url );
+    trace::append_arg( args, "http_code", static_cast< long long >( response.http_code ) );
+    trace::append_arg( args, "replay", std::string( "true" ) );
+    trace::record( "api", method_name( request.method ), start_ns, trace::now_ns() - start_ns, args, async_id );
+}
+
+/*! **************************************************************************
+ * @brief loop of another transport recording each response before it is
+ * handed to the callback
+ ****************************************************************************/
+class RecordingTransport::Loop : public RequestLoop {
+public:
+    Loop( RecordingTransport::sptr transport, RequestLoop::sptr loop )
+        : transport_( transport ), loop_( loop ) {}
+
+    void add( const HttpRequest& request, callback_type on_done )
+    {
+        RecordingTransport::sptr transport = transport_;
+        loop_->add( request, [transport, request, on_done]( HttpResponse& response ) {
+            transport->record_( request, response );
+            on_done( response );
+        } );
+    }
+
+    void run() { loop_->run(); }
+    bool perform_once( int timeout_ms ) { return loop_->perform_once( timeout_ms ); }
+    void wait( int timeout_ms ) { loop_->wait( timeout_ms ); }
+    void wakeup() { loop_->wakeup(); }
+    std::size_t max_in_flight() const { return loop_->max_in_flight(); }
+
+private:
+    RecordingTransport::sptr transport_;
+    RequestLoop::sptr loop_;
+};
+
+RecordingTransport::sptr RecordingTransport::construct( Transport::sptr transport,
+                                                        const ghc::filesystem::path& path,
+                                                        const std::string& url_root )
+{
+    return RecordingTransport::sptr( new RecordingTransport( transport, path, url_root ) );
+}
+
+RecordingTransport::RecordingTransport( Transport::sptr transport, const ghc::filesystem::path& path,
+                                        const std::string& url_root )
+    : transport_( transport ), path_( path ), size_( 0 )
+{
+    if( path.has_parent_path() )
+        ghc::filesystem::create_directories( path.parent_path() );
+    out_.open( path.string().c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary );
+    if( !out_ )
+        throw write_error( "Cassette: Failed to create '" + path.string() + "'" );
+
+    Json::Value header;
+    header["cassette"] = cassette_version_;
+    header["url_root"] = url_root;
+    out_ << to_line_( header ) << std::flush;
+
+    logger::get_logger()->info() << "Cassette: Recording registry requests to " << path.string();
+}
+
+HttpResponse RecordingTransport::perform( const HttpRequest& request )
+{
+    const HttpResponse response = transport_->perform( request );
+    record_( request, response );
+    return response;
+}
+
+RequestLoop::sptr RecordingTransport::loop( std::size_t max_in_flight )
+{
+    return RequestLoop::sptr( new Loop( shared_from_this(), transport_->loop( max_in_flight ) ) );
+}
+
+std::size_t RecordingTransport::size() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return size_;
+}
+
+void RecordingTransport::record_( const HttpRequest& request, const HttpResponse& response )
+{
+    Json::Value entry;
+    entry["method"] = method_name( request.method );
+    entry["url"] = request.url;
+    if( !request.body.empty() )
+        entry["body"] = request.body;
+    entry["result"] = static_cast< int >( response.result );
+    entry["code"] = static_cast< Json::Int64 >( response.http_code );
+    entry["time"] = response.total_time;
+    entry["response"] = response.body;
+    const std::string line = to_line_( entry );
+
+    std::lock_guard< std::mutex > lock( mutex_ );
+    out_ << line << std::flush;
+    if( !out_ )
+        logger::get_logger()->error() << "Cassette: Failed to write to " << path_.string();
+    ++size_;
+}
+
+/*! **************************************************************************
+ * @brief loop answering requests from the cassette, each completing after
+ * its recorded time when timing is enabled
+ ****************************************************************************/
+class ReplayTransport::Loop : public RequestLoop {
+public:
+    Loop( ReplayTransport::sptr transport, std::size_t max_in_flight )
+        : transport_( transport ), max_in_flight_( max_in_flight > 0 ? max_in_flight : 1 ), woken_( false ) {}
+
+    ~Loop()
+    {
+        // As CurlMulti, unfinished requests are completed as aborted
+        std::vector< Pending > abandoned;
+        do
+        {
+            {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                abandoned.assign( in_flight_.begin(), in_flight_.end() );
+                abandoned.insert( abandoned.end(), queued_.begin(), queued_.end() );
+                in_flight_.clear();
+                queued_.clear();
+            }
+            for( std::size_t i = 0; i < abandoned.size(); ++i )
+            {
+                HttpResponse response;
+                response.result = CURLE_ABORTED_BY_CALLBACK;
+                abandoned[i].on_done( response );
+            }
+        } while( !abandoned.empty() );
+    }
+
+    void add( const HttpRequest& request, callback_type on_done )
+    {
+        Pending pending;
+        pending.request = request;
+        pending.on_done = on_done;
+        pending.trace_start_ns = trace::enabled() ? trace::now_ns() : 0;
+
+        std::lock_guard< std::mutex > lock( mutex_ );
+        queued_.push_back( pending );
+        woken_ = true;
+        woken_condition_.notify_all();
+    }
+
+    void run()
+    {
+        while( perform_once( 1000 ) )
+            ;
+    }
+
+    bool perform_once( int timeout_ms )
+    {
+        std::vector< Pending > done;
+        {
+            std::lock_guard< std::mutex > lock( mutex_ );
+            start_pending_();
+            const clock::time_point now = clock::now();
+            for( std::size_t i = 0; i < in_flight_.size(); )
+            {
+                if( in_flight_[i].due <= now )
+                {
+                    done.push_back( in_flight_[i] );
+                    in_flight_.erase( in_flight_.begin() + i );
+                }
+                else
+                    ++i;
+            }
+        }
+
+        for( std::size_t i = 0; i < done.size(); ++i )
+        {
+            if( done[i].trace_start_ns )
+                trace_replay_( done[i].request, done[i].response, done[i].trace_start_ns, trace::new_async_id() );
+            try
+            {
+                done[i].on_done( done[i].response );
+            }
+            catch( const std::exception& e )
+            {
+                logger::get_logger()->error()
+                    << "Cassette: Completion of '" << done[i].request.url << "' failed: " << e.what();
+            }
+        }
+
+        std::unique_lock< std::mutex > lock( mutex_ );
+        // Completions may have freed slots or queued follow up requests
+        start_pending_();
+        if( queued_.empty() && in_flight_.empty() )
+            return false;
+        if( done.empty() )
+        {
+            clock::time_point until = clock::now() + std::chrono::milliseconds( timeout_ms );
+            for( std::size_t i = 0; i < in_flight_.size(); ++i )
+                until = std::min( until, in_flight_[i].due );
+            woken_condition_.wait_until( lock, until, [this]() { return woken_; } );
+            woken_ = false;
+        }
+        return true;
+    }
+
+    void wait( int timeout_ms )
+    {
+        std::unique_lock< std::mutex > lock( mutex_ );
+        woken_condition_.wait_for( lock, std::chrono::milliseconds( timeout_ms ), [this]() { return woken_; } );
+        woken_ = false;
+    }
+
+    void wakeup()
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        woken_ = true;
+        woken_condition_.notify_all();
+    }
+
+    std::size_t max_in_flight() const { return max_in_flight_; }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct Pending {
+        HttpRequest request;
+        HttpResponse response;
+        callback_type on_done;
+        clock::time_point due;
+        std::uint64_t trace_start_ns;
+    };
+
+    // Answers queued requests while there are free slots, mutex_ is held
+    void start_pending_()
+    {
+        while( in_flight_.size() < max_in_flight_ && !queued_.empty() )
+        {
+            Pending pending = queued_.front();
+            queued_.pop_front();
+            pending.response = transport_->lookup_( pending.request );
+            pending.due = clock::now();
+            if( transport_->timing() )
+                pending.due += std::chrono::duration_cast< clock::duration >(
+                    std::chrono::duration< double >( pending.response.total_time ) );
+            in_flight_.push_back( pending );
+        }
+    }
+
+    ReplayTransport::sptr transport_;
+    std::size_t max_in_flight_;
+
+    std::mutex mutex_;
+    std::condition_variable woken_condition_;
+    bool woken_;
+    std::deque< Pending > queued_;
+    std::vector< Pending > in_flight_;
+};
+
+ReplayTransport::sptr ReplayTransport::construct( const ghc::filesystem::path& path, const std::string& url_root,
+                                                  bool timing )
+{
+    return ReplayTransport::sptr( new ReplayTransport( path, url_root, timing ) );
+}
+
+ReplayTransport::ReplayTransport( const ghc::filesystem::path& path, const std::string& url_root, bool timing )
+    : timing_( timing ), misses_( 0 )
+{
+    std::ifstream in( path.string().c_str(), std::ios_base::in | std::ios_base::binary );
+    if( !in )
+        throw json_parse_error( "Cassette: Failed to open '" + path.string() + "'" );
+
+    Json::CharReaderBuilder builder;
+    const std::unique_ptr< Json::CharReader > reader( builder.newCharReader() );
+    std::string recorded_root;
+    std::string line;
+    std::size_t line_number = 0;
+    while( std::getline( in, line ) )
+    {
+        ++line_number;
+        if( line.empty() )
+            continue;
+
+        Json::Value value;
+        std::string errors;
+        if( !reader->parse( line.data(), line.data() + line.size(), &value, &errors ) || !value.isObject() )
+            throw json_parse_error( "Cassette: Line " + std::to_string( line_number ) + " of '" + path.string() +
+                                    "' is not valid: " + errors );
+
+        // Cassettes may be appended to one another, each starts with a header
+        if( value.isMember( "cassette" ) )
+        {
+            if( value["cassette"].asInt() != cassette_version_ )
+                throw json_parse_error( "Cassette: '" + path.string() + "' has an unsupported version" );
+            recorded_root = value["url_root"].asString();
+            continue;
+        }
+        if( line_number == 1 )
+            throw json_parse_error( "Cassette: '" + path.string() + "' is not a cassette" );
+
+        HttpRequest::Method method = HttpRequest::GET;
+        if( value["method"].asString() == "POST" )
+            method = HttpRequest::POST;
+        else if( value["method"].asString() == "PATCH" )
+            method = HttpRequest::PATCH;
+        const std::string url = replace_all_( value["url"].asString(), recorded_root, url_root );
+        const std::string body = replace_all_( value["body"].asString(), recorded_root, url_root );
+
+        Entry entry;
+        entry.response.result = static_cast< CURLcode >( value["result"].asInt() );
+        entry.response.http_code = static_cast< long >( value["code"].asInt64() );
+        entry.response.total_time = value["time"].asDouble();
+        entry.response.body = replace_all_( value["response"].asString(), recorded_root, url_root );
+
+        exact_[exact_key_( method, url, body )].entries.push_back( entries_.size() );
+        by_url_[url_key_( method, url )].entries.push_back( entries_.size() );
+        entries_.push_back( entry );
+    }
+
+    logger::get_logger()->info()
+        << "Cassette: Replaying " << entries_.size() << " registry requests from " << path.string();
+}
+
+bool ReplayTransport::take_( std::map< std::string, Matches >& index, const std::string& key,
+                             HttpResponse& response )
+{
+    std::map< std::string, Matches >::iterator it = index.find( key );
+    if( it == index.end() )
+        return false;
+
+    Matches& matches = it->second;
+    while( matches.next < matches.entries.size() && entries_[matches.entries[matches.next]].used )
+        ++matches.next;
+    if( matches.next == matches.entries.size() )
+    {
+        // Only repeat a recording once the more specific index has none left
+        if( &index == &by_url_ )
+            response = entries_[matches.entries.back()].response;
+        return &index == &by_url_;
+    }
+
+    Entry& entry = entries_[matches.entries[matches.next++]];
+    entry.used = true;
+    response = entry.response;
+    return true;
+}
+
+HttpResponse ReplayTransport::lookup_( const HttpRequest& request )
+{
+    HttpResponse response;
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        if( !take_( exact_, exact_key_( request.method, request.url, request.body ), response ) &&
+            !take_( by_url_, url_key_( request.method, request.url ), response ) )
+        {
+            ++misses_;
+            response.result = CURLE_COULDNT_CONNECT;
+            logger::get_logger()->warn()
+                << "Cassette: No recording of " << method_name( request.method ) << " " << request.url;
+            return response;
+        }
+    }
+    if( !timing_ )
+        response.total_time = 0;
+    return response;
+}
+
+HttpResponse ReplayTransport::perform( const HttpRequest& request )
+{
+    const std::uint64_t trace_start = trace::enabled() ? trace::now_ns() : 0;
+    const HttpResponse response = lookup_( request );
+    if( timing_ && response.total_time > 0 )
+        std::this_thread::sleep_for( std::chrono::duration< double >( response.total_time ) );
+    if( trace_start )
+        trace_replay_( request, response, trace_start, 0 );
+    return response;
+}
+
+RequestLoop::sptr ReplayTransport::loop( std::size_t max_in_flight )
+{
+    return RequestLoop::sptr( new Loop( shared_from_this(), max_in_flight ) );
+}
+
+std::size_t ReplayTransport::misses() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return misses_;
+}
+
+}; // namespace FairDataPipeline
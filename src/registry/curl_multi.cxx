@@ -0,0 +1,315 @@
+#include "fdp/registry/curl_multi.hxx"
+
+#include <algorithm>
+
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/trace.hxx"
+
+namespace FairDataPipeline {
+
+static size_t write_response_(char *ptr, size_t size, size_t nmemb, void* userdata ) {
+    std::string* data = static_cast< std::string* >( userdata );
+    data->append( ptr, size * nmemb );
+    return size * nmemb;
+}
+
+curl_slist* setup_transfer( CURL* curl, const HttpRequest& request,
+                            HttpResponse* response )
+{
+    struct curl_slist *headers = NULL;
+
+    if( request.method != HttpRequest::GET )
+        headers = curl_slist_append( headers, "Content-Type: application/json" );
+
+    if( !request.token.empty() )
+    {
+        FDP_LOG( DEBUG )
+            << "Adding token: "
+            << request.token
+            << " to headers";
+        headers = curl_slist_append(
+            headers, ( std::string( "Authorization: token " ) + request.token ).c_str() );
+    }
+
+    curl_easy_setopt( curl, CURLOPT_URL, request.url.c_str() );
+    if( NULL != headers )
+        curl_easy_setopt( curl, CURLOPT_HTTPHEADER, headers );
+
+    if( request.method == HttpRequest::PATCH )
+        curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST, "PATCH" );
+
+    if( request.method != HttpRequest::GET )
+    {
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDS, request.body.c_str() );
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE, static_cast< long >( request.body.size() ) );
+    }
+
+    curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, write_response_ );
+    curl_easy_setopt( curl, CURLOPT_WRITEDATA, &response->body );
+
+    return headers;
+}
+
+void complete_transfer( CURL* curl, CURLcode result, HttpResponse* response )
+{
+    response->result = result;
+    if( result == CURLE_OK )
+        curl_easy_getinfo( curl, CURLINFO_RESPONSE_CODE, &response->http_code );
+    curl_easy_getinfo( curl, CURLINFO_TOTAL_TIME, &response->total_time );
+}
+
+void trace_transfer( CURL* curl, const HttpRequest& request, const HttpResponse& response,
+                     std::uint64_t start_ns, std::uint64_t async_id )
+{
+    const std::uint64_t end_ns = trace::now_ns();
+
+    // Seconds from the start of curl's transfer to the end of each phase
+    double dns = 0, connect = 0, tls = 0, pretransfer = 0, first_byte = 0, total = 0;
+    curl_easy_getinfo( curl, CURLINFO_NAMELOOKUP_TIME, &dns );
+    curl_easy_getinfo( curl, CURLINFO_CONNECT_TIME, &connect );
+    curl_easy_getinfo( curl, CURLINFO_APPCONNECT_TIME, &tls );
+    curl_easy_getinfo( curl, CURLINFO_PRETRANSFER_TIME, &pretransfer );
+    curl_easy_getinfo( curl, CURLINFO_STARTTRANSFER_TIME, &first_byte );
+    curl_easy_getinfo( curl, CURLINFO_TOTAL_TIME, &total );
+
+    std::string args;
+    trace::append_arg( args, "url", request.url );
+    trace::append_arg( args, "http_code", static_cast< long long >( response.http_code ) );
+    if( response.result != CURLE_OK )
+        trace::append_arg( args, "error", std::string( curl_easy_strerror( response.result ) ) );
+    trace::append_arg( args, "dns_ms", dns * 1e3 );
+    trace::append_arg( args, "connect_ms", connect * 1e3 );
+    trace::append_arg( args, "tls_ms", tls * 1e3 );
+    trace::append_arg( args, "ttfb_ms", first_byte * 1e3 );
+    trace::append_arg( args, "total_ms", total * 1e3 );
+    trace::record( "api", method_name( request.method ), start_ns, end_ns - start_ns, args, async_id );
+
+    // The transfer ended just before now
+    const std::uint64_t total_ns = std::min( static_cast< std::uint64_t >( total * 1e9 ), end_ns - start_ns );
+    const std::uint64_t curl_start_ns = end_ns - total_ns;
+    struct Phase
+    {
+        const char* name;
+        double from;
+        double to;
+    };
+    const Phase phases[] = { { "dns", 0, dns },
+                             { "connect", dns, connect },
+                             { "tls", connect, tls },
+                             { "wait", std::max( std::max( connect, tls ), pretransfer ), first_byte },
+                             { "receive", first_byte, total } };
+
+    if( async_id && curl_start_ns > start_ns )
+        trace::record( "api", "queued", start_ns, curl_start_ns - start_ns, std::string(), async_id );
+    for( std::size_t i = 0; i < sizeof( phases ) / sizeof( phases[0] ); ++i )
+    {
+        if( phases[i].to <= phases[i].from )
+            continue;
+        trace::record( "api", phases[i].name, curl_start_ns + static_cast< std::uint64_t >( phases[i].from * 1e9 ),
+                       static_cast< std::uint64_t >( ( phases[i].to - phases[i].from ) * 1e9 ), std::string(),
+                       async_id );
+    }
+}
+
+struct CurlMulti::Transfer {
+    HttpRequest request;
+    HttpResponse response;
+    callback_type on_done;
+    CURL* curl;
+    curl_slist* headers;
+    std::uint64_t trace_start_ns;
+};
+
+CurlMulti::sptr CurlMulti::construct( CurlPool::sptr pool, std::size_t max_in_flight )
+{
+    return CurlMulti::sptr( new CurlMulti( pool, max_in_flight ) );
+}
+
+CurlMulti::CurlMulti( CurlPool::sptr pool, std::size_t max_in_flight )
+    : pool_( pool ), multi_( curl_multi_init() ),
+      max_in_flight_( max_in_flight > 0 ? max_in_flight : 1 ), in_flight_( 0 )
+{
+}
+
+CurlMulti::~CurlMulti()
+{
+    // Abandon anything in flight, callbacks are still run so that waiting
+    // futures are not left without a value
+    while( !active_.empty() )
+        finish_( active_.back(), CURLE_ABORTED_BY_CALLBACK );
+
+    // Completion callbacks may queue follow up requests, keep draining
+    std::deque< Transfer* > pending;
+    do
+    {
+        {
+            std::lock_guard< std::mutex > lock( pending_mutex_ );
+            pending.swap( pending_ );
+        }
+        for( std::size_t i = 0; i < pending.size(); ++i )
+        {
+            pending[i]->response.result = CURLE_ABORTED_BY_CALLBACK;
+            pending[i]->on_done( pending[i]->response );
+            delete pending[i];
+        }
+        pending.clear();
+    } while( has_work_() );
+
+    curl_multi_cleanup( multi_ );
+}
+
+void CurlMulti::add( const HttpRequest& request, callback_type on_done )
+{
+    Transfer* transfer = new Transfer();
+    transfer->request = request;
+    transfer->on_done = on_done;
+    transfer->curl = NULL;
+    transfer->headers = NULL;
+    transfer->trace_start_ns = trace::enabled() ? trace::now_ns() : 0;
+
+    {
+        std::lock_guard< std::mutex > lock( pending_mutex_ );
+        pending_.push_back( transfer );
+    }
+    wakeup();
+}
+
+void CurlMulti::wakeup()
+{
+    curl_multi_wakeup( multi_ );
+}
+
+bool CurlMulti::has_work_()
+{
+    std::lock_guard< std::mutex > lock( pending_mutex_ );
+    return in_flight_ > 0 || !pending_.empty();
+}
+
+void CurlMulti::start_pending_()
+{
+    while( in_flight_ < max_in_flight_ )
+    {
+        Transfer* transfer = NULL;
+        {
+            std::lock_guard< std::mutex > lock( pending_mutex_ );
+            if( pending_.empty() )
+                return;
+            transfer = pending_.front();
+            pending_.pop_front();
+            ++in_flight_;
+        }
+
+        FDP_LOG( DEBUG )
+            << "API:Multi: Starting request to: " << transfer->request.url;
+
+        transfer->curl = pool_->acquire();
+        transfer->headers = setup_transfer( transfer->curl, transfer->request, &transfer->response );
+        curl_easy_setopt( transfer->curl, CURLOPT_PRIVATE, transfer );
+        curl_multi_add_handle( multi_, transfer->curl );
+        active_.push_back( transfer );
+    }
+}
+
+void CurlMulti::finish_( Transfer* transfer, CURLcode result )
+{
+    curl_multi_remove_handle( multi_, transfer->curl );
+    active_.erase( std::remove( active_.begin(), active_.end(), transfer ), active_.end() );
+
+    complete_transfer( transfer->curl, result, &transfer->response );
+
+    // Transfers overlap on the thread driving the loop, each gets a track
+    if( transfer->trace_start_ns )
+        trace_transfer( transfer->curl, transfer->request, transfer->response, transfer->trace_start_ns,
+                        trace::new_async_id() );
+
+    pool_->release( transfer->curl );
+    curl_slist_free_all( transfer->headers );
+    {
+        std::lock_guard< std::mutex > lock( pending_mutex_ );
+        --in_flight_;
+    }
+
+    try
+    {
+        transfer->on_done( transfer->response );
+    }
+    catch( const std::exception& e )
+    {
+        logger::get_logger()->error()
+            << "API:Multi: Completion of '" << transfer->request.url
+            << "' failed: " << e.what();
+    }
+
+    delete transfer;
+}
+
+bool CurlMulti::perform_once( int timeout_ms )
+{
+    start_pending_();
+
+    int running = 0;
+    curl_multi_perform( multi_, &running );
+
+    CURLMsg* msg;
+    int remaining = 0;
+    while( NULL != ( msg = curl_multi_info_read( multi_, &remaining ) ) )
+    {
+        if( msg->msg != CURLMSG_DONE )
+            continue;
+
+        Transfer* transfer = NULL;
+        curl_easy_getinfo( msg->easy_handle, CURLINFO_PRIVATE, &transfer );
+        finish_( transfer, msg->data.result );
+    }
+
+    // Completions may have freed slots or queued follow up requests
+    start_pending_();
+
+    if( !has_work_() )
+        return false;
+
+    curl_multi_poll( multi_, NULL, 0, timeout_ms, NULL );
+    return true;
+}
+
+void CurlMulti::wait( int timeout_ms )
+{
+    curl_multi_poll( multi_, NULL, 0, timeout_ms, NULL );
+}
+
+void CurlMulti::run()
+{
+    while( perform_once( 1000 ) )
+        ;
+}
+
+CurlTransport::sptr CurlTransport::construct( CurlPool::sptr pool )
+{
+    return CurlTransport::sptr( new CurlTransport( pool ) );
+}
+
+HttpResponse CurlTransport::perform( const HttpRequest& request )
+{
+    HttpResponse response;
+    CurlPool::Handle handle( pool_ );
+    CURL* curl = handle.get();
+
+    FDP_LOG( DEBUG )
+        << "API:JSONSession: Attempting to access: " << request.url;
+
+    const std::uint64_t trace_start = trace::enabled() ? trace::now_ns() : 0;
+    curl_slist* headers = setup_transfer( curl, request, &response );
+    complete_transfer( curl, curl_easy_perform( curl ), &response );
+    curl_slist_free_all( headers );
+    if( trace_start )
+        trace_transfer( curl, request, response, trace_start, 0 );
+
+    return response;
+}
+
+RequestLoop::sptr CurlTransport::loop( std::size_t max_in_flight )
+{
+    return CurlMulti::construct( pool_, max_in_flight );
+}
+
+}; // namespace FairDataPipeline
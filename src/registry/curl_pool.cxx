@@ -0,0 +1,132 @@
+#include "fdp/registry/curl_pool.hxx"
+
+#include <stdexcept>
+
+#include "fdp/utilities/logging.hxx"
+
+namespace FairDataPipeline {
+
+static std::once_flag curl_global_init_flag_;
+
+CurlPool::sptr CurlPool::construct( std::size_t max_idle, const std::string& unix_socket )
+{
+    // curl_global_init is not thread safe, so perform it exactly once for
+    // the lifetime of the process rather than per request
+    std::call_once( curl_global_init_flag_, [](){
+        curl_global_init( CURL_GLOBAL_DEFAULT );
+    });
+
+    const curl_version_info_data* version_ = curl_version_info( CURLVERSION_NOW );
+    if( !unix_socket.empty() && !( version_->features & CURL_VERSION_UNIX_SOCKETS ) )
+        throw std::runtime_error( "CurlPool: libcurl was built without Unix socket support" );
+
+    return CurlPool::sptr( new CurlPool( max_idle, unix_socket ) );
+}
+
+CurlPool::CurlPool( std::size_t max_idle, const std::string& unix_socket )
+    : share_( curl_share_init() ), max_idle_( max_idle ), created_( 0 ), unix_socket_( unix_socket )
+{
+    curl_share_setopt( share_, CURLSHOPT_LOCKFUNC, CurlPool::lock_share_ );
+    curl_share_setopt( share_, CURLSHOPT_UNLOCKFUNC, CurlPool::unlock_share_ );
+    curl_share_setopt( share_, CURLSHOPT_USERDATA, this );
+    curl_share_setopt( share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+    curl_share_setopt( share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION );
+    curl_share_setopt( share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT );
+}
+
+CurlPool::~CurlPool()
+{
+    for( std::size_t i = 0; i < idle_.size(); ++i )
+        curl_easy_cleanup( idle_[i] );
+    idle_.clear();
+    curl_share_cleanup( share_ );
+}
+
+void CurlPool::lock_share_( CURL* curl, curl_lock_data data,
+                            curl_lock_access access, void* userptr )
+{
+    (void)curl;
+    (void)access;
+    static_cast< CurlPool* >( userptr )->share_locks_[ data ].lock();
+}
+
+void CurlPool::unlock_share_( CURL* curl, curl_lock_data data, void* userptr )
+{
+    (void)curl;
+    static_cast< CurlPool* >( userptr )->share_locks_[ data ].unlock();
+}
+
+void CurlPool::apply_defaults_( CURL* curl )
+{
+    curl_easy_setopt( curl, CURLOPT_SHARE, share_ );
+    curl_easy_setopt( curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2 );
+    curl_easy_setopt( curl, CURLOPT_NOPROGRESS, 1L );
+    // Handles may be used from worker threads, signals are not safe there
+    curl_easy_setopt( curl, CURLOPT_NOSIGNAL, 1L );
+    curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE, 1L );
+    curl_easy_setopt( curl, CURLOPT_SSL_SESSIONID_CACHE, 1L );
+    if( !unix_socket_.empty() )
+        curl_easy_setopt( curl, CURLOPT_UNIX_SOCKET_PATH, unix_socket_.c_str() );
+}
+
+CURL* CurlPool::acquire()
+{
+    CURL* curl = NULL;
+    {
+        std::lock_guard< std::mutex > lock( idle_mutex_ );
+        if( !idle_.empty() )
+        {
+            curl = idle_.back();
+            idle_.pop_back();
+        }
+        else
+        {
+            ++created_;
+        }
+    }
+
+    if( NULL == curl )
+    {
+        FDP_LOG( TRACE ) << "CurlPool: Creating new handle";
+        curl = curl_easy_init();
+        apply_defaults_( curl );
+    }
+
+    return curl;
+}
+
+void CurlPool::release( CURL* curl )
+{
+    if( NULL == curl )
+        return;
+
+    // Resetting drops per request options (headers, method, body) but keeps
+    // the live connection and the attached share
+    curl_easy_reset( curl );
+    apply_defaults_( curl );
+
+    {
+        std::lock_guard< std::mutex > lock( idle_mutex_ );
+        if( idle_.size() < max_idle_ )
+        {
+            idle_.push_back( curl );
+            return;
+        }
+    }
+
+    curl_easy_cleanup( curl );
+}
+
+std::size_t CurlPool::idle_count() const
+{
+    std::lock_guard< std::mutex > lock( idle_mutex_ );
+    return idle_.size();
+}
+
+std::size_t CurlPool::created_count() const
+{
+    std::lock_guard< std::mutex > lock( idle_mutex_ );
+    return created_;
+}
+
+}; // namespace FairDataPipeline
@@ -2,7 +2,7 @@
 
 namespace FairDataPipeline {
 YAML::Node parse_yaml_(ghc::filesystem::path yaml_path) {
-  logger::get_logger()->debug() 
+  FDP_LOG(DEBUG) 
       << "LocalFileSystem: Reading configuration file '"
       << yaml_path.string()
       << "'";
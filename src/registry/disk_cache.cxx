@@ -0,0 +1,111 @@
+#include "fdp/registry/disk_cache.hxx"
+
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <json/reader.h>
+#include <json/writer.h>
+
+#include "fdp/objects/metadata.hxx"
+#include "fdp/utilities/logging.hxx"
+
+namespace FairDataPipeline {
+
+DiskCache::sptr DiskCache::construct( const ghc::filesystem::path& directory,
+                                      const std::string& registry_url )
+{
+    return DiskCache::sptr( new DiskCache( directory, registry_url ) );
+}
+
+DiskCache::DiskCache( const ghc::filesystem::path& directory, const std::string& registry_url )
+    : directory_( directory / calculate_hash_from_string( registry_url ) ),
+      hits_( 0 ), misses_( 0 ), writes_( 0 )
+{
+    // Several processes may be creating the directory at once
+    std::error_code ec;
+    ghc::filesystem::create_directories( directory_, ec );
+    if( !ghc::filesystem::is_directory( directory_ ) )
+    {
+        logger::get_logger()->error()
+            << "DiskCache: Failed to create cache directory " << directory_.string();
+        throw std::runtime_error( "Failed to create registry cache directory " + directory_.string() );
+    }
+
+    FDP_LOG( DEBUG )
+        << "DiskCache: Using " << directory_.string() << " for " << registry_url;
+}
+
+ghc::filesystem::path DiskCache::entry_path_( const std::string& key ) const
+{
+    return directory_ / ( calculate_hash_from_string( key ) + ".json" );
+}
+
+bool DiskCache::load( const std::string& key, Json::Value& value )
+{
+    const ghc::filesystem::path path_ = entry_path_( key );
+    std::ifstream file_( path_.string(), std::ios_base::in | std::ios_base::binary );
+    if( !file_ )
+    {
+        ++misses_;
+        return false;
+    }
+
+    Json::CharReaderBuilder builder_;
+    std::string errors_;
+    if( !Json::parseFromStream( builder_, file_, &value, &errors_ ) )
+    {
+        // Entries are renamed into place complete, so this is not a partial
+        // write from another process, discard it
+        logger::get_logger()->warn()
+            << "DiskCache: Discarding unreadable entry " << path_.string() << ": " << errors_;
+        file_.close();
+        std::error_code ec;
+        ghc::filesystem::remove( path_, ec );
+        ++misses_;
+        return false;
+    }
+
+    ++hits_;
+    return true;
+}
+
+void DiskCache::save( const std::string& key, const Json::Value& value )
+{
+    Json::StreamWriterBuilder builder_;
+    builder_["indentation"] = "";
+    const std::string contents_ = Json::writeString( builder_, value );
+
+    const ghc::filesystem::path path_ = entry_path_( key );
+    if( !write_file_atomically( path_, contents_ ) )
+    {
+        logger::get_logger()->warn()
+            << "DiskCache: Failed to write entry " << path_.string();
+        return;
+    }
+
+    ++writes_;
+}
+
+void DiskCache::clear()
+{
+    logger::get_logger()->info() << "DiskCache: Clearing " << directory_.string();
+
+    std::error_code ec;
+    for( ghc::filesystem::directory_iterator it( directory_, ec ), end; !ec && it != end; it.increment( ec ) )
+    {
+        std::error_code remove_ec;
+        ghc::filesystem::remove( it->path(), remove_ec );
+    }
+}
+
+DiskCache::Stats DiskCache::get_stats() const
+{
+    Stats stats_;
+    stats_.hits = hits_;
+    stats_.misses = misses_;
+    stats_.writes = writes_;
+    return stats_;
+}
+
+}; // namespace FairDataPipeline
@@ -0,0 +1,849 @@
+#include "fdp/registry/embedded_registry.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+#include "fdp/exceptions.hxx"
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/trace.hxx"
+
+namespace FairDataPipeline {
+
+static const int journal_version_ = 1;
+
+// Fields which together must be unique within a table, a POST duplicating
+// an existing entry is answered with 409 Conflict as by the registry
+static std::map< std::string, std::vector< std::string > > make_unique_fields_()
+{
+    std::map< std::string, std::vector< std::string > > fields;
+    fields["users"] = std::vector< std::string >( 1, "username" );
+    fields["storage_root"] = std::vector< std::string >( 1, "root" );
+    fields["namespace"] = std::vector< std::string >( 1, "name" );
+
+    fields["storage_location"].push_back( "path" );
+    fields["storage_location"].push_back( "hash" );
+    fields["storage_location"].push_back( "storage_root" );
+
+    fields["file_type"].push_back( "name" );
+    fields["file_type"].push_back( "extension" );
+
+    fields["data_product"].push_back( "name" );
+    fields["data_product"].push_back( "version" );
+    fields["data_product"].push_back( "namespace" );
+    return fields;
+}
+
+static const std::vector< std::string >& unique_fields_( const std::string& table )
+{
+    static const std::map< std::string, std::vector< std::string > > fields = make_unique_fields_();
+    static const std::vector< std::string > none;
+    std::map< std::string, std::vector< std::string > >::const_iterator it = fields.find( table );
+    return it == fields.end() ? none : it->second;
+}
+
+static std::string replace_all_( std::string s, const std::string& from, const std::string& to )
+{
+    if( from.empty() || from == to )
+        return s;
+    for( std::size_t pos = s.find( from ); pos != std::string::npos; pos = s.find( from, pos + to.size() ) )
+        s.replace( pos, from.size(), to );
+    return s;
+}
+
+static std::string url_decode_( const std::string& value )
+{
+    std::string decoded;
+    for( std::size_t i = 0; i < value.size(); ++i )
+    {
+        if( value[i] == '%' && i + 2 < value.size() )
+        {
+            decoded += static_cast< char >( std::strtol( value.substr( i + 1, 2 ).c_str(), NULL, 16 ) );
+            i += 2;
+        }
+        else if( value[i] == '+' )
+            decoded += ' ';
+        else
+            decoded += value[i];
+    }
+    return decoded;
+}
+
+static std::vector< std::pair< std::string, std::string > > parse_query_( const std::string& query )
+{
+    std::vector< std::pair< std::string, std::string > > filters;
+    std::istringstream stream( query );
+    std::string pair;
+    while( std::getline( stream, pair, '&' ) )
+    {
+        if( pair.empty() )
+            continue;
+        const std::size_t eq = pair.find( '=' );
+        if( eq == std::string::npos )
+            continue;
+        filters.push_back( std::make_pair( pair.substr( 0, eq ), url_decode_( pair.substr( eq + 1 ) ) ) );
+    }
+    return filters;
+}
+
+// Registry URLs are given in queries by their trailing id
+static std::string trailing_id_( const std::string& url )
+{
+    std::string trimmed = url;
+    if( !trimmed.empty() && trimmed[trimmed.size() - 1] == '/' )
+        trimmed.erase( trimmed.size() - 1 );
+    const std::size_t slash = trimmed.find_last_of( '/' );
+    if( slash == std::string::npos || trimmed.find( "://" ) == std::string::npos )
+        return std::string();
+    const std::string id = trimmed.substr( slash + 1 );
+    if( id.empty() || id.find_first_not_of( "0123456789" ) != std::string::npos )
+        return std::string();
+    return id;
+}
+
+// Appends the values a query may give to match a field: its value, the
+// trailing id of a registry URL, either spelling of a bool or any element
+// of a list
+static void index_values_( const Json::Value& field, std::vector< std::string >& values )
+{
+    if( field.isArray() )
+    {
+        for( Json::Value::ArrayIndex i = 0; i < field.size(); ++i )
+            index_values_( field[i], values );
+        return;
+    }
+    if( field.isBool() )
+    {
+        values.push_back( field.asBool() ? "true" : "false" );
+        values.push_back( field.asBool() ? "True" : "False" );
+        return;
+    }
+    if( field.isNull() || field.isObject() )
+        return;
+
+    const std::string field_str = field.asString();
+    values.push_back( field_str );
+    const std::string id = trailing_id_( field_str );
+    if( !id.empty() )
+        values.push_back( id );
+}
+
+static std::string index_key_( const std::string& field, const std::string& value )
+{
+    return field + "\n" + value;
+}
+
+static std::string to_json_( const Json::Value& value )
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString( builder, value );
+}
+
+static HttpResponse respond_( long http_code, const Json::Value& body )
+{
+    HttpResponse response;
+    response.http_code = http_code;
+    response.body = to_json_( body );
+    return response;
+}
+
+static HttpResponse detail_( long http_code, const std::string& message )
+{
+    Json::Value detail;
+    detail["detail"] = message;
+    return respond_( http_code, detail );
+}
+
+// Code runs are identified by a random (version 4) UUID as in the registry
+static std::string new_uuid_()
+{
+    static std::mutex mutex;
+    static std::mt19937_64 engine( ( std::random_device() )() ^
+                                   static_cast< std::uint64_t >(
+                                       std::chrono::high_resolution_clock::now().time_since_epoch().count() ) );
+    std::uint64_t high, low;
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        high = engine();
+        low = engine();
+    }
+    high = ( high & 0xFFFFFFFFFFFF0FFFULL ) | 0x0000000000004000ULL;
+    low = ( low & 0x3FFFFFFFFFFFFFFFULL ) | 0x8000000000000000ULL;
+
+    char uuid[37];
+    std::snprintf( uuid, sizeof( uuid ), "%08x-%04x-%04x-%04x-%012llx",
+                   static_cast< unsigned >( high >> 32 ), static_cast< unsigned >( ( high >> 16 ) & 0xFFFF ),
+                   static_cast< unsigned >( high & 0xFFFF ), static_cast< unsigned >( low >> 48 ),
+                   static_cast< unsigned long long >( low & 0xFFFFFFFFFFFFULL ) );
+    return uuid;
+}
+
+static void trace_embedded_( const HttpRequest& request, const HttpResponse& response, std::uint64_t start_ns,
+                             std::uint64_t async_id )
+{
+    std::string args;
+    trace::append_arg( args, "url", request.url );
+    trace::append_arg( args, "http_code", static_cast< long long >( response.http_code ) );
+    trace::append_arg( args, "embedded", std::string( "true" ) );
+    trace::record( "api", method_name( request.method ), start_ns, trace::now_ns() - start_ns, args, async_id );
+}
+
+namespace {
+
+/*! **************************************************************************
+ * @brief holds a lock of a journal shared between processes, if there is
+ * a journal
+ ****************************************************************************/
+class JournalLock {
+public:
+    JournalLock( std::FILE* journal, bool exclusive ) : journal_( journal )
+    {
+#ifndef _WIN32
+        if( journal_ )
+            while( flock( fileno( journal_ ), exclusive ? LOCK_EX : LOCK_SH ) != 0 && errno == EINTR )
+                ;
+#else
+        (void)exclusive;
+#endif
+    }
+
+    ~JournalLock()
+    {
+#ifndef _WIN32
+        if( journal_ )
+            flock( fileno( journal_ ), LOCK_UN );
+#endif
+    }
+
+private:
+    JournalLock( const JournalLock& ) = delete;
+    JournalLock& operator=( const JournalLock& ) = delete;
+
+    std::FILE* journal_;
+};
+
+} // namespace
+
+EmbeddedRegistry::sptr EmbeddedRegistry::construct( const std::string& url_root, const ghc::filesystem::path& path )
+{
+    return EmbeddedRegistry::sptr( new EmbeddedRegistry( url_root, path ) );
+}
+
+EmbeddedRegistry::EmbeddedRegistry( const std::string& url_root, const ghc::filesystem::path& path )
+    : url_root_( url_root ), path_( path ), journal_( NULL ), journal_offset_( 0 )
+{
+    if( url_root_.empty() || url_root_[url_root_.size() - 1] != '/' )
+        url_root_ += "/";
+
+    std::lock_guard< std::mutex > lock( mutex_ );
+    if( path_.empty() )
+    {
+        seed_();
+        return;
+    }
+
+    if( path_.has_parent_path() )
+    {
+        std::error_code ec;
+        ghc::filesystem::create_directories( path_.parent_path(), ec );
+    }
+    journal_ = std::fopen( path_.string().c_str(), "a+b" );
+    if( NULL == journal_ )
+        throw write_error( "EmbeddedRegistry: Failed to open '" + path_.string() + "'" );
+
+    try
+    {
+        JournalLock journal_lock( journal_, true );
+        read_journal_();
+        if( journal_offset_ == 0 )
+        {
+            Json::Value header;
+            header["embedded_registry"] = journal_version_;
+            header["url_root"] = url_root_;
+            const std::string line = to_json_( header ) + "\n";
+            std::fseek( journal_, 0, SEEK_END );
+            std::fwrite( line.data(), 1, line.size(), journal_ );
+            journal_root_ = url_root_;
+            seed_();
+            flush_journal_();
+        }
+    }
+    catch( ... )
+    {
+        std::fclose( journal_ );
+        throw;
+    }
+
+    logger::get_logger()->info()
+        << "EmbeddedRegistry: Serving " << url_root_ << " from " << path_.string();
+}
+
+EmbeddedRegistry::~EmbeddedRegistry()
+{
+    if( journal_ )
+        std::fclose( journal_ );
+}
+
+void EmbeddedRegistry::seed_()
+{
+    Json::Value user;
+    user["username"] = "admin";
+    const Json::Value j_user = insert_( "users", user );
+
+    const char* name = std::getenv( "USER" );
+    if( !name || !*name )
+        name = std::getenv( "USERNAME" );
+    Json::Value author;
+    author["name"] = name && *name ? name : "admin";
+    const Json::Value j_author = insert_( "author", author );
+
+    Json::Value user_author;
+    user_author["user"] = j_user["url"];
+    user_author["author"] = j_author["url"];
+    insert_( "user_author", user_author );
+}
+
+bool EmbeddedRegistry::journal_grown_() const
+{
+#ifndef _WIN32
+    struct stat status;
+    return fstat( fileno( journal_ ), &status ) == 0 && status.st_size > journal_offset_;
+#else
+    return false;
+#endif
+}
+
+// Applies the complete lines appended since the journal was last read
+void EmbeddedRegistry::read_journal_()
+{
+    std::fseek( journal_, journal_offset_, SEEK_SET );
+    std::string text;
+    char buffer[65536];
+    std::size_t n;
+    while( ( n = std::fread( buffer, 1, sizeof( buffer ), journal_ ) ) > 0 )
+        text.append( buffer, n );
+
+    Json::CharReaderBuilder builder;
+    const std::unique_ptr< Json::CharReader > reader( builder.newCharReader() );
+    std::size_t start = 0;
+    for( std::size_t end = text.find( '\n' ); end != std::string::npos; end = text.find( '\n', start ) )
+    {
+        const std::string line = replace_all_( text.substr( start, end - start ), journal_root_, url_root_ );
+        const long line_offset = journal_offset_ + static_cast< long >( start );
+        start = end + 1;
+        if( line.empty() )
+            continue;
+
+        Json::Value value;
+        std::string errors;
+        if( !reader->parse( line.data(), line.data() + line.size(), &value, &errors ) || !value.isObject() )
+            throw json_parse_error( "EmbeddedRegistry: Entry at offset " + std::to_string( line_offset ) +
+                                    " of '" + path_.string() + "' is not valid: " + errors );
+
+        if( value.isMember( "embedded_registry" ) )
+        {
+            if( value["embedded_registry"].asInt() != journal_version_ )
+                throw json_parse_error( "EmbeddedRegistry: '" + path_.string() + "' has an unsupported version" );
+            journal_root_ = value["url_root"].asString();
+            continue;
+        }
+        if( journal_root_.empty() )
+            throw json_parse_error( "EmbeddedRegistry: '" + path_.string() + "' is not a registry journal" );
+
+        // Each line is an entry as it stands after a change, new entries
+        // are indexed once every line has been read
+        if( !store_( value["table"].asString(), value["row"], true ) )
+            throw json_parse_error( "EmbeddedRegistry: Entry at offset " + std::to_string( line_offset ) +
+                                    " of '" + path_.string() + "' has an unexpected id" );
+    }
+    journal_offset_ += static_cast< long >( start );
+
+    for( std::map< std::string, Table >::iterator it = tables_.begin(); it != tables_.end(); ++it )
+        for( ; it->second.indexed < it->second.rows.size(); ++it->second.indexed )
+            index_row_( it->second, it->second.indexed, true );
+}
+
+void EmbeddedRegistry::write_journal_( const std::string& table, const Json::Value& row )
+{
+    if( NULL == journal_ )
+        return;
+    Json::Value value;
+    value["table"] = table;
+    value["row"] = row;
+    const std::string line = to_json_( value ) + "\n";
+    std::fseek( journal_, 0, SEEK_END );
+    if( std::fwrite( line.data(), 1, line.size(), journal_ ) != line.size() )
+        throw write_error( "EmbeddedRegistry: Failed to write to '" + path_.string() + "'" );
+}
+
+// Makes the changes visible to other processes, past which the journal has
+// been read
+void EmbeddedRegistry::flush_journal_()
+{
+    if( NULL == journal_ )
+        return;
+    if( std::fflush( journal_ ) != 0 )
+        throw write_error( "EmbeddedRegistry: Failed to write to '" + path_.string() + "'" );
+    std::fseek( journal_, 0, SEEK_END );
+    journal_offset_ = std::ftell( journal_ );
+}
+
+std::size_t EmbeddedRegistry::table_size( const std::string& table ) const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::map< std::string, Table >::const_iterator it = tables_.find( table );
+    return it == tables_.end() ? 0 : it->second.rows.size();
+}
+
+Json::Value EmbeddedRegistry::insert( const std::string& table, const Json::Value& entry )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    JournalLock journal_lock( journal_, true );
+    if( journal_ )
+        read_journal_();
+    const Json::Value row = insert_( table, entry );
+    flush_journal_();
+    return row;
+}
+
+Json::Value EmbeddedRegistry::insert_( const std::string& table, const Json::Value& entry )
+{
+    const std::size_t id = tables_[table].rows.size() + 1;
+    Json::Value row = entry;
+    row["id"] = static_cast< Json::UInt64 >( id );
+    row["url"] = url_root_ + table + "/" + std::to_string( id ) + "/";
+    if( table == "code_run" && !row.isMember( "uuid" ) )
+        row["uuid"] = new_uuid_();
+
+    // Every object gets a whole_object component as in the registry
+    if( table == "object" )
+    {
+        Json::Value component;
+        component["name"] = "whole_object";
+        component["whole_object"] = true;
+        component["object"] = row["url"];
+        row["components"].append( insert_( "object_component", component )["url"] );
+    }
+
+    store_( table, row );
+    write_journal_( table, row );
+    return row;
+}
+
+// Adds the row with the next id or replaces an existing one, false for any
+// other id. With defer_index a new row is left for the caller to index.
+bool EmbeddedRegistry::store_( const std::string& table, const Json::Value& row, bool defer_index )
+{
+    Table& entries = tables_[table];
+    const Json::UInt64 id = row["id"].asUInt64();
+    if( id < 1 || id > entries.rows.size() + 1 )
+        return false;
+
+    const std::size_t position = static_cast< std::size_t >( id - 1 );
+    if( position < entries.rows.size() )
+    {
+        const bool indexed = position < entries.indexed;
+        if( indexed )
+            index_row_( entries, position, false );
+        entries.rows[position] = row;
+        if( indexed )
+            index_row_( entries, position, true );
+    }
+    else
+    {
+        entries.rows.push_back( row );
+        if( !defer_index && entries.indexed == position )
+            index_row_( entries, entries.indexed++, true );
+    }
+    return true;
+}
+
+void EmbeddedRegistry::index_row_( Table& table, std::size_t position, bool add )
+{
+    const Json::Value& row = table.rows[position];
+    const std::vector< std::string > members = row.getMemberNames();
+    std::vector< std::string > values;
+    for( std::size_t i = 0; i < members.size(); ++i )
+    {
+        values.clear();
+        index_values_( row[members[i]], values );
+        for( std::size_t j = 0; j < values.size(); ++j )
+        {
+            std::vector< std::size_t >& positions = table.index[index_key_( members[i], values[j] )];
+            const std::vector< std::size_t >::iterator at =
+                std::lower_bound( positions.begin(), positions.end(), position );
+            const bool present = at != positions.end() && *at == position;
+            if( add && !present )
+                positions.insert( at, position );
+            else if( !add && present )
+                positions.erase( at );
+        }
+    }
+}
+
+const Json::Value* EmbeddedRegistry::find_( const std::string& table, int id ) const
+{
+    std::map< std::string, Table >::const_iterator it = tables_.find( table );
+    if( it == tables_.end() || id < 1 || static_cast< std::size_t >( id ) > it->second.rows.size() )
+        return NULL;
+    return &it->second.rows[id - 1];
+}
+
+// Positions of the rows matching every filter, in order of id
+std::vector< std::size_t > EmbeddedRegistry::select_( const std::string& table, const filter_type& filters ) const
+{
+    std::vector< std::size_t > selected;
+    std::map< std::string, Table >::const_iterator it = tables_.find( table );
+    if( it == tables_.end() )
+        return selected;
+    const Table& entries = it->second;
+
+    if( filters.empty() )
+    {
+        for( std::size_t i = 0; i < entries.rows.size(); ++i )
+            selected.push_back( i );
+        return selected;
+    }
+
+    for( std::size_t i = 0; i < filters.size(); ++i )
+    {
+        std::map< std::string, std::vector< std::size_t > >::const_iterator positions =
+            entries.index.find( index_key_( filters[i].first, filters[i].second ) );
+        if( positions == entries.index.end() || positions->second.empty() )
+            return std::vector< std::size_t >();
+        if( i == 0 )
+            selected = positions->second;
+        else
+        {
+            std::vector< std::size_t > both;
+            std::set_intersection( selected.begin(), selected.end(), positions->second.begin(),
+                                   positions->second.end(), std::back_inserter( both ) );
+            selected.swap( both );
+        }
+        if( selected.empty() )
+            break;
+    }
+    return selected;
+}
+
+HttpResponse EmbeddedRegistry::handle( const HttpRequest& request )
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Split "<url_root><table>/[<id>/][?<query>]"
+    if( request.url.compare( 0, url_root_.size(), url_root_ ) != 0 )
+        return detail_( 404, "Not found." );
+    std::string path = request.url.substr( url_root_.size() );
+    std::string query;
+    const std::size_t question = path.find( '?' );
+    if( question != std::string::npos )
+    {
+        query = path.substr( question + 1 );
+        path.erase( question );
+    }
+
+    std::vector< std::string > segments;
+    std::istringstream stream( path );
+    std::string segment;
+    while( std::getline( stream, segment, '/' ) )
+        if( !segment.empty() )
+            segments.push_back( segment );
+
+    if( segments.empty() || segments.size() > 2 )
+        return detail_( 404, "Not found." );
+
+    const std::string& table = segments[0];
+    int id = 0;
+    if( segments.size() == 2 )
+    {
+        id = std::atoi( segments[1].c_str() );
+        if( id < 1 )
+            return detail_( 404, "Not found." );
+    }
+
+    Json::Value body;
+    if( request.method != HttpRequest::GET )
+    {
+        Json::CharReaderBuilder builder;
+        std::string errors;
+        std::istringstream body_stream( request.body );
+        if( !Json::parseFromStream( builder, body_stream, &body, &errors ) || !body.isObject() )
+            return detail_( 400, "JSON parse error - " + errors );
+    }
+
+    HttpResponse response;
+    if( request.method == HttpRequest::GET )
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        // Pick up entries registered by other processes sharing the journal
+        if( journal_ && journal_grown_() )
+        {
+            JournalLock journal_lock( journal_, false );
+            read_journal_();
+        }
+        response = get_( table, id, query );
+    }
+    else if( request.method == HttpRequest::POST && id == 0 )
+        response = post_( table, body );
+    else if( request.method == HttpRequest::PATCH && id != 0 )
+        response = patch_( table, id, body );
+    else
+        response = detail_( 405, "Method not allowed." );
+
+    response.total_time = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+    return response;
+}
+
+HttpResponse EmbeddedRegistry::get_( const std::string& table, int id, const std::string& query )
+{
+    if( id != 0 )
+    {
+        const Json::Value* entry = find_( table, id );
+        if( NULL == entry )
+            return detail_( 404, "Not found." );
+        return respond_( 200, *entry );
+    }
+
+    const std::vector< std::size_t > selected = select_( table, parse_query_( query ) );
+    Json::Value results( Json::arrayValue );
+    for( std::size_t i = 0; i < selected.size(); ++i )
+        results.append( tables_[table].rows[selected[i]] );
+
+    Json::Value page;
+    page["count"] = results.size();
+    page["next"] = Json::Value::null;
+    page["previous"] = Json::Value::null;
+    page["results"] = results;
+    return respond_( 200, page );
+}
+
+HttpResponse EmbeddedRegistry::post_( const std::string& table, const Json::Value& body )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    JournalLock journal_lock( journal_, true );
+    if( journal_ )
+        read_journal_();
+
+    const std::vector< std::string >& unique = unique_fields_( table );
+    if( !unique.empty() )
+    {
+        filter_type filters;
+        for( std::size_t i = 0; i < unique.size(); ++i )
+        {
+            if( !body.isMember( unique[i] ) )
+                continue;
+            const Json::Value& value = body[unique[i]];
+            std::string match = value.isBool() ? ( value.asBool() ? "true" : "false" ) : value.asString();
+            if( !trailing_id_( match ).empty() )
+                match = trailing_id_( match );
+            filters.push_back( std::make_pair( unique[i], match ) );
+        }
+
+        if( !filters.empty() && !select_( table, filters ).empty() )
+            return detail_( 409, table + " with these fields already exists." );
+    }
+
+    const Json::Value row = insert_( table, body );
+    flush_journal_();
+    return respond_( 201, row );
+}
+
+HttpResponse EmbeddedRegistry::patch_( const std::string& table, int id, const Json::Value& body )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    JournalLock journal_lock( journal_, true );
+    if( journal_ )
+        read_journal_();
+
+    const Json::Value* entry = find_( table, id );
+    if( NULL == entry )
+        return detail_( 404, "Not found." );
+
+    Json::Value row = *entry;
+    const std::vector< std::string > members = body.getMemberNames();
+    for( std::size_t i = 0; i < members.size(); ++i )
+        if( members[i] != "url" && members[i] != "id" )
+            row[members[i]] = body[members[i]];
+
+    store_( table, row );
+    write_journal_( table, row );
+    flush_journal_();
+    return respond_( 200, row );
+}
+
+/*! **************************************************************************
+ * @brief loop answering queued requests from an EmbeddedRegistry each time
+ * it is driven
+ ****************************************************************************/
+class EmbeddedTransport::Loop : public RequestLoop {
+public:
+    Loop( EmbeddedTransport::sptr transport, std::size_t max_in_flight )
+        : transport_( transport ), max_in_flight_( max_in_flight > 0 ? max_in_flight : 1 ), woken_( false ) {}
+
+    ~Loop()
+    {
+        // As CurlMulti, unfinished requests are completed as aborted
+        for( ;; )
+        {
+            std::deque< Pending > abandoned;
+            {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                abandoned.swap( queued_ );
+            }
+            if( abandoned.empty() )
+                break;
+            for( std::size_t i = 0; i < abandoned.size(); ++i )
+            {
+                HttpResponse response;
+                response.result = CURLE_ABORTED_BY_CALLBACK;
+                abandoned[i].on_done( response );
+            }
+        }
+    }
+
+    void add( const HttpRequest& request, callback_type on_done )
+    {
+        Pending pending;
+        pending.request = request;
+        pending.on_done = on_done;
+        pending.trace_start_ns = trace::enabled() ? trace::now_ns() : 0;
+
+        std::lock_guard< std::mutex > lock( mutex_ );
+        queued_.push_back( pending );
+        woken_ = true;
+        woken_condition_.notify_all();
+    }
+
+    void run()
+    {
+        while( perform_once( 1000 ) )
+            ;
+    }
+
+    bool perform_once( int timeout_ms )
+    {
+        std::deque< Pending > done;
+        {
+            std::lock_guard< std::mutex > lock( mutex_ );
+            while( done.size() < max_in_flight_ && !queued_.empty() )
+            {
+                done.push_back( queued_.front() );
+                queued_.pop_front();
+            }
+        }
+
+        for( std::size_t i = 0; i < done.size(); ++i )
+        {
+            HttpResponse response;
+            try
+            {
+                response = transport_->registry()->handle( done[i].request );
+            }
+            catch( const std::exception& e )
+            {
+                logger::get_logger()->error()
+                    << "EmbeddedRegistry: " << method_name( done[i].request.method ) << " "
+                    << done[i].request.url << " failed: " << e.what();
+                response.result = CURLE_SEND_ERROR;
+            }
+            if( done[i].trace_start_ns )
+                trace_embedded_( done[i].request, response, done[i].trace_start_ns, trace::new_async_id() );
+            try
+            {
+                done[i].on_done( response );
+            }
+            catch( const std::exception& e )
+            {
+                logger::get_logger()->error()
+                    << "EmbeddedRegistry: Completion of '" << done[i].request.url << "' failed: " << e.what();
+            }
+        }
+
+        std::unique_lock< std::mutex > lock( mutex_ );
+        if( !queued_.empty() )
+            return true;
+        if( done.empty() )
+        {
+            woken_condition_.wait_for( lock, std::chrono::milliseconds( timeout_ms ), [this]() { return woken_; } );
+            woken_ = false;
+        }
+        return !queued_.empty();
+    }
+
+    void wait( int timeout_ms )
+    {
+        std::unique_lock< std::mutex > lock( mutex_ );
+        woken_condition_.wait_for( lock, std::chrono::milliseconds( timeout_ms ), [this]() { return woken_; } );
+        woken_ = false;
+    }
+
+    void wakeup()
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        woken_ = true;
+        woken_condition_.notify_all();
+    }
+
+    std::size_t max_in_flight() const { return max_in_flight_; }
+
+private:
+    struct Pending {
+        HttpRequest request;
+        callback_type on_done;
+        std::uint64_t trace_start_ns;
+    };
+
+    EmbeddedTransport::sptr transport_;
+    std::size_t max_in_flight_;
+
+    std::mutex mutex_;
+    std::condition_variable woken_condition_;
+    bool woken_;
+    std::deque< Pending > queued_;
+};
+
+EmbeddedTransport::sptr EmbeddedTransport::construct( EmbeddedRegistry::sptr registry )
+{
+    return EmbeddedTransport::sptr( new EmbeddedTransport( registry ) );
+}
+
+EmbeddedTransport::EmbeddedTransport( EmbeddedRegistry::sptr registry ) : registry_( registry ) {}
+
+HttpResponse EmbeddedTransport::perform( const HttpRequest& request )
+{
+    const std::uint64_t trace_start = trace::enabled() ? trace::now_ns() : 0;
+    HttpResponse response;
+    try
+    {
+        response = registry_->handle( request );
+    }
+    catch( const std::exception& e )
+    {
+        logger::get_logger()->error()
+            << "EmbeddedRegistry: " << method_name( request.method ) << " " << request.url << " failed: " << e.what();
+        response.result = CURLE_SEND_ERROR;
+    }
+    if( trace_start )
+        trace_embedded_( request, response, trace_start, 0 );
+    return response;
+}
+
+RequestLoop::sptr EmbeddedTransport::loop( std::size_t max_in_flight )
+{
+    return RequestLoop::sptr( new Loop( shared_from_this(), max_in_flight ) );
+}
+
+}; // namespace FairDataPipeline
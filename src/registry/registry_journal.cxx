@@ -0,0 +1,275 @@
+#include "fdp/registry/registry_journal.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include "fdp/exceptions.hxx"
+#include "fdp/utilities/logging.hxx"
+
+namespace FairDataPipeline {
+
+static const int journal_version_ = 1;
+static const char* const journal_extension_ = ".wal";
+static const char* const rejected_extension_ = ".rejected";
+
+static std::string to_json_( const Json::Value& value )
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString( builder, value );
+}
+
+// Take the journal's lock without waiting, false if another process holds it
+static bool lock_( std::FILE* file )
+{
+#ifndef _WIN32
+    int rc;
+    while( ( rc = flock( fileno( file ), LOCK_EX | LOCK_NB ) ) != 0 && errno == EINTR )
+        ;
+    return rc == 0;
+#else
+    (void)file;
+    return true;
+#endif
+}
+
+RegistryJournal::sptr RegistryJournal::create( const ghc::filesystem::path& path )
+{
+    if( path.has_parent_path() )
+    {
+        std::error_code ec;
+        ghc::filesystem::create_directories( path.parent_path(), ec );
+    }
+
+    // "x" fails rather than appending to the journal of another run. The
+    // journal only takes its name once locked, so that a process replaying
+    // journals never finds it before then
+    const ghc::filesystem::path creating = path.string() + ".new";
+    std::FILE* file = std::fopen( creating.string().c_str(), "wbx" );
+    if( NULL == file )
+        throw write_error( "RegistryJournal: Failed to create '" + path.string() + "'" );
+    lock_( file );
+
+    sptr journal( new RegistryJournal( creating, file ) );
+    Json::Value header;
+    header["registry_journal"] = journal_version_;
+    journal->write_( header );
+
+    std::error_code ec;
+    if( ghc::filesystem::exists( path, ec ) )
+        ec = std::make_error_code( std::errc::file_exists );
+    else
+        ghc::filesystem::rename( creating, path, ec );
+    if( ec )
+    {
+        journal->remove();
+        throw write_error( "RegistryJournal: Failed to create '" + path.string() + "'" );
+    }
+    journal->path_ = path;
+    return journal;
+}
+
+RegistryJournal::sptr RegistryJournal::open( const ghc::filesystem::path& path )
+{
+    std::FILE* file = std::fopen( path.string().c_str(), "r+b" );
+    if( NULL == file && !ghc::filesystem::exists( path ) )
+        return sptr(); // applied and removed by another process
+    if( NULL == file )
+        throw write_error( "RegistryJournal: Failed to open '" + path.string() + "'" );
+    if( !lock_( file ) )
+    {
+        std::fclose( file );
+        return sptr();
+    }
+
+    sptr journal( new RegistryJournal( path, file ) );
+    journal->read_();
+    return journal;
+}
+
+std::vector< ghc::filesystem::path > RegistryJournal::list( const ghc::filesystem::path& directory )
+{
+    std::vector< std::pair< ghc::filesystem::file_time_type, ghc::filesystem::path > > found;
+    std::error_code ec;
+    for( ghc::filesystem::directory_iterator it( directory, ec ), end; !ec && it != end; it.increment( ec ) )
+    {
+        if( it->path().extension() != journal_extension_ )
+            continue;
+        std::error_code time_ec;
+        found.push_back( std::make_pair( ghc::filesystem::last_write_time( it->path(), time_ec ), it->path() ) );
+    }
+    std::sort( found.begin(), found.end() );
+
+    std::vector< ghc::filesystem::path > paths;
+    for( std::size_t i = 0; i < found.size(); ++i )
+        paths.push_back( found[i].second );
+    return paths;
+}
+
+RegistryJournal::RegistryJournal( const ghc::filesystem::path& path, std::FILE* file )
+    : path_( path ), file_( file ), committed_( false )
+{
+}
+
+RegistryJournal::~RegistryJournal()
+{
+    if( file_ )
+        std::fclose( file_ );
+}
+
+void RegistryJournal::read_()
+{
+    std::string text;
+    char buffer[65536];
+    std::size_t n;
+    while( ( n = std::fread( buffer, 1, sizeof( buffer ), file_ ) ) > 0 )
+        text.append( buffer, n );
+
+    Json::CharReaderBuilder builder;
+    const std::unique_ptr< Json::CharReader > reader( builder.newCharReader() );
+    bool header = false;
+    std::size_t start = 0;
+    // A line without its newline was cut short by the end of its process and
+    // is dropped
+    for( std::size_t end = text.find( '\n' ); end != std::string::npos; end = text.find( '\n', start ) )
+    {
+        const std::string line = text.substr( start, end - start );
+        const std::size_t line_offset = start;
+        start = end + 1;
+        if( line.empty() )
+            continue;
+
+        Json::Value value;
+        std::string errors;
+        if( !reader->parse( line.data(), line.data() + line.size(), &value, &errors ) || !value.isObject() )
+            throw json_parse_error( "RegistryJournal: Line at offset " + std::to_string( line_offset ) +
+                                    " of '" + path_.string() + "' is not valid: " + errors );
+
+        if( value.isMember( "registry_journal" ) )
+        {
+            if( value["registry_journal"].asInt() != journal_version_ )
+                throw json_parse_error( "RegistryJournal: '" + path_.string() + "' has an unsupported version" );
+            header = true;
+        }
+        else if( !header )
+        {
+            throw json_parse_error( "RegistryJournal: '" + path_.string() + "' is not a registry journal" );
+        }
+        else if( value.isMember( "op" ) )
+        {
+            entries_.push_back( value );
+            results_.push_back( Json::Value( Json::objectValue ) );
+            done_.push_back( false );
+        }
+        else if( value.isMember( "commit" ) )
+        {
+            committed_ = value["commit"].asUInt64() == entries_.size();
+        }
+        else if( value.isMember( "entry" ) )
+        {
+            const std::size_t i = static_cast< std::size_t >( value["entry"].asUInt64() );
+            if( i >= entries_.size() )
+                throw json_parse_error( "RegistryJournal: Line at offset " + std::to_string( line_offset ) +
+                                        " of '" + path_.string() + "' refers to an unknown entry" );
+            const Json::Value& result = value["result"];
+            for( Json::Value::const_iterator it = result.begin(); it != result.end(); ++it )
+                results_[i][it.name()] = *it;
+            done_[i] = done_[i] || value["done"].asBool();
+        }
+    }
+    if( !header )
+        throw json_parse_error( "RegistryJournal: '" + path_.string() + "' is not a registry journal" );
+
+    // so that further lines are not appended to it
+    if( start < text.size() )
+    {
+        std::error_code ec;
+        ghc::filesystem::resize_file( path_, start, ec );
+        if( ec )
+            throw write_error( "RegistryJournal: Failed to truncate '" + path_.string() + "'" );
+    }
+}
+
+void RegistryJournal::write_( const Json::Value& line )
+{
+    const std::string text = to_json_( line ) + "\n";
+    std::fseek( file_, 0, SEEK_END );
+    if( std::fwrite( text.data(), 1, text.size(), file_ ) != text.size() )
+        throw write_error( "RegistryJournal: Failed to write to '" + path_.string() + "'" );
+}
+
+std::size_t RegistryJournal::append( const Json::Value& entry )
+{
+    write_( entry );
+    entries_.push_back( entry );
+    results_.push_back( Json::Value( Json::objectValue ) );
+    done_.push_back( false );
+    return entries_.size() - 1;
+}
+
+void RegistryJournal::commit()
+{
+    Json::Value line;
+    line["commit"] = static_cast< Json::UInt64 >( entries_.size() );
+    write_( line );
+
+    bool written = std::fflush( file_ ) == 0;
+#ifndef _WIN32
+    written = written && fsync( fileno( file_ ) ) == 0;
+#endif
+    if( !written )
+        throw write_error( "RegistryJournal: Failed to sync '" + path_.string() + "'" );
+    committed_ = true;
+}
+
+void RegistryJournal::record( std::size_t entry, const Json::Value& result, bool done )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    Json::Value line;
+    line["entry"] = static_cast< Json::UInt64 >( entry );
+    line["result"] = result;
+    line["done"] = done;
+    write_( line );
+    if( std::fflush( file_ ) != 0 )
+        throw write_error( "RegistryJournal: Failed to write to '" + path_.string() + "'" );
+
+    for( Json::Value::const_iterator it = result.begin(); it != result.end(); ++it )
+        results_[entry][it.name()] = *it;
+    done_[entry] = done_[entry] || done;
+}
+
+void RegistryJournal::remove()
+{
+    // Removed while still locked, a process which opened it meanwhile finds
+    // every entry applied
+    std::error_code ec;
+    if( !ghc::filesystem::remove( path_, ec ) && ec )
+        logger::get_logger()->warn() << "RegistryJournal: Failed to remove " << path_.string();
+    if( file_ )
+        std::fclose( file_ );
+    file_ = NULL;
+}
+
+void RegistryJournal::reject()
+{
+    // Renamed while still locked, as for remove()
+    const ghc::filesystem::path rejected = path_.string() + rejected_extension_;
+    std::error_code ec;
+    ghc::filesystem::rename( path_, rejected, ec );
+    if( ec )
+        logger::get_logger()->warn() << "RegistryJournal: Failed to rename " << path_.string();
+    else
+        path_ = rejected;
+    if( file_ )
+        std::fclose( file_ );
+    file_ = NULL;
+}
+
+}; // namespace FairDataPipeline
@@ -0,0 +1,263 @@
+#include "fdp/registry/response_cache.hxx"
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
+#include <vector>
+
+namespace FairDataPipeline {
+
+// Tables whose entries the pipeline never modifies once created
+static const char* const immutable_tables_[] = {
+    "users", "author", "user_author", "storage_root", "storage_location",
+    "file_type", "namespace", "object", "object_component", "data_product"
+};
+
+ResponseCache::sptr ResponseCache::construct( std::size_t capacity )
+{
+    return ResponseCache::sptr( new ResponseCache( capacity ) );
+}
+
+ResponseCache::ResponseCache( std::size_t capacity ) : capacity_( capacity )
+{
+    for( std::size_t i = 0; i < sizeof( immutable_tables_ ) / sizeof( immutable_tables_[0] ); ++i )
+        ttl_[ immutable_tables_[i] ] = immutable();
+}
+
+std::string ResponseCache::make_key( const std::string& addr_path, const std::string& token )
+{
+    std::string path = addr_path;
+    std::replace( path.begin(), path.end(), '\\', '/' );
+    path.erase( 0, path.find_first_not_of( '/' ) );
+
+    std::string query;
+    const std::size_t question = path.find( '?' );
+    if( question != std::string::npos )
+    {
+        query = path.substr( question + 1 );
+        path.erase( question );
+    }
+    if( !path.empty() && path[ path.size() - 1 ] != '/' )
+        path += '/';
+
+    std::vector< std::string > params;
+    std::istringstream stream( query );
+    std::string param;
+    while( std::getline( stream, param, '&' ) )
+        if( !param.empty() )
+            params.push_back( param );
+    std::sort( params.begin(), params.end() );
+
+    std::string key = path;
+    for( std::size_t i = 0; i < params.size(); ++i )
+        key += ( i == 0 ? "?" : "&" ) + params[i];
+
+    return key + "\n" + token;
+}
+
+std::string ResponseCache::table_of( const std::string& addr_path )
+{
+    std::string path = addr_path;
+    std::replace( path.begin(), path.end(), '\\', '/' );
+    path.erase( 0, path.find_first_not_of( '/' ) );
+    return path.substr( 0, path.find_first_of( "/?" ) );
+}
+
+void ResponseCache::set_ttl( const std::string& table, ttl_type ttl )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ttl_[ table ] = ttl;
+}
+
+ResponseCache::ttl_type ResponseCache::get_ttl( const std::string& table ) const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::map< std::string, ttl_type >::const_iterator it = ttl_.find( table );
+    return it == ttl_.end() ? ttl_type::zero() : it->second;
+}
+
+bool ResponseCache::cacheable_( const std::string& table ) const
+{
+    if( capacity_ == 0 )
+        return false;
+    std::map< std::string, ttl_type >::const_iterator it = ttl_.find( table );
+    return it != ttl_.end() && it->second > ttl_type::zero();
+}
+
+bool ResponseCache::find_( const std::string& key, Json::Value& value )
+{
+    std::unordered_map< std::string, list_type::iterator >::iterator it = index_.find( key );
+    if( it == index_.end() )
+        return false;
+
+    if( !it->second->never_expires && clock_type::now() >= it->second->expires )
+    {
+        entries_.erase( it->second );
+        index_.erase( it );
+        return false;
+    }
+
+    entries_.splice( entries_.begin(), entries_, it->second );
+    value = it->second->value;
+    return true;
+}
+
+void ResponseCache::store_( const std::string& key, const std::string& table,
+                            const Json::Value& value )
+{
+    // A query which found nothing may succeed once the entry is created
+    if( !cacheable_( table ) || ( value.isArray() && value.empty() ) )
+        return;
+
+    const ttl_type ttl = ttl_[ table ];
+
+    Entry entry;
+    entry.key = key;
+    entry.table = table;
+    entry.value = value;
+    entry.never_expires = ( ttl == immutable() );
+    if( !entry.never_expires )
+        entry.expires = clock_type::now() + ttl;
+
+    std::unordered_map< std::string, list_type::iterator >::iterator it = index_.find( key );
+    if( it != index_.end() )
+        entries_.erase( it->second );
+
+    entries_.push_front( entry );
+    index_[ key ] = entries_.begin();
+
+    while( entries_.size() > capacity_ )
+    {
+        index_.erase( entries_.back().key );
+        entries_.pop_back();
+        ++stats_.evictions;
+    }
+}
+
+Json::Value ResponseCache::get( const std::string& key, const std::string& table,
+                                fetch_type fetch )
+{
+    std::shared_ptr< std::promise< Json::Value > > promise;
+    {
+        std::unique_lock< std::mutex > lock( mutex_ );
+        if( !cacheable_( table ) )
+        {
+            lock.unlock();
+            return fetch();
+        }
+
+        Json::Value value;
+        if( find_( key, value ) )
+        {
+            ++stats_.hits;
+            return value;
+        }
+
+        std::unordered_map< std::string, std::shared_future< Json::Value > >::iterator it =
+            in_flight_.find( key );
+        if( it != in_flight_.end() )
+        {
+            ++stats_.coalesced;
+            std::shared_future< Json::Value > pending = it->second;
+            lock.unlock();
+            return pending.get();
+        }
+
+        ++stats_.misses;
+        promise = std::make_shared< std::promise< Json::Value > >();
+        in_flight_[ key ] = promise->get_future().share();
+    }
+
+    Json::Value value;
+    try
+    {
+        value = fetch();
+    }
+    catch( ... )
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex_ );
+            in_flight_.erase( key );
+        }
+        promise->set_exception( std::current_exception() );
+        throw;
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        store_( key, table, value );
+        in_flight_.erase( key );
+    }
+    promise->set_value( value );
+    return value;
+}
+
+bool ResponseCache::lookup( const std::string& key, const std::string& table, Json::Value& value )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    if( !cacheable_( table ) )
+        return false;
+
+    if( find_( key, value ) )
+    {
+        ++stats_.hits;
+        return true;
+    }
+    ++stats_.misses;
+    return false;
+}
+
+void ResponseCache::store( const std::string& key, const std::string& table,
+                           const Json::Value& value )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    store_( key, table, value );
+}
+
+void ResponseCache::erase_if_( const std::string& table, bool queries_only )
+{
+    list_type::iterator it = entries_.begin();
+    while( it != entries_.end() )
+    {
+        if( it->table == table && ( !queries_only || it->key.find( '?' ) != std::string::npos ) )
+        {
+            index_.erase( it->key );
+            it = entries_.erase( it );
+        }
+        else
+            ++it;
+    }
+}
+
+void ResponseCache::invalidate( const std::string& table )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    erase_if_( table, false );
+}
+
+void ResponseCache::invalidate_queries( const std::string& table )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    erase_if_( table, true );
+}
+
+void ResponseCache::clear()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    entries_.clear();
+    index_.clear();
+}
+
+ResponseCache::Stats ResponseCache::get_stats() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return stats_;
+}
+
+std::size_t ResponseCache::size() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return entries_.size();
+}
+
+}; // namespace FairDataPipeline
@@ -0,0 +1,18 @@
+#include "fdp/registry/transport.hxx"
+
+namespace FairDataPipeline {
+
+const char* method_name( HttpRequest::Method method )
+{
+    switch( method )
+    {
+    case HttpRequest::POST:
+        return "POST";
+    case HttpRequest::PATCH:
+        return "PATCH";
+    default:
+        return "GET";
+    }
+}
+
+}; // namespace FairDataPipeline
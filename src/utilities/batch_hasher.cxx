@@ -0,0 +1,604 @@
+#include "fdp/utilities/batch_hasher.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#if defined( __linux__ ) && defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined( __NR_io_uring_setup ) && defined( __NR_io_uring_enter )
+#define FDP_HAVE_IO_URING
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#endif
+#endif
+
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/sha1.hxx"
+#include "fdp/utilities/trace.hxx"
+
+namespace FairDataPipeline {
+
+// Hashes one file with blocking reads
+static void hash_file_( const ghc::filesystem::path& path, std::size_t index,
+                        const BatchHasher::callback_type& on_hash )
+{
+    trace::Span span( "hash", "hash_file" );
+    span.arg( "path", path.string() );
+
+    std::string hash;
+    std::exception_ptr error;
+    try
+    {
+        hash = Sha1().update_file( path ).hexdigest();
+    }
+    catch( ... )
+    {
+        error = std::current_exception();
+    }
+    on_hash( index, hash, error );
+}
+
+#ifdef FDP_HAVE_IO_URING
+namespace {
+
+/*! **************************************************************************
+ * @class Ring
+ * @brief an io_uring submission and completion queue pair, used through the
+ * raw system calls so that liburing is not needed
+ ****************************************************************************/
+class Ring {
+public:
+  explicit Ring( unsigned entries )
+      : fd_( -1 ), sq_ptr_( MAP_FAILED ), cq_ptr_( MAP_FAILED ), sqes_( MAP_FAILED ),
+        sq_size_( 0 ), cq_size_( 0 ), sqes_size_( 0 ), queued_( 0 ), unsubmitted_( 0 )
+  {
+    io_uring_params params;
+    std::memset( &params, 0, sizeof( params ) );
+    fd_ = static_cast< int >( ::syscall( __NR_io_uring_setup, entries, &params ) );
+    if( fd_ < 0 )
+      throw std::system_error( errno, std::generic_category(), "io_uring_setup" );
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    const bool single_mmap = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+    if( single_mmap )
+      sq_size_ = cq_size_ = std::max( sq_size_, cq_size_ );
+
+    sq_ptr_ = map_( sq_size_, IORING_OFF_SQ_RING );
+    cq_ptr_ = single_mmap ? sq_ptr_ : map_( cq_size_, IORING_OFF_CQ_RING );
+    sqes_size_ = params.sq_entries * sizeof( io_uring_sqe );
+    sqes_ = map_( sqes_size_, IORING_OFF_SQES );
+
+    char* sq = static_cast< char* >( sq_ptr_ );
+    sq_head_ = reinterpret_cast< unsigned* >( sq + params.sq_off.head );
+    sq_tail_ = reinterpret_cast< unsigned* >( sq + params.sq_off.tail );
+    sq_mask_ = *reinterpret_cast< unsigned* >( sq + params.sq_off.ring_mask );
+    sq_array_ = reinterpret_cast< unsigned* >( sq + params.sq_off.array );
+    sq_entries_ = params.sq_entries;
+
+    char* cq = static_cast< char* >( cq_ptr_ );
+    cq_head_ = reinterpret_cast< unsigned* >( cq + params.cq_off.head );
+    cq_tail_ = reinterpret_cast< unsigned* >( cq + params.cq_off.tail );
+    cq_mask_ = *reinterpret_cast< unsigned* >( cq + params.cq_off.ring_mask );
+    cqes_ = reinterpret_cast< io_uring_cqe* >( cq + params.cq_off.cqes );
+  }
+
+  ~Ring()
+  {
+    if( sqes_ != MAP_FAILED )
+      ::munmap( sqes_, sqes_size_ );
+    if( cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_ )
+      ::munmap( cq_ptr_, cq_size_ );
+    if( sq_ptr_ != MAP_FAILED )
+      ::munmap( sq_ptr_, sq_size_ );
+    if( fd_ >= 0 )
+      ::close( fd_ );
+  }
+
+  /**
+   * @brief a cleared entry at the tail of the submission queue
+   *
+   * @return io_uring_sqe* or nullptr if the queue is full
+   */
+  io_uring_sqe* get_sqe()
+  {
+    const unsigned tail = *sq_tail_ + queued_;
+    if( tail - __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE ) >= sq_entries_ )
+      return nullptr;
+
+    const unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = static_cast< io_uring_sqe* >( sqes_ ) + index;
+    std::memset( sqe, 0, sizeof( *sqe ) );
+    sq_array_[index] = index;
+    ++queued_;
+    return sqe;
+  }
+
+  /**
+   * @brief submit the queued entries and wait for at least one completion
+   */
+  void submit_and_wait()
+  {
+    __atomic_store_n( sq_tail_, *sq_tail_ + queued_, __ATOMIC_RELEASE );
+    unsubmitted_ += queued_;
+    queued_ = 0;
+
+    for( ;; )
+    {
+      const long submitted = ::syscall( __NR_io_uring_enter, fd_, unsubmitted_, 1,
+                                        IORING_ENTER_GETEVENTS, nullptr, 0 );
+      if( submitted >= 0 )
+      {
+        unsubmitted_ -= static_cast< unsigned >( submitted );
+        return;
+      }
+      if( errno != EINTR && errno != EAGAIN && errno != EBUSY )
+        throw std::system_error( errno, std::generic_category(), "io_uring_enter" );
+    }
+  }
+
+  /**
+   * @brief pass each completion to a function taking its user data and
+   * result
+   */
+  template < typename F > void reap( F on_completion )
+  {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n( cq_tail_, __ATOMIC_ACQUIRE );
+    for( ; head != tail; ++head )
+    {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      on_completion( cqe.user_data, cqe.res );
+    }
+    __atomic_store_n( cq_head_, head, __ATOMIC_RELEASE );
+  }
+
+private:
+  Ring( const Ring& ) = delete;
+  Ring& operator=( const Ring& ) = delete;
+
+  void* map_( std::size_t size, unsigned long long offset )
+  {
+    void* mapped = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                           static_cast< off_t >( offset ) );
+    if( mapped == MAP_FAILED )
+      throw std::system_error( errno, std::generic_category(), "io_uring mmap" );
+    return mapped;
+  }
+
+  int fd_;
+  void* sq_ptr_;
+  void* cq_ptr_;
+  void* sqes_;
+  std::size_t sq_size_;
+  std::size_t cq_size_;
+  std::size_t sqes_size_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_array_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+
+  unsigned queued_;
+  unsigned unsubmitted_;
+};
+
+// Reads queued per file, one is hashed while the next is being read
+static const std::size_t blocks_per_file_ = 2;
+
+struct File;
+
+/**
+ * @brief a buffer and the read filling it
+ */
+struct Block {
+  enum State { FREE, READING, READ };
+
+  std::vector< char > buffer;
+  iovec iov;
+  File* file;
+  std::uint64_t offset;
+  std::size_t length;
+  int result;
+  State state;
+};
+
+/**
+ * @brief a file being hashed, blocks are read and hashed in turn
+ */
+struct File {
+  bool active;
+  std::size_t index;
+  int fd;
+  std::uint64_t size;
+  std::uint64_t next_offset;
+  Sha1 sha1;
+  Block blocks[blocks_per_file_];
+  std::size_t next_read;
+  std::size_t next_hash;
+  std::size_t n_reading;
+  bool stopped;
+  std::exception_ptr error;
+  std::uint64_t trace_start_ns;
+};
+
+} // namespace
+#endif
+
+BatchHasher::Backend BatchHasher::best_backend()
+{
+    return is_supported( Backend::IO_URING ) ? Backend::IO_URING : Backend::THREADS;
+}
+
+bool BatchHasher::is_supported( Backend backend )
+{
+    switch( backend )
+    {
+    case Backend::THREADS:
+        return true;
+    case Backend::IO_URING:
+    {
+#ifdef FDP_HAVE_IO_URING
+        // Kernels may be too old or have io_uring disabled by policy
+        static const bool supported = []() -> bool {
+            try
+            {
+                Ring ring( 1 );
+                return true;
+            }
+            catch( const std::exception& e )
+            {
+                FDP_LOG( DEBUG ) << "BatchHasher: io_uring unavailable, " << e.what();
+                return false;
+            }
+        }();
+        return supported;
+#else
+        return false;
+#endif
+    }
+    }
+    return false;
+}
+
+std::string BatchHasher::backend_name( Backend backend )
+{
+    switch( backend )
+    {
+    case Backend::THREADS:
+        return "threads";
+    case Backend::IO_URING:
+        return "io_uring";
+    }
+    return "unknown";
+}
+
+BatchHasher::BatchHasher( Backend backend, std::size_t max_files_in_flight, std::size_t block_size )
+    : backend_( backend ), max_files_in_flight_( std::max< std::size_t >( 1, max_files_in_flight ) ),
+      block_size_( std::max< std::size_t >( 4096, block_size ) )
+{
+    if( !is_supported( backend ) )
+        throw std::invalid_argument( "BatchHasher backend " + backend_name( backend ) +
+                                     " is not supported on this system" );
+}
+
+void BatchHasher::hash( const std::vector< ghc::filesystem::path >& paths, const callback_type& on_hash,
+                        const std::atomic< bool >* cancelled ) const
+{
+    if( paths.empty() )
+        return;
+
+    trace::Span span_( "hash", "BatchHasher::hash" );
+    span_.arg( "files", static_cast< long long >( paths.size() ) );
+    span_.arg( "backend", backend_name( backend_ ) );
+
+    // Every file is reported exactly once, even if a worker fails
+    std::vector< char > reported_( paths.size(), 0 );
+    callback_type report_ = [&]( std::size_t i, const std::string& hash, std::exception_ptr error ) {
+        reported_[i] = 1;
+        on_hash( i, hash, error );
+    };
+
+    std::atomic< std::size_t > next_( 0 );
+    const std::thread::id caller_ = std::this_thread::get_id();
+    std::exception_ptr worker_error_;
+    std::mutex worker_error_mutex_;
+    std::function< void() > worker_ = [&]() {
+        if( std::this_thread::get_id() != caller_ )
+            trace::set_thread_name( "hash worker" );
+        try
+        {
+            if( backend_ == Backend::IO_URING )
+                hash_io_uring_( paths, report_, cancelled, next_ );
+            else
+                hash_threads_( paths, report_, cancelled, next_ );
+        }
+        catch( ... )
+        {
+            std::lock_guard< std::mutex > lock_( worker_error_mutex_ );
+            worker_error_ = std::current_exception();
+        }
+    };
+
+    const std::size_t n_cpus_ = std::max( 1u, std::thread::hardware_concurrency() );
+    const std::size_t n_workers_ = std::min(
+        paths.size(), backend_ == Backend::IO_URING ? n_cpus_ : std::max( n_cpus_, max_files_in_flight_ ) );
+
+    FDP_LOG( DEBUG ) << "BatchHasher: Hashing " << paths.size() << " files with "
+                                  << n_workers_ << " " << backend_name( backend_ ) << " workers";
+
+    std::vector< std::thread > threads_;
+    for( std::size_t i = 1; i < n_workers_; ++i )
+        threads_.push_back( std::thread( worker_ ) );
+    worker_();
+    for( std::size_t i = 0; i < threads_.size(); ++i )
+        threads_[i].join();
+
+    if( !worker_error_ || ( cancelled && *cancelled ) )
+        return;
+    for( std::size_t i = 0; i < paths.size(); ++i )
+    {
+        if( !reported_[i] )
+            on_hash( i, std::string(), worker_error_ );
+    }
+}
+
+std::vector< std::string > BatchHasher::hash( const std::vector< ghc::filesystem::path >& paths ) const
+{
+    std::vector< std::string > hashes_( paths.size() );
+    std::vector< std::exception_ptr > errors_( paths.size() );
+    hash( paths, [&]( std::size_t i, const std::string& hash, std::exception_ptr error ) {
+        hashes_[i] = hash;
+        errors_[i] = error;
+    } );
+
+    for( std::size_t i = 0; i < errors_.size(); ++i )
+    {
+        if( errors_[i] )
+            std::rethrow_exception( errors_[i] );
+    }
+    return hashes_;
+}
+
+void BatchHasher::hash_threads_( const std::vector< ghc::filesystem::path >& paths,
+                                 const callback_type& on_hash, const std::atomic< bool >* cancelled,
+                                 std::atomic< std::size_t >& next ) const
+{
+    for( std::size_t i = next++; i < paths.size() && !( cancelled && *cancelled ); i = next++ )
+        hash_file_( paths[i], i, on_hash );
+}
+
+#ifdef FDP_HAVE_IO_URING
+void BatchHasher::hash_io_uring_( const std::vector< ghc::filesystem::path >& paths,
+                                  const callback_type& on_hash, const std::atomic< bool >* cancelled,
+                                  std::atomic< std::size_t >& next ) const
+{
+    std::unique_ptr< Ring > ring_;
+    try
+    {
+        ring_.reset( new Ring( static_cast< unsigned >( max_files_in_flight_ * blocks_per_file_ ) ) );
+    }
+    catch( const std::exception& e )
+    {
+        logger::get_logger()->warn() << "BatchHasher: " << e.what() << ", reading files on threads";
+        hash_threads_( paths, on_hash, cancelled, next );
+        return;
+    }
+
+    std::vector< File > files_( max_files_in_flight_ );
+    for( std::size_t i = 0; i < files_.size(); ++i )
+    {
+        files_[i].active = false;
+        for( std::size_t b = 0; b < blocks_per_file_; ++b )
+        {
+            files_[i].blocks[b].buffer.resize( block_size_ );
+            files_[i].blocks[b].file = &files_[i];
+        }
+    }
+
+    // Opens the next file into a free slot, files which need no reads are
+    // hashed straight away
+    auto open_next_ = [&]( File& file ) {
+        for( std::size_t i = next++; i < paths.size(); i = next++ )
+        {
+            const int fd = ::open( paths[i].string().c_str(), O_RDONLY );
+            struct stat st;
+            if( fd < 0 || ::fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) || st.st_size == 0 )
+            {
+                if( fd >= 0 )
+                    ::close( fd );
+                hash_file_( paths[i], i, on_hash );
+                continue;
+            }
+
+            file.active = true;
+            file.index = i;
+            file.fd = fd;
+            file.size = static_cast< std::uint64_t >( st.st_size );
+            file.next_offset = 0;
+            file.sha1 = Sha1();
+            file.next_read = 0;
+            file.next_hash = 0;
+            file.n_reading = 0;
+            file.stopped = false;
+            file.error = nullptr;
+            file.trace_start_ns = trace::enabled() ? trace::now_ns() : 0;
+            for( std::size_t b = 0; b < blocks_per_file_; ++b )
+                file.blocks[b].state = Block::FREE;
+            return true;
+        }
+        return false;
+    };
+
+    // Hashes a block, finishing short reads synchronously
+    auto hash_block_ = [&]( File& file, Block& block ) {
+        if( block.result < 0 )
+        {
+            file.error = std::make_exception_ptr( std::runtime_error(
+                "Failed to read '" + paths[file.index].string() + "' for hashing: " +
+                std::strerror( -block.result ) ) );
+            file.stopped = true;
+            return;
+        }
+
+        std::size_t n = static_cast< std::size_t >( block.result );
+        while( n < block.length )
+        {
+            const ssize_t n_read = ::pread( file.fd, &block.buffer[n], block.length - n,
+                                            static_cast< off_t >( block.offset + n ) );
+            if( n_read < 0 && errno == EINTR )
+                continue;
+            if( n_read < 0 )
+            {
+                file.error = std::make_exception_ptr( std::runtime_error(
+                    "Failed to read '" + paths[file.index].string() + "' for hashing" ) );
+                file.stopped = true;
+                return;
+            }
+            if( n_read == 0 )
+                break;
+            n += static_cast< std::size_t >( n_read );
+        }
+
+        file.sha1.update( &block.buffer[0], n );
+
+        // The file was truncated while it was read, it ends here
+        if( n < block.length )
+            file.stopped = true;
+    };
+
+    bool more_files_ = true;
+    std::size_t n_active_ = 0;
+    for( ;; )
+    {
+        const bool cancelled_ = cancelled && *cancelled;
+
+        for( std::size_t f = 0; f < files_.size() && more_files_ && !cancelled_; ++f )
+        {
+            if( !files_[f].active )
+            {
+                more_files_ = open_next_( files_[f] );
+                n_active_ += more_files_ ? 1 : 0;
+            }
+        }
+        if( n_active_ == 0 )
+            break;
+
+        // Queue a read into every free block
+        for( std::size_t f = 0; f < files_.size(); ++f )
+        {
+            File& file = files_[f];
+            if( !file.active )
+                continue;
+            if( cancelled_ )
+                file.stopped = true;
+
+            while( !file.stopped && file.next_offset < file.size &&
+                   file.blocks[file.next_read].state == Block::FREE )
+            {
+                io_uring_sqe* sqe = ring_->get_sqe();
+                if( !sqe )
+                    break;
+
+                Block& block = file.blocks[file.next_read];
+                block.offset = file.next_offset;
+                block.length = static_cast< std::size_t >(
+                    std::min< std::uint64_t >( block_size_, file.size - file.next_offset ) );
+                block.iov.iov_base = &block.buffer[0];
+                block.iov.iov_len = block.length;
+                block.state = Block::READING;
+
+                sqe->opcode = IORING_OP_READV;
+                sqe->fd = file.fd;
+                sqe->off = block.offset;
+                sqe->addr = reinterpret_cast< std::uintptr_t >( &block.iov );
+                sqe->len = 1;
+                sqe->user_data = reinterpret_cast< std::uintptr_t >( &block );
+
+                file.next_offset += block.length;
+                file.next_read = ( file.next_read + 1 ) % blocks_per_file_;
+                ++file.n_reading;
+            }
+        }
+
+        bool reading_ = false;
+        for( std::size_t f = 0; f < files_.size(); ++f )
+            reading_ = reading_ || ( files_[f].active && files_[f].n_reading > 0 );
+
+        if( reading_ )
+        {
+            ring_->submit_and_wait();
+            ring_->reap( [&]( std::uint64_t user_data, int result ) {
+                Block* block = reinterpret_cast< Block* >( static_cast< std::uintptr_t >( user_data ) );
+                block->result = result;
+                block->state = Block::READ;
+                --block->file->n_reading;
+            } );
+        }
+
+        // Hash blocks in file order, then report finished files
+        for( std::size_t f = 0; f < files_.size(); ++f )
+        {
+            File& file = files_[f];
+            if( !file.active )
+                continue;
+
+            while( file.blocks[file.next_hash].state == Block::READ )
+            {
+                Block& block = file.blocks[file.next_hash];
+                if( !file.stopped )
+                    hash_block_( file, block );
+                block.state = Block::FREE;
+                file.next_hash = ( file.next_hash + 1 ) % blocks_per_file_;
+            }
+
+            const bool done = file.stopped || ( file.next_offset == file.size &&
+                                                file.blocks[file.next_hash].state == Block::FREE );
+            if( !done || file.n_reading > 0 )
+                continue;
+
+            ::close( file.fd );
+            file.active = false;
+            --n_active_;
+            // Files read together overlap on this thread, each gets a track
+            if( file.trace_start_ns )
+            {
+                std::string args;
+                trace::append_arg( args, "path", paths[file.index].string() );
+                trace::append_arg( args, "bytes", static_cast< long long >( file.size ) );
+                trace::record( "hash", "hash_file", file.trace_start_ns, trace::now_ns() - file.trace_start_ns,
+                               args, trace::new_async_id() );
+            }
+            if( !cancelled_ )
+                on_hash( file.index, file.error ? std::string() : file.sha1.hexdigest(), file.error );
+        }
+    }
+}
+#else
+void BatchHasher::hash_io_uring_( const std::vector< ghc::filesystem::path >& paths,
+                                  const callback_type& on_hash, const std::atomic< bool >* cancelled,
+                                  std::atomic< std::size_t >& next ) const
+{
+    hash_threads_( paths, on_hash, cancelled, next );
+}
+#endif
+
+}; // namespace FairDataPipeline
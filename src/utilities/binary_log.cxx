@@ -0,0 +1,450 @@
+#include "fdp/utilities/binary_log.hxx"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <json/json.h>
+
+namespace FairDataPipeline {
+namespace logging {
+
+// Every file starts with this, the last byte is the format version
+static const char magic_[8] = {'F', 'D', 'P', 'L', 'O', 'G', '\0', '\1'};
+
+// Each record is a kind byte and a 32 bit payload size followed by the
+// payload, unused space in a file is zero and so reads as END
+enum RecordKind { END = 0, FORMAT = 1, LOGGER = 2, MESSAGE = 3 };
+static const std::size_t record_header_size_ = 5;
+
+// Integers are written little endian whatever the host
+static void put_uint_( std::string& out, std::uint64_t value, std::size_t size )
+{
+    for( std::size_t i = 0; i < size; ++i )
+        out += static_cast< char >( ( value >> ( 8 * i ) ) & 0xff );
+}
+
+static std::uint64_t get_uint_( const char* in, std::size_t size )
+{
+    std::uint64_t value = 0;
+    for( std::size_t i = 0; i < size; ++i )
+        value |= static_cast< std::uint64_t >( static_cast< unsigned char >( in[i] ) ) << ( 8 * i );
+    return value;
+}
+
+static std::string definition_( unsigned char kind, std::uint32_t id, const std::string& text )
+{
+    std::string out;
+    out += static_cast< char >( kind );
+    put_uint_( out, 4 + text.size(), 4 );
+    put_uint_( out, id, 4 );
+    out += text;
+    return out;
+}
+
+BinarySink::sptr BinarySink::create( enum LOG_LEVEL lvl, const ghc::filesystem::path& prefix,
+                                     std::size_t max_file_size, std::size_t max_files )
+{
+    return sptr( new BinarySink( lvl, prefix, max_file_size, max_files ) );
+}
+
+BinarySink::BinarySink( enum LOG_LEVEL lvl, const ghc::filesystem::path& prefix, std::size_t max_file_size,
+                        std::size_t max_files )
+    : Sink( lvl ), prefix_( prefix ),
+      max_file_size_( std::max< std::size_t >( max_file_size, 4096 ) ),
+      max_files_( std::max< std::size_t >( max_files, 1 ) ), sequence_( 0 ), first_sequence_( 0 ),
+      offset_( 0 )
+#ifndef _WIN32
+      , fd_( -1 ), map_( NULL )
+#endif
+{
+    // Records carry no header, the decoder formats them
+    set_formatter( ISinkFormatter::sptr() );
+
+    // Files left by an earlier log with the same prefix would be mistaken for
+    // part of this one
+    std::error_code ec;
+    const ghc::filesystem::path directory = prefix_.has_parent_path() ? prefix_.parent_path() : ".";
+    ghc::filesystem::create_directories( directory, ec );
+    const std::string stem = prefix_.filename().string() + ".";
+    for( ghc::filesystem::directory_iterator it( directory, ec ), end; !ec && it != end; it.increment( ec ) )
+    {
+        const std::string name = it->path().filename().string();
+        if( name.compare( 0, stem.size(), stem ) == 0 && it->path().extension() == ".fdplog" )
+        {
+            std::error_code remove_ec;
+            ghc::filesystem::remove( it->path(), remove_ec );
+        }
+    }
+
+    open_file_();
+}
+
+BinarySink::~BinarySink()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    close_file_();
+}
+
+ghc::filesystem::path BinarySink::file_path_( std::size_t sequence ) const
+{
+    return prefix_.string() + "." + std::to_string( sequence ) + ".fdplog";
+}
+
+void BinarySink::open_file_()
+{
+    const ghc::filesystem::path path = file_path_( sequence_ );
+#ifdef _WIN32
+    file_.open( path.string(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+    if( !file_ )
+        throw std::runtime_error( "Failed to open log file " + path.string() );
+#else
+    fd_ = ::open( path.string().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if( fd_ < 0 )
+        throw std::system_error( errno, std::generic_category(), "Failed to open log file " + path.string() );
+
+    // The file is sized up front, pages are only allocated as they are written
+    void* map = MAP_FAILED;
+    if( ::ftruncate( fd_, static_cast< off_t >( max_file_size_ ) ) == 0 )
+        map = ::mmap( NULL, max_file_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0 );
+    if( map == MAP_FAILED )
+    {
+        const int error = errno;
+        ::close( fd_ );
+        fd_ = -1;
+        throw std::system_error( error, std::generic_category(), "Failed to map log file " + path.string() );
+    }
+    map_ = static_cast< char* >( map );
+#endif
+
+    offset_ = 0;
+    formats_defined_.assign( formats_defined_.size(), false );
+    loggers_defined_.assign( loggers_defined_.size(), false );
+    write_( magic_, sizeof( magic_ ) );
+
+    // Only the newest files are kept
+    if( sequence_ >= first_sequence_ + max_files_ )
+    {
+        std::error_code ec;
+        ghc::filesystem::remove( file_path_( first_sequence_ ), ec );
+        ++first_sequence_;
+    }
+}
+
+void BinarySink::close_file_()
+{
+#ifdef _WIN32
+    file_.close();
+#else
+    if( fd_ < 0 )
+        return;
+
+    ::munmap( map_, max_file_size_ );
+    map_ = NULL;
+    if( ::ftruncate( fd_, static_cast< off_t >( offset_ ) ) != 0 )
+    {
+        // The zeroed remainder still reads as the end of the log
+    }
+    ::close( fd_ );
+    fd_ = -1;
+#endif
+}
+
+void BinarySink::write_( const void* data, std::size_t size )
+{
+#ifdef _WIN32
+    file_.write( static_cast< const char* >( data ), static_cast< std::streamsize >( size ) );
+#else
+    std::memcpy( map_ + offset_, data, size );
+#endif
+    offset_ += size;
+}
+
+void BinarySink::write_string_( const std::string& s )
+{
+    write_( s.data(), s.size() );
+}
+
+int BinarySink::log_record( Logger* logger, const LogRecord& record )
+{
+    return write_record_( logger ? logger->name() : std::string(), record );
+}
+
+int BinarySink::log( enum LOG_LEVEL msg_lvl, const std::string& s )
+{
+    LogRecord record;
+    record.msg_lvl = msg_lvl;
+    record.append_string( !s.empty() && s[s.size() - 1] == '\n' ? s.substr( 0, s.size() - 1 ) : s );
+    return write_record_( std::string(), record );
+}
+
+std::uint32_t BinarySink::intern_( std::map< std::string, std::uint32_t >& ids, std::vector< bool >& defined,
+                                   const std::string& text )
+{
+    std::map< std::string, std::uint32_t >::iterator it = ids.find( text );
+    if( it == ids.end() )
+    {
+        it = ids.insert( std::make_pair( text, static_cast< std::uint32_t >( ids.size() ) ) ).first;
+        defined.push_back( false );
+    }
+    return it->second;
+}
+
+int BinarySink::write_record_( const std::string& logger_name, const LogRecord& record )
+{
+    if( !should_log( record.msg_lvl ) )
+        return 0;
+
+    const std::uint64_t time_ns = static_cast< std::uint64_t >(
+        std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::system_clock::now().time_since_epoch() ).count() );
+
+    // The arguments are encoded before taking the lock
+    std::string args;
+    for( std::size_t i = 0; i < record.args.size(); ++i )
+    {
+        const LogArg& arg = record.args[i];
+        args += static_cast< char >( arg.type );
+        switch( arg.type )
+        {
+        case LogArg::INT:
+            put_uint_( args, static_cast< std::uint64_t >( arg.i ), 8 );
+            break;
+        case LogArg::UINT:
+            put_uint_( args, arg.u, 8 );
+            break;
+        case LogArg::DOUBLE:
+        {
+            std::uint64_t bits;
+            std::memcpy( &bits, &arg.d, sizeof( bits ) );
+            put_uint_( args, bits, 8 );
+            break;
+        }
+        case LogArg::STRING:
+            put_uint_( args, arg.s.size(), 4 );
+            args += arg.s;
+            break;
+        }
+    }
+    const std::size_t message_size = record_header_size_ + 8 + 1 + 4 + 4 + 2 + args.size();
+
+    std::lock_guard< std::mutex > lock( mutex_ );
+
+    const std::uint32_t logger_id = intern_( logger_ids_, loggers_defined_, logger_name );
+    const std::uint32_t format_id = intern_( format_ids_, formats_defined_, record.format );
+    for( int attempt = 0;; ++attempt )
+    {
+        std::size_t size = message_size;
+        if( !loggers_defined_[logger_id] )
+            size += record_header_size_ + 4 + logger_name.size();
+        if( !formats_defined_[format_id] )
+            size += record_header_size_ + 4 + record.format.size();
+
+        if( offset_ + size <= max_file_size_ )
+            break;
+        // Too large for any file
+        if( attempt > 0 )
+            return -1;
+
+        close_file_();
+        ++sequence_;
+        open_file_();
+    }
+
+    if( !loggers_defined_[logger_id] )
+    {
+        write_string_( definition_( LOGGER, logger_id, logger_name ) );
+        loggers_defined_[logger_id] = true;
+    }
+    if( !formats_defined_[format_id] )
+    {
+        write_string_( definition_( FORMAT, format_id, record.format ) );
+        formats_defined_[format_id] = true;
+    }
+
+    std::string message;
+    message.reserve( message_size );
+    message += static_cast< char >( MESSAGE );
+    put_uint_( message, message_size - record_header_size_, 4 );
+    put_uint_( message, time_ns, 8 );
+    message += static_cast< char >( record.msg_lvl );
+    put_uint_( message, logger_id, 4 );
+    put_uint_( message, format_id, 4 );
+    put_uint_( message, record.args.size(), 2 );
+    message += args;
+    write_string_( message );
+    return 0;
+}
+
+void BinarySink::flush()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+#ifdef _WIN32
+    file_.flush();
+#else
+    // Written pages are already visible to readers, this starts writing
+    // them to disk
+    if( map_ )
+        ::msync( map_, offset_, MS_ASYNC );
+#endif
+}
+
+std::vector< ghc::filesystem::path > BinarySink::get_files() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::vector< ghc::filesystem::path > files;
+    for( std::size_t i = first_sequence_; i <= sequence_; ++i )
+        files.push_back( file_path_( i ) );
+    return files;
+}
+
+// Reads the argument at pos in a message payload of size bytes, false if it
+// does not fit
+static bool read_arg_( const char* payload, std::size_t size, std::size_t& pos, LogArg& arg )
+{
+    if( pos + 1 > size )
+        return false;
+    arg.type = static_cast< LogArg::Type >( static_cast< unsigned char >( payload[pos++] ) );
+    if( arg.type == LogArg::STRING )
+    {
+        if( pos + 4 > size )
+            return false;
+        const std::size_t length = static_cast< std::size_t >( get_uint_( payload + pos, 4 ) );
+        if( length > size - pos - 4 )
+            return false;
+        arg.s.assign( payload + pos + 4, length );
+        pos += 4 + length;
+    }
+    else
+    {
+        if( pos + 8 > size )
+            return false;
+        const std::uint64_t bits = get_uint_( payload + pos, 8 );
+        arg.i = static_cast< long long >( bits );
+        arg.u = bits;
+        std::memcpy( &arg.d, &bits, sizeof( bits ) );
+        pos += 8;
+    }
+    return true;
+}
+
+BinaryLogReader::BinaryLogReader( const ghc::filesystem::path& path ) : offset_( sizeof( magic_ ) )
+{
+    std::ifstream file( path.string(), std::ios_base::in | std::ios_base::binary );
+    if( !file )
+        throw std::runtime_error( "Failed to open log file " + path.string() );
+    data_.assign( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() );
+
+    if( data_.size() < sizeof( magic_ ) || std::memcmp( &data_[0], magic_, sizeof( magic_ ) ) != 0 )
+        throw std::runtime_error( path.string() + " is not a binary FDP log" );
+}
+
+bool BinaryLogReader::next( Entry& entry )
+{
+    while( offset_ + record_header_size_ <= data_.size() )
+    {
+        const char* record = &data_[offset_];
+        const unsigned char kind = static_cast< unsigned char >( record[0] );
+        const std::size_t size = static_cast< std::size_t >( get_uint_( record + 1, 4 ) );
+        if( kind == END || offset_ + record_header_size_ + size > data_.size() )
+            return false;
+
+        const char* payload = record + record_header_size_;
+        offset_ += record_header_size_ + size;
+
+        if( ( kind == FORMAT || kind == LOGGER ) && size >= 4 )
+        {
+            std::map< std::uint32_t, std::string >& strings = kind == FORMAT ? formats_ : loggers_;
+            strings[static_cast< std::uint32_t >( get_uint_( payload, 4 ) )] =
+                std::string( payload + 4, size - 4 );
+            continue;
+        }
+        if( kind != MESSAGE || size < 19 )
+            continue;
+
+        entry.time_ns = get_uint_( payload, 8 );
+        entry.msg_lvl = static_cast< LOG_LEVEL >( static_cast< unsigned char >( payload[8] ) );
+        entry.record.msg_lvl = entry.msg_lvl;
+        entry.logger = loggers_[static_cast< std::uint32_t >( get_uint_( payload + 9, 4 ) )];
+        entry.record.format = formats_[static_cast< std::uint32_t >( get_uint_( payload + 13, 4 ) )];
+        entry.record.args.clear();
+
+        // A record whose arguments overrun it is corrupt, and nothing after it
+        // can be trusted
+        const std::size_t n_args = static_cast< std::size_t >( get_uint_( payload + 17, 2 ) );
+        std::size_t pos = 19;
+        for( std::size_t i = 0; i < n_args; ++i )
+        {
+            LogArg arg;
+            if( !read_arg_( payload, size, pos, arg ) )
+            {
+                offset_ = data_.size();
+                return false;
+            }
+            entry.record.args.push_back( arg );
+        }
+        return true;
+    }
+    return false;
+}
+
+std::string BinaryLogReader::Entry::to_text() const
+{
+    // As SinkFormatter::header writes it
+    const std::time_t seconds = static_cast< std::time_t >( time_ns / 1000000000ULL );
+    std::tm tm_;
+#ifdef _WIN32
+    localtime_s( &tm_, &seconds );
+#else
+    localtime_r( &seconds, &tm_ );
+#endif
+    char buffer[80];
+    std::strftime( buffer, sizeof( buffer ), "%Y-%m-%d %H:%M:%S", &tm_ );
+
+    std::ostringstream oss;
+    oss << "[" << buffer << "." << std::setw( 3 ) << std::setfill( '0' )
+        << ( time_ns / 1000000ULL ) % 1000 << "] ";
+    if( !logger.empty() )
+        oss << "[" << logger << "] ";
+    oss << "[" << to_string( msg_lvl ) << "] " << record.render();
+    return oss.str();
+}
+
+std::string BinaryLogReader::Entry::to_json() const
+{
+    Json::Value value;
+    value["time_ns"] = static_cast< Json::UInt64 >( time_ns );
+    value["level"] = to_string( msg_lvl );
+    value["logger"] = logger;
+    value["format"] = record.format;
+    value["args"] = Json::Value( Json::arrayValue );
+    for( std::size_t i = 0; i < record.args.size(); ++i )
+    {
+        const LogArg& arg = record.args[i];
+        switch( arg.type )
+        {
+        case LogArg::INT: value["args"].append( static_cast< Json::Int64 >( arg.i ) ); break;
+        case LogArg::UINT: value["args"].append( static_cast< Json::UInt64 >( arg.u ) ); break;
+        case LogArg::DOUBLE: value["args"].append( arg.d ); break;
+        case LogArg::STRING: value["args"].append( arg.s ); break;
+        }
+    }
+    value["message"] = record.render();
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString( builder, value );
+}
+
+} // namespace logging
+}; // namespace FairDataPipeline
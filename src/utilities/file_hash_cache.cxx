@@ -0,0 +1,188 @@
+#include "fdp/utilities/file_hash_cache.hxx"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include "fdp/objects/metadata.hxx"
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/sha1.hxx"
+
+namespace FairDataPipeline {
+
+// Files modified more recently than this are not cached
+static const long long racy_window_ns_ = 2000000000LL;
+
+FileHashCache::sptr FileHashCache::construct( const ghc::filesystem::path& directory )
+{
+    return FileHashCache::sptr( new FileHashCache( directory ) );
+}
+
+FileHashCache::FileHashCache( const ghc::filesystem::path& directory )
+    : directory_( directory ), hits_( 0 ), misses_( 0 ), writes_( 0 ), skipped_( 0 )
+{
+    std::error_code ec;
+    ghc::filesystem::create_directories( directory_, ec );
+    if( !ghc::filesystem::is_directory( directory_ ) )
+    {
+        logger::get_logger()->error()
+            << "FileHashCache: Failed to create cache directory " << directory_.string();
+        throw std::runtime_error( "Failed to create hash cache directory " + directory_.string() );
+    }
+
+    FDP_LOG( DEBUG ) << "FileHashCache: Using " << directory_.string();
+}
+
+bool FileHashCache::identify_( const ghc::filesystem::path& path, Identity& identity )
+{
+    std::ostringstream key;
+#ifndef _WIN32
+    struct stat st;
+    if( ::stat( path.string().c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) )
+        return false;
+
+#if defined( __APPLE__ )
+    const long long mtime_ns = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+    const long long ctime_ns = st.st_ctimespec.tv_sec * 1000000000LL + st.st_ctimespec.tv_nsec;
+#else
+    const long long mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    const long long ctime_ns = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+#endif
+    key << st.st_dev << ":" << st.st_ino << ":" << st.st_size << ":" << mtime_ns << ":" << ctime_ns;
+
+    const long long now_ns = std::chrono::duration_cast< std::chrono::nanoseconds >(
+        std::chrono::system_clock::now().time_since_epoch() ).count();
+    identity.age_ns = now_ns - mtime_ns;
+#else
+    std::error_code ec;
+    const ghc::filesystem::path absolute = ghc::filesystem::absolute( path, ec );
+    const std::uintmax_t size = ghc::filesystem::file_size( path, ec );
+    if( ec )
+        return false;
+    const ghc::filesystem::file_time_type mtime = ghc::filesystem::last_write_time( path, ec );
+    if( ec )
+        return false;
+    key << absolute.string() << ":" << size << ":" << mtime.time_since_epoch().count();
+
+    identity.age_ns = std::chrono::duration_cast< std::chrono::nanoseconds >(
+        ghc::filesystem::file_time_type::clock::now() - mtime ).count();
+#endif
+    identity.key = key.str();
+    return true;
+}
+
+ghc::filesystem::path FileHashCache::entry_path_( const std::string& key ) const
+{
+    return directory_ / ( calculate_hash_from_string( key ) + ".sha1" );
+}
+
+bool FileHashCache::load_( const std::string& key, std::string& hash ) const
+{
+    std::ifstream file( entry_path_( key ).string() );
+    std::string stored_key;
+    if( !std::getline( file, stored_key ) || !std::getline( file, hash ) )
+        return false;
+
+    // Guards against a collision of the entry names
+    return stored_key == key && hash.size() == 40 &&
+           hash.find_first_not_of( "0123456789abcdef" ) == std::string::npos;
+}
+
+bool FileHashCache::lookup_( const ghc::filesystem::path& path, Identity& identity, std::string& hash )
+{
+    identity.identified = identify_( path, identity );
+    if( identity.identified && load_( identity.key, hash ) )
+    {
+        ++hits_;
+        return true;
+    }
+
+    ++misses_;
+    return false;
+}
+
+void FileHashCache::store_( const ghc::filesystem::path& path, const Identity& before, const std::string& hash )
+{
+    // Only store the hash if the file was not changed while it was read
+    Identity after;
+    if( !before.identified || !identify_( path, after ) || after.key != before.key ||
+        after.age_ns < racy_window_ns_ )
+    {
+        ++skipped_;
+        return;
+    }
+
+    if( write_file_atomically( entry_path_( before.key ), before.key + "\n" + hash + "\n" ) )
+        ++writes_;
+    else
+        logger::get_logger()->warn() << "FileHashCache: Failed to store the hash of " << path.string();
+}
+
+std::string FileHashCache::hash_file( const ghc::filesystem::path& path )
+{
+    Identity before;
+    std::string hash;
+    if( lookup_( path, before, hash ) )
+        return hash;
+
+    hash = Sha1().update_file( path ).hexdigest();
+    store_( path, before, hash );
+    return hash;
+}
+
+void FileHashCache::hash_files( const std::vector< ghc::filesystem::path >& paths,
+                                const BatchHasher& hasher, const BatchHasher::callback_type& on_hash,
+                                const std::atomic< bool >* cancelled )
+{
+    std::vector< Identity > identities_( paths.size() );
+    std::vector< ghc::filesystem::path > missed_;
+    std::vector< std::size_t > missed_index_;
+    for( std::size_t i = 0; i < paths.size(); ++i )
+    {
+        std::string hash;
+        if( lookup_( paths[i], identities_[i], hash ) )
+        {
+            on_hash( i, hash, nullptr );
+            continue;
+        }
+        missed_.push_back( paths[i] );
+        missed_index_.push_back( i );
+    }
+
+    hasher.hash( missed_, [&]( std::size_t j, const std::string& hash, std::exception_ptr error ) {
+        const std::size_t i = missed_index_[j];
+        if( !error )
+            store_( paths[i], identities_[i], hash );
+        on_hash( i, hash, error );
+    }, cancelled );
+}
+
+void FileHashCache::clear()
+{
+    logger::get_logger()->info() << "FileHashCache: Clearing " << directory_.string();
+
+    std::error_code ec;
+    for( ghc::filesystem::directory_iterator it( directory_, ec ), end; !ec && it != end; it.increment( ec ) )
+    {
+        std::error_code remove_ec;
+        ghc::filesystem::remove( it->path(), remove_ec );
+    }
+}
+
+FileHashCache::Stats FileHashCache::get_stats() const
+{
+    Stats stats_;
+    stats_.hits = hits_;
+    stats_.misses = misses_;
+    stats_.writes = writes_;
+    stats_.skipped = skipped_;
+    return stats_;
+}
+
+}; // namespace FairDataPipeline
@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <map>
+#include <mutex>
 #ifdef _WIN32
     #include <windows_sys/time.h>
 #else
@@ -9,6 +12,7 @@
 #include <ctime>
 
 #include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/binary_log.hxx"
 
 namespace FairDataPipeline {
     namespace logging {
@@ -47,7 +51,14 @@ namespace FairDataPipeline {
             int milli = curTime.tv_usec / 1000;
             char buffer[ 80 ];
             std::time_t _tv_sec = curTime.tv_sec;
-            strftime( buffer, 80, "%Y-%m-%d %H:%M:%S", localtime( &_tv_sec ));
+            // localtime shares its result between threads
+            std::tm _tm;
+#ifdef _WIN32
+            localtime_s( &_tm, &_tv_sec );
+#else
+            localtime_r( &_tv_sec, &_tm );
+#endif
+            strftime( buffer, 80, "%Y-%m-%d %H:%M:%S", &_tm );
             std::string currentTime( 84, 0 );
 
             sprintf( &currentTime[0], "%s.%03d", buffer, milli );
@@ -55,9 +66,8 @@ namespace FairDataPipeline {
         }
 
         Logger::Logger( enum LOG_LEVEL lvl, Sink::sptr sink, std::string name ) 
-            : _sink(sink), _name(name)
+            : _log_lvl(lvl), _sink(sink), _name(name)
         {
-            _log_lvl = lvl;
         }
 
         Logger::sptr Logger::create( enum LOG_LEVEL lvl, Sink::sptr sink, std::string name )
@@ -66,56 +76,76 @@ namespace FairDataPipeline {
         }
 
         Logger::MsgBuilder::MsgBuilder( enum LOG_LEVEL msg_lvl, Logger* logger ) 
-            : _msg_lvl( msg_lvl ), _logger(logger)
+            : _logger(logger), _msg_lvl( msg_lvl )
         {
+            if( !logger->should_log( msg_lvl ) )
+                return;
+
+            if( logger->_sink->structured() )
+            {
+                _record.reset( new LogRecord() );
+                _record->msg_lvl = msg_lvl;
+            }
+            else
+                _oss.reset( new std::ostringstream() );
         }
 
-        Logger::MsgBuilder::MsgBuilder( const Logger::MsgBuilder& rhs ) //: _sink( rhs._sink )
+        Logger::MsgBuilder::MsgBuilder( Logger::MsgBuilder&& rhs )
+            : _logger( rhs._logger ), _msg_lvl( rhs._msg_lvl ), _oss( std::move( rhs._oss ) ),
+              _record( std::move( rhs._record ) )
         {
-            this->_msg_lvl = rhs. _msg_lvl;
-            _logger = rhs._logger;
         }
 
         Logger::MsgBuilder::~MsgBuilder()
         {
-            if( _oss.tellp() > 0 )
+            if( _oss && _oss->tellp() > 0 )
             {
                 *this << "\n";
 
-                std::string msg = _oss.str();
+                std::string msg = _oss->str();
 
                 this->_logger->sink()->execute( _logger, _msg_lvl, msg );
             }
+            else if( _record && ( !_record->format.empty() || !_record->args.empty() ) )
+            {
+                if( _logger->_sink->should_log( _msg_lvl ) )
+                    _logger->_sink->log_record( _logger, *_record );
+            }
+        }
+
+        Logger::MsgBuilder Logger::builder( enum LOG_LEVEL msg_lvl )
+        {
+            return MsgBuilder( msg_lvl, this );
         }
 
         Logger::MsgBuilder Logger::info()
         {
-            return std::move( MsgBuilder( INFO, this ) ); 
+            return builder( INFO );
         }
 
         Logger::MsgBuilder Logger::debug()
         {
-            return std::move( MsgBuilder( DEBUG, this ) ); 
+            return builder( DEBUG );
         }
 
         Logger::MsgBuilder Logger::trace()
         {
-            return std::move( MsgBuilder( TRACE, this ) ); 
+            return builder( TRACE );
         }
 
         Logger::MsgBuilder Logger::warn()
         {
-            return std::move( MsgBuilder( WARN, this  ) );
+            return builder( WARN );
         }
 
         Logger:: MsgBuilder Logger::critical()
         {
-            return std::move( MsgBuilder( WARN, this ) ); 
+            return builder( WARN );
         }
 
         Logger::MsgBuilder Logger::error()
         {
-            return std::move(  MsgBuilder( ERROR, this ) ); 
+            return builder( ERROR );
         }
 
         Sink::Sink( enum LOG_LEVEL log_lvl ) 
@@ -124,12 +154,92 @@ namespace FairDataPipeline {
             _fmtr = SinkFormatter::create();
         }
 
+        void LogRecord::append_format( const char* s )
+        {
+            // Braces are doubled so that they are not read as placeholders
+            for( ; *s; ++s )
+            {
+                format += *s;
+                if( *s == '{' || *s == '}' )
+                    format += *s;
+            }
+        }
+
+        void LogRecord::append_int( long long value )
+        {
+            LogArg arg;
+            arg.type = LogArg::INT;
+            arg.i = value;
+            args.push_back( arg );
+            format += "{}";
+        }
+
+        void LogRecord::append_uint( unsigned long long value )
+        {
+            LogArg arg;
+            arg.type = LogArg::UINT;
+            arg.u = value;
+            args.push_back( arg );
+            format += "{}";
+        }
+
+        void LogRecord::append_double( double value )
+        {
+            LogArg arg;
+            arg.type = LogArg::DOUBLE;
+            arg.d = value;
+            args.push_back( arg );
+            format += "{}";
+        }
+
+        void LogRecord::append_string( const std::string& value )
+        {
+            LogArg arg;
+            arg.type = LogArg::STRING;
+            arg.s = value;
+            args.push_back( arg );
+            format += "{}";
+        }
+
+        std::string LogRecord::render() const
+        {
+            std::ostringstream oss;
+            std::size_t next_arg = 0;
+            for( std::size_t i = 0; i < format.size(); ++i )
+            {
+                const char c = format[i];
+                if( ( c == '{' || c == '}' ) && i + 1 < format.size() && format[i + 1] == c )
+                {
+                    oss << c;
+                    ++i;
+                }
+                else if( c == '{' && i + 1 < format.size() && format[i + 1] == '}' && next_arg < args.size() )
+                {
+                    const LogArg& arg = args[next_arg++];
+                    switch( arg.type )
+                    {
+                    case LogArg::INT: oss << arg.i; break;
+                    case LogArg::UINT: oss << arg.u; break;
+                    case LogArg::DOUBLE: oss << arg.d; break;
+                    case LogArg::STRING: oss << arg.s; break;
+                    }
+                    ++i;
+                }
+                else
+                    oss << c;
+            }
+            return oss.str();
+        }
+
+        int Sink::log_record( Logger* logger, const LogRecord& record )
+        {
+            return execute( logger, record.msg_lvl, record.render() + "\n" );
+        }
+
         enum LOG_LEVEL Sink::log_level(){ return _log_lvl;}
 
         void Sink::log_level( enum LOG_LEVEL log_lvl ){ _log_lvl = log_lvl;}
 
-        bool Sink::should_log( enum LOG_LEVEL msg_lvl ){ return msg_lvl >= this->log_level();}
-
         int Sink::execute( Logger* logger, enum LOG_LEVEL msg_lvl, const std::string& msg )
         {
             if( this->should_log( msg_lvl ) )
@@ -159,11 +269,18 @@ namespace FairDataPipeline {
 
         int OStreamSink::log( enum LOG_LEVEL msg_lvl, const std::string& s)
         {
+            std::lock_guard< std::mutex > lock( _mutex );
             _os << s;
 
             return 0;
         }
 
+        void OStreamSink::flush()
+        {
+            std::lock_guard< std::mutex > lock( _mutex );
+            _os.flush();
+        }
+
         OStreamSink::OStreamSink(enum LOG_LEVEL log_lvl, std::ostream& os) : Sink(log_lvl), _os(os)
         {
         }
@@ -197,24 +314,245 @@ namespace FairDataPipeline {
 
             return 0;
         }
+
+        void CompositeSink::flush()
+        {
+            for( std::size_t i = 0; i < _sinks.size(); ++i )
+                _sinks[i]->flush();
+        }
+
+        // Messages moved out of the ring before any of them is written
+        static const std::size_t async_batch_size_ = 256;
+
+        AsyncSink::sptr AsyncSink::create( enum LOG_LEVEL lvl, Sink::sptr sink, std::size_t capacity,
+                                           Overflow overflow )
+        {
+            return sptr( new AsyncSink( lvl, sink, capacity, overflow ) );
+        }
+
+        static std::size_t ring_capacity_( std::size_t capacity )
+        {
+            std::size_t n = 2;
+            while( n < capacity )
+                n <<= 1;
+            return n;
+        }
+
+        AsyncSink::AsyncSink( enum LOG_LEVEL lvl, Sink::sptr sink, std::size_t capacity, Overflow overflow )
+            : Sink( lvl ), _sink( sink ), _overflow( overflow ), _cells( ring_capacity_( capacity ) ),
+              _mask( _cells.size() - 1 ), _enqueue_pos( 0 ), _dequeue_pos( 0 ), _dropped( 0 ),
+              _dropped_reported( 0 ), _written( 0 ), _flush_target( 0 ), _flushed( 0 ), _sleeping( false ),
+              _stopping( false )
+        {
+            for( std::size_t i = 0; i < _cells.size(); ++i )
+                _cells[i].sequence.store( i, std::memory_order_relaxed );
+
+            _thread = std::thread( &AsyncSink::run_, this );
+        }
+
+        AsyncSink::~AsyncSink()
+        {
+            {
+                std::lock_guard< std::mutex > lock( _mutex );
+                _stopping = true;
+            }
+            _wake.notify_one();
+            _thread.join();
+        }
+
+        int AsyncSink::log( enum LOG_LEVEL msg_lvl, const std::string& s )
+        {
+            while( !try_push_( msg_lvl, s ) )
+            {
+                if( _overflow != Overflow::BLOCK )
+                {
+                    ++_dropped;
+                    return 0;
+                }
+
+                // Wait for the writer to free some cells
+                wake_();
+                std::unique_lock< std::mutex > lock( _mutex );
+                _drained.wait_for( lock, std::chrono::milliseconds( 1 ) );
+            }
+
+            wake_();
+            return 0;
+        }
+
+        void AsyncSink::flush()
+        {
+            const std::size_t target = _enqueue_pos.load();
+
+            std::unique_lock< std::mutex > lock( _mutex );
+            _flush_target = std::max( _flush_target, target );
+            _wake.notify_one();
+            _drained.wait( lock, [this, target]() { return _flushed >= target; } );
+        }
+
+        bool AsyncSink::try_push_( enum LOG_LEVEL msg_lvl, const std::string& s )
+        {
+            // Bounded MPMC queue after D. Vyukov, a cell's sequence equals the
+            // position when it is free to write and position + 1 once written
+            std::size_t pos = _enqueue_pos.load( std::memory_order_relaxed );
+            Cell* cell;
+            for( ;; )
+            {
+                cell = &_cells[pos & _mask];
+                const std::size_t sequence = cell->sequence.load( std::memory_order_acquire );
+                const std::ptrdiff_t diff =
+                    static_cast< std::ptrdiff_t >( sequence ) - static_cast< std::ptrdiff_t >( pos );
+                if( diff == 0 )
+                {
+                    if( _enqueue_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                        break;
+                }
+                else if( diff < 0 )
+                    return false;
+                else
+                    pos = _enqueue_pos.load( std::memory_order_relaxed );
+            }
+
+            cell->msg_lvl = msg_lvl;
+            cell->msg = s;
+            cell->sequence.store( pos + 1, std::memory_order_release );
+            return true;
+        }
+
+        std::size_t AsyncSink::drain_()
+        {
+            std::vector< std::pair< LOG_LEVEL, std::string > > batch;
+            batch.reserve( async_batch_size_ );
+            while( batch.size() < async_batch_size_ )
+            {
+                Cell& cell = _cells[_dequeue_pos & _mask];
+                if( cell.sequence.load( std::memory_order_acquire ) != _dequeue_pos + 1 )
+                    break;
+
+                batch.push_back( std::make_pair( cell.msg_lvl, std::string() ) );
+                batch.back().second.swap( cell.msg );
+                cell.sequence.store( _dequeue_pos + _cells.size(), std::memory_order_release );
+                ++_dequeue_pos;
+            }
+
+            for( std::size_t i = 0; i < batch.size(); ++i )
+                _sink->log( batch[i].first, batch[i].second );
+
+            const std::size_t dropped = _dropped.load();
+            if( _overflow == Overflow::COUNT && dropped != _dropped_reported )
+            {
+                std::ostringstream oss;
+                oss << "AsyncSink: " << dropped - _dropped_reported << " log messages dropped\n";
+                _sink->log( WARN, oss.str() );
+                _dropped_reported = dropped;
+            }
+
+            if( !batch.empty() )
+            {
+                std::lock_guard< std::mutex > lock( _mutex );
+                _written += batch.size();
+                _drained.notify_all();
+            }
+            return batch.size();
+        }
+
+        void AsyncSink::run_()
+        {
+            for( ;; )
+            {
+                const std::size_t n = drain_();
+
+                std::unique_lock< std::mutex > lock( _mutex );
+                if( _flushed < _flush_target && _written >= _flush_target )
+                {
+                    const std::size_t written = _written;
+                    lock.unlock();
+                    _sink->flush();
+                    lock.lock();
+                    _flushed = written;
+                    _drained.notify_all();
+                }
+
+                if( n > 0 )
+                    continue;
+                if( _stopping )
+                    break;
+
+                // Producers only take the mutex to wake the writer if it is
+                // about to sleep, the timeout covers a wake up racing this
+                _sleeping.store( true );
+                std::atomic_thread_fence( std::memory_order_seq_cst );
+                const Cell& next = _cells[_dequeue_pos & _mask];
+                if( next.sequence.load( std::memory_order_acquire ) != _dequeue_pos + 1 )
+                    _wake.wait_for( lock, std::chrono::milliseconds( 50 ) );
+                _sleeping.store( false );
+            }
+
+            _sink->flush();
+        }
+
+        void AsyncSink::wake_()
+        {
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            if( _sleeping.load() )
+            {
+                std::lock_guard< std::mutex > lock( _mutex );
+                _wake.notify_one();
+            }
+        }
     }
 
 
     logger::logger_sptr logger::_instance = NULL;
     
-    logger::logger_sptr logger::get_logger()
+    logging::Logger& logger::instance_()
     {
-        if( NULL == logger::_instance )
-        {
+        // Created once even if the first messages come from several threads
+        static std::once_flag created;
+        std::call_once( created, []() {
             enum logging::LOG_LEVEL log_lvl = logging::OFF;
 
             if( const char* env = std::getenv( "FDP_LOG_LEVEL" ) )
                 log_lvl = logging::to_LOG_LEVEL( env );
 
-            auto sink = logging::OStreamSink::create( log_lvl, std::cout );
+            logging::Sink::sptr sink = logging::OStreamSink::create( log_lvl, std::cout );
+
+            // FDP_LOG_BINARY=<prefix> writes binary logs to <prefix>.<n>.fdplog,
+            // which fdplog decodes
+            const char* binary = std::getenv( "FDP_LOG_BINARY" );
+            if( binary && *binary )
+            {
+                try
+                {
+                    sink = logging::BinarySink::create( log_lvl, binary );
+                }
+                catch( const std::exception& e )
+                {
+                    std::cerr << "Failed to start binary log, logging to the console: " << e.what()
+                              << std::endl;
+                }
+            }
+            // FDP_LOG_ASYNC=[BLOCK:DROP:COUNT] writes from a background thread
+            else if( const char* env = std::getenv( "FDP_LOG_ASYNC" ) )
+            {
+                const std::string policy( env );
+                if( policy == "BLOCK" || policy == "DROP" || policy == "COUNT" )
+                    sink = logging::AsyncSink::create(
+                        log_lvl, sink, 8192,
+                        policy == "BLOCK" ? logging::AsyncSink::Overflow::BLOCK
+                        : policy == "DROP" ? logging::AsyncSink::Overflow::DROP
+                                           : logging::AsyncSink::Overflow::COUNT );
+            }
+
             logger::_instance = logging::Logger::create( log_lvl, sink, "FDPAPI" );
-        }
+        } );
 
+        return *logger::_instance;
+    }
+
+    logger::logger_sptr logger::get_logger()
+    {
+        instance_();
         return logger::_instance;
     }
 
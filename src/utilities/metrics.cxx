@@ -0,0 +1,256 @@
+#include "fdp/utilities/metrics.hxx"
+
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+namespace FairDataPipeline {
+
+void Metrics::Gauge::add( double delta )
+{
+    double value = value_.load( std::memory_order_relaxed );
+    while( !value_.compare_exchange_weak( value, value + delta, std::memory_order_relaxed ) )
+        ;
+}
+
+Metrics::Histogram::Histogram() : count_( 0 ), sum_ns_( 0 )
+{
+    for( unsigned i = 0; i < n_buckets_; ++i )
+        buckets_[i].store( 0, std::memory_order_relaxed );
+}
+
+unsigned Metrics::Histogram::bucket_of_( std::uint64_t ns )
+{
+    const std::uint64_t n_sub_buckets = 1u << sub_bucket_bits_;
+    if( ns < n_sub_buckets )
+        return static_cast< unsigned >( ns );
+
+    // The top sub_bucket_bits_ bits below the leading one select the sub bucket
+#if defined( __GNUC__ )
+    const unsigned exponent = 63u - static_cast< unsigned >( __builtin_clzll( ns ) );
+#else
+    unsigned exponent = 0;
+    while( ns >> ( exponent + 1 ) )
+        ++exponent;
+#endif
+    const unsigned shift = exponent - sub_bucket_bits_;
+    const unsigned sub_bucket = static_cast< unsigned >( ( ns >> shift ) & ( n_sub_buckets - 1 ) );
+    return ( shift + 1 ) * static_cast< unsigned >( n_sub_buckets ) + sub_bucket;
+}
+
+double Metrics::Histogram::bucket_middle_ns_( unsigned bucket )
+{
+    const unsigned n_sub_buckets = 1u << sub_bucket_bits_;
+    if( bucket < n_sub_buckets )
+        return bucket;
+
+    const unsigned shift = bucket / n_sub_buckets - 1;
+    const double lower = std::ldexp( static_cast< double >( n_sub_buckets + bucket % n_sub_buckets ), shift );
+    return lower + std::ldexp( 0.5, shift );
+}
+
+void Metrics::Histogram::record( double seconds )
+{
+    record_ns( seconds > 0 ? static_cast< std::uint64_t >( seconds * 1e9 ) : 0 );
+}
+
+void Metrics::Histogram::record_ns( std::uint64_t ns )
+{
+    buckets_[bucket_of_( ns )].fetch_add( 1, std::memory_order_relaxed );
+    sum_ns_.fetch_add( ns, std::memory_order_relaxed );
+    count_.fetch_add( 1, std::memory_order_relaxed );
+}
+
+double Metrics::Histogram::sum() const
+{
+    return static_cast< double >( sum_ns_.load( std::memory_order_relaxed ) ) / 1e9;
+}
+
+double Metrics::Histogram::quantile( double q ) const
+{
+    const std::uint64_t count = this->count();
+    if( count == 0 )
+        return 0;
+
+    const std::uint64_t rank =
+        std::max< std::uint64_t >( 1, static_cast< std::uint64_t >( std::ceil( q * static_cast< double >( count ) ) ) );
+    std::uint64_t seen = 0;
+    for( unsigned i = 0; i < n_buckets_; ++i )
+    {
+        seen += buckets_[i].load( std::memory_order_relaxed );
+        if( seen >= rank )
+            return bucket_middle_ns_( i ) / 1e9;
+    }
+    // Records made while scanning
+    return bucket_middle_ns_( n_buckets_ - 1 ) / 1e9;
+}
+
+std::uint64_t Metrics::Histogram::count_below( double seconds ) const
+{
+    const double bound_ns = seconds * 1e9;
+    std::uint64_t n = 0;
+    for( unsigned i = 0; i < n_buckets_ && bucket_middle_ns_( i ) <= bound_ns; ++i )
+        n += buckets_[i].load( std::memory_order_relaxed );
+    return n;
+}
+
+Metrics::sptr Metrics::construct()
+{
+    return Metrics::sptr( new Metrics() );
+}
+
+Metrics::Family& Metrics::family_( const std::string& name, Type type )
+{
+    std::map< std::string, Family >::iterator it = families_.find( name );
+    if( it == families_.end() )
+    {
+        it = families_.insert( std::make_pair( name, Family() ) ).first;
+        it->second.type = type;
+    }
+    else if( it->second.type != type )
+    {
+        throw std::invalid_argument( "Metrics: '" + name + "' is already used by a metric of another type" );
+    }
+    return it->second;
+}
+
+Metrics::Counter& Metrics::counter( const std::string& name, const labels_type& labels )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::unique_ptr< Counter >& counter = family_( name, COUNTER ).counters[labels];
+    if( !counter )
+        counter.reset( new Counter() );
+    return *counter;
+}
+
+Metrics::Gauge& Metrics::gauge( const std::string& name, const labels_type& labels )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::unique_ptr< Gauge >& gauge = family_( name, GAUGE ).gauges[labels];
+    if( !gauge )
+        gauge.reset( new Gauge() );
+    return *gauge;
+}
+
+Metrics::Histogram& Metrics::histogram( const std::string& name, const labels_type& labels )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::unique_ptr< Histogram >& histogram = family_( name, HISTOGRAM ).histograms[labels];
+    if( !histogram )
+        histogram.reset( new Histogram() );
+    return *histogram;
+}
+
+void Metrics::describe( const std::string& name, const std::string& help )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    help_[name] = help;
+}
+
+void Metrics::add_collector( collector_type collector )
+{
+    std::lock_guard< std::mutex > lock( collectors_mutex_ );
+    collectors_.push_back( collector );
+}
+
+void Metrics::collect()
+{
+    std::lock_guard< std::mutex > lock( collectors_mutex_ );
+    for( std::size_t i = 0; i < collectors_.size(); ++i )
+        collectors_[i]( *this );
+}
+
+static std::string escape_( const std::string& s, bool quotes )
+{
+    std::string escaped;
+    for( std::size_t i = 0; i < s.size(); ++i )
+    {
+        if( s[i] == '\\' )
+            escaped += "\\\\";
+        else if( s[i] == '\n' )
+            escaped += "\\n";
+        else if( s[i] == '"' && quotes )
+            escaped += "\\\"";
+        else
+            escaped += s[i];
+    }
+    return escaped;
+}
+
+// name{label="value",...} with an extra label for histogram buckets
+static std::string series_( const std::string& name, const Metrics::labels_type& labels,
+                            const char* extra_key = NULL, const std::string& extra_value = std::string() )
+{
+    std::string series = name;
+    if( labels.empty() && !extra_key )
+        return series;
+
+    series += '{';
+    for( Metrics::labels_type::const_iterator it = labels.begin(); it != labels.end(); ++it )
+    {
+        if( it != labels.begin() )
+            series += ',';
+        series += it->first + "=\"" + escape_( it->second, true ) + "\"";
+    }
+    if( extra_key )
+    {
+        if( !labels.empty() )
+            series += ',';
+        series += std::string( extra_key ) + "=\"" + extra_value + "\"";
+    }
+    return series + '}';
+}
+
+static std::string number_( double value )
+{
+    char buffer[32];
+    std::snprintf( buffer, sizeof( buffer ), "%.15g", value );
+    return buffer;
+}
+
+std::string Metrics::to_prometheus()
+{
+    collect();
+
+    static const char* types[] = { "counter", "gauge", "histogram" };
+    static const double bounds[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                                     0.05,   0.1,     0.25,   0.5,   1,      2.5,   5,    10,
+                                     30,     60 };
+
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::ostringstream out;
+    for( std::map< std::string, Family >::const_iterator it = families_.begin(); it != families_.end(); ++it )
+    {
+        const std::string& name = it->first;
+        const Family& family = it->second;
+        std::map< std::string, std::string >::const_iterator help = help_.find( name );
+        if( help != help_.end() )
+            out << "# HELP " << name << " " << escape_( help->second, false ) << "\n";
+        out << "# TYPE " << name << " " << types[family.type] << "\n";
+
+        for( std::map< labels_type, std::unique_ptr< Counter > >::const_iterator c = family.counters.begin();
+             c != family.counters.end(); ++c )
+            out << series_( name, c->first ) << " " << c->second->value() << "\n";
+
+        for( std::map< labels_type, std::unique_ptr< Gauge > >::const_iterator g = family.gauges.begin();
+             g != family.gauges.end(); ++g )
+            out << series_( name, g->first ) << " " << number_( g->second->value() ) << "\n";
+
+        for( std::map< labels_type, std::unique_ptr< Histogram > >::const_iterator h = family.histograms.begin();
+             h != family.histograms.end(); ++h )
+        {
+            const Histogram& histogram = *h->second;
+            const std::uint64_t count = histogram.count();
+            for( std::size_t b = 0; b < sizeof( bounds ) / sizeof( bounds[0] ); ++b )
+                out << series_( name + "_bucket", h->first, "le", number_( bounds[b] ) ) << " "
+                    << std::min( histogram.count_below( bounds[b] ), count ) << "\n";
+            out << series_( name + "_bucket", h->first, "le", "+Inf" ) << " " << count << "\n";
+            out << series_( name + "_sum", h->first ) << " " << number_( histogram.sum() ) << "\n";
+            out << series_( name + "_count", h->first ) << " " << count << "\n";
+        }
+    }
+    return out.str();
+}
+
+}; // namespace FairDataPipeline
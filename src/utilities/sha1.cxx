@@ -0,0 +1,341 @@
+#include "fdp/utilities/sha1.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define FDP_SHA1_X86
+#include <immintrin.h>
+#if defined( __GNUC__ ) || defined( __clang__ )
+#include <cpuid.h>
+#define FDP_TARGET_SHA_NI __attribute__( ( target( "sha,sse4.1,ssse3" ) ) )
+#else
+#define FDP_TARGET_SHA_NI
+#endif
+#endif
+
+#include "fdp/utilities/logging.hxx"
+
+namespace FairDataPipeline {
+
+static inline std::uint32_t rotl_( std::uint32_t x, int n )
+{
+    return ( x << n ) | ( x >> ( 32 - n ) );
+}
+
+static void compress_scalar_( std::uint32_t* state, const unsigned char* blocks, std::size_t n_blocks )
+{
+    for( ; n_blocks > 0; --n_blocks, blocks += 64 )
+    {
+        std::uint32_t w[16];
+        for( int i = 0; i < 16; ++i )
+            w[i] = ( std::uint32_t( blocks[4 * i] ) << 24 ) | ( std::uint32_t( blocks[4 * i + 1] ) << 16 ) |
+                   ( std::uint32_t( blocks[4 * i + 2] ) << 8 ) | std::uint32_t( blocks[4 * i + 3] );
+
+        std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+        for( int i = 0; i < 80; ++i )
+        {
+            if( i >= 16 )
+                w[i & 15] = rotl_( w[( i + 13 ) & 15] ^ w[( i + 8 ) & 15] ^ w[( i + 2 ) & 15] ^ w[i & 15], 1 );
+
+            std::uint32_t f, k;
+            if( i < 20 )
+            {
+                f = ( b & c ) | ( ~b & d );
+                k = 0x5A827999;
+            }
+            else if( i < 40 )
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if( i < 60 )
+            {
+                f = ( b & c ) | ( b & d ) | ( c & d );
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            const std::uint32_t t = rotl_( a, 5 ) + f + e + k + w[i & 15];
+            e = d;
+            d = c;
+            c = rotl_( b, 30 );
+            b = a;
+            a = t;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+#ifdef FDP_SHA1_X86
+// Four rounds of the SHA extensions kernel. msg[g % 4] holds the message
+// words for group g while the schedule for the following groups is
+// computed in the other three registers.
+#define FDP_SHA1_GROUP( g )                                                               \
+    {                                                                                     \
+        if( ( g ) == 0 )                                                                  \
+            e[0] = _mm_add_epi32( e[0], msg[0] );                                         \
+        else                                                                              \
+            e[( g ) % 2] = _mm_sha1nexte_epu32( e[( g ) % 2], msg[( g ) % 4] );           \
+        e[1 - ( g ) % 2] = abcd;                                                          \
+        if( ( g ) >= 3 && ( g ) <= 18 )                                                   \
+            msg[( ( g ) + 1 ) % 4] = _mm_sha1msg2_epu32( msg[( ( g ) + 1 ) % 4], msg[( g ) % 4] ); \
+        abcd = _mm_sha1rnds4_epu32( abcd, e[( g ) % 2], ( g ) / 5 );                      \
+        if( ( g ) >= 1 && ( g ) <= 16 )                                                   \
+            msg[( ( g ) + 3 ) % 4] = _mm_sha1msg1_epu32( msg[( ( g ) + 3 ) % 4], msg[( g ) % 4] ); \
+        if( ( g ) >= 2 && ( g ) <= 17 )                                                   \
+            msg[( ( g ) + 2 ) % 4] = _mm_xor_si128( msg[( ( g ) + 2 ) % 4], msg[( g ) % 4] ); \
+    }
+
+FDP_TARGET_SHA_NI
+static void compress_sha_ni_( std::uint32_t* state, const unsigned char* blocks, std::size_t n_blocks )
+{
+    const __m128i byte_swap = _mm_set_epi64x( 0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL );
+
+    __m128i abcd = _mm_shuffle_epi32( _mm_loadu_si128( reinterpret_cast< const __m128i* >( state ) ), 0x1B );
+    __m128i e[2];
+    e[0] = _mm_set_epi32( static_cast< int >( state[4] ), 0, 0, 0 );
+    e[1] = _mm_setzero_si128();
+
+    for( ; n_blocks > 0; --n_blocks, blocks += 64 )
+    {
+        const __m128i abcd_save = abcd;
+        const __m128i e_save = e[0];
+
+        __m128i msg[4];
+        for( int i = 0; i < 4; ++i )
+            msg[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128( reinterpret_cast< const __m128i* >( blocks + 16 * i ) ), byte_swap );
+
+        FDP_SHA1_GROUP( 0 ) FDP_SHA1_GROUP( 1 ) FDP_SHA1_GROUP( 2 ) FDP_SHA1_GROUP( 3 )
+        FDP_SHA1_GROUP( 4 ) FDP_SHA1_GROUP( 5 ) FDP_SHA1_GROUP( 6 ) FDP_SHA1_GROUP( 7 )
+        FDP_SHA1_GROUP( 8 ) FDP_SHA1_GROUP( 9 ) FDP_SHA1_GROUP( 10 ) FDP_SHA1_GROUP( 11 )
+        FDP_SHA1_GROUP( 12 ) FDP_SHA1_GROUP( 13 ) FDP_SHA1_GROUP( 14 ) FDP_SHA1_GROUP( 15 )
+        FDP_SHA1_GROUP( 16 ) FDP_SHA1_GROUP( 17 ) FDP_SHA1_GROUP( 18 ) FDP_SHA1_GROUP( 19 )
+
+        e[0] = _mm_sha1nexte_epu32( e[0], e_save );
+        abcd = _mm_add_epi32( abcd, abcd_save );
+    }
+
+    _mm_storeu_si128( reinterpret_cast< __m128i* >( state ), _mm_shuffle_epi32( abcd, 0x1B ) );
+    state[4] = static_cast< std::uint32_t >( _mm_extract_epi32( e[0], 3 ) );
+}
+
+#undef FDP_SHA1_GROUP
+
+static bool cpu_has_sha_ni_()
+{
+    unsigned int leaf1[4] = { 0, 0, 0, 0 };
+    unsigned int leaf7[4] = { 0, 0, 0, 0 };
+#if defined( __GNUC__ ) || defined( __clang__ )
+    if( !__get_cpuid( 1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3] ) ||
+        !__get_cpuid_count( 7, 0, &leaf7[0], &leaf7[1], &leaf7[2], &leaf7[3] ) )
+        return false;
+#else
+    int info[4];
+    __cpuid( info, 0 );
+    if( info[0] < 7 )
+        return false;
+    __cpuid( info, 1 );
+    leaf1[2] = static_cast< unsigned int >( info[2] );
+    __cpuidex( info, 7, 0 );
+    leaf7[1] = static_cast< unsigned int >( info[1] );
+#endif
+    const bool ssse3 = ( leaf1[2] >> 9 ) & 1;
+    const bool sse41 = ( leaf1[2] >> 19 ) & 1;
+    const bool sha = ( leaf7[1] >> 29 ) & 1;
+    return ssse3 && sse41 && sha;
+}
+#endif
+
+bool Sha1::is_supported( Engine engine )
+{
+    switch( engine )
+    {
+    case Engine::SCALAR:
+        return true;
+    case Engine::SHA_NI:
+#ifdef FDP_SHA1_X86
+    {
+        static const bool supported = cpu_has_sha_ni_();
+        return supported;
+    }
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+Sha1::Engine Sha1::best_engine()
+{
+    static const Engine engine = is_supported( Engine::SHA_NI ) ? Engine::SHA_NI : Engine::SCALAR;
+    return engine;
+}
+
+std::string Sha1::engine_name( Engine engine )
+{
+    switch( engine )
+    {
+    case Engine::SCALAR:
+        return "scalar";
+    case Engine::SHA_NI:
+        return "sha-ni";
+    }
+    return "unknown";
+}
+
+Sha1::Sha1( Engine engine ) : engine_( engine ), compress_( compress_scalar_ ), block_size_( 0 ), length_( 0 )
+{
+    if( !is_supported( engine ) )
+        throw std::invalid_argument( "SHA1 engine " + engine_name( engine ) + " is not supported by this CPU" );
+
+#ifdef FDP_SHA1_X86
+    if( engine == Engine::SHA_NI )
+        compress_ = compress_sha_ni_;
+#endif
+
+    state_[0] = 0x67452301;
+    state_[1] = 0xEFCDAB89;
+    state_[2] = 0x98BADCFE;
+    state_[3] = 0x10325476;
+    state_[4] = 0xC3D2E1F0;
+}
+
+Sha1& Sha1::update( const void* data, std::size_t size )
+{
+    const unsigned char* bytes = static_cast< const unsigned char* >( data );
+    length_ += size;
+
+    if( block_size_ > 0 )
+    {
+        const std::size_t n = std::min( size, sizeof( block_ ) - block_size_ );
+        std::memcpy( block_ + block_size_, bytes, n );
+        block_size_ += n;
+        bytes += n;
+        size -= n;
+        if( block_size_ < sizeof( block_ ) )
+            return *this;
+        compress_( state_, block_, 1 );
+        block_size_ = 0;
+    }
+
+    // Whole blocks are hashed in place
+    const std::size_t n_blocks = size / 64;
+    if( n_blocks > 0 )
+        compress_( state_, bytes, n_blocks );
+
+    block_size_ = size % 64;
+    std::memcpy( block_, bytes + 64 * n_blocks, block_size_ );
+    return *this;
+}
+
+std::string Sha1::hexdigest() const
+{
+    std::uint32_t state[5];
+    std::memcpy( state, state_, sizeof( state ) );
+
+    // Padding: a one bit, zeros, then the length in bits, big endian
+    unsigned char tail[128];
+    std::memcpy( tail, block_, block_size_ );
+    tail[block_size_] = 0x80;
+    const std::size_t tail_size = block_size_ < 56 ? 64 : 128;
+    std::memset( tail + block_size_ + 1, 0, tail_size - block_size_ - 1 );
+    const std::uint64_t bits = length_ * 8;
+    for( int i = 0; i < 8; ++i )
+        tail[tail_size - 1 - i] = static_cast< unsigned char >( bits >> ( 8 * i ) );
+    compress_( state, tail, tail_size / 64 );
+
+    static const char digits[] = "0123456789abcdef";
+    std::string hex( 40, '0' );
+    for( int i = 0; i < 20; ++i )
+    {
+        const unsigned int byte = ( state[i / 4] >> ( 24 - 8 * ( i % 4 ) ) ) & 0xFF;
+        hex[2 * i] = digits[byte >> 4];
+        hex[2 * i + 1] = digits[byte & 0xF];
+    }
+    return hex;
+}
+
+// Size of the reads used when a file is not mapped
+static const std::size_t read_size_ = 1 << 20;
+
+Sha1& Sha1::update_file( const ghc::filesystem::path& path )
+{
+#ifndef _WIN32
+    const int fd = ::open( path.string().c_str(), O_RDONLY );
+    if( fd < 0 )
+        throw std::runtime_error( "Failed to open '" + path.string() + "' for hashing" );
+
+    // Small files are read in one call, larger ones are mapped to save
+    // copying them through a buffer
+    struct stat st;
+    if( ::fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) &&
+        static_cast< std::size_t >( st.st_size ) >= read_size_ )
+    {
+        const std::size_t size = static_cast< std::size_t >( st.st_size );
+        void* mapped = ::mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( mapped != MAP_FAILED )
+        {
+            ::madvise( mapped, size, MADV_SEQUENTIAL );
+            update( mapped, size );
+            ::munmap( mapped, size );
+            ::close( fd );
+            return *this;
+        }
+        FDP_LOG( DEBUG ) << "Sha1: Failed to map " << path.string() << ", reading it";
+    }
+
+    std::vector< char > buffer( read_size_ );
+    for( ;; )
+    {
+        const ssize_t n = ::read( fd, &buffer[0], buffer.size() );
+        if( n == 0 )
+            break;
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n < 0 )
+        {
+            ::close( fd );
+            throw std::runtime_error( "Failed to read '" + path.string() + "' for hashing" );
+        }
+        update( &buffer[0], static_cast< std::size_t >( n ) );
+    }
+    ::close( fd );
+#else
+    std::ifstream file( path.string(), std::ios_base::in | std::ios_base::binary );
+    if( !file )
+        throw std::runtime_error( "Failed to open '" + path.string() + "' for hashing" );
+
+    std::vector< char > buffer( read_size_ );
+    while( file.read( &buffer[0], buffer.size() ) || file.gcount() > 0 )
+        update( &buffer[0], static_cast< std::size_t >( file.gcount() ) );
+#endif
+    return *this;
+}
+
+}; // namespace FairDataPipeline
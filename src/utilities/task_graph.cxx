@@ -0,0 +1,133 @@
+#include "fdp/utilities/task_graph.hxx"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/trace.hxx"
+
+namespace FairDataPipeline {
+
+TaskGraph::sptr TaskGraph::construct()
+{
+    return TaskGraph::sptr( new TaskGraph() );
+}
+
+TaskGraph::task_id TaskGraph::add( const std::string& name, task_type task,
+                                   const std::vector< task_id >& dependencies )
+{
+    const task_id id = nodes_.size();
+
+    Node node;
+    node.name = name;
+    node.task = task;
+    node.n_dependencies = dependencies.size();
+
+    for( std::size_t i = 0; i < dependencies.size(); ++i )
+    {
+        if( dependencies[i] >= id )
+            throw std::invalid_argument( "TaskGraph: task '" + name +
+                                         "' depends on a task which has not been added" );
+        nodes_[ dependencies[i] ].dependents.push_back( id );
+    }
+
+    nodes_.push_back( node );
+    return id;
+}
+
+void TaskGraph::run( std::size_t max_parallel )
+{
+    if( nodes_.empty() )
+        return;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque< task_id > ready;
+    std::vector< std::size_t > remaining( nodes_.size() );
+    std::size_t n_finished = 0;
+    std::exception_ptr error;
+
+    for( task_id i = 0; i < nodes_.size(); ++i )
+    {
+        remaining[i] = nodes_[i].n_dependencies;
+        if( remaining[i] == 0 )
+            ready.push_back( i );
+    }
+
+    const std::thread::id caller = std::this_thread::get_id();
+    std::function< void() > worker = [&]() {
+        if( std::this_thread::get_id() != caller )
+            trace::set_thread_name( "task worker" );
+        std::unique_lock< std::mutex > lock( mutex );
+        for( ;; )
+        {
+            cv.wait( lock, [&](){
+                return !ready.empty() || n_finished == nodes_.size() || error;
+            });
+
+            if( n_finished == nodes_.size() || error )
+                break;
+
+            const task_id id = ready.front();
+            ready.pop_front();
+            lock.unlock();
+
+            FDP_LOG( TRACE ) << "TaskGraph: Starting '" << nodes_[id].name << "'";
+
+            std::exception_ptr task_error;
+            {
+                trace::Span span( "task", "task" );
+                span.label( nodes_[id].name );
+                try
+                {
+                    nodes_[id].task();
+                }
+                catch( ... )
+                {
+                    task_error = std::current_exception();
+                    span.arg( "failed", 1LL );
+                }
+            }
+
+            lock.lock();
+            ++n_finished;
+
+            if( task_error )
+            {
+                FDP_LOG( DEBUG ) << "TaskGraph: Task '" << nodes_[id].name << "' failed";
+                if( !error )
+                    error = task_error;
+            }
+            else
+            {
+                for( std::size_t i = 0; i < nodes_[id].dependents.size(); ++i )
+                {
+                    const task_id dependent = nodes_[id].dependents[i];
+                    if( --remaining[ dependent ] == 0 )
+                        ready.push_back( dependent );
+                }
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::size_t n_threads = ( max_parallel == 0 || max_parallel > nodes_.size() )
+        ? nodes_.size() : max_parallel;
+
+    // The calling thread acts as one of the workers
+    std::vector< std::thread > threads;
+    for( std::size_t i = 1; i < n_threads; ++i )
+        threads.push_back( std::thread( worker ) );
+    worker();
+    for( std::size_t i = 0; i < threads.size(); ++i )
+        threads[i].join();
+
+    if( error )
+        std::rethrow_exception( error );
+}
+
+}; // namespace FairDataPipeline
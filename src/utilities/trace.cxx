@@ -0,0 +1,333 @@
+#include "fdp/utilities/trace.hxx"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <json/json.h>
+
+#include "fdp/utilities/logging.hxx"
+
+namespace FairDataPipeline {
+namespace trace {
+
+std::atomic< bool > enabled_( false );
+
+namespace {
+
+struct Event
+{
+    const char* category;
+    std::string name;
+    std::uint64_t start_ns;
+    std::uint64_t duration_ns;
+    std::uint64_t async_id;
+    std::string args;
+};
+
+// Spans of one thread, only locked against a concurrent write()
+struct Buffer
+{
+    Buffer( unsigned tid ) : tid( tid ), name( NULL ), dropped( 0 ) {}
+
+    std::mutex mutex;
+    unsigned tid;
+    const char* name;
+    std::vector< Event > events;
+    std::size_t dropped;
+};
+
+// Bounds the memory of a trace left running
+const std::size_t max_events_per_thread_ = 1 << 20;
+
+struct Tracer
+{
+    Tracer() : epoch_ns( now_ns() ), next_tid( 1 ) {}
+
+    std::mutex mutex;
+    std::string path;
+    std::uint64_t epoch_ns;
+    unsigned next_tid;
+    // Buffers outlive their threads so that their spans are still written
+    std::vector< std::shared_ptr< Buffer > > buffers;
+};
+
+// Never destroyed as spans may end during static destruction
+Tracer& tracer_()
+{
+    static Tracer* tracer = new Tracer();
+    return *tracer;
+}
+
+Buffer& buffer_()
+{
+    static thread_local std::shared_ptr< Buffer > buffer;
+    if( !buffer )
+    {
+        Tracer& tracer = tracer_();
+        std::lock_guard< std::mutex > lock( tracer.mutex );
+        buffer = std::make_shared< Buffer >( tracer.next_tid++ );
+        tracer.buffers.push_back( buffer );
+    }
+    return *buffer;
+}
+
+long long write_file_( Tracer& tracer );
+
+// The logger may already be destroyed at exit
+void write_at_exit_()
+{
+    Tracer& tracer = tracer_();
+    std::lock_guard< std::mutex > lock( tracer.mutex );
+    write_file_( tracer );
+}
+
+// FDP_TRACE_FILE=<path> traces the whole process
+struct StartFromEnvironment
+{
+    StartFromEnvironment()
+    {
+        const char* path = std::getenv( "FDP_TRACE_FILE" );
+        if( path && *path )
+        {
+            start( path );
+            set_thread_name( "main" );
+            std::atexit( write_at_exit_ );
+        }
+    }
+} start_from_environment_;
+
+} // namespace
+
+void start( const std::string& path )
+{
+    Tracer& tracer = tracer_();
+    {
+        std::lock_guard< std::mutex > lock( tracer.mutex );
+        tracer.path = path;
+    }
+    enabled_.store( true );
+}
+
+void stop() { enabled_.store( false ); }
+
+void clear()
+{
+    Tracer& tracer = tracer_();
+    std::lock_guard< std::mutex > lock( tracer.mutex );
+    for( std::size_t i = 0; i < tracer.buffers.size(); ++i )
+    {
+        std::lock_guard< std::mutex > buffer_lock( tracer.buffers[i]->mutex );
+        tracer.buffers[i]->events.clear();
+        tracer.buffers[i]->dropped = 0;
+    }
+}
+
+void set_thread_name( const char* name )
+{
+    if( !enabled() )
+        return;
+
+    Buffer& buffer = buffer_();
+    std::lock_guard< std::mutex > lock( buffer.mutex );
+    buffer.name = name;
+}
+
+std::uint64_t now_ns()
+{
+    return static_cast< std::uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >(
+        std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+std::uint64_t new_async_id()
+{
+    static std::atomic< std::uint64_t > next_id( 1 );
+    return next_id.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void record( const char* category, const char* name, std::uint64_t start_ns, std::uint64_t duration_ns,
+             const std::string& args, std::uint64_t async_id )
+{
+    if( enabled() )
+        record( category, std::string( name ), start_ns, duration_ns, args, async_id );
+}
+
+void record( const char* category, const std::string& name, std::uint64_t start_ns, std::uint64_t duration_ns,
+             const std::string& args, std::uint64_t async_id )
+{
+    if( !enabled() )
+        return;
+
+    Buffer& buffer = buffer_();
+    std::lock_guard< std::mutex > lock( buffer.mutex );
+    if( buffer.events.size() >= max_events_per_thread_ )
+    {
+        ++buffer.dropped;
+        return;
+    }
+
+    Event event;
+    event.category = category;
+    event.name = name;
+    event.start_ns = start_ns;
+    event.duration_ns = duration_ns;
+    event.async_id = async_id;
+    event.args = args;
+    buffer.events.push_back( event );
+}
+
+namespace {
+
+void write_metadata_( std::ostream& out, int pid, unsigned tid, const char* name, const std::string& value )
+{
+    out << "{\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"name\":\"" << name
+        << "\",\"args\":{\"name\":" << Json::valueToQuotedString( value.c_str() ) << "}},\n";
+}
+
+// Writes the trace file, returning the number of spans or -1 on failure
+long long write_file_( Tracer& tracer )
+{
+    std::ofstream out( tracer.path.c_str(), std::ios_base::out | std::ios_base::trunc );
+    if( !out )
+        return -1;
+
+#ifdef _WIN32
+    const int pid = _getpid();
+#else
+    const int pid = getpid();
+#endif
+
+    // Timestamps are microseconds from the start of tracing
+    char time[64];
+    long long n_events = 0;
+    std::size_t n_dropped = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    write_metadata_( out, pid, 0, "process_name", "FDPAPI" );
+    for( std::size_t i = 0; i < tracer.buffers.size(); ++i )
+    {
+        Buffer& buffer = *tracer.buffers[i];
+        std::lock_guard< std::mutex > buffer_lock( buffer.mutex );
+        write_metadata_( out, pid, buffer.tid, "thread_name",
+                         buffer.name ? buffer.name : "thread " + std::to_string( buffer.tid ) );
+
+        for( std::size_t j = 0; j < buffer.events.size(); ++j )
+        {
+            const Event& event = buffer.events[j];
+            const std::uint64_t start_ns = event.start_ns > tracer.epoch_ns ? event.start_ns - tracer.epoch_ns : 0;
+            out << "{\"pid\":" << pid << ",\"tid\":" << buffer.tid << ",\"cat\":\"" << event.category
+                << "\",\"name\":" << Json::valueToQuotedString( event.name.c_str() ) << ",";
+            if( event.async_id == 0 )
+            {
+                std::snprintf( time, sizeof( time ), "\"ts\":%.3f,\"dur\":%.3f", start_ns / 1e3,
+                               event.duration_ns / 1e3 );
+                out << "\"ph\":\"X\"," << time << ",\"args\":{" << event.args << "}},\n";
+            }
+            else
+            {
+                // A nestable async begin and end pair
+                std::snprintf( time, sizeof( time ), "\"ts\":%.3f", start_ns / 1e3 );
+                out << "\"ph\":\"b\",\"id\":" << event.async_id << "," << time << ",\"args\":{" << event.args
+                    << "}},\n";
+                std::snprintf( time, sizeof( time ), "\"ts\":%.3f", ( start_ns + event.duration_ns ) / 1e3 );
+                out << "{\"pid\":" << pid << ",\"tid\":" << buffer.tid << ",\"cat\":\"" << event.category
+                    << "\",\"name\":" << Json::valueToQuotedString( event.name.c_str() ) << ",\"ph\":\"e\",\"id\":" << event.async_id << ","
+                    << time << "},\n";
+            }
+        }
+        n_events += static_cast< long long >( buffer.events.size() );
+        n_dropped += buffer.dropped;
+    }
+    // The array ends with an event as JSON allows no trailing comma
+    out << "{\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,\"name\":\"trace_stats\",\"args\":{\"events\":"
+        << n_events << ",\"dropped\":" << n_dropped << "}}\n]}\n";
+    out.close();
+    return out ? n_events : -1;
+}
+
+} // namespace
+
+void write()
+{
+    Tracer& tracer = tracer_();
+    std::lock_guard< std::mutex > lock( tracer.mutex );
+    if( tracer.path.empty() )
+        return;
+
+    const long long n_events = write_file_( tracer );
+    if( n_events < 0 )
+        logger::get_logger()->error() << "Trace: Failed to write " << tracer.path;
+    else
+        FDP_LOG( DEBUG ) << "Trace: Wrote " << n_events << " spans to " << tracer.path;
+}
+
+void append_arg( std::string& args, const char* key, const std::string& value )
+{
+    if( !args.empty() )
+        args += ',';
+    args += '"';
+    args += key;
+    args += "\":";
+    args += Json::valueToQuotedString( value.c_str() );
+}
+
+void append_arg( std::string& args, const char* key, long long value )
+{
+    if( !args.empty() )
+        args += ',';
+    args += '"';
+    args += key;
+    args += "\":";
+    args += std::to_string( value );
+}
+
+void append_arg( std::string& args, const char* key, double value )
+{
+    char buffer[32];
+    if( value == value && value - value == 0 )
+        std::snprintf( buffer, sizeof( buffer ), "%.15g", value );
+    else
+        std::snprintf( buffer, sizeof( buffer ), "null" );
+    if( !args.empty() )
+        args += ',';
+    args += '"';
+    args += key;
+    args += "\":";
+    args += buffer;
+}
+
+void Span::label( const std::string& name )
+{
+    if( start_ns_ )
+        label_ = name;
+}
+
+void Span::arg( const char* key, const std::string& value )
+{
+    if( start_ns_ )
+        append_arg( args_, key, value );
+}
+
+void Span::arg( const char* key, long long value )
+{
+    if( start_ns_ )
+        append_arg( args_, key, value );
+}
+
+void Span::arg( const char* key, double value )
+{
+    if( start_ns_ )
+        append_arg( args_, key, value );
+}
+
+} // namespace trace
+}; // namespace FairDataPipeline
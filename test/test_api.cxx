@@ -3,12 +3,30 @@
 #endif
 
 #include "fdp/registry/api.hxx"
+#include "fdp/registry/cassette.hxx"
+#include "fdp/registry/curl_multi.hxx"
+#include "fdp/registry/disk_cache.hxx"
+#include "fdp/registry/embedded_registry.hxx"
+#include "fdp/registry/response_cache.hxx"
 #include "fdp/fdp.hxx"
 #include "fdp/objects/metadata.hxx"
 #include "gtest/gtest.h"
 #include "fdp/utilities/json.hxx"
 #include "fdp/utilities/logging.hxx"
 
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 using namespace FairDataPipeline;
 
 class ApiTest : public ::testing::Test {
@@ -62,3 +80,321 @@ TEST_F(ApiTest, TestPostEntry) {
   Json::Value storage_root = api_->post("storage_root", post_data, token);
   ASSERT_EQ(storage_root["root"], "http://test.com");
 }
+
+//![TestConnectionReuse]
+TEST_F(ApiTest, TestConnectionReuse) {
+  api_->set_response_cache(ResponseCache::construct(0));
+  api_->get_request(std::string("author/?name=Interface%20Test"));
+  api_->get_request(std::string("author/?name=Interface%20Test"));
+  ASSERT_EQ(api_->get_curl_pool()->created_count(), 1);
+  ASSERT_EQ(api_->get_curl_pool()->idle_count(), 1);
+} //![TestConnectionReuse]
+
+//![TestGetAsync]
+TEST_F(ApiTest, TestGetAsync) {
+  std::future<Json::Value> author = api_->get_async(std::string("author/?name=Interface%20Test"));
+  ASSERT_EQ(author.get()[0]["name"].asString(), std::string("Interface Test"));
+} //![TestGetAsync]
+
+//![TestBatch]
+TEST_F(ApiTest, TestBatch) {
+  API::Batch::sptr batch = api_->batch(2);
+  Json::Value post_data;
+  post_data["name"] = std::string("Interface Test");
+  post_data["identifier"] = std::string("https://orcid.org/000-0000-0000-0000");
+  std::future<Json::Value> author = batch->post(std::string("author"), post_data, token);
+  std::future<Json::Value> query = batch->get(std::string("author/?name=Interface%20Test"));
+  std::future<Json::Value> missing = batch->get(std::string("not_a_table/"));
+  ASSERT_EQ(batch->size(), 3);
+  batch->execute();
+  ASSERT_EQ(author.get()["name"].asString(), std::string("Interface Test"));
+  ASSERT_EQ(query.get()[0]["name"].asString(), std::string("Interface Test"));
+  ASSERT_THROW(missing.get(), rest_apiquery_error);
+} //![TestBatch]
+
+//![TestResponseCache]
+TEST_F(ApiTest, TestResponseCache) {
+  Json::Value first = api_->get_by_id("author", 1);
+  Json::Value second = api_->get_by_id("author", 1);
+  ASSERT_EQ(first, second);
+  ASSERT_EQ(api_->get_response_cache()->get_stats().misses, 1);
+  ASSERT_EQ(api_->get_response_cache()->get_stats().hits, 1);
+} //![TestResponseCache]
+
+//![TestDiskCachedPosts]
+TEST_F(ApiTest, TestDiskCachedPosts) {
+  const ghc::filesystem::path cache_dir_ = ghc::filesystem::temp_directory_path() / "fdpapi-test-disk-cached-posts";
+  ghc::filesystem::remove_all(cache_dir_);
+  EmbeddedRegistry::sptr registry_ = EmbeddedRegistry::construct(api_url_ + "/");
+  api_->set_transport(EmbeddedTransport::construct(registry_));
+  api_->set_disk_cache(DiskCache::construct(cache_dir_, api_url_));
+
+  // Namespaces are unique on their name, so the second POST is served from disk
+  Json::Value namespace_data;
+  namespace_data["name"] = "disk_cached_posts";
+  Json::Value first_namespace = api_->post("namespace", namespace_data, token);
+  Json::Value second_namespace = api_->post("namespace", namespace_data, token);
+  ASSERT_EQ(first_namespace["url"], second_namespace["url"]);
+  ASSERT_EQ(registry_->table_size("namespace"), 1);
+
+  // Every object POSTed is a new one, even for identical outputs
+  Json::Value object_data;
+  object_data["description"] = "identical output";
+  Json::Value first_object = api_->post("object", object_data, token);
+  Json::Value second_object = api_->post("object", object_data, token);
+  ASSERT_NE(first_object["url"], second_object["url"]);
+  ASSERT_EQ(registry_->table_size("object"), 2);
+
+  ghc::filesystem::remove_all(cache_dir_);
+} //![TestDiskCachedPosts]
+
+TEST(ApiOfflineTest, TestResponseCacheKey) {
+  ASSERT_EQ(ResponseCache::make_key("/namespace?name=PSU&version=1&", "token"),
+            ResponseCache::make_key("namespace/?version=1&name=PSU", "token"));
+  ASSERT_NE(ResponseCache::make_key("namespace/?name=PSU", "a"),
+            ResponseCache::make_key("namespace/?name=PSU", "b"));
+  ASSERT_EQ(ResponseCache::table_of("/storage_root/3/"), "storage_root");
+  ASSERT_EQ(ResponseCache::table_of("namespace?name=PSU"), "namespace");
+}
+
+TEST(ApiOfflineTest, TestResponseCachePolicy) {
+  ResponseCache::sptr cache_ = ResponseCache::construct(2);
+  int fetches_ = 0;
+  Json::Value entry_;
+  entry_["name"] = "PSU";
+  const ResponseCache::fetch_type fetch_ = [&]() { ++fetches_; return entry_; };
+
+  // Immutable tables are fetched once, least recently used are evicted
+  cache_->get("namespace/1/\n", "namespace", fetch_);
+  cache_->get("namespace/1/\n", "namespace", fetch_);
+  cache_->get("namespace/2/\n", "namespace", fetch_);
+  cache_->get("namespace/3/\n", "namespace", fetch_);
+  ASSERT_EQ(fetches_, 3);
+  ASSERT_EQ(cache_->size(), 2);
+  ASSERT_EQ(cache_->get_stats().evictions, 1);
+  cache_->get("namespace/1/\n", "namespace", fetch_);
+  ASSERT_EQ(fetches_, 4);
+
+  // code_run is patched during a run so is never cached
+  cache_->get("code_run/1/\n", "code_run", fetch_);
+  cache_->get("code_run/1/\n", "code_run", fetch_);
+  ASSERT_EQ(fetches_, 6);
+
+  // Empty query results are not remembered
+  const ResponseCache::fetch_type empty_ = [&]() { ++fetches_; return Json::Value(Json::arrayValue); };
+  cache_->get("namespace/?name=new\n", "namespace", empty_);
+  cache_->get("namespace/?name=new\n", "namespace", empty_);
+  ASSERT_EQ(fetches_, 8);
+
+  // Expiring tables are refetched once their time to live has passed
+  cache_->set_ttl("code_run", std::chrono::milliseconds(1));
+  cache_->get("code_run/1/\n", "code_run", fetch_);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  cache_->get("code_run/1/\n", "code_run", fetch_);
+  ASSERT_EQ(fetches_, 10);
+}
+
+TEST(ApiOfflineTest, TestResponseCacheSingleFlight) {
+  ResponseCache::sptr cache_ = ResponseCache::construct();
+  int fetches_ = 0;
+  // The first fetch only completes once the second caller is waiting on it
+  const ResponseCache::fetch_type fetch_ = [&]() {
+    ++fetches_;
+    for (int i = 0; i < 1000 && cache_->get_stats().coalesced == 0; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return Json::Value("author");
+  };
+
+  Json::Value first_;
+  std::thread thread_([&]() { first_ = cache_->get("author/1/\n", "author", fetch_); });
+  while (cache_->get_stats().misses == 0) {
+    std::this_thread::yield();
+  }
+  Json::Value second_ = cache_->get("author/1/\n", "author", fetch_);
+  thread_.join();
+
+  ASSERT_EQ(fetches_, 1);
+  ASSERT_EQ(first_, second_);
+  ASSERT_EQ(cache_->get_stats().coalesced, 1);
+}
+
+TEST(ApiOfflineTest, TestDiskCache) {
+  const ghc::filesystem::path directory_ =
+      ghc::filesystem::temp_directory_path() / ("fdpapi-disk-cache-" + generate_random_hash());
+  DiskCache::sptr cache_ = DiskCache::construct(directory_, "http://127.0.0.1:8000/api/");
+
+  Json::Value value_;
+  ASSERT_FALSE(cache_->load("author/1/\nsecret-token", value_));
+
+  Json::Value author_;
+  author_["name"] = "Interface Test";
+  cache_->save("author/1/\nsecret-token", author_);
+
+  // Entries are visible to other instances, e.g. in later processes, and
+  // are kept apart per registry
+  DiskCache::sptr other_ = DiskCache::construct(directory_, "http://127.0.0.1:8000/api/");
+  ASSERT_TRUE(other_->load("author/1/\nsecret-token", value_));
+  ASSERT_EQ(value_, author_);
+  ASSERT_FALSE(DiskCache::construct(directory_, "https://data.scrc.uk/api/")
+                   ->load("author/1/\nsecret-token", value_));
+
+  // The token is never written to disk and no temporary files remain
+  std::size_t n_files_ = 0;
+  for (ghc::filesystem::directory_iterator it(cache_->get_directory()), end; it != end; ++it) {
+    ++n_files_;
+    std::ifstream file_(it->path().string());
+    const std::string contents_((std::istreambuf_iterator<char>(file_)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(contents_.find("secret-token"), std::string::npos);
+  }
+  ASSERT_EQ(n_files_, 1);
+
+  other_->clear();
+  ASSERT_FALSE(cache_->load("author/1/\nsecret-token", value_));
+  ASSERT_EQ(cache_->get_stats().hits, 0);
+  ASSERT_EQ(cache_->get_stats().misses, 2);
+  ASSERT_EQ(cache_->get_stats().writes, 1);
+
+  ghc::filesystem::remove_all(directory_);
+}
+
+namespace {
+
+// Answers every request with its URL and the number of requests so far
+class CannedTransport : public Transport {
+public:
+  CannedTransport() : n_(0) {}
+
+  HttpResponse perform(const HttpRequest &request) {
+    HttpResponse response_;
+    response_.http_code = request.method == HttpRequest::GET ? 200 : 201;
+    response_.body = "{\"url\":\"" + request.url + "\",\"n\":" + std::to_string(++n_) + "}";
+    response_.total_time = 0.05;
+    return response_;
+  }
+
+  RequestLoop::sptr loop(std::size_t) {
+    throw std::logic_error("CannedTransport has no loop");
+  }
+
+private:
+  int n_;
+};
+
+} // namespace
+
+TEST(ApiOfflineTest, TestCassette) {
+  const ghc::filesystem::path path_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-test-cassette.jsonl";
+  const std::string recorded_root_ = "http://registry:8000/api/";
+  const std::string root_ = "http://127.0.0.1:1/api/";
+
+  HttpRequest get_;
+  get_.url = recorded_root_ + "object/?name=a b";
+  get_.token = "secret";
+  HttpRequest post_;
+  post_.method = HttpRequest::POST;
+  post_.url = recorded_root_ + "code_run/";
+  post_.body = "{\"run_date\":\"2021-01-01\",\"object\":\"" + recorded_root_ + "object/1/\"}";
+  {
+    RecordingTransport::sptr recording_ = RecordingTransport::construct(
+        Transport::sptr(new CannedTransport()), path_, recorded_root_);
+    recording_->perform(get_);
+    recording_->perform(get_);
+    recording_->perform(post_);
+    ASSERT_EQ(recording_->size(), 3);
+  }
+
+  std::ifstream in_(path_.string());
+  const std::string cassette_((std::istreambuf_iterator<char>(in_)), std::istreambuf_iterator<char>());
+  ASSERT_EQ(cassette_.find("secret"), std::string::npos);
+
+  ReplayTransport::sptr replay_ = ReplayTransport::construct(path_, root_);
+  ASSERT_EQ(replay_->size(), 3);
+
+  // Recordings of a request are served in order, then the last repeated
+  get_.url = root_ + "object/?name=a b";
+  ASSERT_EQ(replay_->perform(get_).body, "{\"url\":\"" + root_ + "object/?name=a b\",\"n\":1}");
+  ASSERT_EQ(replay_->perform(get_).body, "{\"url\":\"" + root_ + "object/?name=a b\",\"n\":2}");
+  ASSERT_EQ(replay_->perform(get_).body, "{\"url\":\"" + root_ + "object/?name=a b\",\"n\":2}");
+
+  // A body holding the time of the run falls back to the URL
+  post_.url = root_ + "code_run/";
+  post_.body = "{\"run_date\":\"2022-02-02\"}";
+  const HttpResponse posted_ = replay_->perform(post_);
+  ASSERT_EQ(posted_.http_code, 201);
+  ASSERT_EQ(posted_.total_time, 0);
+
+  HttpRequest unknown_;
+  unknown_.url = root_ + "author/";
+  ASSERT_EQ(replay_->perform(unknown_).result, CURLE_COULDNT_CONNECT);
+  ASSERT_EQ(replay_->misses(), 1);
+
+  // With timing each request takes its recorded 50ms, concurrently in a loop
+  ReplayTransport::sptr timed_ = ReplayTransport::construct(path_, root_, true);
+  RequestLoop::sptr loop_ = timed_->loop(4);
+  int completed_ = 0;
+  const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+  for (int i = 0; i < 3; ++i) {
+    loop_->add(get_, [&completed_](HttpResponse &response) {
+      ASSERT_EQ(response.http_code, 200);
+      ++completed_;
+    });
+  }
+  loop_->run();
+  const double elapsed_ =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  ASSERT_EQ(completed_, 3);
+  ASSERT_GE(elapsed_, 0.045);
+  ASSERT_LT(elapsed_, 0.14);
+
+  ghc::filesystem::remove(path_);
+}
+
+#ifndef _WIN32
+TEST(ApiOfflineTest, TestCurlUnixSocket) {
+  const std::string path_ = (ghc::filesystem::temp_directory_path() / "fdpapi-test.sock").string();
+  ::unlink(path_.c_str());
+  sockaddr_un addr_;
+  std::memset(&addr_, 0, sizeof(addr_));
+  addr_.sun_family = AF_UNIX;
+  std::strncpy(addr_.sun_path, path_.c_str(), sizeof(addr_.sun_path) - 1);
+  const int listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr_), sizeof(addr_)), 0);
+  ASSERT_EQ(::listen(listen_fd_, 1), 0);
+
+  // Answers a single request, echoing its request line
+  std::string request_line_;
+  std::thread server_([listen_fd_, &request_line_]() {
+    const int fd_ = ::accept(listen_fd_, NULL, NULL);
+    std::string received_;
+    char chunk_[4096];
+    ssize_t n_;
+    while (received_.find("\r\n\r\n") == std::string::npos &&
+           (n_ = ::recv(fd_, chunk_, sizeof(chunk_), 0)) > 0) {
+      received_.append(chunk_, static_cast<std::size_t>(n_));
+    }
+    request_line_ = received_.substr(0, received_.find("\r\n"));
+    const std::string body_ = "{\"ok\":true}";
+    const std::string response_ = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                  "Content-Length: " + std::to_string(body_.size()) +
+                                  "\r\nConnection: close\r\n\r\n" + body_;
+    ::send(fd_, response_.data(), response_.size(), 0);
+    ::close(fd_);
+  });
+
+  CurlPool::sptr pool_ = CurlPool::construct(8, path_);
+  ASSERT_EQ(pool_->unix_socket(), path_);
+  HttpRequest request_;
+  request_.url = "http://localhost/api/users/";
+  const HttpResponse response_ = CurlTransport::construct(pool_)->perform(request_);
+  server_.join();
+  ::close(listen_fd_);
+  ::unlink(path_.c_str());
+
+  ASSERT_EQ(response_.result, CURLE_OK);
+  ASSERT_EQ(response_.http_code, 200);
+  ASSERT_EQ(response_.body, "{\"ok\":true}");
+  ASSERT_EQ(request_line_, "GET /api/users/ HTTP/1.1");
+}
+#endif
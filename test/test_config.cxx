@@ -4,9 +4,14 @@
 
 #include <iostream>
 #include <fstream>
+#include <thread>
 
+#include "fdp/exceptions.hxx"
+#include "fdp/fdp.hxx"
 #include "fdp/objects/config.hxx"
 #include "fdp/registry/api.hxx"
+#include "fdp/registry/embedded_registry.hxx"
+#include "fdp/registry/registry_journal.hxx"
 //#include "fdp/registry/datapipeline.hxx"
 #include "fdp/objects/metadata.hxx"
 
@@ -49,6 +54,15 @@ protected:
               use_local ? RESTAPI::LOCAL : RESTAPI::REMOTE ); 
   }
 
+  // The journal of an embedded registry in a data store, as Config finds it
+  static ghc::filesystem::path embedded_registry_path(const ghc::filesystem::path &data_store) {
+    const char* embedded_env = std::getenv("FDP_EMBEDDED_REGISTRY");
+    if (embedded_env && *embedded_env) {
+      return embedded_env;
+    }
+    return data_store / ".registry" / "registry.jsonl";
+  }
+
   void TearDown() override {}
 };
 
@@ -84,11 +98,322 @@ TEST_F(ConfigTest, TestLinkWrite){
   
 }
 
+TEST_F(ConfigTest, TestLinkRepeated){
+  Config::sptr cnf = config();
+  std::string data_product = "test/csv";
+  ghc::filesystem::path currentLink = cnf->link_write(data_product);
+  EXPECT_EQ(currentLink, cnf->link_write(data_product));
+  EXPECT_THROW(cnf->link_write("test/missing"), config_parsing_error);
+  EXPECT_THROW(cnf->link_read(data_product), config_parsing_error);
+
+  std::ofstream testCSV;
+  testCSV.open(currentLink.string());
+  testCSV << "Test";
+  testCSV.close();
+
+  cnf->finalise();
+}
+
+TEST_F(ConfigTest, TestLinkWriteStream){
+  Config::sptr cnf = config();
+  std::string data_product = "test/csv";
+  OutputStream::sptr stream = cnf->link_write_stream(data_product);
+  EXPECT_EQ(stream->get_path(), cnf->link_write(data_product));
+
+  *stream << "Test";
+  EXPECT_THROW(cnf->finalise(), std::runtime_error);
+
+  stream->close();
+  EXPECT_EQ(stream->get_digest()->hash, calculate_hash_from_file(stream->get_path()));
+  cnf->finalise();
+}
+
+TEST_F(ConfigTest, TestCommit){
+  Config::sptr cnf = config();
+  std::string data_product = "test/csv";
+  EXPECT_THROW(cnf->commit(data_product), config_parsing_error);
+
+  ghc::filesystem::path currentLink = cnf->link_write(data_product);
+  std::ofstream testCSV;
+  testCSV.open(currentLink.string());
+  testCSV << "Test";
+  testCSV.close();
+
+  cnf->commit(data_product);
+  cnf->commit(data_product);
+  cnf->finalise();
+  EXPECT_FALSE(ghc::filesystem::exists(currentLink));
+  EXPECT_TRUE(cnf->has_outputs());
+}
+
+TEST_F(ConfigTest, TestLinkConcurrent){
+  Config::sptr cnf = config(true, "write_many_csv.yaml");
+  const std::size_t n_products = 8;
+  const std::size_t n_threads = 16;
+
+  // Every thread links every data product, starting at a different one
+  std::vector< std::vector<ghc::filesystem::path> > links(n_threads);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < n_threads; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      links[t].resize(n_products);
+      for (std::size_t i = 0; i < n_products; ++i) {
+        const std::size_t product = (t + i) % n_products;
+        links[t][product] = cnf->link_write("test/csv/" + std::to_string(product));
+      }
+      EXPECT_THROW(cnf->link_write("test/missing"), config_parsing_error);
+    }));
+  }
+  for (std::size_t t = 0; t < n_threads; ++t) {
+    threads[t].join();
+  }
+
+  // A data product is linked to one file whichever thread asks first
+  for (std::size_t i = 0; i < n_products; ++i) {
+    for (std::size_t t = 1; t < n_threads; ++t) {
+      EXPECT_EQ(links[t][i], links[0][i]);
+    }
+    std::ofstream testCSV(links[0][i].string());
+    testCSV << "Test," << i;
+  }
+
+  threads.clear();
+  for (std::size_t i = 0; i < n_products; ++i) {
+    threads.push_back(std::thread([&, i]() {
+      cnf->commit("test/csv/" + std::to_string(i));
+    }));
+  }
+  for (std::size_t i = 0; i < n_products; ++i) {
+    threads[i].join();
+  }
+  cnf->finalise();
+  EXPECT_TRUE(cnf->has_outputs());
+}
+
+TEST_F(ConfigTest, TestEmbeddedRegistry){
+  // A local run with embedded_registry registers without a registry server
+  Config::sptr cnf = config(true, "write_csv_embedded.yaml");
+  EXPECT_EQ(cnf->get_rest_api_location(), RESTAPI::EMBEDDED);
+  std::string data_product = "test/csv";
+  ghc::filesystem::path currentLink = cnf->link_write(data_product);
+  std::ofstream testCSV;
+  testCSV.open(currentLink.string());
+  testCSV << "Test,embedded";
+  testCSV.close();
+  const std::string code_run_uuid = cnf->get_code_run_uuid();
+  cnf->finalise();
+  EXPECT_TRUE(cnf->has_outputs());
+
+  const ghc::filesystem::path registry_path = embedded_registry_path("data_store");
+  ASSERT_TRUE(ghc::filesystem::exists(registry_path));
+
+  // The run is found by another process reading the journal
+  EmbeddedRegistry::sptr registry = EmbeddedRegistry::construct(cnf->get_api_url(), registry_path);
+  HttpRequest request;
+  request.url = registry->url_root() + "code_run/?uuid=" + code_run_uuid;
+  Json::Value code_runs;
+  Json::Reader reader;
+  ASSERT_TRUE(reader.parse(registry->handle(request).body, code_runs));
+  ASSERT_EQ(code_runs["count"].asInt(), 1);
+  EXPECT_EQ(code_runs["results"][0]["outputs"].size(), 1);
+}
+
+TEST_F(ConfigTest, TestRegistryJournalReplay){
+  // A data store and data product of its own, so that the output is new to
+  // the registry however often the test runs
+  const ghc::filesystem::path data_store =
+      ghc::filesystem::temp_directory_path() / ("fdpapi-test-journal-" + generate_random_hash());
+  const std::string data_product = "test/journal/" + generate_random_hash();
+  ghc::filesystem::create_directories(data_store);
+  const ghc::filesystem::path config_path = data_store / "config.yaml";
+  {
+    std::ofstream config_file(config_path.string());
+    config_file << "run_metadata:\n"
+        << "  description: Journal a csv file\n"
+        << "  local_data_registry_url: http://127.0.0.1:8000/api/\n"
+        << "  remote_data_registry_url: https://data.scrc.uk/api/\n"
+        << "  default_input_namespace: testing\n"
+        << "  default_output_namespace: testing\n"
+        << "  write_data_store: " << data_store.string() << "/\n"
+        << "  local_repo: ./\n"
+        << "  script: bash fdpapi-tests\n"
+        << "  public: true\n"
+        << "  latest_commit: 52008720d240693150e96021ea34ac6fffe05870\n"
+        << "  remote_repo: https://github.com/FAIRDataPipeline/cppDataPipeline\n"
+        << "  embedded_registry: true\n"
+        << "  registry_journal: true\n"
+        << "  registry_journal_defer: true\n"
+        << "write:\n"
+        << "- data_product: " << data_product << "\n"
+        << "  description: journaled csv file\n"
+        << "  file_type: csv\n";
+  }
+  const ghc::filesystem::path script_path = ghc::filesystem::path(TESTDIR) / "test_script.sh";
+  const ghc::filesystem::path journal_dir = data_store / ".registry_journal";
+
+  // A deferred journal is left with the outputs moved
+  Config::sptr cnf = Config::construct(config_path, script_path, "", RESTAPI::LOCAL);
+  const std::string code_run_uuid = cnf->get_code_run_uuid();
+  {
+    std::ofstream testCSV(cnf->link_write(data_product).string());
+    testCSV << "Test,journal";
+  }
+  cnf->finalise();
+  cnf.reset();
+  const std::vector<ghc::filesystem::path> journals = RegistryJournal::list(journal_dir);
+  ASSERT_EQ(journals.size(), 1);
+
+  // Stop applying it once the object is registered and recorded
+  EmbeddedRegistry::sptr registry =
+      EmbeddedRegistry::construct("http://127.0.0.1:8000/api/", embedded_registry_path(data_store));
+  std::string object_url;
+  {
+    RegistryJournal::sptr journal = RegistryJournal::open(journals[0]);
+    ASSERT_TRUE(journal);
+    ASSERT_TRUE(journal->committed());
+    for (std::size_t i = 0; i < journal->size(); ++i) {
+      if (journal->entry(i)["op"].asString() != "register_write") {
+        continue;
+      }
+      Json::Value object;
+      object["description"] = journal->entry(i)["description"];
+      object["authors"].append(journal->entry(i)["author"]);
+      object_url = registry->insert("object", object)["url"].asString();
+      Json::Value progress;
+      progress["object"] = object_url;
+      journal->record(i, progress, false);
+    }
+  }
+  ASSERT_FALSE(object_url.empty());
+
+  // Replayed by another run, the recorded object is used and the journal
+  // removed. A registry only reads the changes of others when it opens.
+  DataPipeline::sptr pipeline = DataPipeline::construct(config_path.string(), script_path.string());
+  registry = EmbeddedRegistry::construct(registry->url_root(), registry->path());
+  const std::size_t n_objects = registry->table_size("object");
+  const std::size_t n_data_products = registry->table_size("data_product");
+  EXPECT_EQ(pipeline->replay_registry_journal(), 1);
+  EXPECT_TRUE(RegistryJournal::list(journal_dir).empty());
+  EXPECT_EQ(pipeline->replay_registry_journal(), 0);
+  registry = EmbeddedRegistry::construct(registry->url_root(), registry->path());
+  EXPECT_EQ(registry->table_size("object"), n_objects);
+  EXPECT_EQ(registry->table_size("data_product"), n_data_products + 1);
+
+  Json::Reader reader;
+  HttpRequest request;
+  request.url = registry->url_root() + "data_product/?name=" + url_encode(data_product);
+  Json::Value data_products;
+  ASSERT_TRUE(reader.parse(registry->handle(request).body, data_products));
+  ASSERT_EQ(data_products["count"].asInt(), 1);
+  EXPECT_EQ(data_products["results"][0]["object"].asString(), object_url);
+
+  request.url = registry->url_root() + "code_run/?uuid=" + code_run_uuid;
+  Json::Value code_runs;
+  ASSERT_TRUE(reader.parse(registry->handle(request).body, code_runs));
+  ASSERT_EQ(code_runs["count"].asInt(), 1);
+  EXPECT_EQ(code_runs["results"][0]["outputs"].size(), 1);
+  pipeline.reset();
+
+  // Journals left by earlier runs which the registry rejects, here one
+  // updating a code run it does not have, or which were never committed do
+  // not fail a later run
+  const ghc::filesystem::path rejected = journal_dir / "rejected.wal";
+  {
+    RegistryJournal::sptr journal = RegistryJournal::create(rejected);
+    Json::Value entry;
+    entry["op"] = "code_run";
+    entry["code_run"] = registry->url_root() + "code_run/999999999/";
+    entry["outputs"] = Json::Value(Json::arrayValue);
+    entry["inputs"] = Json::Value(Json::arrayValue);
+    journal->append(entry);
+    journal->commit();
+  }
+  const ghc::filesystem::path incomplete = journal_dir / "incomplete.wal";
+  {
+    RegistryJournal::sptr journal = RegistryJournal::create(incomplete);
+    Json::Value entry;
+    entry["op"] = "code_run";
+    journal->append(entry);
+  }
+  ASSERT_EQ(RegistryJournal::list(journal_dir).size(), 2);
+
+  const std::string next_data_product = data_product + "/next";
+  {
+    std::ifstream config_in(config_path.string());
+    std::string config_text((std::istreambuf_iterator<char>(config_in)), std::istreambuf_iterator<char>());
+    config_in.close();
+    const std::string defer = "registry_journal_defer: true";
+    config_text.replace(config_text.find(defer), defer.size(), "registry_journal_defer: false");
+    config_text.replace(config_text.find("data_product: " + data_product),
+                        14 + data_product.size(), "data_product: " + next_data_product);
+    std::ofstream config_out(config_path.string());
+    config_out << config_text;
+  }
+  cnf = Config::construct(config_path, script_path, "", RESTAPI::LOCAL);
+  {
+    std::ofstream testCSV(cnf->link_write(next_data_product).string());
+    testCSV << "Test,journal,next";
+  }
+  ASSERT_NO_THROW(cnf->finalise());
+  cnf.reset();
+  EXPECT_TRUE(RegistryJournal::list(journal_dir).empty());
+  EXPECT_FALSE(ghc::filesystem::exists(rejected));
+  EXPECT_TRUE(ghc::filesystem::exists(rejected.string() + ".rejected"));
+  EXPECT_FALSE(ghc::filesystem::exists(incomplete));
+
+  registry = EmbeddedRegistry::construct(registry->url_root(), registry->path());
+  request.url = registry->url_root() + "data_product/?name=" + url_encode(next_data_product);
+  ASSERT_TRUE(reader.parse(registry->handle(request).body, data_products));
+  EXPECT_EQ(data_products["count"].asInt(), 1);
+
+  registry.reset();
+  ghc::filesystem::remove_all(data_store);
+}
+
 TEST_F(ConfigTest, TestLinkRead){
     Config::sptr cnf = config(true, "read_csv.yaml");
   std::string data_product = "test/csv";
   ghc::filesystem::path currentLink = cnf->link_read(data_product);
   EXPECT_GT(currentLink.string().size(), 1);
+  EXPECT_EQ(currentLink, cnf->link_read(data_product));
+
+  cnf->finalise();
+}
 
+TEST_F(ConfigTest, TestLinkReadMany){
+  Config::sptr cnf = config(true, "read_csv.yaml");
+  std::vector<std::string> data_products(1, "test/csv");
+  std::vector<ghc::filesystem::path> links = cnf->link_read_many(data_products);
+  ASSERT_EQ(links.size(), 1);
+  ASSERT_EQ(links[0], cnf->link_read(data_products[0]));
+
+  cnf->prefetch_reads();
+  cnf->finalise();
+}
+
+TEST_F(ConfigTest, TestLinkReadConcurrent){
+  Config::sptr cnf = config(true, "read_csv.yaml");
+  const std::string data_product = "test/csv";
+  const std::size_t n_threads = 16;
+
+  std::vector<ghc::filesystem::path> links(n_threads);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < n_threads; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      if (t % 4 == 0) {
+        cnf->prefetch_reads();
+      }
+      links[t] = cnf->link_read(data_product);
+    }));
+  }
+  for (std::size_t t = 0; t < n_threads; ++t) {
+    threads[t].join();
+  }
+
+  for (std::size_t t = 0; t < n_threads; ++t) {
+    EXPECT_GT(links[t].string().size(), 1);
+    EXPECT_EQ(links[t], links[0]);
+  }
   cnf->finalise();
+  EXPECT_TRUE(cnf->has_inputs());
 }
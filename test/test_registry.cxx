@@ -1,10 +1,15 @@
 #ifndef TESTDIR
 #define TESTDIR ""
 #endif
+#include "fdp/exceptions.hxx"
 #include "fdp/fdp.hxx"
 #include "fdp/objects/metadata.hxx"
 #include "fdp/registry/data_io.hxx"
+#include "fdp/registry/embedded_registry.hxx"
+#include "fdp/registry/registry_journal.hxx"
 #include "gtest/gtest.h"
+#include "json/reader.h"
+#include <fstream>
 #include <ghc/filesystem.hpp>
 #include <ostream>
 #include <vector>
@@ -88,3 +93,161 @@ TEST_F(RegistryTest, TestLogger) {
 
     logger::get_logger()->info() << " WARNINF";
 }
+
+TEST(RegistryOfflineTest, TestEmbeddedRegistry) {
+  const ghc::filesystem::path path_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-test-embedded" / "registry.jsonl";
+  ghc::filesystem::remove_all(path_.parent_path());
+  const std::string root_ = "http://127.0.0.1:8000/api/";
+  Json::Reader reader_;
+
+  EmbeddedRegistry::sptr registry_ = EmbeddedRegistry::construct(root_, path_);
+  ASSERT_EQ(registry_->table_size("users"), 1);
+  ASSERT_EQ(registry_->table_size("user_author"), 1);
+
+  // Get or create: a duplicate of a unique entry is a conflict
+  HttpRequest post_;
+  post_.method = HttpRequest::POST;
+  post_.url = root_ + "namespace/";
+  post_.body = "{\"name\":\"testing\"}";
+  const HttpResponse created_ = registry_->handle(post_);
+  ASSERT_EQ(created_.http_code, 201);
+  ASSERT_EQ(registry_->handle(post_).http_code, 409);
+
+  Json::Value object_;
+  object_["description"] = "an object";
+  const Json::Value j_object_ = registry_->insert("object", object_);
+  ASSERT_EQ(j_object_["url"].asString(), root_ + "object/1/");
+  ASSERT_EQ(j_object_["components"][0].asString(), root_ + "object_component/1/");
+
+  // Queries match fields, registry URLs by their id and bools either way
+  HttpRequest get_;
+  get_.url = root_ + "object_component/?object=1&whole_object=True";
+  Json::Value page_;
+  reader_.parse(registry_->handle(get_).body, page_);
+  ASSERT_EQ(page_["count"].asInt(), 1);
+  ASSERT_EQ(page_["results"][0]["name"].asString(), "whole_object");
+  get_.url = root_ + "namespace/?name=other";
+  reader_.parse(registry_->handle(get_).body, page_);
+  ASSERT_EQ(page_["count"].asInt(), 0);
+
+  post_.url = root_ + "code_run/";
+  post_.body = "{\"description\":\"run\"}";
+  Json::Value code_run_;
+  reader_.parse(registry_->handle(post_).body, code_run_);
+  ASSERT_EQ(code_run_["uuid"].asString().size(), 36);
+
+  HttpRequest patch_;
+  patch_.method = HttpRequest::PATCH;
+  patch_.url = code_run_["url"].asString();
+  patch_.body = "{\"outputs\":[\"" + root_ + "object_component/1/\"],\"id\":7}";
+  ASSERT_EQ(registry_->handle(patch_).http_code, 200);
+  get_.url = root_ + "code_run/?outputs=1";
+  reader_.parse(registry_->handle(get_).body, page_);
+  ASSERT_EQ(page_["count"].asInt(), 1);
+  ASSERT_EQ(page_["results"][0]["id"].asInt(), 1);
+  patch_.url = root_ + "code_run/2/";
+  ASSERT_EQ(registry_->handle(patch_).http_code, 404);
+
+  // Another process sharing the journal, under another root, sees every
+  // change and continues the ids
+  const std::string other_root_ = "http://localhost:8000/api/";
+  EmbeddedRegistry::sptr other_ = EmbeddedRegistry::construct(other_root_, path_);
+  ASSERT_EQ(other_->table_size("users"), 1);
+  ASSERT_EQ(other_->table_size("object_component"), 1);
+  get_.url = other_root_ + "code_run/1/";
+  Json::Value reloaded_;
+  reader_.parse(other_->handle(get_).body, reloaded_);
+  ASSERT_EQ(reloaded_["uuid"].asString(), code_run_["uuid"].asString());
+  ASSERT_EQ(reloaded_["outputs"][0].asString(), other_root_ + "object_component/1/");
+
+  post_.url = other_root_ + "namespace/";
+  post_.body = "{\"name\":\"second\"}";
+  ASSERT_EQ(other_->handle(post_).http_code, 201);
+  post_.url = root_ + "namespace/";
+  ASSERT_EQ(registry_->handle(post_).http_code, 409);
+  get_.url = root_ + "namespace/2/";
+  ASSERT_EQ(registry_->handle(get_).http_code, 200);
+
+  // Through a transport loop
+  RequestLoop::sptr loop_ = EmbeddedTransport::construct(registry_)->loop(4);
+  int completed_ = 0;
+  get_.url = root_ + "users/?username=admin";
+  loop_->add(get_, [&completed_](HttpResponse &response) {
+    ASSERT_EQ(response.http_code, 200);
+    ++completed_;
+  });
+  loop_->run();
+  ASSERT_EQ(completed_, 1);
+
+  other_.reset();
+  registry_.reset();
+  ghc::filesystem::remove_all(path_.parent_path());
+}
+
+TEST(RegistryOfflineTest, TestRegistryJournal) {
+  const ghc::filesystem::path dir_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-test-journal";
+  ghc::filesystem::remove_all(dir_);
+  const ghc::filesystem::path path_ = dir_ / "run.wal";
+
+  RegistryJournal::sptr journal_ = RegistryJournal::create(path_);
+  ASSERT_THROW(RegistryJournal::create(path_), write_error);
+  Json::Value entry_;
+  entry_["op"] = "register_write";
+  entry_["name"] = "first";
+  ASSERT_EQ(journal_->append(entry_), 0);
+  entry_["name"] = "second";
+  ASSERT_EQ(journal_->append(entry_), 1);
+  ASSERT_FALSE(journal_->committed());
+
+  // Uncommitted entries are not applied
+  journal_.reset();
+  journal_ = RegistryJournal::open(path_);
+  ASSERT_EQ(journal_->size(), 2);
+  ASSERT_FALSE(journal_->committed());
+  journal_->commit();
+
+  Json::Value result_;
+  result_["object"] = "http://127.0.0.1:8000/api/object/1/";
+  journal_->record(0, result_, false);
+  result_.clear();
+  result_["component"] = "http://127.0.0.1:8000/api/object_component/1/";
+  journal_->record(0, result_, true);
+
+  // Locked while open, including against this process
+#ifndef _WIN32
+  ASSERT_FALSE(RegistryJournal::open(path_));
+#endif
+  journal_.reset();
+
+  // A line cut short by the end of a process is ignored
+  {
+    std::ofstream out_(path_.string(), std::ios::app | std::ios::binary);
+    out_ << "{\"entry\":1,\"res";
+  }
+  ASSERT_EQ(RegistryJournal::list(dir_).size(), 1);
+  journal_ = RegistryJournal::open(path_);
+  ASSERT_TRUE(journal_->committed());
+  ASSERT_EQ(journal_->entry(1)["name"].asString(), "second");
+  ASSERT_TRUE(journal_->done(0));
+  ASSERT_FALSE(journal_->done(1));
+  ASSERT_EQ(journal_->result(0)["object"].asString(), "http://127.0.0.1:8000/api/object/1/");
+  ASSERT_EQ(journal_->result(0)["component"].asString(), "http://127.0.0.1:8000/api/object_component/1/");
+  journal_->record(1, Json::Value(Json::objectValue), true);
+  journal_.reset();
+  journal_ = RegistryJournal::open(path_);
+  ASSERT_TRUE(journal_->done(1));
+
+  journal_->remove();
+  ASSERT_FALSE(ghc::filesystem::exists(path_));
+  ASSERT_TRUE(RegistryJournal::list(dir_).empty());
+  ASSERT_FALSE(RegistryJournal::open(path_));
+
+  {
+    std::ofstream out_(path_.string(), std::ios::binary);
+    out_ << "{\"table\":\"users\"}\n";
+  }
+  ASSERT_THROW(RegistryJournal::open(path_), json_parse_error);
+  ghc::filesystem::remove_all(dir_);
+}
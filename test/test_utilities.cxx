@@ -2,13 +2,32 @@
 #define TESTDIR ""
 #endif
 #include "fdp/exceptions.hxx"
+#include "fdp/utilities/batch_hasher.hxx"
+#include "fdp/utilities/binary_log.hxx"
+#include "fdp/utilities/file_hash_cache.hxx"
 #include "fdp/utilities/json.hxx"
+#include "fdp/utilities/logging.hxx"
+#include "fdp/utilities/metrics.hxx"
 #include "fdp/utilities/semver.hxx"
+#include "fdp/utilities/sha1.hxx"
 #include "fdp/objects/metadata.hxx"
+#include "fdp/objects/output_stream.hxx"
+#include "fdp/registry/api.hxx"
+#include "fdp/utilities/task_graph.hxx"
+#include "fdp/utilities/trace.hxx"
 #include "gtest/gtest.h"
 
 #include "json/reader.h"
 
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
 using namespace FairDataPipeline;
 
 TEST(FDPAPITest, TestSemVerComparisons) {
@@ -53,4 +72,638 @@ TEST(FDAPITest, TestRandomHash) {
 
 TEST(FDAPITest, TestRemoveLocalFromRoot) {
   ASSERT_EQ(remove_local_from_root(std::string("file://test")), "test");
-}
\ No newline at end of file
+}
+
+TEST(FDAPITest, TestUrlEncode) {
+  ASSERT_EQ(url_encode(std::string("SCRC:a b/c~d_e.f-g")), "SCRC%3Aa%20b%2Fc~d_e.f-g");
+}
+
+TEST(FDAPITest, TestTaskGraphOrder) {
+  TaskGraph::sptr graph_ = TaskGraph::construct();
+  std::mutex mutex_;
+  std::vector<std::string> order_;
+  std::function<TaskGraph::task_type(const std::string&)> record_ =
+      [&](const std::string &name) -> TaskGraph::task_type {
+        return [&, name]() {
+          std::lock_guard<std::mutex> lock(mutex_);
+          order_.push_back(name);
+        };
+      };
+
+  TaskGraph::task_id a_ = graph_->add("a", record_("a"));
+  TaskGraph::task_id b_ = graph_->add("b", record_("b"));
+  TaskGraph::task_id c_ = graph_->add("c", record_("c"), {a_, b_});
+  graph_->add("d", record_("d"), {c_});
+  graph_->run(4);
+
+  ASSERT_EQ(order_.size(), 4);
+  ASSERT_EQ(order_[2], "c");
+  ASSERT_EQ(order_[3], "d");
+  ASSERT_THROW(graph_->add("e", record_("e"), {10}), std::invalid_argument);
+}
+
+TEST(FDAPITest, TestTaskGraphException) {
+  TaskGraph::sptr graph_ = TaskGraph::construct();
+  bool dependent_ran_ = false;
+  TaskGraph::task_id failing_ = graph_->add("failing", []() {
+    throw std::runtime_error("failed");
+  });
+  graph_->add("dependent", [&]() { dependent_ran_ = true; }, {failing_});
+
+  ASSERT_THROW(graph_->run(), std::runtime_error);
+  ASSERT_FALSE(dependent_ran_);
+}
+
+TEST(FDAPITest, TestOutputStream) {
+  const ghc::filesystem::path path_ =
+      ghc::filesystem::temp_directory_path() / ("fdpapi-output-stream-" + generate_random_hash());
+
+  // Small buffer so that writes both fill it and bypass it
+  OutputStream::sptr stream_ = OutputStream::construct(path_, 16);
+  std::shared_ptr<const OutputStream::Digest> digest_ = stream_->get_digest();
+  *stream_ << "header," << 42 << "\n";
+  const std::string large_(1000, 'x');
+  stream_->write(large_.data(), large_.size());
+  for (int i = 0; i < 100; ++i) {
+    stream_->put(static_cast<char>('a' + i % 26));
+  }
+  ASSERT_TRUE(stream_->is_open());
+  ASSERT_FALSE(digest_->closed);
+
+  stream_->close();
+  ASSERT_FALSE(stream_->is_open());
+  ASSERT_TRUE(digest_->closed);
+  ASSERT_EQ(digest_->size, ghc::filesystem::file_size(path_));
+  ASSERT_EQ(digest_->size, 10 + large_.size() + 100);
+  ASSERT_EQ(digest_->hash, calculate_hash_from_file(path_));
+
+  // The digest outlives the stream
+  stream_.reset();
+  ASSERT_EQ(digest_->hash, calculate_hash_from_file(path_));
+
+  ghc::filesystem::remove(path_);
+}
+
+TEST(FDAPITest, TestSha1Engines) {
+  const std::string million_a_(1000000, 'a');
+  const Sha1::Engine engines_[] = {Sha1::Engine::SCALAR, Sha1::Engine::SHA_NI};
+
+  for (std::size_t i = 0; i < sizeof(engines_) / sizeof(engines_[0]); ++i) {
+    if (!Sha1::is_supported(engines_[i])) {
+      ASSERT_THROW(Sha1 unsupported_(engines_[i]), std::invalid_argument);
+      continue;
+    }
+
+    ASSERT_EQ(Sha1(engines_[i]).hexdigest(), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    ASSERT_EQ(Sha1(engines_[i]).update(std::string("abc")).hexdigest(),
+              "a9993e364706816aba3e25717850c26c9cd0d89d");
+    ASSERT_EQ(Sha1(engines_[i]).update(std::string(
+                  "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")).hexdigest(),
+              "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+    // Updates which straddle block boundaries
+    Sha1 sha1_(engines_[i]);
+    for (std::size_t offset_ = 0; offset_ < million_a_.size(); offset_ += 999) {
+      sha1_.update(million_a_.data() + offset_, std::min<std::size_t>(999, million_a_.size() - offset_));
+    }
+    ASSERT_EQ(sha1_.hexdigest(), "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+  }
+
+  const ghc::filesystem::path path_ =
+      ghc::filesystem::temp_directory_path() / ("fdpapi-sha1-" + generate_random_hash());
+  std::ofstream(path_.string(), std::ios_base::binary) << million_a_;
+  ASSERT_EQ(calculate_hash_from_file(path_), "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+  std::ofstream(path_.string(), std::ios_base::binary | std::ios_base::trunc).close();
+  ASSERT_EQ(calculate_hash_from_file(path_), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+  ghc::filesystem::remove(path_);
+}
+
+TEST(FDAPITest, TestFileHashCache) {
+  const ghc::filesystem::path directory_ =
+      ghc::filesystem::temp_directory_path() / ("fdpapi-hash-cache-" + generate_random_hash());
+  const ghc::filesystem::path path_ = directory_ / "data.csv";
+  FileHashCache::sptr cache_ = FileHashCache::construct(directory_ / "cache");
+
+  // Files modified within the last few seconds are hashed but not cached
+  std::ofstream(path_.string()) << "a,b\n1,2\n";
+  ASSERT_EQ(cache_->hash_file(path_), calculate_hash_from_string("a,b\n1,2\n"));
+  ASSERT_EQ(cache_->get_stats().skipped, 1);
+  ASSERT_EQ(cache_->get_stats().writes, 0);
+
+  const ghc::filesystem::file_time_type old_ =
+      ghc::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+  ghc::filesystem::last_write_time(path_, old_);
+  ASSERT_EQ(calculate_hash_from_file(path_, cache_), calculate_hash_from_string("a,b\n1,2\n"));
+  ASSERT_EQ(cache_->get_stats().writes, 1);
+
+  // Other instances, e.g. in later processes, find the entry
+  FileHashCache::sptr other_ = FileHashCache::construct(directory_ / "cache");
+  ASSERT_EQ(other_->hash_file(path_), calculate_hash_from_string("a,b\n1,2\n"));
+  ASSERT_EQ(other_->get_stats().hits, 1);
+
+  // Rewriting the file is noticed even when its size and modification time
+  // are restored, as its status change time is not
+#ifndef _WIN32
+  std::ofstream(path_.string()) << "a,b\n3,4\n";
+  ghc::filesystem::last_write_time(path_, old_);
+  ASSERT_EQ(other_->hash_file(path_), calculate_hash_from_string("a,b\n3,4\n"));
+  ASSERT_EQ(other_->get_stats().hits, 1);
+  ASSERT_EQ(other_->get_stats().misses, 1);
+#else
+  std::ofstream(path_.string()) << "a,b\n3,4\n";
+  ghc::filesystem::last_write_time(path_, old_ + std::chrono::seconds(1));
+#endif
+
+  other_->clear();
+  ASSERT_EQ(cache_->hash_file(path_), calculate_hash_from_string("a,b\n3,4\n"));
+  ASSERT_EQ(cache_->get_stats().hits, 0);
+
+  ghc::filesystem::remove_all(directory_);
+}
+
+TEST(FDAPITest, TestBatchHasher) {
+  const ghc::filesystem::path directory_ =
+      ghc::filesystem::temp_directory_path() / ("fdpapi-batch-hash-" + generate_random_hash());
+  ghc::filesystem::create_directories(directory_);
+
+  // Empty, single byte and multi block files, one of them not a multiple
+  // of the block size
+  const std::size_t sizes_[] = {0, 1, 4096, 100000, 1300000};
+  std::vector<ghc::filesystem::path> paths_;
+  std::vector<std::string> expected_;
+  for (std::size_t i = 0; i < sizeof(sizes_) / sizeof(sizes_[0]); ++i) {
+    std::string contents_(sizes_[i], 'a');
+    for (std::size_t j = 0; j < contents_.size(); ++j) {
+      contents_[j] = static_cast<char>(j * 31 + i);
+    }
+    paths_.push_back(directory_ / ("file-" + std::to_string(i) + ".dat"));
+    std::ofstream(paths_.back().string(), std::ios_base::binary) << contents_;
+    expected_.push_back(calculate_hash_from_string(contents_));
+  }
+
+  const BatchHasher::Backend backends_[] = {BatchHasher::Backend::THREADS,
+                                            BatchHasher::Backend::IO_URING};
+  for (std::size_t i = 0; i < sizeof(backends_) / sizeof(backends_[0]); ++i) {
+    if (!BatchHasher::is_supported(backends_[i])) {
+      ASSERT_THROW(BatchHasher unsupported_(backends_[i]), std::invalid_argument);
+      continue;
+    }
+
+    const BatchHasher hasher_(backends_[i], 3, 4096);
+    ASSERT_EQ(hasher_.hash(paths_), expected_);
+
+    // A file which cannot be read fails on its own
+    std::vector<ghc::filesystem::path> with_missing_(paths_);
+    with_missing_.insert(with_missing_.begin() + 2, directory_ / "missing.dat");
+    std::vector<std::string> hashes_(with_missing_.size());
+    std::vector<int> n_reported_(with_missing_.size(), 0);
+    std::mutex mutex_;
+    hasher_.hash(with_missing_, [&](std::size_t j, const std::string &hash, std::exception_ptr error) {
+      std::lock_guard<std::mutex> lock_(mutex_);
+      ++n_reported_[j];
+      hashes_[j] = error ? "error" : hash;
+    });
+    ASSERT_EQ(n_reported_, std::vector<int>(with_missing_.size(), 1));
+    ASSERT_EQ(hashes_[2], "error");
+    hashes_.erase(hashes_.begin() + 2);
+    ASSERT_EQ(hashes_, expected_);
+    ASSERT_THROW(hasher_.hash(with_missing_), std::runtime_error);
+  }
+
+  ASSERT_EQ(hash_files(paths_), expected_);
+  ASSERT_THROW(hash_files(std::vector<ghc::filesystem::path>(1, directory_ / "missing.dat")),
+               std::invalid_argument);
+
+  // Unchanged files are then read from the cache
+  for (std::size_t i = 0; i < paths_.size(); ++i) {
+    ghc::filesystem::last_write_time(
+        paths_[i], ghc::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+  }
+  FileHashCache::sptr cache_ = FileHashCache::construct(directory_ / "cache");
+  ASSERT_EQ(hash_files(paths_, cache_), expected_);
+  ASSERT_EQ(cache_->get_stats().writes, paths_.size());
+  ASSERT_EQ(hash_files(paths_, cache_), expected_);
+  ASSERT_EQ(cache_->get_stats().hits, paths_.size());
+
+  ghc::filesystem::remove_all(directory_);
+}
+
+namespace {
+// Counts how often it is formatted
+struct Formatted {
+  int *count;
+};
+std::ostream &operator<<(std::ostream &os, const Formatted &formatted) {
+  ++*formatted.count;
+  return os << "formatted";
+}
+} // namespace
+
+TEST(FDAPITest, TestLoggerDisabledLevels) {
+  std::ostringstream out_;
+  logging::Logger::sptr logger_ =
+      logging::Logger::create(logging::INFO, logging::OStreamSink::create(logging::INFO, out_));
+
+  // Disabled messages are neither formatted nor written
+  int n_formatted_ = 0;
+  logger_->debug() << "debug " << Formatted{&n_formatted_};
+  logger_->log(logging::TRACE, "trace ", Formatted{&n_formatted_});
+  ASSERT_FALSE(logger_->debug().enabled());
+  ASSERT_EQ(n_formatted_, 0);
+  ASSERT_TRUE(out_.str().empty());
+
+  logger_->info() << "info " << Formatted{&n_formatted_};
+  logger_->log(logging::WARN, "warn ", 1, " ", Formatted{&n_formatted_});
+  ASSERT_EQ(n_formatted_, 2);
+  ASSERT_NE(out_.str().find("[INFO] info formatted\n"), std::string::npos);
+  ASSERT_NE(out_.str().find("[WARN] warn 1 formatted\n"), std::string::npos);
+
+  // FDP_LOG does not evaluate the message of a disabled level
+  const logging::LOG_LEVEL previous_ = logger::get_logger()->sink()->log_level();
+  logger::get_logger()->sink()->log_level(logging::OFF);
+  int n_evaluated_ = 0;
+  FDP_LOG(DEBUG) << "evaluated " << ++n_evaluated_;
+  if (n_evaluated_ == 0)
+    FDP_LOG(ERROR) << ++n_evaluated_;
+  else
+    n_evaluated_ = -1;
+  ASSERT_EQ(n_evaluated_, 0);
+  ASSERT_FALSE(logger::should_log(logging::CRITICAL));
+  logger::get_logger()->sink()->log_level(previous_);
+}
+
+namespace {
+// Records messages, optionally slowly
+class RecordingSink : public logging::Sink {
+public:
+  typedef std::shared_ptr<RecordingSink> sptr;
+
+  static sptr create(std::chrono::microseconds delay = std::chrono::microseconds(0)) {
+    return sptr(new RecordingSink(delay));
+  }
+
+  int log(logging::LOG_LEVEL, const std::string &s) {
+    if (delay_.count() > 0) {
+      std::this_thread::sleep_for(delay_);
+    }
+    std::lock_guard<std::mutex> lock_(mutex_);
+    messages_.push_back(s);
+    return 0;
+  }
+
+  void flush() { ++flushes_; }
+
+  std::vector<std::string> messages() {
+    std::lock_guard<std::mutex> lock_(mutex_);
+    return messages_;
+  }
+
+  std::atomic<int> flushes_;
+
+private:
+  explicit RecordingSink(std::chrono::microseconds delay)
+      : logging::Sink(logging::TRACE), flushes_(0), delay_(delay) {}
+
+  std::chrono::microseconds delay_;
+  std::mutex mutex_;
+  std::vector<std::string> messages_;
+};
+} // namespace
+
+TEST(FDAPITest, TestAsyncSink) {
+  // Every message from several threads arrives, each thread's in order
+  RecordingSink::sptr recorded_ = RecordingSink::create();
+  {
+    logging::AsyncSink::sptr sink_ =
+        logging::AsyncSink::create(logging::DEBUG, recorded_, 16, logging::AsyncSink::Overflow::BLOCK);
+    logging::Logger::sptr logger_ = logging::Logger::create(logging::DEBUG, sink_);
+
+    std::vector<std::thread> threads_;
+    for (int t = 0; t < 4; ++t) {
+      threads_.push_back(std::thread([logger_, t]() {
+        for (int i = 0; i < 500; ++i) {
+          logger_->info() << t << " " << i;
+        }
+      }));
+    }
+    for (std::size_t t = 0; t < threads_.size(); ++t) {
+      threads_[t].join();
+    }
+    logger_->trace() << "below the level";
+
+    logger_->flush();
+    ASSERT_EQ(recorded_->messages().size(), 2000);
+    ASSERT_GE(recorded_->flushes_, 1);
+    ASSERT_EQ(sink_->dropped(), 0);
+  }
+
+  std::vector<int> next_(4, 0);
+  const std::vector<std::string> messages_ = recorded_->messages();
+  for (std::size_t i = 0; i < messages_.size(); ++i) {
+    std::istringstream message_(messages_[i].substr(messages_[i].find("[INFO] ") + 7));
+    int t_ = 0, i_ = 0;
+    message_ >> t_ >> i_;
+    ASSERT_EQ(i_, next_[t_]++);
+  }
+
+  // A slow sink with a small ring drops and counts what does not fit
+  RecordingSink::sptr slow_ = RecordingSink::create(std::chrono::microseconds(2000));
+  logging::AsyncSink::sptr counting_ =
+      logging::AsyncSink::create(logging::INFO, slow_, 4, logging::AsyncSink::Overflow::COUNT);
+  for (int i = 0; i < 100; ++i) {
+    counting_->log(logging::INFO, "message\n");
+  }
+  counting_->flush();
+  ASSERT_GT(counting_->dropped(), 0);
+
+  std::size_t n_written_ = 0, n_reported_ = 0;
+  const std::vector<std::string> slow_messages_ = slow_->messages();
+  for (std::size_t i = 0; i < slow_messages_.size(); ++i) {
+    if (slow_messages_[i] == "message\n") {
+      ++n_written_;
+      continue;
+    }
+    std::size_t n_ = 0;
+    ASSERT_EQ(std::sscanf(slow_messages_[i].c_str(), "AsyncSink: %zu log messages dropped", &n_), 1);
+    n_reported_ += n_;
+  }
+  ASSERT_EQ(n_written_ + counting_->dropped(), 100);
+  ASSERT_EQ(n_reported_, counting_->dropped());
+}
+
+TEST(FDAPITest, TestBinarySink) {
+  const ghc::filesystem::path directory_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-test-binary-log";
+  ghc::filesystem::remove_all(directory_);
+  const ghc::filesystem::path prefix_ = directory_ / "run";
+
+  // Messages decode to what a text sink would have written
+  {
+    logging::BinarySink::sptr sink_ = logging::BinarySink::create(logging::DEBUG, prefix_);
+    logging::Logger::sptr logger_ = logging::Logger::create(logging::DEBUG, sink_, "TEST");
+    logger_->info() << "Wrote " << 42 << " of " << std::string("data.csv")
+                    << " in " << 1.5 << "s {braces}";
+    logger_->debug() << "unsigned " << static_cast<unsigned long>(7) << ", negative " << -3;
+    logger_->trace() << "below the level";
+    sink_->log(logging::WARN, "preformatted\n");
+    logger_->flush();
+    ASSERT_EQ(sink_->get_files().size(), 1);
+
+    logging::BinaryLogReader reader_(sink_->get_files()[0]);
+    logging::BinaryLogReader::Entry entry_;
+    ASSERT_TRUE(reader_.next(entry_));
+    ASSERT_EQ(entry_.msg_lvl, logging::INFO);
+    ASSERT_EQ(entry_.logger, "TEST");
+    ASSERT_EQ(entry_.record.format, "Wrote {} of {} in {}s {{braces}}");
+    ASSERT_EQ(entry_.record.args.size(), 3);
+    ASSERT_EQ(entry_.record.args[0].type, logging::LogArg::INT);
+    ASSERT_EQ(entry_.record.args[0].i, 42);
+    ASSERT_EQ(entry_.record.args[1].s, "data.csv");
+    ASSERT_EQ(entry_.record.args[2].d, 1.5);
+    ASSERT_EQ(entry_.record.render(), "Wrote 42 of data.csv in 1.5s {braces}");
+    const std::string text_ = entry_.to_text();
+    ASSERT_NE(text_.find("] [TEST] [INFO] Wrote 42 of data.csv in 1.5s {braces}"), std::string::npos);
+
+    Json::Value json_;
+    std::istringstream(entry_.to_json()) >> json_;
+    ASSERT_EQ(json_["level"].asString(), "INFO");
+    ASSERT_EQ(json_["args"][0].asInt(), 42);
+    ASSERT_EQ(json_["message"].asString(), "Wrote 42 of data.csv in 1.5s {braces}");
+    ASSERT_EQ(json_["time_ns"].asUInt64(), entry_.time_ns);
+
+    ASSERT_TRUE(reader_.next(entry_));
+    ASSERT_EQ(entry_.record.args[0].type, logging::LogArg::UINT);
+    ASSERT_EQ(entry_.record.render(), "unsigned 7, negative -3");
+    ASSERT_TRUE(reader_.next(entry_));
+    ASSERT_EQ(entry_.msg_lvl, logging::WARN);
+    ASSERT_EQ(entry_.record.render(), "preformatted");
+    ASSERT_FALSE(reader_.next(entry_));
+  }
+
+  // Small files rotate, only the newest are kept and each decodes alone
+  {
+    logging::BinarySink::sptr sink_ = logging::BinarySink::create(logging::INFO, prefix_, 4096, 3);
+    logging::Logger::sptr logger_ = logging::Logger::create(logging::INFO, sink_, "TEST");
+    for (int i = 0; i < 1000; ++i) {
+      logger_->info() << "message " << i;
+    }
+    logger_->error() << std::string(8192, 'x');
+    logger_->flush();
+
+    const std::vector<ghc::filesystem::path> files_ = sink_->get_files();
+    ASSERT_EQ(files_.size(), 3);
+    std::size_t n_files_ = 0;
+    for (ghc::filesystem::directory_iterator it_(directory_), end_; it_ != end_; ++it_) {
+      ++n_files_;
+    }
+    ASSERT_EQ(n_files_, 3);
+
+    int next_ = -1;
+    for (std::size_t f = 0; f < files_.size(); ++f) {
+      logging::BinaryLogReader reader_(files_[f]);
+      logging::BinaryLogReader::Entry entry_;
+      while (reader_.next(entry_)) {
+        ASSERT_EQ(entry_.logger, "TEST");
+        ASSERT_EQ(entry_.record.format, "message {}");
+        if (next_ >= 0) {
+          ASSERT_EQ(entry_.record.args[0].i, next_);
+        }
+        next_ = static_cast<int>(entry_.record.args[0].i) + 1;
+      }
+    }
+    // The oversized message was dropped
+    ASSERT_EQ(next_, 1000);
+  }
+
+  // A file cut short mid record, as after a crash, ends at the last whole one
+  {
+    logging::BinarySink::sptr sink_ = logging::BinarySink::create(logging::INFO, prefix_);
+    logging::Logger::sptr logger_ = logging::Logger::create(logging::INFO, sink_);
+    logger_->info() << "first";
+    logger_->info() << "second";
+    const ghc::filesystem::path file_ = sink_->get_files()[0];
+    sink_.reset();
+    logger_.reset();
+
+    const std::uintmax_t size_ = ghc::filesystem::file_size(file_);
+    ghc::filesystem::resize_file(file_, size_ - 2);
+    logging::BinaryLogReader reader_(file_);
+    logging::BinaryLogReader::Entry entry_;
+    ASSERT_TRUE(reader_.next(entry_));
+    ASSERT_EQ(entry_.record.render(), "first");
+    ASSERT_FALSE(reader_.next(entry_));
+  }
+
+  // A record cut short partway through its arguments is corrupt, decoding
+  // stops there
+  {
+    logging::BinarySink::sptr sink_ = logging::BinarySink::create(logging::INFO, prefix_);
+    logging::Logger::sptr logger_ = logging::Logger::create(logging::INFO, sink_);
+    logger_->info() << "first";
+    logger_->info() << "wrote " << std::string("data.csv");
+    logger_->info() << "third";
+    const ghc::filesystem::path file_ = sink_->get_files()[0];
+    sink_.reset();
+    logger_.reset();
+
+    std::string data_;
+    {
+      std::ifstream in_(file_.string(), std::ios_base::binary);
+      data_.assign(std::istreambuf_iterator<char>(in_), std::istreambuf_iterator<char>());
+    }
+    // Shrink the payload size of the second message so that its string
+    // argument overruns the record
+    std::size_t offset_ = 8;
+    int n_messages_ = 0;
+    while (offset_ + 5 <= data_.size()) {
+      std::size_t size_ = 0;
+      for (std::size_t b = 0; b < 4; ++b) {
+        size_ |= static_cast<std::size_t>(static_cast<unsigned char>(data_[offset_ + 1 + b])) << (8 * b);
+      }
+      if (data_[offset_] == 3 && ++n_messages_ == 2) {
+        for (std::size_t b = 0; b < 4; ++b) {
+          data_[offset_ + 1 + b] = static_cast<char>(((size_ - 3) >> (8 * b)) & 0xff);
+        }
+        break;
+      }
+      offset_ += 5 + size_;
+    }
+    ASSERT_EQ(n_messages_, 2);
+    {
+      std::ofstream out_(file_.string(), std::ios_base::binary | std::ios_base::trunc);
+      out_ << data_;
+    }
+
+    logging::BinaryLogReader reader_(file_);
+    logging::BinaryLogReader::Entry entry_;
+    ASSERT_TRUE(reader_.next(entry_));
+    ASSERT_EQ(entry_.record.render(), "first");
+    ASSERT_FALSE(reader_.next(entry_));
+    ASSERT_FALSE(reader_.next(entry_));
+  }
+
+  ghc::filesystem::remove_all(directory_);
+  ASSERT_THROW(logging::BinaryLogReader(directory_ / "missing.fdplog"), std::runtime_error);
+}
+
+TEST(FDAPITest, TestTrace) {
+  const ghc::filesystem::path path_ =
+      ghc::filesystem::temp_directory_path() / "fdpapi-test-trace.json";
+  const bool was_enabled_ = trace::enabled();
+
+  // Nothing is recorded while disabled
+  trace::stop();
+  {
+    trace::Span span_("test", "disabled");
+    ASSERT_FALSE(span_.active());
+  }
+
+  trace::start(path_.string());
+  trace::clear();
+  {
+    trace::Span outer_("test", "outer");
+    outer_.arg("path", std::string("a \"quoted\" path"));
+    outer_.arg("count", 3LL);
+    {
+      trace::Span inner_("test", "inner");
+      inner_.label("inner write model/output");
+    }
+    std::thread([]() {
+      trace::set_thread_name("test worker");
+      trace::Span span_("test", "on a thread");
+    }).join();
+
+    const std::uint64_t start_ = trace::now_ns();
+    trace::record("test", "overlapping", start_, 1000, "", trace::new_async_id());
+    trace::record("test", "overlapping", start_, 2000, "", trace::new_async_id());
+
+    TaskGraph::sptr graph_ = TaskGraph::construct();
+    graph_->add("a task", []() {});
+    graph_->run();
+  }
+  trace::write();
+  if (!was_enabled_) {
+    trace::stop();
+  }
+
+  Json::Value trace_;
+  std::ifstream file_(path_.string());
+  file_ >> trace_;
+  ghc::filesystem::remove(path_);
+
+  std::map<std::string, Json::Value> spans_;
+  std::map<std::string, int> phases_;
+  std::set<std::string> threads_;
+  for (Json::Value::ArrayIndex i = 0; i < trace_["traceEvents"].size(); ++i) {
+    const Json::Value &event_ = trace_["traceEvents"][i];
+    ++phases_[event_["ph"].asString()];
+    if (event_["ph"].asString() == "X") {
+      spans_[event_["name"].asString()] = event_;
+    } else if (event_["name"].asString() == "thread_name") {
+      threads_.insert(event_["args"]["name"].asString());
+    }
+  }
+
+  ASSERT_EQ(spans_.count("disabled"), 0);
+  ASSERT_EQ(spans_["outer"]["args"]["path"].asString(), "a \"quoted\" path");
+  ASSERT_EQ(spans_["outer"]["args"]["count"].asInt(), 3);
+  ASSERT_EQ(spans_.count("inner write model/output"), 1);
+  ASSERT_EQ(spans_.count("a task"), 1);
+  ASSERT_EQ(spans_["inner write model/output"]["tid"], spans_["outer"]["tid"]);
+  ASSERT_NE(spans_["on a thread"]["tid"], spans_["outer"]["tid"]);
+  ASSERT_GE(spans_["inner write model/output"]["ts"].asDouble(), spans_["outer"]["ts"].asDouble());
+  ASSERT_LE(spans_["inner write model/output"]["ts"].asDouble() +
+                spans_["inner write model/output"]["dur"].asDouble(),
+            spans_["outer"]["ts"].asDouble() + spans_["outer"]["dur"].asDouble());
+  ASSERT_EQ(threads_.count("test worker"), 1);
+  ASSERT_EQ(phases_["b"], 2);
+  ASSERT_EQ(phases_["e"], 2);
+}
+
+TEST(FDAPITest, TestMetrics) {
+  Metrics::sptr metrics_ = Metrics::construct();
+
+  Metrics::labels_type labels_;
+  labels_["table"] = "a \"quoted\"\\table";
+  metrics_->counter("requests_total", labels_).increment();
+  metrics_->counter("requests_total", labels_).increment(2);
+  metrics_->counter("requests_total").increment();
+  ASSERT_EQ(metrics_->counter("requests_total", labels_).value(), 3);
+  ASSERT_THROW(metrics_->gauge("requests_total"), std::invalid_argument);
+
+  metrics_->gauge("in_flight").add(2.5);
+  metrics_->gauge("in_flight").add(-1);
+  ASSERT_DOUBLE_EQ(metrics_->gauge("in_flight").value(), 1.5);
+
+  // 1ms to 1s, quantiles within the width of a bucket
+  Metrics::Histogram &histogram_ = metrics_->histogram("duration_seconds");
+  for (int i = 1; i <= 1000; ++i) {
+    histogram_.record(i / 1000.0);
+  }
+  ASSERT_EQ(histogram_.count(), 1000);
+  ASSERT_NEAR(histogram_.sum(), 500.5, 1e-6);
+  ASSERT_NEAR(histogram_.quantile(0.5), 0.5, 0.5 * 0.07);
+  ASSERT_NEAR(histogram_.quantile(0.99), 0.99, 0.99 * 0.07);
+  ASSERT_EQ(metrics_->histogram("empty_seconds").quantile(0.5), 0);
+
+  int collected_ = 0;
+  metrics_->add_collector([&collected_](Metrics &metrics) {
+    ++collected_;
+    metrics.counter("collected_total").set(42);
+  });
+  metrics_->describe("requests_total", "Requests\nmade");
+
+  const std::string text_ = metrics_->to_prometheus();
+  ASSERT_EQ(collected_, 1);
+  ASSERT_NE(text_.find("# HELP requests_total Requests\\nmade\n"), std::string::npos);
+  ASSERT_NE(text_.find("# TYPE requests_total counter\n"), std::string::npos);
+  ASSERT_NE(text_.find("requests_total{table=\"a \\\"quoted\\\"\\\\table\"} 3\n"), std::string::npos);
+  ASSERT_NE(text_.find("requests_total 1\n"), std::string::npos);
+  ASSERT_NE(text_.find("collected_total 42\n"), std::string::npos);
+  ASSERT_NE(text_.find("in_flight 1.5\n"), std::string::npos);
+  ASSERT_NE(text_.find("# TYPE duration_seconds histogram\n"), std::string::npos);
+  ASSERT_NE(text_.find("duration_seconds_bucket{le=\"+Inf\"} 1000\n"), std::string::npos);
+  ASSERT_NE(text_.find("duration_seconds_count 1000\n"), std::string::npos);
+  ASSERT_NE(text_.find("duration_seconds_bucket{le=\"60\"} 1000\n"), std::string::npos);
+  ASSERT_NE(text_.find("duration_seconds_bucket{le=\"0.0001\"} 0\n"), std::string::npos);
+}
@@ -0,0 +1,50 @@
+/*! **************************************************************************
+ * @file fdplog.cxx
+ * @brief Prints binary logs written by logging::BinarySink
+ *
+ * Usage: fdplog [--json] <file.fdplog>...
+ *
+ * Each message is printed on its own line, as the text sinks write it or
+ * with --json as a JSON object. Files are read in the order given.
+ ****************************************************************************/
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include "fdp/utilities/binary_log.hxx"
+
+using namespace FairDataPipeline;
+
+int main( int argc, char** argv )
+{
+    bool json = false;
+    int first = 1;
+    if( first < argc && std::strcmp( argv[first], "--json" ) == 0 )
+    {
+        json = true;
+        ++first;
+    }
+    if( first >= argc )
+    {
+        std::cerr << "Usage: " << argv[0] << " [--json] <file.fdplog>..." << std::endl;
+        return 2;
+    }
+
+    int status = 0;
+    for( int i = first; i < argc; ++i )
+    {
+        try
+        {
+            logging::BinaryLogReader reader( argv[i] );
+            logging::BinaryLogReader::Entry entry;
+            while( reader.next( entry ) )
+                std::cout << ( json ? entry.to_json() : entry.to_text() ) << '\n';
+        }
+        catch( const std::exception& e )
+        {
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}